@@ -54,44 +54,57 @@ ATenAutotuner<Backend, Search>::tune(
     const std::vector<at::Tensor>& inputs,
     const std::vector<typename Backend::MappingOptionsType>& baseMappings,
     const tc::autotune::TuningParameterFixer& fixedParams) {
-  // TODO: some checks that inputs memory lives on the proper Backend device
+  return tune(
+      tcName,
+      std::vector<std::vector<at::Tensor>>{inputs},
+      {1.0},
+      baseMappings,
+      fixedParams);
+}
 
-  // prepare outputs of the proper shape
-  auto outputs = tc::aten::prepareOutputs(tc_, tcName, inputs);
+template <typename Backend, typename Search>
+std::vector<typename Backend::MappingOptionsType>
+ATenAutotuner<Backend, Search>::tune(
+    const std::string& tcName,
+    const std::vector<std::vector<at::Tensor>>& inputs,
+    const std::vector<double>& weights,
+    const std::vector<typename Backend::MappingOptionsType>& baseMappings,
+    const tc::autotune::TuningParameterFixer& fixedParams) {
+  // TODO: some checks that inputs memory lives on the proper Backend device
+  TC_CHECK_EQ(inputs.size(), weights.size())
+      << "Expected one weight per input shape";
 
   // first parse the devices
   auto devices =
       tc::autotune::detail::parseDevices<Backend>(FLAGS_tuner_devices);
-  // clone the inputs/outputs on each device
+  // clone the inputs/outputs of each shape on each device
   // TODO: this takes twice the space it should, alternatives are:
   // 1. enforce inputs and outputs live on the CPU in the first place so we
   //    don't spuriously run out of device memory (assuming CPU memory is
   //    infinite for now);
   // 2. if 1. is not reasonable, detect the device on which each tensor lives
   //    and point to the raw data for that (device, tensor) pair.
-  std::unordered_map<size_t, std::vector<DLConstTensorUPtr>> inputsPerDevice;
-  std::unordered_map<size_t, std::vector<const DLConstTensor*>>
-      rawInputsPerDevice;
-  std::unordered_map<size_t, std::vector<DLTensorUPtr>> outputsPerDevice;
-  std::unordered_map<size_t, std::vector<const DLTensor*>> rawOutputsPerDevice;
-  for (auto device : devices) {
-    typename Backend::WithDevice wd(device);
-    auto deviceInputs = cloneTensors(inputs);
-    inputsPerDevice.emplace(device, makeDLConstTensors(deviceInputs));
-    rawInputsPerDevice.emplace(
-        device, extractRawPtrs(inputsPerDevice.at(device)));
-    auto deviceOutputs = cloneTensors(outputs);
-    outputsPerDevice.emplace(device, makeDLTensors(deviceOutputs));
-    rawOutputsPerDevice.emplace(
-        device, extractRawPtrs(outputsPerDevice.at(device)));
+  std::vector<std::vector<DLConstTensorUPtr>> ownedInputs;
+  std::vector<std::vector<DLTensorUPtr>> ownedOutputs;
+  std::vector<tc::autotune::TuningShape> shapes;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    // prepare outputs of the proper shape
+    auto outputs = tc::aten::prepareOutputs(tc_, tcName, inputs[i]);
+    tc::autotune::TuningShape shape;
+    shape.weight = weights[i];
+    for (auto device : devices) {
+      typename Backend::WithDevice wd(device);
+      auto deviceInputs = cloneTensors(inputs[i]);
+      ownedInputs.push_back(makeDLConstTensors(deviceInputs));
+      shape.inputs.emplace(device, extractRawPtrs(ownedInputs.back()));
+      auto deviceOutputs = cloneTensors(outputs);
+      ownedOutputs.push_back(makeDLTensors(deviceOutputs));
+      shape.outputs.emplace(device, extractRawPtrs(ownedOutputs.back()));
+    }
+    shapes.push_back(std::move(shape));
   }
   return tc::autotune::Autotuner<Backend, Search>::tune(
-      tc_,
-      tcName,
-      rawInputsPerDevice,
-      rawOutputsPerDevice,
-      baseMappings,
-      fixedParams);
+      tc_, tcName, shapes, baseMappings, fixedParams);
 }
 } // namespace aten
 } // namespace tc
@@ -31,6 +31,8 @@ namespace aten {
  *    using namespace tc::aten;
  *    std::string tc("...");
  *    ATenAutotuner<tc::CudaBackend, tc::autotune::GeneticSearch> tuner(tc);
+ * or, to select the search strategy with --tuner_search_strategy,
+ *    ATenAutotuner<tc::CudaBackend, tc::autotune::SearchStrategy> tuner(tc);
  *    std::string cacheFn("/tmp/some_file");
  *    auto best = tuner.tune("tc_function_name", inputs, baseOption, cacheFn)
  *
@@ -82,6 +84,19 @@ class ATenAutotuner : public tc::autotune::Autotuner<Backend, SearchStrategy> {
       const std::vector<MappingOptionsType>& baseMappings,
       const tc::autotune::TuningParameterFixer& fixedParams = {});
 
+  /// Runs autotuning on the TC function tcEntryPoint for several input
+  /// shapes at once, inputs[i] being weighted by weights[i] (e.g. the
+  /// frequency of the shape in the workload).
+  /// \return the options with the best weighted mean runtime over all the
+  /// shapes, see tc::autotune::Autotuner::tune. The runtimes on each shape
+  /// are recorded in the options cache.
+  std::vector<MappingOptionsType> tune(
+      const std::string& tcEntryPoint,
+      const std::vector<std::vector<at::Tensor>>& inputs,
+      const std::vector<double>& weights,
+      const std::vector<MappingOptionsType>& baseMappings,
+      const tc::autotune::TuningParameterFixer& fixedParams = {});
+
  protected:
   /// The TC string is stored internally so we can tune independent TC
   /// functions on demand.
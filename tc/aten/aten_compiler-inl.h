@@ -22,6 +22,7 @@
 #include "tc/aten/aten.h"
 #include "tc/core/check.h"
 #include "tc/core/compiler.h"
+#include "tc/core/executor_cache.h"
 #include "tc/core/tc_executor.h"
 #include "tc/core/tensor.h"
 
@@ -38,6 +39,17 @@ std::unique_ptr<typename Backend::ExecutorType> compile(
       tc, entryPoint, extractRawPtrs(inputDLTensors), options);
 }
 
+template <typename Backend>
+std::shared_ptr<typename Backend::ExecutorType> compileCached(
+    const std::string& tc,
+    const std::string& entryPoint,
+    const std::vector<at::Tensor>& inputs,
+    const typename Backend::MappingOptionsType& options) {
+  auto inputDLTensors = makeDLConstTensors(inputs);
+  return tc::compileCached<Backend>(
+      tc, entryPoint, extractRawPtrs(inputDLTensors), options);
+}
+
 template <typename Executor>
 void run(
     const Executor& executor,
@@ -67,6 +79,21 @@ ProfilingInfo profile(
   return ProfilingInfo{cpuOverhead, pi.kernelRuntime};
 }
 
+template <typename Executor>
+ProfilingInfo profile(
+    const Executor& executor,
+    const std::vector<at::Tensor>& inputs,
+    std::vector<at::Tensor>& outputs,
+    const MeasurementOptions& measurementOptions) {
+  auto inputDLTensors = makeDLConstTensors(inputs);
+  auto outputDLTensors = makeDLTensors(outputs);
+  auto rawInputs = extractRawPtrs(inputDLTensors);
+  auto rawOutputs = extractRawPtrs(outputDLTensors);
+  return measure(
+      [&]() { return executor.profile(rawInputs, rawOutputs); },
+      measurementOptions);
+}
+
 template <typename Executor>
 void uncheckedRun(
     const Executor& executor,
@@ -16,11 +16,13 @@
 #pragma once
 
 #include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "tc/aten/aten.h"
 #include "tc/core/tensor.h"
+#include "tc/core/utils/measure.h"
 #include "tc/core/utils/time.h"
 
 namespace tc {
@@ -59,6 +61,15 @@ std::unique_ptr<typename Backend::ExecutorType> compile(
     const std::vector<at::Tensor>& inputs,
     const typename Backend::MappingOptionsType& options);
 
+/// Same as compile but the executor is shared through the process-wide
+/// ExecutorCache<Backend>, the TC is only compiled the first time.
+template <typename Backend>
+std::shared_ptr<typename Backend::ExecutorType> compileCached(
+    const std::string& tc,
+    const std::string& entryPoint,
+    const std::vector<at::Tensor>& inputs,
+    const typename Backend::MappingOptionsType& options);
+
 /// Given an executor resulting from compiling a TC, run the TC and fill the
 /// outputs vector with the results. The output vector must have as many
 /// tensors as the number of outputs in the TC. These must be preallocated and
@@ -80,6 +91,19 @@ ProfilingInfo profile(
     const std::vector<at::Tensor>& inputs,
     std::vector<at::Tensor>& outputs);
 
+/// Given an executor resulting from compiling a TC, run the TC repeatedly
+/// until the stopping criteria of measurementOptions are met and fill the
+/// outputs vector with the results.
+/// \returns ProfilingInfo with the median cpuOverhead and kernelRuntime,
+/// the standard deviation of the kernel runtimes and the number of runs
+/// retained once outliers are removed (see tc::measure), in microseconds.
+template <typename Executor>
+ProfilingInfo profile(
+    const Executor& executor,
+    const std::vector<at::Tensor>& inputs,
+    std::vector<at::Tensor>& outputs,
+    const MeasurementOptions& measurementOptions);
+
 /// This is the "low-latency" mode in which we just propagate ATen tensors
 /// Sizes are not checked and it is the user's responsibility to ensure that
 /// they match. If the user doesn't then segfault will likely occur.
@@ -13,13 +13,17 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
 #include <numeric>
 #include <thread>
 
 #include <glog/stl_logging.h>
 
+#include "tc/autotuner/child_process.h"
+#include "tc/autotuner/cost_model.h"
 #include "tc/autotuner/utils.h"
 #include "tc/core/check.h"
 #include "tc/core/compiler.h"
@@ -32,34 +36,158 @@
 namespace tc {
 namespace autotune {
 namespace detail {
+/// At most this many options recorded in the options cache train the cost
+/// model before tuning starts.
+constexpr size_t kCostModelHistory = 256;
+
 template <typename Backend>
 TuningHarness<Backend>::TuningHarness(
     size_t maxPopulationSize,
     lang::TreeRef tcTree,
-    const std::unordered_map<size_t, std::vector<const DLConstTensor*>>& inputs,
-    std::unordered_map<size_t, std::vector<const DLTensor*>>& outputs,
+    const std::vector<TuningShape>& shapes,
     const typename Backend::MappingOptionsType& baseMapping,
     const TuningParameterFixer& fixedParams,
     std::shared_ptr<OptionsCache<Backend>> optionsCache)
     : stopRequested_(false),
       currentCompilationJob_(0),
       numEvaluations_(0),
+      maxPopulationSize_(maxPopulationSize),
+      isolate_(false),
+      benchmarkIterations_(FLAGS_tuner_benchmark_max_runs),
+      hasDeadline_(false),
+      numCompilationJobs_(0),
       tcTree_(tcTree),
       baseMapping_(baseMapping),
-      inputs_(inputs),
-      outputs_(outputs),
+      shapes_(shapes),
       bestTime_(Duration::max()),
+      bestTimeNoise_(Duration::zero()),
       bestMappingOptions_(baseMapping),
-      optionsCache_(optionsCache) {}
+      optionsCache_(optionsCache) {
+  TC_CHECK(!shapes_.empty()) << "No shape to tune for";
+  double totalWeight = 0;
+  for (const auto& shape : shapes_) {
+    TC_CHECK_GT(shape.weight, 0) << "Shapes must have a positive weight";
+    totalWeight += shape.weight;
+  }
+  for (auto& shape : shapes_) {
+    shape.weight /= totalWeight;
+  }
+}
 
 template <typename Backend>
 template <typename SearchStrategy>
 void TuningHarness<Backend>::run(SearchStrategy& searchStrategy) {
+  // Define tensors per device once globally
+  auto devices = detail::parseDevices<Backend>(FLAGS_tuner_devices);
+  TC_CHECK(!devices.empty()) << "No device to evaluate candidates on";
+  isolate_ = FLAGS_tuner_isolate_candidates;
+  if (isolate_ and not canIsolateCandidates<Backend>()) {
+    LOG(WARNING) << "Candidates cannot be isolated on "
+                 << Backend::backendString()
+                 << ", evaluating them in the tuner process";
+    isolate_ = false;
+  }
+  hasDeadline_ = FLAGS_tuner_time_budget_s > 0;
+  deadline_ = std::chrono::system_clock::now() +
+      std::chrono::seconds(FLAGS_tuner_time_budget_s);
+  numCompilationJobs_ = 0;
+  bestTimes_.clear();
+  trainCostModelFromCache();
+  startWorkers(devices);
+  ScopeGuard sgWorkers([this]() { this->stopWorkers(); });
+
   for (size_t i = 0; i < searchStrategy.numGenerations; ++i) {
-    if (not stopRequested_) {
-      runOneIteration(searchStrategy, i);
+    if (stopRequested_) {
+      break;
     }
+    runOneIteration(searchStrategy, i);
+    if (budgetExhaustedOrConverged()) {
+      break;
+    }
+  }
+}
+
+template <typename Backend>
+bool TuningHarness<Backend>::budgetExhaustedOrConverged() {
+  if (hasDeadline_ and std::chrono::system_clock::now() >= deadline_) {
+    LOG(INFO) << "[TUNER] Stopping: time budget of "
+              << FLAGS_tuner_time_budget_s << "s exhausted";
+    return true;
+  }
+  if (FLAGS_tuner_max_evaluations > 0 and
+      numCompilationJobs_ >= FLAGS_tuner_max_evaluations) {
+    LOG(INFO) << "[TUNER] Stopping: " << numCompilationJobs_
+              << " candidates evaluated";
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(bestTimeMutex_);
+    bestTimes_.push_back(bestTime_);
+  }
+  size_t window = FLAGS_tuner_convergence_generations;
+  if (window == 0 or bestTimes_.size() <= window) {
+    return false;
+  }
+  // Without any valid candidate k generations ago, there is no baseline.
+  auto before = bestTimes_[bestTimes_.size() - 1 - window];
+  auto now = bestTimes_.back();
+  if (before == Duration::max()) {
+    return false;
+  }
+  auto threshold = 1.0 - FLAGS_tuner_convergence_threshold / 100.0;
+  if (static_cast<double>(now.toMicroSeconds()) <
+      threshold * before.toMicroSeconds()) {
+    return false;
   }
+  LOG(INFO) << "[TUNER] Stopping: best runtime " << now.toMicroSeconds()
+            << "us improved by less than " << FLAGS_tuner_convergence_threshold
+            << "% over the last " << window << " generations";
+  return true;
+}
+
+template <typename Backend>
+void TuningHarness<Backend>::startWorkers(const std::vector<size_t>& devices) {
+  // Room for the whole population, and for each device to always have a
+  // compiled candidate to evaluate next.
+  compilationJobs_.reset(new BlockingQueue<CompilationJob>(
+      std::max<size_t>(maxPopulationSize_, 1)));
+  evaluationJobs_.reset(new BlockingQueue<EvaluationJob>(devices.size()));
+  freeDevices_ = devices;
+
+  compilationThreads_.reserve(FLAGS_tuner_threads);
+  for (size_t i = 0; i < std::max<size_t>(FLAGS_tuner_threads, 1); ++i) {
+    compilationThreads_.emplace_back([this]() { this->doCompile(); });
+  }
+  if (not isolate_) {
+    for (auto device : devices) {
+      evaluationThreads_.emplace_back(
+          [this, device]() { this->doEvaluate(device); });
+    }
+  }
+}
+
+template <typename Backend>
+void TuningHarness<Backend>::stopWorkers() {
+  compilationJobs_->close();
+  for (auto& thread : compilationThreads_) {
+    thread.join();
+  }
+  compilationThreads_.clear();
+  evaluationJobs_->close();
+  for (auto& thread : evaluationThreads_) {
+    thread.join();
+  }
+  evaluationThreads_.clear();
+}
+
+template <typename Backend>
+void TuningHarness<Backend>::finishCandidate() {
+  {
+    std::lock_guard<std::mutex> lock(numEvaluationsMutex_);
+    numEvaluations_.fetch_add(1);
+  }
+  numEvaluationsCv_.notify_all();
 }
 
 template <typename Backend>
@@ -80,85 +208,75 @@ TuningHarness<Backend>::bestMappingOptions() const {
   }
 
 template <typename Backend>
-template <typename SearchStrategy>
-void TuningHarness<Backend>::doCompile(SearchStrategy& searchStrategy) {
-  // Atomically fetch and add the next job until there are no jobs left
-  while (true) {
+void TuningHarness<Backend>::doCompile() {
+  CompilationJob job;
+  while (compilationJobs_->pop(job)) {
     auto current = currentCompilationJob_.fetch_add(1);
-    if (current >= searchStrategy.population.size()) {
-      break;
+    if (isolate_) {
+      compileAndEvaluateIsolated(job);
+      continue;
     }
-    std::unique_ptr<typename Backend::ExecutorType> pExecutor(nullptr);
-    auto pConf = searchStrategy.population.at(current).get();
+    std::vector<std::unique_ptr<ExecutorType>> executors;
+    std::vector<std::vector<double>> features;
+    auto pConf = job.conf;
     if (not stopRequested_) {
       auto options = makeOptions<Backend>(baseMapping_, *pConf);
-      try {
-        if (FLAGS_debug_tuner) {
-          std::stringstream ssInfo;
-          typename Backend::MappingOptionsCppPrinter infoPrinter(ssInfo);
-          infoPrinter << options;
-          LOG(INFO) << "[COMPILE] Start compilation @:" << current;
-          LOG_LINE_BY_LINE(INFO, ssInfo);
-        }
-        pExecutor =
-            tc::compile<Backend>(tcTree_, inputs_.begin()->second, options);
-        LOG_IF(INFO, FLAGS_debug_tuner) << "[COMPILE] Done compilation";
-      } catch (const std::exception& e) {
-        LOG(WARNING) << "[TUNER][COMPILE] failed compilation: " << e.what();
-        std::stringstream ssWarning;
-        typename Backend::MappingOptionsCppPrinter warningPrinter(ssWarning);
-        warningPrinter << options;
-        LOG_LINE_BY_LINE(WARNING, ssWarning);
+      if (pruneWithCostModel(options, features)) {
         pConf->invalid = true;
+      } else {
+        try {
+          if (FLAGS_debug_tuner) {
+            std::stringstream ssInfo;
+            typename Backend::MappingOptionsCppPrinter infoPrinter(ssInfo);
+            infoPrinter << options;
+            LOG(INFO) << "[COMPILE] Start compilation @:" << current;
+            LOG_LINE_BY_LINE(INFO, ssInfo);
+          }
+          executors = compileShapes(options);
+          LOG_IF(INFO, FLAGS_debug_tuner) << "[COMPILE] Done compilation";
+        } catch (const std::exception& e) {
+          LOG(WARNING) << "[TUNER][COMPILE] failed compilation: " << e.what();
+          std::stringstream ssWarning;
+          typename Backend::MappingOptionsCppPrinter warningPrinter(ssWarning);
+          warningPrinter << options;
+          LOG_LINE_BY_LINE(WARNING, ssWarning);
+          pConf->invalid = true;
+        }
       }
     } else {
       pConf->invalid = true;
     }
 
-    // Emplace pExecutor (nullptr if compilation failed)
-    std::lock_guard<std::mutex> lock(executorsMutex_);
-    executors_.push(std::move(pExecutor));
-    configurations_.push(pConf);
+    // Queue the executors (none if compilation failed), blocks while the
+    // evaluation threads are busy.
+    evaluationJobs_->push(EvaluationJob{
+        pConf, std::move(executors), job.printer, std::move(features)});
   }
 }
 
 template <typename Backend>
-void TuningHarness<Backend>::doEvaluate(
-    size_t device,
-    size_t populationSize,
-    Printer& printer) {
+void TuningHarness<Backend>::doEvaluate(size_t device) {
   typename Backend::WithDevice wd(device);
-  TC_CHECK_EQ(inputs_.count(device), 1u);
-  auto& inputs = inputs_.at(device);
-  TC_CHECK_EQ(outputs_.count(device), 1u);
-  auto& outputs = outputs_.at(device);
+  for (const auto& shape : shapes_) {
+    TC_CHECK_EQ(shape.inputs.count(device), 1u);
+    TC_CHECK_EQ(shape.outputs.count(device), 1u);
+  }
 
   while (true) {
-    auto current = numEvaluations_.load();
-    if (current >= populationSize) {
-      // We have seen enough, exit
+    EvaluationJob job;
+    if (!evaluationJobs_->pop(job)) {
+      // Tuning is over, exit
       break;
     }
-
-    CandidateConfiguration* pConf;
-    std::unique_ptr<typename Backend::ExecutorType> pExecutor;
-    {
-      std::lock_guard<std::mutex> lock(executorsMutex_);
-      if (executors_.size() == 0) {
-        // No executors atm, wait for the queue to populate
-        continue;
-      }
-      pExecutor = std::move(executors_.front());
-      executors_.pop();
-      pConf = configurations_.front();
-      configurations_.pop();
-    }
+    auto pConf = job.conf;
+    auto& executors = job.executors;
+    auto& printer = *job.printer;
 
     // Properly keep track of count, RAII way
-    ScopeGuard sg([this]() { this->numEvaluations_.fetch_add(1); });
-    if (!pExecutor.get()) {
-      // If I popped an empty executor then compilation didn't go as
-      // planned, skip it.
+    ScopeGuard sg([this]() { this->finishCandidate(); });
+    if (executors.empty()) {
+      // If I popped no executor then compilation didn't go as planned, skip
+      // it.
       TC_CHECK(pConf->invalid);
       continue;
     }
@@ -178,29 +296,16 @@ void TuningHarness<Backend>::doEvaluate(
       LOG_LINE_BY_LINE(INFO, ssInfo);
     }
 
-    std::vector<Duration> runtimes{Duration::max()};
+    std::vector<ProfilingInfo> timings;
     try {
       Duration bestTimeSoFar(Duration::max());
       {
         std::lock_guard<std::mutex> lock(bestTimeMutex_);
         bestTimeSoFar = bestTime_;
       }
-      auto prune = detail::skipExecutionOrWarmup<Backend>(
-          *pExecutor, outputs, inputs, bestTimeSoFar);
-      if (prune) {
+      if (!benchmark(executors, device, bestTimeSoFar, timings)) {
         pConf->invalid = true;
         continue;
-      } else {
-        /// We don't want the autotuner to take too long evaluating, we just
-        /// need to *rank* the results.
-        constexpr int kReducedBenchmarkIterations = 10;
-        runtimes.reserve(kReducedBenchmarkIterations);
-        for (size_t i = 0; i < kReducedBenchmarkIterations; ++i) {
-          auto timings = pExecutor->profile(inputs, outputs);
-          if (timings.kernelRuntime.toMicroSeconds() > 0) {
-            runtimes.push_back(timings.kernelRuntime);
-          }
-        }
       }
     } catch (std::exception& e) {
       LOG(WARNING) << "Runtime error device " << device << ": " << e.what();
@@ -214,36 +319,395 @@ void TuningHarness<Backend>::doEvaluate(
       continue;
     }
 
-    if (runtimes.size() == 0u) {
-      pConf->invalid = true;
-      return;
-    }
+    recordRuntime(*pConf, options, job.features, device, timings, printer);
+  } // end while
+}
 
-    auto prof = median(runtimes);
+template <typename Backend>
+std::vector<std::unique_ptr<typename Backend::ExecutorType>>
+TuningHarness<Backend>::compileShapes(const MappingOptionsType& options) {
+  std::vector<std::unique_ptr<ExecutorType>> executors;
+  executors.reserve(shapes_.size());
+  for (const auto& shape : shapes_) {
+    executors.push_back(
+        tc::compile<Backend>(tcTree_, shape.inputs.begin()->second, options));
+  }
+  return executors;
+}
 
-    LOG_IF(INFO, tc::FLAGS_debug_tuner)
-        << "Run on device " << device << " took: " << prof.toMicroSeconds()
-        << "us";
-    printer.record(prof);
-    pConf->runtime = prof;
+template <typename Backend>
+bool TuningHarness<Backend>::benchmark(
+    std::vector<std::unique_ptr<ExecutorType>>& executors,
+    size_t device,
+    Duration bestTimeSoFar,
+    std::vector<ProfilingInfo>& timings) {
+  // We don't want the autotuner to take too long evaluating, we just need to
+  // *rank* the results.
+  auto maxRuns = benchmarkIterations_.load();
+  MeasurementOptions measurementOptions{
+      std::min<size_t>(FLAGS_tuner_benchmark_min_runs, maxRuns),
+      maxRuns,
+      FLAGS_tuner_benchmark_relative_ci,
+      Duration::fromMicroSeconds(
+          static_cast<size_t>(FLAGS_tuner_benchmark_time_budget_ms) * 1000)};
+  timings.clear();
+  for (size_t i = 0; i < shapes_.size(); ++i) {
+    auto& executor = *executors.at(i);
+    auto& inputs = shapes_[i].inputs.at(device);
+    auto& outputs = shapes_[i].outputs.at(device);
+    // The weighted mean runtime exceeds bestTimeSoFar as soon as the runtime
+    // of one shape exceeds bestTimeSoFar divided by its weight.
+    auto bound = bestTimeSoFar;
+    if (shapes_.size() > 1 and bestTimeSoFar < Duration::max()) {
+      auto us = bestTimeSoFar.toMicroSeconds() / shapes_[i].weight;
+      bound = us < Duration::max().toMicroSeconds()
+          ? Duration::fromMicroSeconds(static_cast<size_t>(us))
+          : Duration::max();
+    }
+    auto prune = detail::skipExecutionOrWarmup<Backend>(
+        executor, outputs, inputs, bound);
+    if (prune) {
+      return false;
+    }
+    timings.push_back(measure(
+        [&]() { return executor.profile(inputs, outputs); },
+        measurementOptions));
+  }
+  return true;
+}
 
+template <typename Backend>
+void TuningHarness<Backend>::recordRuntime(
+    CandidateConfiguration& conf,
+    const MappingOptionsType& options,
+    const std::vector<std::vector<double>>& features,
+    size_t device,
+    const std::vector<ProfilingInfo>& timings,
+    Printer& printer) {
+  TC_CHECK_EQ(timings.size(), shapes_.size());
+  auto tc = lang::canonicalTc(tcTree_);
+  std::vector<Duration> runtimes;
+  std::vector<Duration> noises;
+  for (size_t i = 0; i < shapes_.size(); ++i) {
+    const auto& shapeTimings = timings[i];
+    auto runtime = shapeTimings.kernelRuntime;
+    auto stdDev = shapeTimings.kernelRuntimeStdDev;
+    LOG_IF(INFO, tc::FLAGS_debug_tuner)
+        << "Run of shape " << i << " on device " << device
+        << " took: " << runtime.toMicroSeconds()
+        << "us (stddev: " << stdDev.toMicroSeconds()
+        << "us, runs: " << shapeTimings.numRuns << ")";
     optionsCache_->recordRuntime(
-        lang::canonicalTc(tcTree_),
-        makeTensorInfoVector(inputs),
-        makeTensorInfoVector(outputs),
+        tc,
+        makeTensorInfoVector(shapes_[i].inputs.at(device)),
+        makeTensorInfoVector(shapes_[i].outputs.at(device)),
         Backend::backendString(),
         options,
-        prof);
+        runtime,
+        stdDev);
+    if (!features.empty()) {
+      costModel_.train(features.at(i), runtime);
+    }
+    runtimes.push_back(runtime);
+    noises.push_back(Duration::fromMicroSeconds(
+        std::llround(confidenceInterval(shapeTimings))));
+  }
 
-    // Save best time under lock
-    {
-      std::lock_guard<std::mutex> lock(bestTimeMutex_);
-      if (prof < bestTime_) {
-        bestTime_ = prof;
-        bestMappingOptions_ = options;
+  auto runtime = weightedMean(runtimes);
+  printer.record(runtime);
+  conf.runtime = runtime;
+  updateBestTime(options, runtime, weightedNoise(noises));
+}
+
+template <typename Backend>
+Duration TuningHarness<Backend>::weightedMean(
+    const std::vector<Duration>& values) const {
+  TC_CHECK_EQ(values.size(), shapes_.size());
+  double us = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    auto value = values[i];
+    us += shapes_[i].weight * value.toMicroSeconds();
+  }
+  return Duration::fromMicroSeconds(std::llround(us));
+}
+
+template <typename Backend>
+Duration TuningHarness<Backend>::weightedNoise(
+    const std::vector<Duration>& noises) const {
+  TC_CHECK_EQ(noises.size(), shapes_.size());
+  double variance = 0;
+  for (size_t i = 0; i < noises.size(); ++i) {
+    auto noise = noises[i];
+    auto us = shapes_[i].weight * noise.toMicroSeconds();
+    variance += us * us;
+  }
+  return Duration::fromMicroSeconds(std::llround(std::sqrt(variance)));
+}
+
+template <typename Backend>
+bool TuningHarness<Backend>::pruneWithCostModel(
+    const MappingOptionsType& options,
+    std::vector<std::vector<double>>& features) {
+  if (FLAGS_tuner_cost_model_prune_factor <= 0) {
+    return false;
+  }
+  features.clear();
+  try {
+    for (const auto& shape : shapes_) {
+      features.push_back(extractFeatures(
+          tcTree_, shape.inputs.begin()->second, options.generic));
+    }
+  } catch (const std::exception& e) {
+    // The compilation fails the same way and reports it.
+    features.clear();
+    return false;
+  }
+  std::vector<Duration> predictions;
+  for (const auto& shapeFeatures : features) {
+    predictions.push_back(costModel_.predict(shapeFeatures));
+    if (predictions.back() == Duration::max()) {
+      return false;
+    }
+  }
+  auto predicted = weightedMean(predictions);
+  Duration bestTimeSoFar(Duration::max());
+  {
+    std::lock_guard<std::mutex> lock(bestTimeMutex_);
+    bestTimeSoFar = bestTime_;
+  }
+  if (bestTimeSoFar == Duration::max() or
+      predicted.toMicroSeconds() <= FLAGS_tuner_cost_model_prune_factor *
+              bestTimeSoFar.toMicroSeconds()) {
+    return false;
+  }
+  LOG_IF(INFO, FLAGS_debug_tuner)
+      << "[COMPILE] Skipped, predicted runtime: " << predicted.toMicroSeconds()
+      << "us, best so far: " << bestTimeSoFar.toMicroSeconds() << "us";
+  return true;
+}
+
+template <typename Backend>
+void TuningHarness<Backend>::trainCostModelFromCache() {
+  if (FLAGS_tuner_cost_model_prune_factor <= 0) {
+    return;
+  }
+  auto tc = lang::canonicalTc(tcTree_);
+  for (const auto& shape : shapes_) {
+    const auto& shapeInputs = shape.inputs.begin()->second;
+    auto inputs = makeTensorInfoVector(shapeInputs);
+    auto outputs = makeTensorInfoVector(shape.outputs.begin()->second);
+    auto cachedOptions = optionsCache_->getTopKOptions(
+        tc, inputs, outputs, Backend::backendString(), kCostModelHistory);
+    for (const auto& options : cachedOptions) {
+      auto runtimes = optionsCache_->getRuntimes(
+          tc, inputs, outputs, Backend::backendString(), options);
+      if (runtimes.empty()) {
+        continue;
+      }
+      try {
+        costModel_.train(
+            extractFeatures(tcTree_, shapeInputs, options.generic),
+            median(runtimes));
+      } catch (const std::exception& e) {
+        LOG_IF(INFO, FLAGS_debug_tuner)
+            << "[TUNER] Cannot learn from cached options: " << e.what();
       }
     }
-  } // end while
+  }
+  LOG_IF(INFO, FLAGS_debug_tuner) << "[TUNER] Cost model trained with "
+                                  << costModel_.numSamples()
+                                  << " cached runtimes";
+}
+
+template <typename Backend>
+void TuningHarness<Backend>::updateBestTime(
+    const MappingOptionsType& options,
+    Duration runtime,
+    Duration noise) {
+  // Save best time under lock
+  std::lock_guard<std::mutex> lock(bestTimeMutex_);
+  auto noiseUs = static_cast<double>(noise.toMicroSeconds());
+  auto bestNoiseUs = static_cast<double>(bestTimeNoise_.toMicroSeconds());
+  auto margin = Duration::fromMicroSeconds(
+      std::llround(std::sqrt(noiseUs * noiseUs + bestNoiseUs * bestNoiseUs)));
+  if (runtime + margin < bestTime_) {
+    bestTime_ = runtime;
+    bestTimeNoise_ = noise;
+    bestMappingOptions_ = options;
+  }
+}
+
+template <typename Backend>
+void TuningHarness<Backend>::reuseResult(
+    CandidateConfiguration& conf,
+    const MappingOptionsType& options,
+    const EvaluationResult& result,
+    Printer& printer) {
+  conf.invalid = result.invalid;
+  if (!result.invalid) {
+    printer.record(result.runtime);
+    conf.runtime = result.runtime;
+    updateBestTime(options, result.runtime, result.noise);
+  }
+  finishCandidate();
+}
+
+namespace {
+enum class IsolatedStatus : uint32_t { Compiled, Benchmarked, Pruned, Failed };
+
+/// Sent by the tuner to an isolated candidate once it has compiled.
+struct IsolatedRequest {
+  size_t device;
+  size_t bestTimeSoFarUs;
+};
+
+/// Sent back by the isolated candidate once it has been benchmarked, once
+/// per shape with the status of the candidate.
+struct IsolatedResult {
+  IsolatedStatus status;
+  size_t runtimeUs;
+  size_t stdDevUs;
+  size_t numRuns;
+};
+} // namespace
+
+template <typename Backend>
+void TuningHarness<Backend>::compileAndEvaluateIsolated(
+    const CompilationJob& job) {
+  auto timeout = std::chrono::milliseconds(
+      std::chrono::seconds(FLAGS_tuner_candidate_timeout));
+  auto memoryLimit = FLAGS_tuner_candidate_memory_limit << 20;
+  // Properly keep track of count, RAII way
+  ScopeGuard sg([this]() { this->finishCandidate(); });
+  auto pConf = job.conf;
+  if (stopRequested_) {
+    pConf->invalid = true;
+    return;
+  }
+  auto options = makeOptions<Backend>(baseMapping_, *pConf);
+  std::vector<std::vector<double>> features;
+  if (pruneWithCostModel(options, features)) {
+    pConf->invalid = true;
+    return;
+  }
+  if (FLAGS_debug_tuner) {
+    std::stringstream ssInfo;
+    typename Backend::MappingOptionsCppPrinter infoPrinter(ssInfo);
+    infoPrinter << options;
+    LOG(INFO) << "[COMPILE] Start isolated compilation @:" << job.index;
+    LOG_LINE_BY_LINE(INFO, ssInfo);
+  }
+
+  // Everything the child does happens in its copy of the address space,
+  // only the messages come back.
+  ChildProcess child(
+      [this, &options](Channel& tuner) {
+        std::vector<std::unique_ptr<ExecutorType>> executors;
+        try {
+          executors = compileShapes(options);
+        } catch (const std::exception& e) {
+          LOG(WARNING) << "[TUNER][COMPILE] failed compilation: " << e.what();
+          tuner.send(IsolatedStatus::Failed);
+          return;
+        }
+        IsolatedRequest request;
+        if (!tuner.send(IsolatedStatus::Compiled) ||
+            !tuner.receive(request)) {
+          return;
+        }
+        typename Backend::WithDevice wd(request.device);
+        IsolatedStatus status;
+        std::vector<ProfilingInfo> timings;
+        auto bestTimeSoFar =
+            Duration::fromMicroSeconds(request.bestTimeSoFarUs);
+        try {
+          status = benchmark(executors, request.device, bestTimeSoFar, timings)
+              ? IsolatedStatus::Benchmarked
+              : IsolatedStatus::Pruned;
+        } catch (const std::exception& e) {
+          LOG(WARNING) << "Runtime error device " << request.device << ": "
+                       << e.what();
+          status = IsolatedStatus::Failed;
+        }
+        for (size_t i = 0; i < shapes_.size(); ++i) {
+          IsolatedResult result{status, 0, 0, 0};
+          if (i < timings.size()) {
+            result.runtimeUs = timings[i].kernelRuntime.toMicroSeconds();
+            result.stdDevUs = timings[i].kernelRuntimeStdDev.toMicroSeconds();
+            result.numRuns = timings[i].numRuns;
+          }
+          if (!tuner.send(result)) {
+            return;
+          }
+        }
+      },
+      memoryLimit);
+
+  // The child logs its own errors, only report the ones that killed it
+  // (or that it was killed for).
+  auto fail = [&](const char* stage) {
+    child.kill();
+    LOG(WARNING) << "[TUNER][" << stage << "] isolated candidate "
+                 << child.wait();
+    std::stringstream ssWarning;
+    typename Backend::MappingOptionsCppPrinter warningPrinter(ssWarning);
+    warningPrinter << options;
+    LOG_LINE_BY_LINE(WARNING, ssWarning);
+    pConf->invalid = true;
+  };
+
+  IsolatedStatus status;
+  if (!child.channel().receive(status, timeout)) {
+    fail("COMPILE");
+    return;
+  }
+  if (status != IsolatedStatus::Compiled) {
+    pConf->invalid = true;
+    return;
+  }
+  LOG_IF(INFO, FLAGS_debug_tuner) << "[COMPILE] Done compilation";
+
+  size_t device;
+  {
+    std::unique_lock<std::mutex> lock(freeDevicesMutex_);
+    freeDevicesCv_.wait(lock, [this]() { return !freeDevices_.empty(); });
+    device = freeDevices_.back();
+    freeDevices_.pop_back();
+  }
+  ScopeGuard sgDevice([this, device]() {
+    {
+      std::lock_guard<std::mutex> lock(freeDevicesMutex_);
+      freeDevices_.push_back(device);
+    }
+    freeDevicesCv_.notify_one();
+  });
+  IsolatedRequest request{device, Duration::max().toMicroSeconds()};
+  {
+    std::lock_guard<std::mutex> lock(bestTimeMutex_);
+    request.bestTimeSoFarUs = bestTime_.toMicroSeconds();
+  }
+  if (!child.channel().send(request)) {
+    fail("EVALUATE");
+    return;
+  }
+  std::vector<ProfilingInfo> timings;
+  for (size_t i = 0; i < shapes_.size(); ++i) {
+    IsolatedResult result;
+    if (!child.channel().receive(result, timeout)) {
+      fail("EVALUATE");
+      return;
+    }
+    if (result.status != IsolatedStatus::Benchmarked) {
+      pConf->invalid = true;
+      return;
+    }
+    timings.emplace_back(
+        Duration::zero(),
+        Duration::fromMicroSeconds(result.runtimeUs),
+        Duration::fromMicroSeconds(result.stdDevUs),
+        result.numRuns);
+  }
+  recordRuntime(*pConf, options, features, device, timings, *job.printer);
 }
 
 template <typename Backend>
@@ -251,11 +715,6 @@ template <typename SearchStrategy>
 void TuningHarness<Backend>::runOneIteration(
     SearchStrategy& searchStrategy,
     size_t iteration) {
-  // Define tensors per device once globally
-  auto devices = detail::parseDevices<Backend>(FLAGS_tuner_devices);
-  TC_CHECK(executors_.empty());
-  TC_CHECK(configurations_.empty());
-
   {
     // Initialize for this round
     currentCompilationJob_.store(0);
@@ -273,35 +732,123 @@ void TuningHarness<Backend>::runOneIteration(
       }
     });
 
-    // Just spawn and join new threads for each iteration
-    std::vector<std::thread> cpuCompilationThreads;
-    cpuCompilationThreads.reserve(FLAGS_tuner_threads);
-    ScopeGuard sgCompilationThreads([&cpuCompilationThreads]() {
-      for (auto& cpuCompilationThread : cpuCompilationThreads) {
-        cpuCompilationThread.join();
+    auto iterations = searchStrategy.benchmarkIterations();
+    size_t maxRuns = FLAGS_tuner_benchmark_max_runs;
+    benchmarkIterations_ =
+        iterations == 0 ? maxRuns : std::min(iterations, maxRuns);
+
+    // Hand the new candidates over to the workers and wait until they have
+    // evaluated all of them. Candidates evaluated before reuse their result
+    // and copies of a new candidate wait for the result of the first one.
+    auto& population = searchStrategy.population;
+    auto populationSize = population.size();
+    std::unordered_map<std::string, size_t> firstCopies;
+    std::vector<std::pair<size_t, size_t>> copies;
+    size_t numReused = 0;
+    for (size_t i = 0; i < populationSize; ++i) {
+      auto& conf = *population.at(i);
+      auto options = makeOptions<Backend>(baseMapping_, conf);
+      auto fingerprint = options.proto().SerializeAsString();
+      auto evaluated = evaluated_.find(fingerprint);
+      if (evaluated == evaluated_.end() and
+          FLAGS_tuner_reuse_cached_runtimes) {
+        // The number of runs behind the cached runtimes is unknown, their
+        // standard deviation bounds the uncertainty. All the shapes must
+        // have been evaluated.
+        std::vector<Duration> runtimes;
+        std::vector<Duration> noises;
+        for (const auto& shape : shapes_) {
+          std::vector<Duration> stdDevs;
+          auto cached = optionsCache_->getRuntimes(
+              lang::canonicalTc(tcTree_),
+              makeTensorInfoVector(shape.inputs.begin()->second),
+              makeTensorInfoVector(shape.outputs.begin()->second),
+              Backend::backendString(),
+              options,
+              &stdDevs);
+          if (cached.empty()) {
+            break;
+          }
+          runtimes.push_back(median(cached));
+          noises.push_back(median(stdDevs));
+        }
+        if (runtimes.size() == shapes_.size()) {
+          EvaluationResult result{false,
+                                  weightedMean(runtimes),
+                                  FLAGS_tuner_benchmark_max_runs,
+                                  weightedNoise(noises)};
+          evaluated = evaluated_.emplace(fingerprint, result).first;
+        }
       }
-    });
-    for (size_t i = 0; i < FLAGS_tuner_threads; ++i) {
-      cpuCompilationThreads.emplace_back(
-          [this, &searchStrategy]() { this->doCompile(searchStrategy); });
+      if (evaluated != evaluated_.end() and
+          evaluated->second.benchmarkIterations >= benchmarkIterations_) {
+        reuseResult(conf, options, evaluated->second, printer);
+        ++numReused;
+        continue;
+      }
+      auto first = firstCopies.emplace(fingerprint, i);
+      if (!first.second) {
+        copies.emplace_back(i, first.first->second);
+        continue;
+      }
+      if (FLAGS_tuner_max_evaluations > 0 and
+          numCompilationJobs_ >= FLAGS_tuner_max_evaluations) {
+        // Out of evaluations, tuning stops after this generation.
+        firstCopies.erase(first.first);
+        conf.invalid = true;
+        finishCandidate();
+        continue;
+      }
+      ++numCompilationJobs_;
+      compilationJobs_->push(CompilationJob{&conf, i, &printer});
     }
-
-    // Just spawn and join new threads for each device
-    std::vector<std::thread> workerThreads;
-    workerThreads.reserve(devices.size());
     LOG_IF(INFO, tc::FLAGS_debug_tuner)
-        << "Start evaluation: " << devices.size() << " " << executors_.size()
-        << " " << configurations_.size();
-    ScopeGuard sgDeviceWorkerThreads([&workerThreads]() {
-      for (auto& workerThread : workerThreads) {
-        workerThread.join();
+        << "Start evaluation: " << firstCopies.size() << " new candidates, "
+        << numReused + copies.size() << " out of " << populationSize
+        << " reuse earlier results";
+    {
+      auto numJobs = populationSize - copies.size();
+      std::unique_lock<std::mutex> lock(numEvaluationsMutex_);
+      auto done = [this, numJobs]() {
+        return numEvaluations_.load() >= numJobs;
+      };
+      // Once out of time, the workers drop the remaining candidates as if
+      // tuning had been interrupted.
+      if (hasDeadline_ and
+          not numEvaluationsCv_.wait_until(lock, deadline_, done)) {
+        stopRequested_ = true;
       }
-    });
-    auto populationSize = searchStrategy.population.size();
-    for (auto device : devices) {
-      workerThreads.emplace_back([this, device, populationSize, &printer]() {
-        this->doEvaluate(device, populationSize, printer);
-      });
+      numEvaluationsCv_.wait(lock, done);
+    }
+
+    // Candidates interrupted by a stop request were not really evaluated.
+    if (not stopRequested_) {
+      for (const auto& kvp : firstCopies) {
+        const auto& conf = *population.at(kvp.second);
+        // EvaluationResult is not default constructible, no operator[].
+        EvaluationResult result{conf.invalid,
+                                conf.runtime,
+                                benchmarkIterations_.load(),
+                                Duration::zero()};
+        auto evaluated = evaluated_.find(kvp.first);
+        if (evaluated != evaluated_.end()) {
+          evaluated->second = result;
+        } else {
+          evaluated_.emplace(kvp.first, result);
+        }
+      }
+    }
+    for (const auto& copy : copies) {
+      const auto& first = *population.at(copy.second);
+      auto& conf = *population.at(copy.first);
+      reuseResult(
+          conf,
+          makeOptions<Backend>(baseMapping_, conf),
+          EvaluationResult{first.invalid,
+                           first.runtime,
+                           benchmarkIterations_.load(),
+                           Duration::zero()},
+          printer);
     }
   }
 
@@ -427,14 +974,36 @@ Autotuner<Backend, SearchStrategy>::tune(
     std::unordered_map<size_t, std::vector<const DLTensor*>>& outputs,
     const std::vector<typename Backend::MappingOptionsType>& baseMappings,
     const TuningParameterFixer& fixedParams) {
+  return tune(
+      tc,
+      tcEntryPoint,
+      std::vector<TuningShape>{TuningShape{inputs, outputs, 1.0}},
+      baseMappings,
+      fixedParams);
+}
+
+template <typename Backend, typename SearchStrategy>
+std::vector<typename Backend::MappingOptionsType>
+Autotuner<Backend, SearchStrategy>::tune(
+    const std::string& tc,
+    const std::string& tcEntryPoint,
+    const std::vector<TuningShape>& shapes,
+    const std::vector<typename Backend::MappingOptionsType>& baseMappings,
+    const TuningParameterFixer& fixedParams) {
   std::map<std::string, lang::TreeRef> tcEntryPointMap(tc::detail::parse(tc));
   TC_CHECK_EQ(tcEntryPointMap.count(tcEntryPoint), 1u)
       << "Error looking up " << tcEntryPoint;
 
-  // Initialize a model configuration
-  TC_CHECK_GE(inputs.size(), 1u);
-  auto modelConfiguration =
-      setupTuningParameters(inputs.begin()->second, baseMappings);
+  // Initialize a model configuration, its parameter ranges cover the sizes
+  // of all the shapes.
+  TC_CHECK_GE(shapes.size(), 1u);
+  std::vector<const DLConstTensor*> allInputs;
+  for (const auto& shape : shapes) {
+    TC_CHECK_GE(shape.inputs.size(), 1u);
+    const auto& inputs = shape.inputs.begin()->second;
+    allInputs.insert(allInputs.end(), inputs.begin(), inputs.end());
+  }
+  auto modelConfiguration = setupTuningParameters(allInputs, baseMappings);
   modelConfiguration.fixParameters(fixedParams);
 
   // Create initial configs based on options + model configuration
@@ -454,20 +1023,13 @@ Autotuner<Backend, SearchStrategy>::tune(
       });
 
   // searchStrategy is passed to tuningHarness.run()
-  SearchStrategy searchStrategy(
-      configs,
-      FLAGS_tuner_gen_generations,
-      FLAGS_tuner_gen_pop_size,
-      FLAGS_tuner_gen_crossover_rate,
-      FLAGS_tuner_gen_mutation_rate,
-      FLAGS_tuner_gen_number_elites);
+  auto searchStrategy = SearchStrategy::makeFromFlags(configs);
 
   // Create a tuning harness
   detail::TuningHarness<Backend> tuningHarness(
       FLAGS_tuner_gen_pop_size,
       tcEntryPointMap.at(tcEntryPoint),
-      inputs,
-      outputs,
+      shapes,
       options[0],
       fixedParams,
       optionsCache);
@@ -487,7 +1049,7 @@ Autotuner<Backend, SearchStrategy>::tune(
   std::exception_ptr tuningHarnessThreadEx = nullptr;
   std::thread tuningHarnessThread([&]() {
     try {
-      tuningHarness.run(searchStrategy);
+      tuningHarness.run(*searchStrategy);
     } catch (const std::exception& e) {
       tuningHarnessThreadEx = std::current_exception();
     }
@@ -16,24 +16,39 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
 #include <memory>
-#include <queue>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "tc/autotuner/blocking_queue.h"
+#include "tc/autotuner/cost_model.h"
 #include "tc/autotuner/genetic_search.h"
 #include "tc/autotuner/options_cache.h"
 #include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
 #include "tc/autotuner/utils.h"
 #include "tc/core/tensor.h"
+#include "tc/core/utils/measure.h"
 #include "tc/core/utils/time.h"
 #include "tc/lang/parser.h"
 
 namespace tc {
 namespace autotune {
 
+/// One of the input shapes a TC is tuned for: the input and output tensors
+/// of that shape allocated on each device (represented by a size_t), and the
+/// weight of the shape, e.g. its frequency in the workload.
+struct TuningShape {
+  std::unordered_map<size_t, std::vector<const DLConstTensor*>> inputs;
+  std::unordered_map<size_t, std::vector<const DLTensor*>> outputs;
+  double weight;
+};
+
 namespace detail {
 /**
  * Internal harness to support multithreaded compilation and evaluation over
@@ -50,14 +65,15 @@ class TuningHarness {
   TuningHarness(
       size_t maxPopulationSize,
       lang::TreeRef tcTree,
-      const std::unordered_map<size_t, std::vector<const DLConstTensor*>>&
-          inputs,
-      std::unordered_map<size_t, std::vector<const DLTensor*>>& outputs,
+      const std::vector<TuningShape>& shapes,
       const MappingOptionsType& baseMapping,
       const TuningParameterFixer& fixedParams,
       std::shared_ptr<OptionsCache<Backend>> optionsCache);
 
-  /// Runs a SearchStrategy
+  /// Runs a SearchStrategy for its numGenerations generations, or until
+  /// the time budget (FLAGS_tuner_time_budget_s) or the evaluation budget
+  /// (FLAGS_tuner_max_evaluations) is exhausted or the best runtime has
+  /// converged (FLAGS_tuner_convergence_generations), whichever comes first.
   template <typename SearchStrategy>
   void run(SearchStrategy& searchStrategy);
 
@@ -71,50 +87,188 @@ class TuningHarness {
   const MappingOptionsType& bestMappingOptions() const;
 
  private:
+  struct CompilationJob {
+    CandidateConfiguration* conf;
+    /// position of the candidate in the population, for logging
+    size_t index;
+    Printer* printer;
+  };
+  struct EvaluationJob {
+    CandidateConfiguration* conf;
+    /// one per shape, empty if the compilation failed
+    std::vector<std::unique_ptr<ExecutorType>> executors;
+    Printer* printer;
+    /// one per shape, empty unless the cost model is enabled
+    std::vector<std::vector<double>> features;
+  };
+  /// Outcome of the evaluation of a candidate
+  struct EvaluationResult {
+    bool invalid;
+    Duration runtime;
+    size_t benchmarkIterations;
+    /// uncertainty on runtime, zero if unknown
+    Duration noise;
+  };
+
   /// Traverse one iteration of candidates in parallel and evaluate their
   /// runtimes
   template <typename SearchStrategy>
   void runOneIteration(SearchStrategy& searchStrategy, size_t iteration);
 
-  /// Helper function to delegate compiling on the cpu to different threads
-  template <typename SearchStrategy>
-  void doCompile(SearchStrategy& searchStrategy);
+  /// Checks the stopping criteria of run other than the number of
+  /// generations after each generation.
+  bool budgetExhaustedOrConverged();
+
+  /// Starts the FLAGS_tuner_threads compilation threads and one evaluation
+  /// thread per device (none if candidates are isolated), they serve all the
+  /// iterations of run.
+  void startWorkers(const std::vector<size_t>& devices);
+  /// Lets the workers finish their jobs and joins them.
+  void stopWorkers();
+
+  /// Body of the compilation threads
+  void doCompile();
+
+  /// Body of the evaluation thread of device
+  void doEvaluate(size_t device);
+
+  /// Replaces the compilation and evaluation of a candidate when candidates
+  /// are isolated (FLAGS_tuner_isolate_candidates): the candidate is compiled
+  /// and benchmarked in a forked child process, on the first device of
+  /// freeDevices_ to become available. Candidates whose process crashes,
+  /// exceeds FLAGS_tuner_candidate_memory_limit or takes longer than
+  /// FLAGS_tuner_candidate_timeout to compile or to benchmark are invalid.
+  /// The child is forked while the other compilation threads run, if one of
+  /// them holds a lock (allocator, glog, LLVM) at that time the child
+  /// deadlocks on it and the candidate is dropped once the timeout expires;
+  /// FLAGS_tuner_threads=1 leaves no other busy thread in the tuner.
+  void compileAndEvaluateIsolated(const CompilationJob& job);
+
+  /// Compiles options for each shape.
+  std::vector<std::unique_ptr<ExecutorType>> compileShapes(
+      const MappingOptionsType& options);
+
+  /// Warms up the executor of each shape and measures its runtime on device
+  /// (see measure) with at most benchmarkIterations_ runs and the other
+  /// stopping criteria set by the FLAGS_tuner_benchmark_* flags.
+  /// \return false if the candidate was pruned instead.
+  bool benchmark(
+      std::vector<std::unique_ptr<ExecutorType>>& executors,
+      size_t device,
+      Duration bestTimeSoFar,
+      std::vector<ProfilingInfo>& timings);
+
+  /// Records the runtimes of a candidate evaluated on device for each shape,
+  /// the candidate runtime being their weighted mean, and trains the cost
+  /// model with them if the features of the candidate were computed.
+  void recordRuntime(
+      CandidateConfiguration& conf,
+      const MappingOptionsType& options,
+      const std::vector<std::vector<double>>& features,
+      size_t device,
+      const std::vector<ProfilingInfo>& timings,
+      Printer& printer);
 
-  /// Helper function to delegate running the compiled code to different
-  /// threads. This function must be specialized per Backend
-  void doEvaluate(size_t device, size_t populationSize, Printer& printer);
+  /// Weighted mean of values, one per shape, and its uncertainty from the
+  /// uncertainties of the values.
+  Duration weightedMean(const std::vector<Duration>& values) const;
+  Duration weightedNoise(const std::vector<Duration>& noises) const;
+
+  /// With FLAGS_tuner_cost_model_prune_factor, computes the features of
+  /// options and decides whether the candidate is predicted to be slower than
+  /// the best one so far by more than this factor, and thus not worth
+  /// compiling.
+  /// \return true if the candidate should be skipped.
+  bool pruneWithCostModel(
+      const MappingOptionsType& options,
+      std::vector<std::vector<double>>& features);
+
+  /// Trains the cost model with the options recorded in the options cache
+  /// for this TC and the inputs of each shape.
+  void trainCostModelFromCache();
+
+  /// Keeps track of the best options found so far. Options only replace the
+  /// best ones if they are faster by more than the combined uncertainty (the
+  /// half-width of the confidence interval) of both runtimes, slighter
+  /// differences may just be measurement noise.
+  void updateBestTime(
+      const MappingOptionsType& options,
+      Duration runtime,
+      Duration noise);
+
+  /// Evaluates a candidate with the result of an earlier evaluation of the
+  /// same options.
+  void reuseResult(
+      CandidateConfiguration& conf,
+      const MappingOptionsType& options,
+      const EvaluationResult& result,
+      Printer& printer);
+
+  /// Counts a candidate as evaluated (or invalid) and wakes up
+  /// runOneIteration.
+  void finishCandidate();
 
   /// Synchronization related objects
   /// The main invariant is that we always try to compile and evaluate
   /// exactly searchStrategy->population.size() candidates.
-  /// If a candidate fails compilation we still add a null Executor so that
+  /// If a candidate fails compilation we still queue a null Executor so that
   /// the invariant holds.
-  /// This way it is easy to implement multi-threaded termination by just
-  /// taking an atomic counter and pushing/popping the queues under lock until
-  /// we have evaluated searchStrategy->population.size() compilation results.
+  /// This way an iteration is over once numEvaluations_ reaches
+  /// searchStrategy->population.size().
+  /// The queues are bounded, compilation threads block when the evaluation
+  /// threads lag behind, and all the threads block when they have no job.
   mutable std::mutex bestTimeMutex_;
-  std::mutex executorsMutex_;
   std::atomic_bool stopRequested_;
   std::atomic_size_t currentCompilationJob_;
   std::atomic_size_t numEvaluations_;
-  std::queue<std::unique_ptr<ExecutorType>> executors_;
-  std::queue<CandidateConfiguration*> configurations_;
+  std::mutex numEvaluationsMutex_;
+  std::condition_variable numEvaluationsCv_;
+  const size_t maxPopulationSize_;
+  bool isolate_;
+  /// as requested by the search strategy for the current iteration
+  std::atomic_size_t benchmarkIterations_;
+  std::unique_ptr<BlockingQueue<CompilationJob>> compilationJobs_;
+  std::unique_ptr<BlockingQueue<EvaluationJob>> evaluationJobs_;
+  std::vector<std::thread> compilationThreads_;
+  std::vector<std::thread> evaluationThreads_;
+  /// devices on which no isolated candidate is being benchmarked
+  std::mutex freeDevicesMutex_;
+  std::condition_variable freeDevicesCv_;
+  std::vector<size_t> freeDevices_;
+  /// budget of run, the deadline only applies with FLAGS_tuner_time_budget_s
+  std::chrono::system_clock::time_point deadline_;
+  bool hasDeadline_;
+  /// candidates handed over to the compilation threads during run, only
+  /// accessed by runOneIteration
+  size_t numCompilationJobs_;
 
   /// inputs
   lang::TreeRef tcTree_;
   const MappingOptionsType baseMapping_;
-  /// maps of inputs and outputs per device (represented by a size_t)
-  /// involved in autotuning. The client of the autotuner API must allocate
-  /// these properly on each device where autotuning evaluation needs to run.
-  /// In particular all the inputs and outputs must contain the same values
-  /// across devices for the purpose of running correctness checks during
-  /// tuning (future work).
-  const std::unordered_map<size_t, std::vector<const DLConstTensor*>> inputs_;
-  std::unordered_map<size_t, std::vector<const DLTensor*>> outputs_;
+  /// inputs and outputs per device of each shape involved in autotuning,
+  /// with weights normalized to sum to 1. The client of the autotuner API
+  /// must allocate these properly on each device where autotuning evaluation
+  /// needs to run. In particular all the inputs and outputs must contain the
+  /// same values across devices for the purpose of running correctness
+  /// checks during tuning (future work).
+  std::vector<TuningShape> shapes_;
 
   // results
+  /// Candidates evaluated during this run (and, with
+  /// FLAGS_tuner_reuse_cached_runtimes, found in the options cache), keyed
+  /// by the serialized proto of their options. The search regularly
+  /// reproduces candidates, e.g. elites, which are not evaluated again
+  /// unless more benchmark iterations are requested for them.
+  /// Only accessed by runOneIteration.
+  std::unordered_map<std::string, EvaluationResult> evaluated_;
+  /// weighted mean runtime over the shapes
   Duration bestTime_;
+  Duration bestTimeNoise_;
   MappingOptionsType bestMappingOptions_;
+  /// bestTime_ after each generation of run
+  std::vector<Duration> bestTimes_;
+  /// trained with every runtime recorded, when enabled
+  CostModel costModel_;
 
   // backing options cache
   std::shared_ptr<OptionsCache<Backend>> optionsCache_;
@@ -167,6 +321,19 @@ class Autotuner {
       const std::vector<MappingOptionsType>& baseMapping,
       const TuningParameterFixer& fixedParams = TuningParameterFixer());
 
+  /// Runs autotuning on the TC function tcEntryPoint for several input
+  /// shapes at once, looking for the options with the best weighted mean
+  /// runtime over all the shapes, e.g. to serve a distribution of batch
+  /// sizes with a single mapping. The runtimes of the candidates on each
+  /// shape are recorded in the options cache like those of single-shape
+  /// tuning.
+  std::vector<MappingOptionsType> tune(
+      const std::string& tc,
+      const std::string& tcEntryPoint,
+      const std::vector<TuningShape>& shapes,
+      const std::vector<MappingOptionsType>& baseMapping,
+      const TuningParameterFixer& fixedParams = TuningParameterFixer());
+
  public:
   /// This is accessed by multiple threads in the tuning harness.
   /// Even though manipulations are threadsafe, you want to be sure tuning
@@ -216,8 +383,15 @@ bool skipExecutionOrWarmup(
     const std::vector<const DLConstTensor*>& inputs,
     Duration bestTimeSoFar);
 
+/// Parses FLAGS_tuner_devices, empty devices stand for the default devices
+/// of the backend.
 template <typename Backend>
 std::vector<size_t> parseDevices(const std::string& devices);
+
+/// Whether candidates can be compiled and benchmarked in a forked process,
+/// which requires the state of the devices to survive a fork.
+template <typename Backend>
+bool canIsolateCandidates();
 } // namespace detail
 } // namespace autotune
 } // namespace tc
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/bayesian_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <set>
+
+#include "tc/core/check.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+constexpr double BayesianSearch::gamma;
+constexpr size_t BayesianSearch::minObservations;
+constexpr int BayesianSearch::sampleIterations;
+
+namespace {
+std::vector<size_t> selectedOptions(TuningConfiguration& conf) {
+  std::vector<size_t> options;
+  for (const auto& p : conf.collectParameters()) {
+    options.push_back(p.numberOptions() > 0 ? p.selectedOption() : 0);
+  }
+  return options;
+}
+} // namespace
+
+BayesianSearch::BayesianSearch(
+    const std::vector<TuningConfiguration>& confs,
+    size_t numGenerations,
+    size_t populationSize,
+    size_t numSamples)
+    : SearchStrategy(numGenerations),
+      baseConf(confs.at(0)),
+      maxPopulationSize(populationSize),
+      numSamples(std::max<size_t>(numSamples, 1)),
+      rng{std::random_device{}()} {
+  detail::restoreRngState(rng);
+  population = detail::makeInitialPopulation(confs, populationSize, rng);
+}
+
+std::unique_ptr<BayesianSearch> BayesianSearch::makeFromFlags(
+    const std::vector<TuningConfiguration>& confs) {
+  return make_unique<BayesianSearch>(
+      confs,
+      FLAGS_tuner_gen_generations,
+      FLAGS_tuner_gen_pop_size,
+      FLAGS_tuner_bayesian_samples);
+}
+
+void BayesianSearch::updateParameters() {
+  for (const auto& candidate : population) {
+    observations.push_back(Observation{selectedOptions(candidate->configuration),
+                                       candidate->invalid,
+                                       candidate->runtime});
+  }
+  population.clear();
+
+  // Fastest first, invalid last
+  std::vector<const Observation*> sorted;
+  for (const auto& observation : observations) {
+    sorted.push_back(&observation);
+  }
+  std::stable_sort(
+      sorted.begin(),
+      sorted.end(),
+      [](const Observation* a, const Observation* b) {
+        if (a->invalid or b->invalid) {
+          return not a->invalid and b->invalid;
+        }
+        return a->runtime < b->runtime;
+      });
+  auto numValid = std::count_if(
+      observations.begin(), observations.end(), [](const Observation& o) {
+        return not o.invalid;
+      });
+  if (static_cast<size_t>(numValid) < minObservations) {
+    for (size_t i = 0; i < maxPopulationSize; ++i) {
+      population.push_back(make_unique<CandidateConfiguration>(baseConf));
+      detail::randomizeConfiguration(population.back()->configuration, rng);
+    }
+    return;
+  }
+  auto numGood = static_cast<size_t>(std::ceil(gamma * numValid));
+
+  // Option counts among good and bad configurations, starting from 1
+  TuningConfiguration conf(baseConf);
+  auto params = conf.collectParameters();
+  std::vector<std::vector<double>> good, bad;
+  for (const auto& p : params) {
+    good.emplace_back(p.numberOptions(), 1.0);
+    bad.emplace_back(p.numberOptions(), 1.0);
+  }
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    auto& counts = i < numGood ? good : bad;
+    for (size_t j = 0; j < params.size(); ++j) {
+      if (params[j].numberOptions() > 0) {
+        counts[j].at(sorted[i]->options.at(j)) += 1.0;
+      }
+    }
+  }
+  std::vector<std::discrete_distribution<size_t>> samplers;
+  std::vector<std::vector<double>> logRatios;
+  for (size_t j = 0; j < params.size(); ++j) {
+    samplers.emplace_back(good[j].begin(), good[j].end());
+    auto goodTotal = std::accumulate(good[j].begin(), good[j].end(), 0.0);
+    auto badTotal = std::accumulate(bad[j].begin(), bad[j].end(), 0.0);
+    logRatios.emplace_back();
+    for (size_t o = 0; o < good[j].size(); ++o) {
+      logRatios.back().push_back(
+          std::log(good[j][o] / goodTotal) - std::log(bad[j][o] / badTotal));
+    }
+  }
+
+  std::set<std::vector<size_t>> seen;
+  for (const auto& observation : observations) {
+    seen.insert(observation.options);
+  }
+  for (size_t k = 0; k < maxPopulationSize; ++k) {
+    std::unique_ptr<CandidateConfiguration> best;
+    std::vector<size_t> bestOptions;
+    auto bestScore = -std::numeric_limits<double>::infinity();
+    bool bestSeen = true;
+    for (size_t s = 0; s < numSamples; ++s) {
+      auto sample = make_unique<CandidateConfiguration>(baseConf);
+      auto sampleParams = sample->configuration.collectParameters();
+      bool valid = false;
+      for (int i = 0; i < sampleIterations and not valid; ++i) {
+        for (size_t j = 0; j < sampleParams.size(); ++j) {
+          auto& p = sampleParams[j];
+          if (not p.isForced() and p.numberOptions() > 0) {
+            p.selectOption(samplers[j](rng));
+          }
+        }
+        valid = sample->configuration.isValid();
+      }
+      if (not valid) {
+        continue;
+      }
+      auto options = selectedOptions(sample->configuration);
+      double score = 0.0;
+      for (size_t j = 0; j < sampleParams.size(); ++j) {
+        if (not sampleParams[j].isForced() and
+            sampleParams[j].numberOptions() > 0) {
+          score += logRatios[j].at(options[j]);
+        }
+      }
+      // Prefer configurations that were not evaluated yet
+      auto isSeen = seen.count(options) > 0;
+      if ((bestSeen and not isSeen) or
+          (bestSeen == isSeen and score > bestScore)) {
+        best = std::move(sample);
+        bestOptions = std::move(options);
+        bestScore = score;
+        bestSeen = isSeen;
+      }
+    }
+    if (not best) {
+      best = make_unique<CandidateConfiguration>(baseConf);
+      detail::randomizeConfiguration(best->configuration, rng);
+      bestOptions = selectedOptions(best->configuration);
+    }
+    seen.insert(bestOptions);
+    population.push_back(std::move(best));
+  }
+}
+
+} // namespace autotune
+} // namespace tc
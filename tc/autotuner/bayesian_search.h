@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * BayesianSearch is a Tree-structured Parzen Estimator (TPE) over the
+ * options of the parameters of TuningConfiguration, which are all
+ * categorical.
+ *
+ * All the evaluated configurations are split into the fastest fraction
+ * gamma ("good") and the rest ("bad", including invalid ones). For each
+ * parameter, the frequencies of its options among good and bad
+ * configurations (plus one, so that unseen options remain possible) give
+ * the densities l and g. Each candidate of a new generation is the best, in
+ * the sense of the expected improvement which grows with the product of
+ * l/g over the parameters, of numSamples configurations drawn from l, not
+ * evaluated yet if possible.
+ *
+ * The first generation consists of the seed configurations and random ones,
+ * as well as the generations before minObservations valid configurations
+ * have been observed.
+ */
+class BayesianSearch : public SearchStrategy {
+ public:
+  BayesianSearch(
+      const std::vector<TuningConfiguration>& confs,
+      size_t numGenerations,
+      size_t populationSize,
+      size_t numSamples);
+
+  /// Configured by FLAGS_tuner_gen_generations, FLAGS_tuner_gen_pop_size and
+  /// FLAGS_tuner_bayesian_samples
+  static std::unique_ptr<BayesianSearch> makeFromFlags(
+      const std::vector<TuningConfiguration>& confs);
+
+  void updateParameters() override;
+
+  static constexpr double gamma = 0.25;
+  static constexpr size_t minObservations = 4;
+  static constexpr int sampleIterations = 1000;
+
+  const TuningConfiguration baseConf;
+  const size_t maxPopulationSize;
+  const size_t numSamples;
+
+  /// A configuration evaluated so far, as the selected option of each of its
+  /// parameters
+  struct Observation {
+    std::vector<size_t> options;
+    bool invalid;
+    Duration runtime;
+  };
+  std::vector<Observation> observations;
+
+  mutable std::mt19937_64 rng;
+};
+
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace tc {
+namespace autotune {
+/**
+ * Multi-producer multi-consumer FIFO of at most capacity elements whose
+ * producers block while it is full and consumers block while it is empty.
+ * Once closed, pushes fail and pops drain the remaining elements then fail.
+ */
+template <typename T>
+class BlockingQueue {
+ public:
+  explicit BlockingQueue(size_t capacity) : capacity_(capacity) {}
+
+  /// \return false if the queue was closed, value is then dropped.
+  bool push(T value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(
+        lock, [this]() { return closed_ or elements_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    elements_.push_back(std::move(value));
+    lock.unlock();
+    notEmpty_.notify_one();
+    return true;
+  }
+
+  /// \return false if the queue is closed and empty.
+  bool pop(T& value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this]() { return closed_ or !elements_.empty(); });
+    if (elements_.empty()) {
+      return false;
+    }
+    value = std::move(elements_.front());
+    elements_.pop_front();
+    lock.unlock();
+    notFull_.notify_one();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    notFull_.notify_all();
+    notEmpty_.notify_all();
+  }
+
+ private:
+  const size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable notFull_;
+  std::condition_variable notEmpty_;
+  std::deque<T> elements_;
+  bool closed_ = false;
+};
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,446 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/cache_file.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "tc/core/check.h"
+
+namespace tc {
+namespace autotune {
+namespace detail {
+namespace {
+/// Each journal record starts with this header.
+struct RecordHeader {
+  uint64_t magic;
+  uint64_t id;
+  uint64_t size;
+  uint64_t checksum;
+};
+constexpr uint64_t kRecordMagic = 0x32524e4a43435454; // "TTCCJNR2"
+
+/// Indexed images start with this header, followed by numMergedRecords
+/// journal record ids and numBuckets buckets. Empty buckets have offset 0,
+/// blobs are stored after the buckets.
+struct ImageHeader {
+  uint64_t magic;
+  uint64_t numMergedRecords;
+  uint64_t numBuckets;
+  uint64_t numBlobs;
+};
+struct ImageBucket {
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t size;
+};
+constexpr uint64_t kImageMagic = 0x3258444943435454; // "TTCCIDX2"
+
+/// FNV-1a of the id and the data of a record, only meant to detect torn
+/// writes.
+uint64_t checksum(uint64_t id, const char* data, size_t size) {
+  return fnv1a(
+      data, size, fnv1a(reinterpret_cast<const char*>(&id), sizeof(id)));
+}
+
+std::runtime_error systemError(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void writeAll(int fd, const char* data, size_t size, const std::string& name) {
+  while (size > 0) {
+    auto n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw systemError("write " + name);
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+/// \return whether a journal record, whose checksum was not verified yet,
+/// may hold blobs with hash. Records that are not indexed images, or whose
+/// index is corrupted, are assumed to.
+bool mayHoldBlobs(llvm::StringRef record, uint64_t hash) {
+  if (!isIndexedImage(record)) {
+    return true;
+  }
+  try {
+    return !findIndexedImageBlobs(record, hash).empty();
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+}
+
+/// Parses the records of a journal up to the first incomplete or corrupted
+/// one, and returns the size of the records parsed. If hash is not null,
+/// only the records which may hold blobs with *hash are verified and
+/// returned, the others are skipped without reading their blobs.
+size_t parseJournal(
+    llvm::StringRef content,
+    std::vector<JournalRecord>* records,
+    const uint64_t* hash = nullptr) {
+  size_t pos = 0;
+  while (pos + sizeof(RecordHeader) <= content.size()) {
+    RecordHeader header;
+    std::memcpy(&header, content.data() + pos, sizeof(header));
+    auto data = pos + sizeof(header);
+    if (header.magic != kRecordMagic or header.size > content.size() - data) {
+      break;
+    }
+    auto record = content.substr(data, header.size);
+    if (!hash or mayHoldBlobs(record, *hash)) {
+      if (header.checksum !=
+          checksum(header.id, record.data(), record.size())) {
+        break;
+      }
+      if (records) {
+        records->push_back(JournalRecord{header.id, record});
+      }
+    }
+    pos = data + header.size;
+  }
+  return pos;
+}
+
+/// \return the header of an indexed image, after checking the record ids
+/// and the buckets fit in it.
+ImageHeader imageHeader(llvm::StringRef image) {
+  TC_CHECK(isIndexedImage(image)) << "Not an indexed options cache image";
+  ImageHeader header;
+  std::memcpy(&header, image.data(), sizeof(header));
+  auto capacity = (image.size() - sizeof(header)) / sizeof(uint64_t);
+  TC_CHECK_LE(header.numMergedRecords, capacity)
+      << "Corrupted options cache image: " << header.numMergedRecords
+      << " merged records";
+  capacity = (image.size() - sizeof(header) -
+              header.numMergedRecords * sizeof(uint64_t)) /
+      sizeof(ImageBucket);
+  TC_CHECK(
+      header.numBuckets > 0 and header.numBuckets <= capacity and
+      (header.numBuckets & (header.numBuckets - 1)) == 0)
+      << "Corrupted options cache image: " << header.numBuckets
+      << " buckets";
+  return header;
+}
+
+/// \return the offset of the buckets of an indexed image
+uint64_t bucketsOffset(const ImageHeader& header) {
+  return sizeof(header) + header.numMergedRecords * sizeof(uint64_t);
+}
+
+/// Journal records are not aligned, buckets are copied out.
+ImageBucket
+imageBucket(llvm::StringRef image, const ImageHeader& header, uint64_t i) {
+  ImageBucket bucket;
+  std::memcpy(
+      &bucket,
+      image.data() + bucketsOffset(header) + i * sizeof(ImageBucket),
+      sizeof(bucket));
+  return bucket;
+}
+
+llvm::StringRef imageBlob(
+    llvm::StringRef image,
+    const ImageHeader& header,
+    const ImageBucket& b) {
+  auto begin = bucketsOffset(header) + header.numBuckets * sizeof(ImageBucket);
+  TC_CHECK(
+      b.offset >= begin and b.offset <= image.size() and
+      b.size <= image.size() - b.offset)
+      << "Corrupted options cache image: blob at " << b.offset << " of size "
+      << b.size << " out of bounds";
+  return image.substr(b.offset, b.size);
+}
+
+std::string directoryOf(const std::string& filename) {
+  auto slash = filename.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : filename.substr(0, slash);
+}
+} // namespace
+
+CacheFileLock::CacheFileLock(const std::string& filename, Mode mode) {
+  auto lockname = filename + ".lock";
+  fd_ = ::open(lockname.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd_ < 0) {
+    throw systemError("open " + lockname);
+  }
+  auto operation = mode == Mode::Shared ? LOCK_SH : LOCK_EX;
+  while (::flock(fd_, operation) != 0) {
+    if (errno != EINTR) {
+      auto error = systemError("flock " + lockname);
+      ::close(fd_);
+      throw error;
+    }
+  }
+}
+
+CacheFileLock::~CacheFileLock() {
+  // Closing the descriptor releases the lock.
+  ::close(fd_);
+}
+
+MappedFile::MappedFile(const std::string& filename)
+    : filename_(filename), data_(nullptr), size_(0) {
+  auto fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return;
+    }
+    throw systemError("open " + filename);
+  }
+  struct stat buffer = {0};
+  if (::fstat(fd, &buffer) != 0) {
+    auto error = systemError("fstat " + filename);
+    ::close(fd);
+    throw error;
+  }
+  // Empty files cannot be mapped.
+  if (buffer.st_size > 0) {
+    auto data = ::mmap(nullptr, buffer.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      auto error = systemError("mmap " + filename);
+      ::close(fd);
+      throw error;
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = buffer.st_size;
+  }
+  // The mapping outlives the descriptor.
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+std::string journalFilename(const std::string& filename) {
+  return filename + ".journal";
+}
+
+std::string readFile(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.is_open()) {
+    return "";
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+size_t fileSize(const std::string& filename) {
+  struct stat buffer = {0};
+  if (::stat(filename.c_str(), &buffer) != 0) {
+    return 0;
+  }
+  return buffer.st_size;
+}
+
+void writeFileAtomically(const std::string& filename, const std::string& data) {
+  std::string tmp = filename + ".XXXXXX";
+  auto fd = ::mkstemp(&tmp[0]);
+  TC_CHECK(fd >= 0, std::invalid_argument)
+      << "Failed to create a temporary file for " << filename << ": "
+      << std::strerror(errno);
+  try {
+    // mkstemp creates files only readable by their owner
+    ::fchmod(fd, 0644);
+    writeAll(fd, data.data(), data.size(), tmp);
+    if (::fsync(fd) != 0) {
+      throw systemError("fsync " + tmp);
+    }
+  } catch (...) {
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    throw;
+  }
+  ::close(fd);
+  if (::rename(tmp.c_str(), filename.c_str()) != 0) {
+    auto error = systemError("rename " + tmp);
+    ::unlink(tmp.c_str());
+    throw error;
+  }
+  // Make the rename itself durable.
+  auto dir = ::open(directoryOf(filename).c_str(), O_RDONLY | O_CLOEXEC);
+  if (dir >= 0) {
+    ::fsync(dir);
+    ::close(dir);
+  }
+}
+
+void removeFile(const std::string& filename) {
+  if (::unlink(filename.c_str()) != 0 && errno != ENOENT) {
+    throw systemError("unlink " + filename);
+  }
+}
+
+void appendJournalRecord(const std::string& journal, const std::string& data) {
+  std::random_device device;
+  uint64_t id = (static_cast<uint64_t>(device()) << 32) ^ device();
+  RecordHeader header{
+      kRecordMagic, id, data.size(), checksum(id, data.data(), data.size())};
+  std::string record(reinterpret_cast<const char*>(&header), sizeof(header));
+  record += data;
+
+  auto fd = ::open(
+      journal.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw systemError("open " + journal);
+  }
+  try {
+    // Drop the remains of a record torn by a crash, the records appended
+    // after them would never be read.
+    auto size = fileSize(journal);
+    auto valid = parseJournal(MappedFile(journal).content(), nullptr);
+    if (valid != size && ::ftruncate(fd, valid) != 0) {
+      throw systemError("ftruncate " + journal);
+    }
+    writeAll(fd, record.data(), record.size(), journal);
+    if (::fsync(fd) != 0) {
+      throw systemError("fsync " + journal);
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+std::vector<JournalRecord> readJournalRecords(
+    const MappedFile& journal,
+    const uint64_t* hash) {
+  auto content = journal.content();
+  std::vector<JournalRecord> records;
+  auto valid = parseJournal(content, &records, hash);
+  LOG_IF(WARNING, valid != content.size())
+      << "Ignoring the " << content.size() - valid
+      << " bytes of incomplete or corrupted records at the end of "
+      << journal.filename();
+  return records;
+}
+
+std::string makeIndexedImage(
+    const std::vector<std::pair<uint64_t, std::string>>& blobs,
+    const std::vector<uint64_t>& mergedRecords) {
+  // At most half full, probe sequences stay short.
+  uint64_t numBuckets = 1;
+  while (numBuckets < 2 * blobs.size()) {
+    numBuckets *= 2;
+  }
+  ImageHeader header{
+      kImageMagic, mergedRecords.size(), numBuckets, blobs.size()};
+  std::vector<ImageBucket> buckets(numBuckets, ImageBucket{0, 0, 0});
+  uint64_t offset =
+      bucketsOffset(header) + numBuckets * sizeof(ImageBucket);
+  for (const auto& blob : blobs) {
+    auto i = blob.first & (numBuckets - 1);
+    while (buckets[i].offset != 0) {
+      i = (i + 1) & (numBuckets - 1);
+    }
+    buckets[i] = ImageBucket{blob.first, offset, blob.second.size()};
+    offset += blob.second.size();
+  }
+
+  std::string image;
+  image.reserve(offset);
+  image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  image.append(
+      reinterpret_cast<const char*>(mergedRecords.data()),
+      mergedRecords.size() * sizeof(uint64_t));
+  image.append(
+      reinterpret_cast<const char*>(buckets.data()),
+      buckets.size() * sizeof(ImageBucket));
+  for (const auto& blob : blobs) {
+    image += blob.second;
+  }
+  return image;
+}
+
+bool isIndexedImage(llvm::StringRef image) {
+  uint64_t magic;
+  if (image.size() < sizeof(ImageHeader)) {
+    return false;
+  }
+  std::memcpy(&magic, image.data(), sizeof(magic));
+  return magic == kImageMagic;
+}
+
+std::vector<uint64_t> indexedImageMergedRecords(llvm::StringRef image) {
+  auto header = imageHeader(image);
+  std::vector<uint64_t> ids(header.numMergedRecords);
+  std::memcpy(
+      ids.data(), image.data() + sizeof(header), ids.size() * sizeof(uint64_t));
+  return ids;
+}
+
+std::vector<llvm::StringRef> indexedImageBlobs(llvm::StringRef image) {
+  auto header = imageHeader(image);
+  std::vector<llvm::StringRef> blobs;
+  for (uint64_t i = 0; i < header.numBuckets; ++i) {
+    auto bucket = imageBucket(image, header, i);
+    if (bucket.offset != 0) {
+      blobs.push_back(imageBlob(image, header, bucket));
+    }
+  }
+  return blobs;
+}
+
+std::vector<llvm::StringRef> findIndexedImageBlobs(
+    llvm::StringRef image,
+    uint64_t hash) {
+  auto header = imageHeader(image);
+  auto numBuckets = header.numBuckets;
+  std::vector<llvm::StringRef> blobs;
+  // Images are never full, the probe sequence ends on an empty bucket, the
+  // bound only protects against corrupted images.
+  auto i = hash & (numBuckets - 1);
+  for (uint64_t probe = 0; probe < numBuckets; ++probe) {
+    auto bucket = imageBucket(image, header, i);
+    if (bucket.offset == 0) {
+      break;
+    }
+    if (bucket.hash == hash) {
+      blobs.push_back(imageBlob(image, header, bucket));
+    }
+    i = (i + 1) & (numBuckets - 1);
+  }
+  return blobs;
+}
+} // namespace detail
+} // namespace autotune
+} // namespace tc
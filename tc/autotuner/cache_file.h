@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+
+namespace tc {
+namespace autotune {
+namespace detail {
+/**
+ * File operations behind the options cache files, safe to use from
+ * concurrent processes sharing a cache file.
+ *
+ * A cache file consists of a snapshot, the file itself, which is only ever
+ * replaced atomically, and of a journal (see journalFilename) to which
+ * updates are appended until they are compacted into the snapshot.
+ * Both are protected by an advisory lock on a third file (see
+ * CacheFileLock).
+ * The snapshot and the journal records are indexed images (see
+ * makeIndexedImage), so that the entries of one key are read without
+ * reading, or even loading the pages of, the others.
+ * Journal records have unique ids, a snapshot lists those of the records
+ * it merged so that they are skipped if the journal is replayed, e.g. when
+ * a compaction is interrupted before it removes the journal.
+ */
+
+constexpr uint64_t kFnv1aOffsetBasis = 14695981039346656037ull;
+
+/// FNV-1a hash of the size bytes at data, continued from hash.
+inline uint64_t
+fnv1a(const char* data, size_t size, uint64_t hash = kFnv1aOffsetBasis) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/// Holds an flock on filename + ".lock" for its lifetime, blocking until it
+/// is acquired. The lock cannot be taken on the cache file itself since the
+/// cache file is replaced when it is updated.
+/// Locks held by the same process through different CacheFileLock objects
+/// conflict like those of different processes, do not nest them.
+class CacheFileLock {
+ public:
+  enum class Mode { Shared, Exclusive };
+
+  CacheFileLock(const std::string& filename, Mode mode);
+  ~CacheFileLock();
+
+  CacheFileLock(const CacheFileLock&) = delete;
+  CacheFileLock& operator=(const CacheFileLock&) = delete;
+
+ private:
+  int fd_;
+};
+
+/// Maps filename read-only for its lifetime, only the pages actually read
+/// are loaded. The mapping is empty if the file does not exist.
+/// The file must not be modified while it is mapped, which the cache file
+/// locks ensure: snapshots are replaced, not modified, and journals are only
+/// modified under the exclusive lock.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  llvm::StringRef content() const {
+    return llvm::StringRef(data_, size_);
+  }
+  const std::string& filename() const {
+    return filename_;
+  }
+
+ private:
+  std::string filename_;
+  const char* data_;
+  size_t size_;
+};
+
+/// \return the name of the journal of the cache file filename
+std::string journalFilename(const std::string& filename);
+
+/// \return the content of filename, empty if it does not exist
+std::string readFile(const std::string& filename);
+
+/// \return the size of filename, 0 if it does not exist
+size_t fileSize(const std::string& filename);
+
+/// Replaces the content of filename by writing a temporary file next to it
+/// and renaming it, readers see either the old or the new content, even if
+/// the writer crashes.
+/// Throws std::invalid_argument if the temporary file cannot be created.
+void writeFileAtomically(const std::string& filename, const std::string& data);
+
+/// Removes filename if it exists.
+void removeFile(const std::string& filename);
+
+/// A journal record and its id, see appendJournalRecord.
+struct JournalRecord {
+  uint64_t id;
+  llvm::StringRef data;
+};
+
+/// Appends a record to the journal, with a random 64-bit id, and its size
+/// and checksum so that a record torn by a crash is detected, and syncs it
+/// to disk. The remains of a torn record are dropped first. The caller holds
+/// the exclusive lock.
+void appendJournalRecord(const std::string& journal, const std::string& data);
+
+/// \return the records of the journal, up to the first incomplete or
+/// corrupted one. They point into the mapping.
+/// If hash is not null, only the records that may hold blobs with *hash
+/// are returned, the indexes of the others are probed but their blobs are
+/// neither read nor checksummed. Since appendJournalRecord drops torn
+/// records, only the last record can be corrupted.
+std::vector<JournalRecord> readJournalRecords(
+    const MappedFile& journal,
+    const uint64_t* hash = nullptr);
+
+/// \return an indexed image of blobs, each given with the 64-bit hash of
+/// its key, which merged the journal records with ids mergedRecords. The
+/// image starts with these ids and an open addressing hash table from the
+/// hashes to the offsets of the blobs, followed by the blobs, so that the
+/// blobs of a key are found by reading a few buckets.
+/// Integers are stored in the native byte order, indexed images are not
+/// portable across architectures.
+std::string makeIndexedImage(
+    const std::vector<std::pair<uint64_t, std::string>>& blobs,
+    const std::vector<uint64_t>& mergedRecords = {});
+
+/// \return whether image starts like an indexed image, other images are
+/// cache files stored before indexed images were introduced.
+bool isIndexedImage(llvm::StringRef image);
+
+/// \return the ids of the journal records merged into an indexed image.
+/// Throws std::runtime_error if image is corrupted.
+std::vector<uint64_t> indexedImageMergedRecords(llvm::StringRef image);
+
+/// \return all the blobs of an indexed image, they point into image.
+/// Throws std::runtime_error if image is corrupted.
+std::vector<llvm::StringRef> indexedImageBlobs(llvm::StringRef image);
+
+/// \return the blobs stored with hash in an indexed image, they point into
+/// image. Different keys may have the same hash, the blobs found may not all
+/// be those of the key looked for.
+/// Throws std::runtime_error if image is corrupted.
+std::vector<llvm::StringRef> findIndexedImageBlobs(
+    llvm::StringRef image,
+    uint64_t hash);
+} // namespace detail
+} // namespace autotune
+} // namespace tc
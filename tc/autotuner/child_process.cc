@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/child_process.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+namespace tc {
+namespace autotune {
+namespace detail {
+bool Channel::sendBytes(const void* data, size_t size) {
+  auto p = static_cast<const char*>(data);
+  while (size > 0) {
+    // MSG_NOSIGNAL: a dead peer must not raise SIGPIPE in the tuner.
+    auto n = ::send(fd_, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool Channel::receiveBytes(
+    void* data,
+    size_t size,
+    std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto p = static_cast<char*>(data);
+  while (size > 0) {
+    int waitMs = -1;
+    if (timeout.count() > 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        return false;
+      }
+      waitMs = static_cast<int>(left.count());
+    }
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    auto ready = ::poll(&pfd, 1, waitMs);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      return false;
+    }
+    auto n = ::recv(fd_, p, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+ChildProcess::ChildProcess(
+    std::function<void(Channel&)> body,
+    size_t memoryLimit)
+    : pid_(-1), fd_(-1), channel_(-1), reaped_(false), status_(0) {
+  int fds[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    throw std::runtime_error(
+        std::string("socketpair: ") + std::strerror(errno));
+  }
+  pid_ = ::fork();
+  if (pid_ < 0) {
+    auto err = errno;
+    ::close(fds[0]);
+    ::close(fds[1]);
+    throw std::runtime_error(std::string("fork: ") + std::strerror(err));
+  }
+  if (pid_ == 0) {
+    ::close(fds[0]);
+    if (memoryLimit > 0) {
+      struct rlimit limit = {memoryLimit, memoryLimit};
+      if (::setrlimit(RLIMIT_AS, &limit) != 0) {
+        // Running unbounded would defeat the purpose of the limit.
+        ::_exit(1);
+      }
+    }
+    Channel channel(fds[1]);
+    int status = 0;
+    try {
+      body(channel);
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "Child process failed: " << e.what();
+      status = 1;
+    } catch (...) {
+      status = 1;
+    }
+    // Skip the atexit handlers and static destructors of the parent.
+    ::_exit(status);
+  }
+  ::close(fds[1]);
+  fd_ = fds[0];
+  channel_ = Channel(fd_);
+}
+
+ChildProcess::~ChildProcess() {
+  kill();
+  ::close(fd_);
+}
+
+void ChildProcess::kill() {
+  if (!reaped_) {
+    ::kill(pid_, SIGKILL);
+    wait();
+  }
+}
+
+std::string ChildProcess::wait() {
+  while (!reaped_) {
+    if (::waitpid(pid_, &status_, 0) == pid_) {
+      reaped_ = true;
+    } else if (errno != EINTR) {
+      return std::string("waitpid: ") + std::strerror(errno);
+    }
+  }
+  std::stringstream ss;
+  if (WIFEXITED(status_)) {
+    ss << "exited with status " << WEXITSTATUS(status_);
+  } else if (WIFSIGNALED(status_)) {
+    ss << "killed by signal " << WTERMSIG(status_) << " ("
+       << strsignal(WTERMSIG(status_)) << ")";
+  } else {
+    ss << "terminated with status " << status_;
+  }
+  return ss.str();
+}
+} // namespace detail
+} // namespace autotune
+} // namespace tc
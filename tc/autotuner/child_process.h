@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+namespace tc {
+namespace autotune {
+namespace detail {
+/**
+ * Endpoint of the socket connecting a parent and a child process, messages
+ * are trivially copyable values.
+ * Operations return false if the other end is gone, a receive also returns
+ * false when its timeout expires (a zero timeout waits indefinitely).
+ */
+class Channel {
+ public:
+  explicit Channel(int fd) : fd_(fd) {}
+
+  bool sendBytes(const void* data, size_t size);
+  bool receiveBytes(
+      void* data,
+      size_t size,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+  template <typename T>
+  bool send(const T& msg) {
+    static_assert(std::is_trivially_copyable<T>::value, "POD messages only");
+    return sendBytes(&msg, sizeof(T));
+  }
+  template <typename T>
+  bool receive(
+      T& msg,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(0)) {
+    static_assert(std::is_trivially_copyable<T>::value, "POD messages only");
+    return receiveBytes(&msg, sizeof(T), timeout);
+  }
+
+ private:
+  int fd_;
+};
+
+/**
+ * A forked copy of the current process which runs body and exits, used to
+ * contain crashes, hangs and memory blowups of untrusted work.
+ *
+ * The child only contains the thread that forked it, it must not wait for
+ * other threads nor for locks they may have held at the time of the fork.
+ * If memoryLimit is not zero, the address space of the child is limited to
+ * that many bytes so that allocations beyond the limit fail in the child,
+ * the child exits with status 1 without running body if the limit cannot be
+ * set.
+ *
+ * The destructor kills the child if it is still running and reaps it.
+ */
+class ChildProcess {
+ public:
+  ChildProcess(std::function<void(Channel&)> body, size_t memoryLimit = 0);
+  ~ChildProcess();
+
+  ChildProcess(const ChildProcess&) = delete;
+  ChildProcess& operator=(const ChildProcess&) = delete;
+
+  /// Channel to the child, a failed receive (timeout or termination of the
+  /// child) should be followed by kill.
+  Channel& channel() {
+    return channel_;
+  }
+
+  /// Kills the child and waits for its termination.
+  void kill();
+
+  /// Waits for the termination of the child and returns a description of
+  /// how it terminated, e.g. "killed by signal 11".
+  std::string wait();
+
+ private:
+  pid_t pid_;
+  int fd_;
+  Channel channel_;
+  bool reaped_;
+  int status_;
+};
+} // namespace detail
+} // namespace autotune
+} // namespace tc
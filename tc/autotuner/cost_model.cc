@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/cost_model.h"
+
+#include <cmath>
+#include <utility>
+
+#include "tc/core/check.h"
+#include "tc/core/compilation_stage_cache.h"
+#include "tc/core/halide_utils.h"
+#include "tc/core/polyhedral/memory_promotion.h"
+#include "tc/core/polyhedral/schedule_tree.h"
+#include "tc/core/polyhedral/schedule_tree_elem.h"
+#include "tc/core/polyhedral/schedule_utils.h"
+#include "tc/core/polyhedral/scop.h"
+
+namespace tc {
+namespace autotune {
+namespace {
+/// Footprints larger than this do not fit in the on-chip memory close to the
+/// cores (L1 cache or shared memory).
+constexpr double kOnChipMemoryBytes = 48 * 1024;
+
+/// Regularization of the regression, the features are in the order of 1-10.
+constexpr double kRidge = 1.0;
+
+double log2p1(double x) {
+  return std::log2(1.0 + x);
+}
+} // namespace
+
+std::vector<double> extractFeatures(
+    const lang::TreeRef& tcDefinition,
+    const std::vector<const DLConstTensor*>& inputs,
+    const MappingOptionsView& options) {
+  using namespace polyhedral;
+  using namespace polyhedral::detail;
+
+  auto& cache = CompilationStageCache::forThisThread();
+  auto halideComponents = cache.translate(tcDefinition);
+  auto pvm = computeParamValueMap(halideComponents, inputs);
+  auto scop = cache.makeScheduledScop(halideComponents, pvm, options);
+
+  // The footprint of a tile is that of the elements accessed below the tile
+  // loops. Without tiling, the tile is the whole iteration space.
+  auto root = scop->scheduleRoot();
+  auto tileSizes = options.tiling.extractVector();
+  ScheduleTree* band;
+  isl::union_map tileSchedule;
+  if (tileSizes.empty()) {
+    band = scop->obtainOuterBand();
+    tileSchedule = prefixSchedule(root, band);
+  } else {
+    band = scop->tileOuterBand(options.tiling);
+    tileSchedule = partialSchedule(root, band);
+  }
+  auto bandNode = band->as<ScheduleTreeBand>();
+  TC_CHECK(bandNode);
+
+  double footprintBytes = 0;
+  double footprintElements = 0;
+  double readOnlyBytes = 0;
+  auto groups = TensorReferenceGroup::accessedWithin(tileSchedule, scop->body);
+  for (const auto& kvp : groups) {
+    auto elementBytes = scop->findArgument(kvp.first).type().bytes();
+    for (const auto& group : kvp.second) {
+      double elements = 1;
+      for (auto size : group->approximationSizes()) {
+        elements *= size;
+      }
+      footprintElements += elements;
+      footprintBytes += elements * elementBytes;
+      if (group->isReadOnly()) {
+        readOnlyBytes += elements * elementBytes;
+      }
+    }
+  }
+
+  // Untiled members (tile size 0) are not accounted for in the work per
+  // tile.
+  double tileWork = 1;
+  for (size_t i = 0; i < tileSizes.size() && i < bandNode->nMember(); ++i) {
+    if (tileSizes[i] > 0) {
+      tileWork *= tileSizes[i];
+    }
+  }
+
+  auto numBands = ScheduleTree::collect(root, ScheduleTreeType::Band).size();
+  auto unroll = options.proto.has_unroll() ? options.proto.unroll() : 1;
+
+  std::vector<double> features{
+      1.0,
+      log2p1(footprintBytes),
+      log2p1(readOnlyBytes),
+      footprintBytes > kOnChipMemoryBytes ? 1.0 : 0.0,
+      log2p1(tileWork),
+      log2p1(tileWork) - log2p1(footprintElements),
+      static_cast<double>(bandNode->nMember()),
+      static_cast<double>(bandNode->nOuterCoincident()),
+      static_cast<double>(numBands),
+      log2p1(unroll)};
+  TC_CHECK_EQ(features.size(), kNumCostModelFeatures);
+  return features;
+}
+
+constexpr size_t CostModel::minSamples;
+
+CostModel::CostModel()
+    : xtx_(kNumCostModelFeatures * kNumCostModelFeatures, 0.0),
+      xty_(kNumCostModelFeatures, 0.0),
+      numSamples_(0) {}
+
+void CostModel::train(const std::vector<double>& features, Duration runtime) {
+  TC_CHECK_EQ(features.size(), kNumCostModelFeatures);
+  auto y = std::log2(static_cast<double>(runtime.toMicroSeconds()) + 1.0);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < kNumCostModelFeatures; ++i) {
+    for (size_t j = 0; j < kNumCostModelFeatures; ++j) {
+      xtx_[i * kNumCostModelFeatures + j] += features[i] * features[j];
+    }
+    xty_[i] += features[i] * y;
+  }
+  ++numSamples_;
+}
+
+Duration CostModel::predict(const std::vector<double>& features) const {
+  TC_CHECK_EQ(features.size(), kNumCostModelFeatures);
+  const size_t n = kNumCostModelFeatures;
+  std::vector<double> a;
+  std::vector<double> w;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (numSamples_ < minSamples) {
+      return Duration::max();
+    }
+    a = xtx_;
+    w = xty_;
+  }
+
+  // Solve (X^T X + kRidge I) w = X^T y by Gaussian elimination with partial
+  // pivoting, the matrix is symmetric positive definite.
+  for (size_t i = 0; i < n; ++i) {
+    a[i * n + i] += kRidge;
+  }
+  for (size_t col = 0; col < n; ++col) {
+    auto pivot = col;
+    for (size_t row = col + 1; row < n; ++row) {
+      if (std::abs(a[row * n + col]) > std::abs(a[pivot * n + col])) {
+        pivot = row;
+      }
+    }
+    if (pivot != col) {
+      for (size_t k = 0; k < n; ++k) {
+        std::swap(a[col * n + k], a[pivot * n + k]);
+      }
+      std::swap(w[col], w[pivot]);
+    }
+    for (size_t row = col + 1; row < n; ++row) {
+      auto factor = a[row * n + col] / a[col * n + col];
+      for (size_t k = col; k < n; ++k) {
+        a[row * n + k] -= factor * a[col * n + k];
+      }
+      w[row] -= factor * w[col];
+    }
+  }
+  for (size_t col = n; col-- > 0;) {
+    for (size_t k = col + 1; k < n; ++k) {
+      w[col] -= a[col * n + k] * w[k];
+    }
+    w[col] /= a[col * n + col];
+  }
+
+  double logRuntime = 0;
+  for (size_t i = 0; i < n; ++i) {
+    logRuntime += w[i] * features[i];
+  }
+  auto us = std::exp2(logRuntime) - 1.0;
+  if (!(us < static_cast<double>(Duration::max().toMicroSeconds()))) {
+    return Duration::max();
+  }
+  return Duration::fromMicroSeconds(us < 0 ? 0 : static_cast<size_t>(us));
+}
+
+size_t CostModel::numSamples() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numSamples_;
+}
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "tc/core/mapping_options.h"
+#include "tc/core/tensor.h"
+#include "tc/core/utils/time.h"
+#include "tc/lang/tree.h"
+
+namespace tc {
+namespace autotune {
+
+/// Number of features returned by extractFeatures.
+constexpr size_t kNumCostModelFeatures = 10;
+
+/// Features of the TC tcDefinition compiled for inputs with the generic
+/// options, read off its schedule after scheduling and tiling of the outer
+/// band: footprint of a tile (from the tensor reference groups accessed
+/// within it), work per tile and reuse, number of members of the outer band,
+/// of its outer coincident (parallel) members and of bands in the tree, and
+/// unrolling.
+/// The front end is memoized by CompilationStageCache, which the
+/// compilation of the candidate then reuses.
+std::vector<double> extractFeatures(
+    const lang::TreeRef& tcDefinition,
+    const std::vector<const DLConstTensor*>& inputs,
+    const MappingOptionsView& options);
+
+/**
+ * A CostModel predicts the runtime of a candidate from its features.
+ * It is a ridge regression of the logarithm of the runtime, trained online
+ * by accumulating the normal equations, which is cheap enough to be solved
+ * for every prediction. Until minSamples runtimes have been learned, it
+ * makes no prediction.
+ * train and predict are threadsafe.
+ */
+class CostModel {
+ public:
+  static constexpr size_t minSamples = 16;
+
+  CostModel();
+
+  void train(const std::vector<double>& features, Duration runtime);
+
+  /// \return the predicted runtime, Duration::max() if the model has not
+  /// learned enough runtimes yet.
+  Duration predict(const std::vector<double>& features) const;
+
+  size_t numSamples() const;
+
+ private:
+  mutable std::mutex mutex_;
+  /// X^T X, row-major, and X^T y for the features X and the log2 of the
+  /// runtimes in microseconds y.
+  std::vector<double> xtx_;
+  std::vector<double> xty_;
+  size_t numSamples_;
+};
+} // namespace autotune
+} // namespace tc
@@ -16,6 +16,7 @@
 
 #include "tc/autotuner/autotuner.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <numeric>
@@ -25,6 +26,7 @@
 
 #include "tc/autotuner/utils.h"
 #include "tc/core/compiler.h"
+#include "tc/core/cpu/cpu_device.h"
 #include "tc/core/cpu/cpu_mapping_options_cpp_printer.h"
 #include "tc/core/cpu/cpu_tc_executor.h"
 #include "tc/core/flags.h"
@@ -60,7 +62,45 @@ bool skipExecutionOrWarmup<CpuBackend>(
     const std::vector<const DLTensor*>& outputs,
     const std::vector<const DLConstTensor*>& inputs,
     Duration bestTimeSoFar) {
-  LOG(ERROR) << "NYI: skipExecutionOrWarmup<CpuBackend>";
+  // 1. Perform a first run which may have one of 2 behaviors:
+  //   1.a. return a very slow first execution time, we should stop
+  //     early. This is akin to pruning but in this case we have run once,
+  //   1.b. return a reasonable execution time, in which case we proceed with
+  //     warmup.
+  // The first run also pages in the outputs and wakes up the threads of the
+  // device pool.
+  auto timings = executor.profile(inputs, outputs);
+  // 1.a.
+  constexpr size_t kCatastrophicPerfFactor = 100;
+  if (bestTimeSoFar < Duration::max() and
+      timings.kernelRuntime >= bestTimeSoFar * kCatastrophicPerfFactor) {
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "Skip configuration: first run took "
+        << timings.kernelRuntime.toMicroSeconds() << "us";
+    return true;
+  }
+  // 1.b. during autotuning we don't want to spend too much time executing,
+  // use a reduced number of iterations for warmup, enough to bring the
+  // inputs and outputs in the caches of the device.
+  constexpr size_t kReducedWarmupIterations = 3;
+  auto warmupIterations = std::min<size_t>(
+      std::max<size_t>(FLAGS_benchmark_warmup, 1), kReducedWarmupIterations);
+  for (size_t i = 0; i < warmupIterations; ++i) {
+    timings = executor.profile(inputs, outputs);
+  }
+
+  // 2. After reasonable warmup, look at the performance and prune if
+  // catastrophically bad.
+  constexpr size_t kEarlyPruneFactor = 5;
+  if (bestTimeSoFar < Duration::max() and
+      timings.kernelRuntime >= bestTimeSoFar * kEarlyPruneFactor) {
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "Skip configuration: warm run took "
+        << timings.kernelRuntime.toMicroSeconds() << "us";
+    return true;
+  }
+
+  // 3. If we get here then the kernel is good to be benchmarked
   return false;
 }
 
@@ -68,13 +108,27 @@ template <>
 void handleDeviceRuntimeError<CpuBackend>(
     size_t device,
     typename CpuBackend::MappingOptionsType& options) {
-  LOG(ERROR) << "NYI: handleDeviceRuntimeError<CpuBackend>";
+  // Errors raised by CPU kernels are exceptions thrown before the kernel
+  // starts (e.g. size mismatches), they leave no state behind on the cores
+  // of the device.
 }
 
 template <>
 std::vector<size_t> parseDevices<CpuBackend>(const std::string& devices) {
-  LOG(ERROR) << "NYI: handleDeviceRuntimeError<CpuBackend>";
-  return {};
+  // Parallel candidates must be measured on all the cores they may use.
+  if (devices.empty()) {
+    return {CpuDevices::add(getThreadAffinity())};
+  }
+  std::vector<size_t> res;
+  for (const auto& cores : parseCpuCoreSets(devices)) {
+    res.push_back(CpuDevices::add(cores));
+  }
+  return res;
+}
+
+template <>
+bool canIsolateCandidates<CpuBackend>() {
+  return true;
 }
 } // namespace detail
 } // namespace autotune
@@ -155,6 +155,9 @@ void handleDeviceRuntimeError<CudaBackend>(
 
 template <>
 std::vector<size_t> parseDevices<CudaBackend>(const std::string& devices) {
+  if (devices.empty()) {
+    return {0};
+  }
   std::stringstream ss(devices);
   size_t device;
   std::vector<size_t> res;
@@ -166,6 +169,12 @@ std::vector<size_t> parseDevices<CudaBackend>(const std::string& devices) {
   }
   return res;
 }
+
+template <>
+bool canIsolateCandidates<CudaBackend>() {
+  // A CUDA context cannot be used in a forked child.
+  return false;
+}
 } // namespace detail
 } // namespace autotune
 } // namespace tc
@@ -20,57 +20,19 @@
 #include <sstream>
 
 #include "tc/core/check.h"
+#include "tc/core/flags.h"
 
 namespace tc {
 namespace autotune {
 
 namespace {
 
-template <typename Parameter, typename RNG>
-void randomizeParameter(Parameter& param, RNG& rng) {
-  auto paramIndex = std::uniform_int_distribution<size_t>(
-      size_t(0), param.numberOptions() - 1)(rng);
-  param.selectOption(paramIndex);
-}
-
-template <typename RNG>
 void randomizePopulation(
     GeneticSearch::Population::iterator begin,
     GeneticSearch::Population::iterator end,
-    RNG& rng) {
+    std::mt19937_64& rng) {
   for (auto candidate = begin; candidate != end; ++candidate) {
-    auto& conf = (*candidate)->configuration;
-    do {
-      conf.applyToParameters(
-          [&](ParameterView& p) { randomizeParameter(p, rng); });
-    } while (!conf.isValid());
-  }
-}
-
-template <typename RNG>
-void mutate(
-    CandidateConfiguration& candidate,
-    double rate,
-    size_t iterations,
-    RNG& rng) {
-  auto shouldMutate = [&]() -> bool {
-    return std::discrete_distribution<int>{static_cast<double>(100 - rate),
-                                           static_cast<double>(rate)}(rng);
-  };
-
-  CandidateConfiguration res(candidate);
-  for (size_t i = 0; i < iterations; ++i) {
-    res.configuration.applyToParameters([&](ParameterView& p) {
-      if (not p.isForced() and shouldMutate()) {
-        randomizeParameter(p, rng);
-      }
-    });
-
-    if (res.configuration.isValid()) {
-      candidate.configuration = res.configuration;
-      return;
-    }
-    res.configuration = candidate.configuration;
+    detail::randomizeConfiguration((*candidate)->configuration, rng);
   }
 }
 
@@ -141,20 +103,6 @@ void dropInvalidConfigurations(GeneticSearch::Population& population) {
       << "the crossover (" << crossOverRate             \
       << ") rate should be in the [0,100] interval";
 
-namespace {
-
-template <typename RNG>
-void restoreRngState(RNG& rng) {
-  if (FLAGS_tuner_rng_restore.empty()) {
-    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG state " << rng;
-  } else {
-    std::istringstream ss(FLAGS_tuner_rng_restore);
-    ss >> rng;
-    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG restored state " << rng;
-  }
-}
-} // namespace
-
 GeneticSearch::GeneticSearch(
     const std::vector<TuningConfiguration>& confs,
     size_t numGenerations,
@@ -162,29 +110,27 @@ GeneticSearch::GeneticSearch(
     uint8_t crossOverRate,
     uint8_t mutationRate,
     size_t numElites)
-    : population(),
+    : SearchStrategy(numGenerations),
       lastBestConf(confs[0]),
-      numGenerations(numGenerations),
       maxPopulationSize(populationSize),
       crossOverRate(crossOverRate),
       mutationRate(mutationRate),
       numberElites(std::min(numElites, populationSize / 2)),
       rng{std::random_device{}()} {
-  restoreRngState(rng);
+  detail::restoreRngState(rng);
   VALIDATE();
-  TC_CHECK(not confs.empty()) << "empty set of predefined configurations";
+  population = detail::makeInitialPopulation(confs, populationSize, rng);
+}
 
-  population.reserve(populationSize);
-  size_t size = 0;
-  for (; size < confs.size() && size < maxPopulationSize; ++size) {
-    population.push_back(make_unique<CandidateConfiguration>(confs[size]));
-  }
-  size_t oldSize = size;
-  for (; size < maxPopulationSize; ++size) {
-    population.emplace_back(
-        make_unique<CandidateConfiguration>(*population.front()));
-  }
-  randomizePopulation(population.begin() + oldSize, population.end(), rng);
+std::unique_ptr<GeneticSearch> GeneticSearch::makeFromFlags(
+    const std::vector<TuningConfiguration>& confs) {
+  return make_unique<GeneticSearch>(
+      confs,
+      FLAGS_tuner_gen_generations,
+      FLAGS_tuner_gen_pop_size,
+      FLAGS_tuner_gen_crossover_rate,
+      FLAGS_tuner_gen_mutation_rate,
+      FLAGS_tuner_gen_number_elites);
 }
 
 TuningConfiguration GeneticSearch::crossover(
@@ -305,7 +251,8 @@ void GeneticSearch::updateParameters() {
 
   breed();
   for (size_t i = numberElites; i < population.size(); ++i) {
-    mutate(*population[i], mutationRate, mutateIterations, rng);
+    detail::mutateConfiguration(
+        population[i]->configuration, mutationRate, mutateIterations, rng);
   }
 }
 
@@ -15,9 +15,11 @@
  */
 #pragma once
 
+#include <memory>
 #include <random>
 
 #include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
 
 namespace tc {
 namespace autotune {
@@ -48,7 +50,7 @@ namespace autotune {
  * The mutation rate controls the probability with which mutation occurs.
  */
 
-class GeneticSearch {
+class GeneticSearch : public SearchStrategy {
  public:
   /**
    * confs are used to seed the first generation, the rest of the population is
@@ -76,7 +78,11 @@ class GeneticSearch {
       uint8_t mutationRate,
       size_t numberElites);
 
-  void updateParameters();
+  /// Configured by the FLAGS_tuner_gen_* flags
+  static std::unique_ptr<GeneticSearch> makeFromFlags(
+      const std::vector<TuningConfiguration>& confs);
+
+  void updateParameters() override;
 
  private:
   void breed();
@@ -90,11 +96,7 @@ class GeneticSearch {
   static constexpr int mutateIterations = 1000;
   static constexpr int minCandidatesForBreeding = 3;
 
-  using Population = std::vector<std::unique_ptr<CandidateConfiguration>>;
-
-  Population population;
   TuningConfiguration lastBestConf;
-  const size_t numGenerations;
   const size_t maxPopulationSize;
   const uint8_t crossOverRate;
   const uint8_t mutationRate;
@@ -15,17 +15,24 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
-#include <fstream>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringRef.h>
 
+#include "tc/autotuner/cache_file.h"
 #include "tc/core/check.h"
 #include "tc/core/compiler.h"
 #include "tc/core/tensor.h"
@@ -37,10 +44,291 @@
 
 namespace tc {
 namespace autotune {
+namespace detail {
+/// Journals smaller than this are not worth compacting.
+constexpr size_t kMinJournalCompactionBytes = 1 << 20;
+
+template <typename T>
+uint64_t hashValue(const T& value, uint64_t hash) {
+  return fnv1a(reinterpret_cast<const char*>(&value), sizeof(value), hash);
+}
+
+inline uint64_t hashTensorInfos(
+    const std::vector<TensorInfo>& infos,
+    uint64_t hash) {
+  hash = hashValue<uint64_t>(infos.size(), hash);
+  for (const auto& info : infos) {
+    hash = hashValue<uint64_t>(info.dtype.code, hash);
+    hash = hashValue<uint64_t>(info.dtype.bits, hash);
+    hash = hashValue<uint64_t>(info.dtype.lanes, hash);
+    hash = hashValue(info.alignment, hash);
+    hash = hashValue<uint64_t>(info.shape.size(), hash);
+    for (auto s : info.shape) {
+      hash = hashValue(s, hash);
+    }
+    hash = hashValue<uint64_t>(info.strides.size(), hash);
+    for (auto s : info.strides) {
+      hash = hashValue(s, hash);
+    }
+  }
+  return hash;
+}
+
+inline uint64_t fingerprint(
+    const lang::CanonicalTcString& id,
+    const std::vector<TensorInfo>& inputs,
+    const std::vector<TensorInfo>& outputs,
+    const std::string& backendStr) {
+  auto hash = hashValue<uint64_t>(id.size(), kFnv1aOffsetBasis);
+  hash = fnv1a(id.data(), id.size(), hash);
+  hash = hashTensorInfos(inputs, hash);
+  hash = hashTensorInfos(outputs, hash);
+  hash = hashValue<uint64_t>(backendStr.size(), hash);
+  return fnv1a(backendStr.data(), backendStr.size(), hash);
+}
+
+/// Appends the entries of proto to entries, only those of the key only if
+/// it is not null.
+template <typename Backend>
+void appendProtobufEntries(
+    const typename Backend::OptionsCacheProtoType& proto,
+    const OptionsCacheKey* only,
+    std::vector<std::pair<OptionsCacheKey, OptionsCacheValue<Backend>>>&
+        entries) {
+  // Caches stored before keys were deduplicated have one key per value.
+  auto deduplicated = proto.key_indices().size() > 0;
+  TC_CHECK_EQ(
+      deduplicated ? proto.key_indices().size() : proto.keys().size(),
+      proto.values().size());
+  std::vector<OptionsCacheKey> keys;
+  keys.reserve(proto.keys().size());
+  for (const auto& key : proto.keys()) {
+    keys.push_back(OptionsCacheKey::fromProtobuf(key));
+  }
+  for (int i = 0; i < proto.values().size(); ++i) {
+    size_t k = deduplicated ? proto.key_indices(i) : i;
+    TC_CHECK_LT(k, keys.size());
+    if (only and keys[k] != *only) {
+      continue;
+    }
+    entries.emplace_back(
+        keys[k],
+        OptionsCacheValue<Backend>::fromProtobuf(proto.values().Get(i)));
+  }
+}
+
+/// \return the index of the value of options in entries,
+/// entries.values.size() if there is none
+template <typename Backend>
+size_t findOptions(
+    const OptionsCacheEntries<Backend>& entries,
+    const typename Backend::MappingOptionsType& options) {
+  size_t i = 0;
+  while (i < entries.values.size() and
+         !(entries.values[i]->mappingOptions == options)) {
+    ++i;
+  }
+  return i;
+}
+
+/// Inserts value in entries at the rank of its median runtime, after the
+/// values with the same median.
+template <typename Backend>
+void insertValue(
+    OptionsCacheEntries<Backend>& entries,
+    OptionsCacheValue<Backend> value) {
+  auto m = value.runtimes.empty() ? Duration::max() : median(value.runtimes);
+  auto pos = std::upper_bound(
+      entries.medians.begin(),
+      entries.medians.end(),
+      m,
+      [](const Duration& a, const Duration& b) {
+        // fun with C++, a < b does not mix with templates
+        return operator<(a, b);
+      });
+  auto i = pos - entries.medians.begin();
+  entries.medians.insert(pos, m);
+  entries.values.insert(
+      entries.values.begin() + i,
+      std::make_shared<const OptionsCacheValue<Backend>>(std::move(value)));
+}
+
+/// Appends the runtimes of value to those of the i-th value of entries, which
+/// moves to its new rank. The stored runtimes of value remain stored if all
+/// those of the i-th value are.
+template <typename Backend>
+void appendRuntimes(
+    OptionsCacheEntries<Backend>& entries,
+    size_t i,
+    const OptionsCacheValue<Backend>& value) {
+  auto updated = *entries.values[i];
+  if (updated.numStoredRuntimes == updated.runtimes.size()) {
+    updated.numStoredRuntimes += value.numStoredRuntimes;
+  }
+  updated.runtimes.insert(
+      updated.runtimes.end(), value.runtimes.begin(), value.runtimes.end());
+  updated.runtimeStdDevs.insert(
+      updated.runtimeStdDevs.end(),
+      value.runtimeStdDevs.begin(),
+      value.runtimeStdDevs.end());
+  entries.values.erase(entries.values.begin() + i);
+  entries.medians.erase(entries.medians.begin() + i);
+  insertValue(entries, std::move(updated));
+}
+
+/// \return the distance between two lists of tensors of the same TC: the sum
+/// over all their dimensions of the absolute log ratio of the extents (plus
+/// one, for empty tensors), so that doubling any extent costs the same.
+/// None if the tensors are not comparable: different numbers of tensors, or
+/// of dimensions, or different element types.
+inline llvm::Optional<double> shapeDistance(
+    const std::vector<TensorInfo>& a,
+    const std::vector<TensorInfo>& b) {
+  if (a.size() != b.size()) {
+    return llvm::None;
+  }
+  double distance = 0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!(a[i].dtype == b[i].dtype) or
+        a[i].shape.size() != b[i].shape.size()) {
+      return llvm::None;
+    }
+    for (size_t d = 0; d < a[i].shape.size(); ++d) {
+      distance += std::abs(std::log(
+          (1.0 + static_cast<double>(a[i].shape[d])) /
+          (1.0 + static_cast<double>(b[i].shape[d]))));
+    }
+  }
+  return distance;
+}
+
+/// \return the tile sizes tiles, tuned for the tensors from, adapted to the
+/// tensors to (of the same TC, see shapeDistance): the tile sizes equal to
+/// the extent of a dimension of from, which usually mean that the dimension
+/// is not tiled, are replaced by the extent of the same dimension of to. The
+/// other tile sizes are kept, as are those equal to extents that changed
+/// differently in different dimensions, which cannot be told apart.
+inline std::vector<uint64_t> rescaleTileSizes(
+    std::vector<uint64_t> tiles,
+    const std::vector<TensorInfo>& from,
+    const std::vector<TensorInfo>& to) {
+  TC_CHECK_EQ(from.size(), to.size());
+  // Extents of from that map to several extents of to are ambiguous.
+  std::unordered_map<int64_t, llvm::Optional<int64_t>> extents;
+  for (size_t i = 0; i < from.size(); ++i) {
+    TC_CHECK_EQ(from[i].shape.size(), to[i].shape.size());
+    for (size_t d = 0; d < from[i].shape.size(); ++d) {
+      auto res = extents.emplace(from[i].shape[d], to[i].shape[d]);
+      if (!res.second and res.first->second and
+          *res.first->second != to[i].shape[d]) {
+        res.first->second = llvm::None;
+      }
+    }
+  }
+  for (auto& tile : tiles) {
+    auto it = extents.find(static_cast<int64_t>(tile));
+    if (it != extents.end() and it->second and *it->second > 0) {
+      tile = static_cast<uint64_t>(*it->second);
+    }
+  }
+  return tiles;
+}
+
+/// Updates a shard of an OptionsCache: holds its lock, and publishes the
+/// updated entries, then the slots if keys were added, on destruction.
+/// Entries updated several times are copied and published once.
+template <typename Backend>
+class OptionsCacheShardWriter {
+ public:
+  explicit OptionsCacheShardWriter(OptionsCacheShard<Backend>& shard)
+      : shard_(shard),
+        lock_(shard.mutex),
+        slots_(std::atomic_load(&shard.slots)) {}
+
+  ~OptionsCacheShardWriter() {
+    for (auto& kvp : pending_) {
+      std::atomic_store(
+          &kvp.first->entries,
+          std::shared_ptr<const OptionsCacheEntries<Backend>>(
+              std::move(kvp.second)));
+    }
+    if (added_) {
+      std::atomic_store(
+          &shard_.slots,
+          std::shared_ptr<const OptionsCacheSlots<Backend>>(std::move(added_)));
+    }
+  }
+
+  /// \return the slots of the shard, null if it is empty
+  const OptionsCacheSlots<Backend>* slots() const {
+    return added_ ? added_.get() : slots_.get();
+  }
+
+  /// \return the entries of key to update, added if key is missing
+  OptionsCacheEntries<Backend>& entries(const OptionsCacheKey& key) {
+    auto& slot = this->slot(key);
+    auto& entries = pending_[&slot];
+    if (!entries) {
+      entries = std::make_shared<OptionsCacheEntries<Backend>>();
+      if (auto current = std::atomic_load(&slot.entries)) {
+        *entries = *current;
+      }
+    }
+    return *entries;
+  }
+
+ private:
+  OptionsCacheSlot<Backend>& slot(const OptionsCacheKey& key) {
+    if (auto slots = this->slots()) {
+      auto it = slots->find(key.fingerprint);
+      if (it != slots->end()) {
+        for (const auto& slot : it->second) {
+          if (slot->key == key) {
+            return *slot;
+          }
+        }
+      }
+    }
+    if (!added_) {
+      added_ = slots_ ? std::make_shared<OptionsCacheSlots<Backend>>(*slots_)
+                      : std::make_shared<OptionsCacheSlots<Backend>>();
+    }
+    auto slot = std::make_shared<OptionsCacheSlot<Backend>>(key);
+    (*added_)[key.fingerprint].push_back(slot);
+    return *slot;
+  }
+
+  OptionsCacheShard<Backend>& shard_;
+  // Released last, after the destructor has published the updates.
+  std::lock_guard<std::mutex> lock_;
+  std::shared_ptr<const OptionsCacheSlots<Backend>> slots_;
+  std::shared_ptr<OptionsCacheSlots<Backend>> added_;
+  std::unordered_map<
+      OptionsCacheSlot<Backend>*,
+      std::shared_ptr<OptionsCacheEntries<Backend>>>
+      pending_;
+};
+} // namespace detail
+
+OptionsCacheKey::OptionsCacheKey(
+    lang::CanonicalTcString id,
+    std::vector<TensorInfo> inputs,
+    std::vector<TensorInfo> outputs,
+    std::string backendStr)
+    : id(std::move(id)),
+      inputs(std::move(inputs)),
+      outputs(std::move(outputs)),
+      backendStr(std::move(backendStr)),
+      fingerprint(detail::fingerprint(
+          this->id,
+          this->inputs,
+          this->outputs,
+          this->backendStr)) {}
 
 bool OptionsCacheKey::operator==(const OptionsCacheKey& other) const {
-  return id == other.id && backendStr == other.backendStr &&
-      inputs == other.inputs && outputs == other.outputs;
+  return fingerprint == other.fingerprint && id == other.id &&
+      backendStr == other.backendStr && inputs == other.inputs &&
+      outputs == other.outputs;
 }
 
 bool OptionsCacheKey::operator!=(const OptionsCacheKey& other) const {
@@ -65,33 +353,23 @@ OptionsCacheKeyProto OptionsCacheKey::toProtobuf() const {
 
 OptionsCacheKey OptionsCacheKey::fromProtobuf(
     const OptionsCacheKeyProto& proto) {
-  OptionsCacheKey res;
-  res.id = lang::CanonicalTcString(proto.id());
+  std::vector<TensorInfo> inputs;
   for (int i = 0; i < proto.inputs().size(); ++i) {
-    res.inputs.push_back(TensorInfo(proto.inputs().Get(i)));
+    inputs.push_back(TensorInfo(proto.inputs().Get(i)));
   }
+  std::vector<TensorInfo> outputs;
   for (int i = 0; i < proto.outputs().size(); ++i) {
-    res.outputs.push_back(TensorInfo(proto.outputs().Get(i)));
+    outputs.push_back(TensorInfo(proto.outputs().Get(i)));
   }
-  res.backendStr = proto.backend_str();
-  return res;
+  return OptionsCacheKey(
+      lang::CanonicalTcString(proto.id()),
+      std::move(inputs),
+      std::move(outputs),
+      proto.backend_str());
 }
 
 std::size_t OptionsCacheKeyHash::operator()(const OptionsCacheKey& k) const {
-  using std::hash;
-  // Just hash some string representation for now. When we measure
-  // collisions are a problem; then deal with it. Before that it's
-  // premature optimization.
-  std::stringstream ss;
-  ss << k.id;
-  for (size_t i = 0; i < k.inputs.size(); ++i) {
-    ss << k.inputs[i].toProtobuf().SerializeAsString();
-  }
-  for (size_t i = 0; i < k.outputs.size(); ++i) {
-    ss << k.outputs[i].toProtobuf().SerializeAsString();
-  }
-  ss << k.backendStr;
-  return std::hash<std::string>()(ss.str());
+  return k.fingerprint;
 }
 
 template <typename Backend>
@@ -102,6 +380,9 @@ OptionsCacheValue<Backend>::toProtobuf() const {
   for (auto d : runtimes) {
     buf_value.add_recorded_runtimes(d.toMicroSeconds());
   }
+  for (auto d : runtimeStdDevs) {
+    buf_value.add_recorded_runtime_stddevs(d.toMicroSeconds());
+  }
   return buf_value;
 }
 
@@ -112,21 +393,92 @@ OptionsCacheValue<Backend> OptionsCacheValue<Backend>::fromProtobuf(
   for (auto d : proto.recorded_runtimes()) {
     runtimes.push_back(Duration::fromMicroSeconds(d));
   }
+  // Caches stored before standard deviations were recorded have none.
+  std::vector<Duration> stdDevs;
+  for (auto d : proto.recorded_runtime_stddevs()) {
+    stdDevs.push_back(Duration::fromMicroSeconds(d));
+  }
+  stdDevs.resize(runtimes.size(), Duration::zero());
   return OptionsCacheValue<Backend>{
-      runtimes, typename Backend::MappingOptionsType(proto.kernel_options())};
+      runtimes,
+      typename Backend::MappingOptionsType(proto.kernel_options()),
+      stdDevs,
+      0};
 }
 
 template <typename Backend>
 OptionsCache<Backend>::OptionsCache(const OptionsCache<Backend>& other) {
-  std::lock_guard<std::mutex> lg(mutex);
-  std::lock_guard<std::mutex> lg2(other.mutex);
-  store_ = other.store_;
+  // The entries are immutable and shared, the slots are not.
+  for (size_t i = 0; i < kNumShards; ++i) {
+    auto slots = std::atomic_load(&other.shards_[i].slots);
+    if (!slots) {
+      continue;
+    }
+    auto copy = std::make_shared<detail::OptionsCacheSlots<Backend>>();
+    for (const auto& kvp : *slots) {
+      for (const auto& slot : kvp.second) {
+        auto slotCopy =
+            std::make_shared<detail::OptionsCacheSlot<Backend>>(slot->key);
+        slotCopy->entries = std::atomic_load(&slot->entries);
+        (*copy)[kvp.first].push_back(slotCopy);
+      }
+    }
+    shards_[i].slots = copy;
+  }
+}
+
+template <typename Backend>
+size_t OptionsCache<Backend>::shardIndex(const OptionsCacheKey& key) {
+  // The low bits of the fingerprint select the buckets within the shards.
+  return (key.fingerprint >> 32) % kNumShards;
+}
+
+template <typename Backend>
+std::shared_ptr<const detail::OptionsCacheEntries<Backend>>
+OptionsCache<Backend>::find(const OptionsCacheKey& key) const {
+  auto slots = std::atomic_load(&shards_[shardIndex(key)].slots);
+  if (!slots) {
+    return nullptr;
+  }
+  auto it = slots->find(key.fingerprint);
+  if (it == slots->end()) {
+    return nullptr;
+  }
+  for (const auto& slot : it->second) {
+    if (slot->key == key) {
+      return std::atomic_load(&slot->entries);
+    }
+  }
+  return nullptr;
+}
+
+template <typename Backend>
+template <typename F>
+void OptionsCache<Backend>::forEachKey(F f) const {
+  for (const auto& shard : shards_) {
+    auto slots = std::atomic_load(&shard.slots);
+    if (!slots) {
+      continue;
+    }
+    for (const auto& kvp : *slots) {
+      for (const auto& slot : kvp.second) {
+        auto entries = std::atomic_load(&slot->entries);
+        if (entries and !entries->values.empty()) {
+          f(slot->key, *entries);
+        }
+      }
+    }
+  }
 }
 
 template <typename Backend>
 void OptionsCache<Backend>::clear() {
-  std::lock_guard<std::mutex> clear(mutex);
-  store_.clear();
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::atomic_store(
+        &shard.slots,
+        std::shared_ptr<const detail::OptionsCacheSlots<Backend>>());
+  }
   numberCacheAttempts = 0;
   numberAttemptedRetrievals = 0;
   numberSuccessfulRetrievals = 0;
@@ -134,43 +486,118 @@ void OptionsCache<Backend>::clear() {
 
 template <typename Backend>
 size_t OptionsCache<Backend>::count(const OptionsCacheKey& key) const {
-  std::lock_guard<std::mutex> lock(mutex);
-  return store_.count(key);
+  auto entries = find(key);
+  return entries ? entries->values.size() : 0;
 }
 
 template <typename Backend>
 size_t OptionsCache<Backend>::size() const {
-  std::lock_guard<std::mutex> lock(mutex);
-  return store_.size();
+  size_t size = 0;
+  forEachKey([&size](const OptionsCacheKey&, const EntriesType& entries) {
+    size += entries.values.size();
+  });
+  return size;
 }
 
 template <typename Backend>
-void OptionsCache<Backend>::loadCacheFromFile(const std::string& filename) {
-  typename Backend::OptionsCacheProtoType buf;
-  struct stat buffer = {0};
-  if (stat(filename.c_str(), &buffer) == 0) {
-    std::ifstream serialized(filename, std::ios::binary);
-    buf.ParseFromIstream(&serialized);
+void OptionsCache<Backend>::loadImage(
+    llvm::StringRef image,
+    bool merge,
+    const OptionsCacheKey* only) {
+  std::vector<Entry> entries;
+  auto load = [&](llvm::StringRef blob) {
+    typename Backend::OptionsCacheProtoType buf;
+    if (buf.ParseFromArray(blob.data(), blob.size())) {
+      detail::appendProtobufEntries<Backend>(buf, only, entries);
+    }
+  };
+  // Cache files stored before indexed images were introduced are a single
+  // protobuf.
+  if (!detail::isIndexedImage(image)) {
+    load(image);
+  } else if (only) {
+    for (auto blob : detail::findIndexedImageBlobs(image, only->fingerprint)) {
+      load(blob);
+    }
+  } else {
+    for (auto blob : detail::indexedImageBlobs(image)) {
+      load(blob);
+    }
+  }
+  for (auto& entry : entries) {
+    entry.second.numStoredRuntimes = entry.second.runtimes.size();
   }
-  fromProtobuf(buf);
+  insertEntries(std::move(entries), merge);
 }
 
 template <typename Backend>
-void OptionsCache<Backend>::storeCacheToFile(
-    const std::string& filename) const {
-  // toProtobuf() takes the lock too, get a copy of the result first
-  auto proto = toProtobuf();
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    std::fstream serialized(
-        filename, std::ios::binary | std::ios::trunc | std::ios::out);
-    TC_CHECK(serialized.is_open(), std::invalid_argument)
-        << "Failed to open the output stream for dumping protobuf: "
-        << filename;
-    proto.SerializePartialToOstream(&serialized);
+void OptionsCache<Backend>::loadCacheFiles(
+    const std::string& filename,
+    const OptionsCacheKey* only,
+    std::vector<uint64_t>* recordIds) {
+  detail::MappedFile snapshot(filename);
+  loadImage(snapshot.content(), false, only);
+  std::unordered_set<uint64_t> merged;
+  if (detail::isIndexedImage(snapshot.content())) {
+    auto ids = detail::indexedImageMergedRecords(snapshot.content());
+    merged.insert(ids.begin(), ids.end());
+  }
+  detail::MappedFile journal(detail::journalFilename(filename));
+  auto records = detail::readJournalRecords(
+      journal, only ? &only->fingerprint : nullptr);
+  for (const auto& record : records) {
+    if (recordIds) {
+      recordIds->push_back(record.id);
+    }
+    // Left by a compaction interrupted before it removed the journal.
+    if (merged.count(record.id) == 0) {
+      loadImage(record.data, true, only);
+    }
   }
 }
 
+template <typename Backend>
+void OptionsCache<Backend>::loadCacheFromFile(const std::string& filename) {
+  detail::CacheFileLock lock(filename, detail::CacheFileLock::Mode::Shared);
+  loadCacheFiles(filename);
+}
+
+template <typename Backend>
+void OptionsCache<Backend>::loadKeyFromCacheFile(
+    const std::string& filename,
+    const OptionsCacheKey& key) {
+  detail::CacheFileLock lock(filename, detail::CacheFileLock::Mode::Shared);
+  loadCacheFiles(filename, &key);
+}
+
+template <typename Backend>
+void OptionsCache<Backend>::compactCacheFiles(const std::string& filename) {
+  OptionsCache<Backend> merged;
+  std::vector<uint64_t> recordIds;
+  merged.loadCacheFiles(filename, nullptr, &recordIds);
+  detail::writeFileAtomically(filename, merged.toIndexedImage(recordIds));
+  // Should this fail or not happen, the snapshot skips the records merged.
+  detail::removeFile(detail::journalFilename(filename));
+}
+
+template <typename Backend>
+void OptionsCache<Backend>::storeCacheToFile(const std::string& filename) {
+  detail::CacheFileLock lock(filename, detail::CacheFileLock::Mode::Exclusive);
+  // The entries of the journal were not stored, they are gone, also if it
+  // is not removed.
+  auto journal = detail::journalFilename(filename);
+  std::vector<uint64_t> recordIds;
+  for (const auto& record :
+       detail::readJournalRecords(detail::MappedFile(journal))) {
+    recordIds.push_back(record.id);
+  }
+  std::vector<StoredValue> stored;
+  unstoredEntries(&stored);
+  detail::writeFileAtomically(filename, toIndexedImage(recordIds));
+  detail::removeFile(journal);
+  markStored(stored);
+}
+
 template <typename Backend>
 void OptionsCache<Backend>::recordRuntime(
     const lang::CanonicalTcString& tc,
@@ -178,61 +605,47 @@ void OptionsCache<Backend>::recordRuntime(
     const std::vector<TensorInfo>& outputs,
     const std::string& backendStr,
     const typename Backend::MappingOptionsType& options,
-    Duration duration) {
-  std::lock_guard<std::mutex> lock(mutex);
+    Duration duration,
+    Duration stdDev) {
   ++numberCacheAttempts;
   OptionsCacheKey key{tc, inputs, outputs, backendStr};
-  auto range = store_.equal_range(key);
-  for (auto it = range.first; it != range.second; ++it) {
-    if (it->second.mappingOptions == options) {
-      // key exists, append to it and return
-      it->second.runtimes.push_back(duration);
-      return;
-    }
+  OptionsCacheValue<Backend> value{std::vector<Duration>{duration},
+                                   options,
+                                   std::vector<Duration>{stdDev},
+                                   0};
+  detail::OptionsCacheShardWriter<Backend> writer(shards_[shardIndex(key)]);
+  auto& entries = writer.entries(key);
+  auto i = detail::findOptions(entries, options);
+  if (i == entries.values.size()) {
+    detail::insertValue(entries, std::move(value));
+  } else {
+    detail::appendRuntimes(entries, i, value);
   }
-  // key does not exist, emplace a new key, value
-  store_.emplace(
-      key,
-      OptionsCacheValue<Backend>{std::vector<Duration>{duration}, options});
 }
 
-namespace detail {
-template <typename Backend>
-struct OptionsWithMedianAndRuntimes {
-  Duration median;
-  std::vector<Duration> runtimes;
-  typename Backend::MappingOptionsType mappingOptions;
-};
-
 template <typename Backend>
-std::vector<OptionsWithMedianAndRuntimes<Backend>> sortedOptions(
-    const OptionsCacheKey& key,
-    const std::unordered_multimap<
-        OptionsCacheKey,
-        OptionsCacheValue<Backend>,
-        OptionsCacheKeyHash>& store) {
-  using Options = OptionsWithMedianAndRuntimes<Backend>;
-  std::vector<Options> toSort;
-  if (store.count(key) == 0) {
+std::vector<Duration> OptionsCache<Backend>::getRuntimes(
+    const lang::CanonicalTcString& tc,
+    const std::vector<TensorInfo>& inputs,
+    const std::vector<TensorInfo>& outputs,
+    const std::string& backendStr,
+    const typename Backend::MappingOptionsType& options,
+    std::vector<Duration>* stdDevs) const {
+  ++numberAttemptedRetrievals;
+  auto entries = find(OptionsCacheKey{tc, inputs, outputs, backendStr});
+  if (!entries) {
     return {};
   }
-  auto range = store.equal_range(key);
-  for (auto it = range.first; it != range.second; ++it) {
-    if (it->second.runtimes.size() == 0) {
-      throw std::runtime_error("No runtime for cache option");
-    }
-    toSort.push_back(Options{median(it->second.runtimes),
-                             it->second.runtimes,
-                             it->second.mappingOptions});
+  auto i = detail::findOptions(*entries, options);
+  if (i == entries->values.size()) {
+    return {};
   }
-  std::sort(
-      toSort.begin(), toSort.end(), [](const Options& a, const Options& b) {
-        // fun with C++, a.median < b.median does not mix with templates
-        return operator<(a.median, b.median);
-      });
-  return toSort;
+  ++numberSuccessfulRetrievals;
+  if (stdDevs) {
+    *stdDevs = entries->values[i]->runtimeStdDevs;
+  }
+  return entries->values[i]->runtimes;
 }
-} // namespace detail
 
 template <typename Backend>
 std::vector<typename Backend::MappingOptionsType>
@@ -242,48 +655,115 @@ OptionsCache<Backend>::getTopKOptions(
     const std::vector<TensorInfo>& outputs,
     const std::string& backendStr,
     size_t K) const {
-  std::lock_guard<std::mutex> lock(mutex);
   ++numberAttemptedRetrievals;
-  OptionsCacheKey key{tc, inputs, outputs, backendStr};
-  auto sorted = detail::sortedOptions<Backend>(key, store_);
-  if (sorted.size() == 0u) {
+  auto entries = find(OptionsCacheKey{tc, inputs, outputs, backendStr});
+  if (!entries or entries->values.empty()) {
     return {};
   }
+  // The entries are sorted by median runtime.
   std::vector<typename Backend::MappingOptionsType> res;
-  res.reserve(K);
-  for (size_t i = 0; i < std::min(K, sorted.size()); ++i) {
-    res.push_back(sorted[i].mappingOptions);
+  res.reserve(std::min(K, entries->values.size()));
+  for (size_t i = 0; i < std::min(K, entries->values.size()); ++i) {
+    res.push_back(entries->values[i]->mappingOptions);
   }
   ++numberSuccessfulRetrievals;
   return res;
 }
 
+template <typename Backend>
+std::vector<typename Backend::MappingOptionsType>
+OptionsCache<Backend>::getTopKOptionsForNearestShapes(
+    const lang::CanonicalTcString& tc,
+    const std::vector<TensorInfo>& inputs,
+    const std::vector<TensorInfo>& outputs,
+    const std::string& backendStr,
+    size_t K,
+    bool rescaleTiles) const {
+  ++numberAttemptedRetrievals;
+  struct Candidate {
+    double distance;
+    Duration median;
+    typename Backend::MappingOptionsType options;
+  };
+  std::vector<Candidate> candidates;
+  std::vector<TensorInfo> tensors(inputs);
+  tensors.insert(tensors.end(), outputs.begin(), outputs.end());
+  forEachKey([&](const OptionsCacheKey& key, const EntriesType& entries) {
+    if (key.id != tc or key.backendStr != backendStr) {
+      return;
+    }
+    auto inputDistance = detail::shapeDistance(key.inputs, inputs);
+    auto outputDistance = detail::shapeDistance(key.outputs, outputs);
+    if (!inputDistance or !outputDistance) {
+      return;
+    }
+    std::vector<TensorInfo> keyTensors(key.inputs);
+    keyTensors.insert(keyTensors.end(), key.outputs.begin(), key.outputs.end());
+    // Only the top-K of each key can make it to the top-K of all keys.
+    for (size_t i = 0; i < std::min(K, entries.values.size()); ++i) {
+      auto options = entries.values[i]->mappingOptions;
+      if (rescaleTiles) {
+        options.generic.tile(detail::rescaleTileSizes(
+            options.generic.tiling.extractVector(), keyTensors, tensors));
+      }
+      candidates.push_back(Candidate{*inputDistance + *outputDistance,
+                                     entries.medians[i],
+                                     std::move(options)});
+    }
+  });
+  // The options of equally near shapes are ranked by their runtimes.
+  std::stable_sort(
+      candidates.begin(),
+      candidates.end(),
+      [](const Candidate& a, const Candidate& b) {
+        return a.distance < b.distance or
+            (a.distance == b.distance and operator<(a.median, b.median));
+      });
+
+  std::vector<typename Backend::MappingOptionsType> res;
+  for (const auto& candidate : candidates) {
+    if (res.size() == K) {
+      break;
+    }
+    // Rescaling may turn different options into the same ones.
+    if (std::find(res.begin(), res.end(), candidate.options) == res.end()) {
+      res.push_back(candidate.options);
+    }
+  }
+  if (!res.empty()) {
+    ++numberSuccessfulRetrievals;
+  }
+  return res;
+}
+
 template <typename Backend>
 std::unordered_set<OptionsCacheKey, OptionsCacheKeyHash>
 OptionsCache<Backend>::getKeys() const {
-  std::lock_guard<std::mutex> lock(mutex);
   std::unordered_set<OptionsCacheKey, OptionsCacheKeyHash> keys;
-  for (auto kvp : store_) {
-    keys.emplace(kvp.first);
-  }
+  forEachKey([&keys](const OptionsCacheKey& key, const EntriesType&) {
+    keys.emplace(key);
+  });
   return keys;
 }
 
 template <typename Backend>
 void OptionsCache<Backend>::pruneKeepTopK(size_t K) {
-  auto keys = getKeys();
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    for (auto& k : keys) {
-      // this is of course wasteful but real topk is premature optimization atm
-      auto sorted = detail::sortedOptions<Backend>(k, store_);
-      // erase all then reinsert makes it easier to reuse code
-      store_.erase(k);
-      for (size_t i = 0; i < std::min(sorted.size(), K); ++i) {
-        auto option = sorted[i];
-        store_.emplace(
-            k,
-            OptionsCacheValue<Backend>{option.runtimes, option.mappingOptions});
+  for (auto& shard : shards_) {
+    detail::OptionsCacheShardWriter<Backend> writer(shard);
+    if (!writer.slots()) {
+      continue;
+    }
+    for (const auto& kvp : *writer.slots()) {
+      for (const auto& slot : kvp.second) {
+        auto current = std::atomic_load(&slot->entries);
+        if (!current or current->values.size() <= K) {
+          continue;
+        }
+        // The entries are sorted by median runtime, the best K come first.
+        auto& entries = writer.entries(slot->key);
+        entries.values.erase(entries.values.begin() + K, entries.values.end());
+        entries.medians.erase(
+            entries.medians.begin() + K, entries.medians.end());
       }
     }
   }
@@ -292,27 +772,128 @@ void OptionsCache<Backend>::pruneKeepTopK(size_t K) {
 template <typename Backend>
 typename Backend::OptionsCacheProtoType OptionsCache<Backend>::toProtobuf()
     const {
-  std::lock_guard<std::mutex> lock(mutex);
   typename Backend::OptionsCacheProtoType buf;
-  for (const auto& kvp : store_) {
-    auto pkey = buf.add_keys();
-    *pkey = kvp.first.toProtobuf();
-    auto pvalues = buf.add_values();
-    *pvalues = kvp.second.toProtobuf();
-  }
+  forEachKey([&buf](const OptionsCacheKey& key, const EntriesType& entries) {
+    *buf.add_keys() = key.toProtobuf();
+    for (const auto& value : entries.values) {
+      buf.add_key_indices(buf.keys().size() - 1);
+      *buf.add_values() = value->toProtobuf();
+    }
+  });
   return buf;
 }
 
+template <typename Backend>
+std::string OptionsCache<Backend>::toIndexedImage(
+    const std::vector<uint64_t>& mergedRecords) const {
+  std::vector<std::pair<uint64_t, std::string>> blobs;
+  forEachKey([&blobs](const OptionsCacheKey& key, const EntriesType& entries) {
+    typename Backend::OptionsCacheProtoType buf;
+    *buf.add_keys() = key.toProtobuf();
+    for (const auto& value : entries.values) {
+      buf.add_key_indices(0);
+      *buf.add_values() = value->toProtobuf();
+    }
+    blobs.emplace_back(key.fingerprint, buf.SerializePartialAsString());
+  });
+  return detail::makeIndexedImage(blobs, mergedRecords);
+}
+
 template <typename Backend>
 void OptionsCache<Backend>::fromProtobuf(
-    const typename Backend::OptionsCacheProtoType& proto) {
-  std::lock_guard<std::mutex> lock(mutex);
-  TC_CHECK_EQ(proto.keys().size(), proto.values().size());
-  for (int i = 0; i < proto.keys().size(); ++i) {
-    OptionsCacheKey key(OptionsCacheKey::fromProtobuf(proto.keys().Get(i)));
-    OptionsCacheValue<Backend> value(
-        OptionsCacheValue<Backend>::fromProtobuf(proto.values().Get(i)));
-    store_.emplace(key, value);
+    const typename Backend::OptionsCacheProtoType& proto,
+    const OptionsCacheKey* only) {
+  std::vector<Entry> entries;
+  detail::appendProtobufEntries<Backend>(proto, only, entries);
+  insertEntries(std::move(entries), false);
+}
+
+template <typename Backend>
+void OptionsCache<Backend>::mergeProtobuf(
+    const typename Backend::OptionsCacheProtoType& proto,
+    const OptionsCacheKey* only) {
+  std::vector<Entry> entries;
+  detail::appendProtobufEntries<Backend>(proto, only, entries);
+  insertEntries(std::move(entries), true);
+}
+
+template <typename Backend>
+void OptionsCache<Backend>::insertEntries(
+    std::vector<Entry> entries,
+    bool merge) {
+  std::array<std::vector<size_t>, kNumShards> shardEntries;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    shardEntries[shardIndex(entries[i].first)].push_back(i);
+  }
+  for (size_t s = 0; s < kNumShards; ++s) {
+    if (shardEntries[s].empty()) {
+      continue;
+    }
+    detail::OptionsCacheShardWriter<Backend> writer(shards_[s]);
+    for (auto i : shardEntries[s]) {
+      auto& current = writer.entries(entries[i].first);
+      auto& value = entries[i].second;
+      auto j = merge ? detail::findOptions(current, value.mappingOptions)
+                     : current.values.size();
+      if (j == current.values.size()) {
+        detail::insertValue(current, std::move(value));
+      } else {
+        detail::appendRuntimes(current, j, value);
+      }
+    }
+  }
+}
+
+template <typename Backend>
+std::vector<typename OptionsCache<Backend>::Entry>
+OptionsCache<Backend>::unstoredEntries(
+    std::vector<StoredValue>* sources) const {
+  std::vector<Entry> entries;
+  forEachKey([&](const OptionsCacheKey& key, const EntriesType& current) {
+    for (const auto& value : current.values) {
+      auto stored = value->numStoredRuntimes;
+      if (stored == value->runtimes.size()) {
+        continue;
+      }
+      entries.emplace_back(
+          key,
+          OptionsCacheValue<Backend>{
+              std::vector<Duration>(
+                  value->runtimes.begin() + stored, value->runtimes.end()),
+              value->mappingOptions,
+              std::vector<Duration>(
+                  value->runtimeStdDevs.begin() + stored,
+                  value->runtimeStdDevs.end()),
+              0});
+      if (sources) {
+        sources->emplace_back(key, value);
+      }
+    }
+  });
+  return entries;
+}
+
+template <typename Backend>
+void OptionsCache<Backend>::markStored(const std::vector<StoredValue>& values) {
+  for (const auto& kvp : values) {
+    const auto& source = *kvp.second;
+    detail::OptionsCacheShardWriter<Backend> writer(
+        shards_[shardIndex(kvp.first)]);
+    auto& entries = writer.entries(kvp.first);
+    // Runtimes are only ever appended, a value updated since it was read
+    // has the same options and stored runtimes, and more runtimes.
+    for (auto& value : entries.values) {
+      if (value == kvp.second or
+          (value->mappingOptions == source.mappingOptions and
+           value->numStoredRuntimes == source.numStoredRuntimes and
+           value->runtimes.size() >= source.runtimes.size())) {
+        auto updated = *value;
+        updated.numStoredRuntimes = source.runtimes.size();
+        value = std::make_shared<const OptionsCacheValue<Backend>>(
+            std::move(updated));
+        break;
+      }
+    }
   }
 }
 
@@ -322,30 +903,61 @@ std::vector<typename Backend::MappingOptionsType> loadTopKFromCacheFile(
     const std::string& entryPoint,
     const std::string& cacheFilename,
     const std::vector<const DLConstTensor*>& inputs,
-    size_t count) {
+    size_t count,
+    bool nearestShapes) {
+  OptionsCacheKey key{lang::canonicalTc(tc::detail::parse(tc).at(entryPoint)),
+                      tc::makeTensorInfoVector(inputs),
+                      tc::inferOutputTensorInfo(tc, entryPoint, inputs),
+                      Backend::backendString()};
   OptionsCache<Backend> optionsCache;
-  optionsCache.loadCacheFromFile(cacheFilename);
-  auto outputs = tc::inferOutputTensorInfo(tc, entryPoint, inputs);
-  return optionsCache.getTopKOptions(
-      lang::canonicalTc(tc::detail::parse(tc).at(entryPoint)),
-      tc::makeTensorInfoVector(inputs),
-      outputs,
-      Backend::backendString(),
-      count);
+  optionsCache.loadKeyFromCacheFile(cacheFilename, key);
+  auto topK = optionsCache.getTopKOptions(
+      key.id, key.inputs, key.outputs, key.backendStr, count);
+  if (!topK.empty() or !nearestShapes) {
+    return topK;
+  }
+  // The keys of the other shapes have unrelated fingerprints, they are not
+  // indexed by TC.
+  OptionsCache<Backend> all;
+  all.loadCacheFromFile(cacheFilename);
+  return all.getTopKOptionsForNearestShapes(
+      key.id, key.inputs, key.outputs, key.backendStr, count, true);
 }
 
 template <typename Backend>
 void appendTopKToCacheFile(
-    const OptionsCache<Backend>& cache,
+    OptionsCache<Backend>& cache,
     const std::string& cacheFilename,
     uint32_t count) {
   OptionsCache<Backend> copy(cache);
   copy.pruneKeepTopK(count);
-  auto proto = copy.toProtobuf();
-  OptionsCache<Backend> optionsCache;
-  optionsCache.loadCacheFromFile(cacheFilename);
-  optionsCache.fromProtobuf(proto);
-  optionsCache.storeCacheToFile(cacheFilename);
+  std::vector<typename OptionsCache<Backend>::StoredValue> appended;
+  OptionsCache<Backend> unstored;
+  unstored.insertEntries(copy.unstoredEntries(&appended), false);
+  if (appended.empty()) {
+    return;
+  }
+  auto record = unstored.toIndexedImage();
+
+  detail::CacheFileLock lock(
+      cacheFilename, detail::CacheFileLock::Mode::Exclusive);
+  auto journal = detail::journalFilename(cacheFilename);
+  detail::appendJournalRecord(journal, record);
+  // Compacting once the journal outgrows the file keeps both the size of the
+  // journal and the cost of compactions proportional to the file.
+  size_t minCompactionBytes = detail::kMinJournalCompactionBytes;
+  if (detail::fileSize(journal) >
+      std::max(detail::fileSize(cacheFilename), minCompactionBytes)) {
+    OptionsCache<Backend>::compactCacheFiles(cacheFilename);
+  }
+  cache.markStored(appended);
+}
+
+template <typename Backend>
+void compactCacheFile(const std::string& cacheFilename) {
+  detail::CacheFileLock lock(
+      cacheFilename, detail::CacheFileLock::Mode::Exclusive);
+  OptionsCache<Backend>::compactCacheFiles(cacheFilename);
 }
 
 } // namespace autotune
@@ -15,15 +15,20 @@
  */
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringRef.h>
 
 #include <version.h>
 
@@ -39,12 +44,23 @@ namespace autotune {
  * tc/proto/compcache.proto. It provides simple conversions and the equality
  * operator. Additionally we provide a hash function to allow it to be a key
  * in a hash map.
+ * Keys are hashed on every access to the cache, their hash, the fingerprint,
+ * is computed once when they are constructed and their content cannot change
+ * afterwards. The fingerprint does not depend on the process computing it,
+ * it also indexes the keys in the cache files.
  */
 struct OptionsCacheKey {
-  lang::CanonicalTcString id;
-  std::vector<TensorInfo> inputs;
-  std::vector<TensorInfo> outputs;
-  std::string backendStr;
+  inline OptionsCacheKey(
+      lang::CanonicalTcString id,
+      std::vector<TensorInfo> inputs,
+      std::vector<TensorInfo> outputs,
+      std::string backendStr);
+
+  const lang::CanonicalTcString id;
+  const std::vector<TensorInfo> inputs;
+  const std::vector<TensorInfo> outputs;
+  const std::string backendStr;
+  const uint64_t fingerprint;
 
   inline bool operator==(const OptionsCacheKey& other) const;
   inline bool operator!=(const OptionsCacheKey& other) const;
@@ -70,15 +86,78 @@ struct OptionsCacheValue {
 
   std::vector<Duration> runtimes;
   typename Backend::MappingOptionsType mappingOptions;
+  /// Standard deviation of the runs summarized by each of runtimes, zero if
+  /// unknown. Always as many as runtimes once in the cache.
+  std::vector<Duration> runtimeStdDevs;
+  /// The number of the first runtimes that are already in the cache file
+  /// the value was loaded from or appended to, appendTopKToCacheFile only
+  /// appends the others.
+  size_t numStoredRuntimes;
+};
+
+namespace detail {
+/// The values of a key in an OptionsCache, sorted by increasing median
+/// runtime so that its top-K are the first K. Published entries and values
+/// are never modified, updates publish new ones sharing the values that did
+/// not change.
+template <typename Backend>
+struct OptionsCacheEntries {
+  std::vector<std::shared_ptr<const OptionsCacheValue<Backend>>> values;
+  /// The median runtimes of values, Duration::max() for values without
+  /// runtimes.
+  std::vector<Duration> medians;
+};
+
+/// A key of an OptionsCache and its current entries, which are read and
+/// replaced with std::atomic_load and std::atomic_store.
+template <typename Backend>
+struct OptionsCacheSlot {
+  explicit OptionsCacheSlot(const OptionsCacheKey& key) : key(key) {}
+
+  const OptionsCacheKey key;
+  std::shared_ptr<const OptionsCacheEntries<Backend>> entries;
 };
 
+/// The slots of a shard of an OptionsCache by key fingerprint. Published
+/// maps are never modified, adding a key publishes a new map sharing the
+/// slots.
+template <typename Backend>
+using OptionsCacheSlots = std::unordered_map<
+    uint64_t,
+    std::vector<std::shared_ptr<OptionsCacheSlot<Backend>>>>;
+
+template <typename Backend>
+struct OptionsCacheShard {
+  /// Serializes the updates of the shard, lookups do not take it.
+  std::mutex mutex;
+  /// Read and replaced with std::atomic_load and std::atomic_store, null
+  /// when empty.
+  std::shared_ptr<const OptionsCacheSlots<Backend>> slots;
+};
+} // namespace detail
+
 /**
- * An Options cache is a simple abstraction around an unordered_multimap of
- * protobuf-backed key value pairs. It has an underlying store object and
+ * An Options cache is a multimap of protobuf-backed key value pairs. It
  * provides simple functions to load/store from proto, record, prune and
  * extract topK values ordered by runtime.
- * All store and retrieve operations are protected by taking a lock on an
- * internal mutex and thus are threadsafe.
+ * The cache is read far more often than it is updated (serving threads look
+ * up options while background tuners record runtimes), it is split in
+ * shards by key, each with its own lock for the updates, and lookups do not
+ * take any lock: they read immutable snapshots of the shard and of the
+ * entries of the key, which updates replace (read-copy-update, the
+ * snapshots are reclaimed by reference counting). The entries of each key
+ * are kept sorted by median runtime as runtimes are recorded, the top-K
+ * are not sorted on every query.
+ * All operations are thus threadsafe; updates to a key are atomic, those
+ * to several keys (loads, pruneKeepTopK) are not atomic as a whole.
+ * The cache files are shared safely between processes, see
+ * tc/autotuner/cache_file.h: a cache file is a snapshot, replaced
+ * atomically, and a journal of the entries appended since the last
+ * compaction, under an flock. Both store the entries of each key in a
+ * separate protobuf behind a hash index, loadKeyFromCacheFile only reads
+ * those of the key it loads. The journal records only hold the runtimes
+ * that were not in the file yet, merging them is exact however many tuners
+ * extend the same entries.
  * An OptionsCache is templated by the backend type because the values stored
  * are backend-dependent.
  */
@@ -87,10 +166,10 @@ struct OptionsCache {
  public:
   using KeyType = OptionsCacheKey;
   using ValueType = OptionsCacheValue<Backend>;
-  using MultiMapType = std::unordered_multimap<
-      OptionsCacheKey,
-      OptionsCacheValue<Backend>,
-      OptionsCacheKeyHash>;
+  using EntriesType = detail::OptionsCacheEntries<Backend>;
+
+  /// Number of shards, updates to keys in different shards do not contend.
+  static constexpr size_t kNumShards = 64;
 
   OptionsCache<Backend>() = default;
   OptionsCache<Backend>(const OptionsCache<Backend>& other);
@@ -108,25 +187,50 @@ struct OptionsCache {
   /// \return an unordered_set of keys
   std::unordered_set<OptionsCacheKey, OptionsCacheKeyHash> getKeys() const;
 
-  /// Loads in place from proto file. Calls fromProto which can insert
-  /// duplicates, so be sure your cache is cleared if you don't want those
+  /// Loads in place from proto file, and the entries appended to its
+  /// journal. Calls fromProto which can insert duplicates, so be sure your
+  /// cache is cleared if you don't want those
   void loadCacheFromFile(const std::string& filename);
 
-  /// Stores to a proto file at the specified location
-  void storeCacheToFile(const std::string& filename) const;
+  /// Same as loadCacheFromFile, for the entries of key only. Only the pages
+  /// of the file holding them are read, the cost does not depend on the
+  /// size of the file (except for the parts of the file stored before the
+  /// cache files were indexed).
+  void loadKeyFromCacheFile(
+      const std::string& filename,
+      const OptionsCacheKey& key);
+
+  /// Stores to a proto file at the specified location, atomically replacing
+  /// its previous content, including its journal. All the runtimes are then
+  /// stored, see appendTopKToCacheFile.
+  void storeCacheToFile(const std::string& filename);
 
   /// Saves a new runtime.
   /// If the key does not exist, a new entry is inserted.
   /// If the key exists, a search is performed on options.
   /// If the corresponding options are found, the duration is appended to the
   /// runtimes, otherwise a new entry is inserted in the multimap.
+  /// When the duration summarizes several runs, their standard deviation
+  /// stdDev is recorded alongside.
   void recordRuntime(
       const lang::CanonicalTcString& tc,
       const std::vector<TensorInfo>& inputs,
       const std::vector<TensorInfo>& outputs,
       const std::string& backendStr,
       const typename Backend::MappingOptionsType& options,
-      Duration duration);
+      Duration duration,
+      Duration stdDev = Duration::zero());
+
+  /// \return the runtimes recorded for options with a particular
+  /// TC/inputs/outputs/device, empty if options were never recorded.
+  /// If stdDevs is not null, it is filled with their standard deviations.
+  std::vector<Duration> getRuntimes(
+      const lang::CanonicalTcString& tc,
+      const std::vector<TensorInfo>& inputs,
+      const std::vector<TensorInfo>& outputs,
+      const std::string& backendStr,
+      const typename Backend::MappingOptionsType& options,
+      std::vector<Duration>* stdDevs = nullptr) const;
 
   /// Returns the top-K mapping options with the best median runtime for a
   /// particular TC/inputs/outputs/device. Note that the result may be empty
@@ -140,6 +244,25 @@ struct OptionsCache {
       const std::string& backendStr,
       size_t K) const;
 
+  /// Same as getTopKOptions, for shapes that may not have been tuned: returns
+  /// the top-K mapping options of the keys of the same TC and device with
+  /// the nearest shapes (see detail::shapeDistance), nearest first. The
+  /// options of an exact match come first, those of equally near shapes are
+  /// ranked by median runtime. Keys with different numbers of tensors, ranks
+  /// or element types are never considered near.
+  /// If rescaleTiles is set, the tile sizes of the options are adapted to
+  /// inputs/outputs (see detail::rescaleTileSizes).
+  /// All the keys in the cache are scanned.
+  /// \returns a vector of mapping options, empty if no key is comparable
+  std::vector<typename Backend::MappingOptionsType>
+  getTopKOptionsForNearestShapes(
+      const lang::CanonicalTcString& tc,
+      const std::vector<TensorInfo>& inputs,
+      const std::vector<TensorInfo>& outputs,
+      const std::string& backendStr,
+      size_t K,
+      bool rescaleTiles = false) const;
+
   /// Drops the (N - K) worst performing options for each key in the cache.
   /// That is, for each unique tuple(
   ///    CanonicalTcString, input TensorInfo, output TensorInfo, backend string)
@@ -149,61 +272,114 @@ struct OptionsCache {
  protected:
   // Make protected and not private so we can derive and test the internals
   typename Backend::OptionsCacheProtoType toProtobuf() const;
-  void fromProtobuf(const typename Backend::OptionsCacheProtoType& proto);
+  /// Only the entries of the key only are loaded if it is not null.
+  void fromProtobuf(
+      const typename Backend::OptionsCacheProtoType& proto,
+      const OptionsCacheKey* only = nullptr);
+  /// Same as fromProtobuf but the runtimes of options already in the cache
+  /// are appended to their entry.
+  void mergeProtobuf(
+      const typename Backend::OptionsCacheProtoType& proto,
+      const OptionsCacheKey* only = nullptr);
+  /// The content of a cache file or journal record, see
+  /// detail::makeIndexedImage, with a protobuf per key.
+  std::string toIndexedImage(
+      const std::vector<uint64_t>& mergedRecords = {}) const;
+  /// Loads an image of a cache file with fromProtobuf, or mergeProtobuf if
+  /// merge is set, its runtimes are stored.
+  void
+  loadImage(llvm::StringRef image, bool merge, const OptionsCacheKey* only);
+  /// Loads the snapshot and the journal of the cache file filename, with
+  /// its file lock held by the caller. The journal records merged into the
+  /// snapshot are skipped, the ids of all the records of the journal are
+  /// appended to recordIds if it is not null.
+  void loadCacheFiles(
+      const std::string& filename,
+      const OptionsCacheKey* only = nullptr,
+      std::vector<uint64_t>* recordIds = nullptr);
+  /// Merges the journal of the cache file filename into its snapshot, with
+  /// its exclusive file lock held by the caller.
+  static void compactCacheFiles(const std::string& filename);
+
+  using Entry = std::pair<OptionsCacheKey, OptionsCacheValue<Backend>>;
+  /// Inserts entries, as fromProtobuf does, or merges them, as
+  /// mergeProtobuf does, if merge is set. Each shard is published once.
+  void insertEntries(std::vector<Entry> entries, bool merge);
+  /// \return the current entries of key, null if there are none
+  std::shared_ptr<const EntriesType> find(const OptionsCacheKey& key) const;
+  /// Calls f(key, entries) on the current entries of each key
+  template <typename F>
+  void forEachKey(F f) const;
+  static size_t shardIndex(const OptionsCacheKey& key);
+
+  using StoredValue =
+      std::pair<OptionsCacheKey, std::shared_ptr<const ValueType>>;
+  /// \return the entries whose runtimes are not all stored, with those only.
+  /// The values they come from are appended to sources if it is not null.
+  std::vector<Entry> unstoredEntries(
+      std::vector<StoredValue>* sources = nullptr) const;
+  /// Marks the runtimes values have as stored in the cache, also if runtimes
+  /// were appended to them in the meantime.
+  void markStored(const std::vector<StoredValue>& values);
 
  public:
-  mutable size_t numberCacheAttempts{0};
-  mutable size_t numberAttemptedRetrievals{0};
-  mutable size_t numberSuccessfulRetrievals{0};
+  mutable std::atomic<size_t> numberCacheAttempts{0};
+  mutable std::atomic<size_t> numberAttemptedRetrievals{0};
+  mutable std::atomic<size_t> numberSuccessfulRetrievals{0};
 
  protected:
   // Make protected and not private so we can derive and test the internals
-  mutable std::mutex mutex;
-
-  std::unordered_multimap<
-      OptionsCacheKey,
-      OptionsCacheValue<Backend>,
-      OptionsCacheKeyHash>
-      store_;
+  mutable std::array<detail::OptionsCacheShard<Backend>, kNumShards> shards_;
 
   // Make friend to access toProtobuf/fromProtobuf
   template <typename BackendType>
   friend void appendTopKToCacheFile(
-      const OptionsCache<BackendType>& cache,
+      OptionsCache<BackendType>& cache,
       const std::string& cacheFilename,
       uint32_t count);
+  template <typename BackendType>
+  friend void compactCacheFile(const std::string& cacheFilename);
 };
 
 /// Loads at most `count' bets entries from the file `cacheFilename', for the
 /// TC definition corresponding to the entryPoint.
+/// If nearestShapes is set and inputs were never tuned, falls back to the
+/// best entries of the nearest tuned shapes of the same TC and backend,
+/// with their tile sizes rescaled (see
+/// OptionsCache::getTopKOptionsForNearestShapes). Finding them reads the
+/// whole file, not only the entries of inputs.
 ///
-/// Note that the file manipulation is threadsafe but not IPC-safe.
-/// TODO: implement using a filesystem lock (e.g. flock) if more safety is
-/// needed.
+/// Note that the file manipulation is threadsafe and IPC-safe.
 template <typename Backend>
 std::vector<typename Backend::MappingOptionsType> loadTopKFromCacheFile(
     const std::string& tc,
     const std::string& entryPoint,
     const std::string& cacheFilename,
     const std::vector<const DLConstTensor*>& inputs,
-    size_t count);
+    size_t count,
+    bool nearestShapes = false);
 
 /// Stores at most `count' best entries from the cache into the file
 /// `cacheFilename', if that filename can be written to; otherwise throws.
 /// To avoid spuriously overwriting previous results, this ***appends*** the
-/// at most `count' best entries from cache to the cache loaded from
-/// cacheFilename. If the file is empty or does not exist then this function
-/// just writes instead of appending.
+/// at most `count' best entries from cache to the journal of cacheFilename,
+/// concurrent tuners appending to the same file all keep their results.
+/// Only the runtimes that are not stored yet are appended, i.e. neither
+/// those loaded from the file nor those appended before, and they are then
+/// marked as stored in cache.
+/// The journal is compacted into the file once it outgrows it.
 ///
-/// Note that the file manipulation is threadsafe but not IPC-safe.
-/// TODO: implement using a filesystem lock (e.g. flock) if more safety is
-/// needed.
+/// Note that the file manipulation is threadsafe and IPC-safe.
 template <typename Backend>
 void appendTopKToCacheFile(
-    const OptionsCache<Backend>& cache,
+    OptionsCache<Backend>& cache,
     const std::string& cacheFilename,
     uint32_t count);
 
+/// Merges the journal of the file `cacheFilename' into it.
+template <typename Backend>
+void compactCacheFile(const std::string& cacheFilename);
+
 } // namespace autotune
 } // namespace tc
 
@@ -162,6 +162,15 @@ void ParameterView::selectOption(size_t idx) {
   }
 }
 
+size_t ParameterView::selectedOption() const {
+  TC_CHECK((rangePtr == nullptr) xor (boolPtr == nullptr));
+  if (rangePtr) {
+    return rangePtr->selected_;
+  } else {
+    return boolPtr->value_ ? 1 : 0;
+  }
+}
+
 ParameterView::ParameterView(BoolParameter& p)
     : rangePtr(nullptr), boolPtr(&p) {}
 ParameterView::ParameterView(RangeParameter& p)
@@ -355,6 +364,10 @@ TuningConfiguration::TuningConfiguration()
       useReadOnlyCache("use readonly cache (i.e. emit __ldg loads)"),
       matchLibraryCalls("match library calls") {
   addValidator([](const TuningConfiguration& conf) {
+    // CPU configurations have no block sizes
+    if (conf.blockParams.dims.empty()) {
+      return true;
+    }
     auto b0v = conf.blockParams.dims.at(0).value();
     auto b1v = conf.blockParams.dims.at(1).value();
     auto b2v = conf.blockParams.dims.at(2).value();
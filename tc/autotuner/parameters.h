@@ -86,6 +86,8 @@ class ParameterView {
 
   size_t numberOptions() const;
   void selectOption(size_t idx);
+  /// Index of the selected option, the one passed to selectOption
+  size_t selectedOption() const;
   void overwrite(const ParameterView&);
   bool isForced() const;
 
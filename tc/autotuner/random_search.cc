@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/random_search.h"
+
+#include "tc/core/check.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+RandomSearch::RandomSearch(
+    const std::vector<TuningConfiguration>& confs,
+    size_t numGenerations,
+    size_t populationSize)
+    : SearchStrategy(numGenerations),
+      baseConf(confs.at(0)),
+      maxPopulationSize(populationSize),
+      rng{std::random_device{}()} {
+  detail::restoreRngState(rng);
+  population = detail::makeInitialPopulation(confs, populationSize, rng);
+}
+
+std::unique_ptr<RandomSearch> RandomSearch::makeFromFlags(
+    const std::vector<TuningConfiguration>& confs) {
+  return make_unique<RandomSearch>(
+      confs, FLAGS_tuner_gen_generations, FLAGS_tuner_gen_pop_size);
+}
+
+void RandomSearch::updateParameters() {
+  population.clear();
+  for (size_t i = 0; i < maxPopulationSize; ++i) {
+    population.push_back(make_unique<CandidateConfiguration>(baseConf));
+    detail::randomizeConfiguration(population.back()->configuration, rng);
+  }
+}
+
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <random>
+
+#include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * RandomSearch evaluates independent uniformly random valid configurations,
+ * the first generation also contains the configurations it is seeded with.
+ * It is the baseline the other strategies should beat.
+ */
+class RandomSearch : public SearchStrategy {
+ public:
+  RandomSearch(
+      const std::vector<TuningConfiguration>& confs,
+      size_t numGenerations,
+      size_t populationSize);
+
+  /// Configured by FLAGS_tuner_gen_generations and FLAGS_tuner_gen_pop_size
+  static std::unique_ptr<RandomSearch> makeFromFlags(
+      const std::vector<TuningConfiguration>& confs);
+
+  void updateParameters() override;
+
+  const TuningConfiguration baseConf;
+  const size_t maxPopulationSize;
+  mutable std::mt19937_64 rng;
+};
+
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/search_strategy.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "tc/autotuner/bayesian_search.h"
+#include "tc/autotuner/genetic_search.h"
+#include "tc/autotuner/random_search.h"
+#include "tc/autotuner/simulated_annealing.h"
+#include "tc/autotuner/successive_halving.h"
+#include "tc/core/check.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+std::unique_ptr<SearchStrategy> SearchStrategy::makeFromFlags(
+    const std::vector<TuningConfiguration>& confs) {
+  const auto& name = FLAGS_tuner_search_strategy;
+  if (name == "genetic") {
+    return GeneticSearch::makeFromFlags(confs);
+  } else if (name == "random") {
+    return RandomSearch::makeFromFlags(confs);
+  } else if (name == "annealing") {
+    return SimulatedAnnealing::makeFromFlags(confs);
+  } else if (name == "halving") {
+    return SuccessiveHalving::makeFromFlags(confs);
+  } else if (name == "bayesian") {
+    return BayesianSearch::makeFromFlags(confs);
+  }
+  throw std::invalid_argument("Unknown search strategy: " + name);
+}
+
+namespace detail {
+namespace {
+void randomizeParameter(ParameterView& param, std::mt19937_64& rng) {
+  // Parameters that do not apply to the backend have no option
+  if (param.numberOptions() == 0) {
+    return;
+  }
+  auto paramIndex = std::uniform_int_distribution<size_t>(
+      size_t(0), param.numberOptions() - 1)(rng);
+  param.selectOption(paramIndex);
+}
+} // namespace
+
+void randomizeConfiguration(TuningConfiguration& conf, std::mt19937_64& rng) {
+  do {
+    conf.applyToParameters(
+        [&](ParameterView& p) { randomizeParameter(p, rng); });
+  } while (!conf.isValid());
+}
+
+void mutateConfiguration(
+    TuningConfiguration& conf,
+    double rate,
+    size_t iterations,
+    std::mt19937_64& rng) {
+  auto shouldMutate = [&]() -> bool {
+    return std::discrete_distribution<int>{static_cast<double>(100 - rate),
+                                           static_cast<double>(rate)}(rng);
+  };
+
+  TuningConfiguration res(conf);
+  for (size_t i = 0; i < iterations; ++i) {
+    res.applyToParameters([&](ParameterView& p) {
+      if (not p.isForced() and shouldMutate()) {
+        randomizeParameter(p, rng);
+      }
+    });
+
+    if (res.isValid()) {
+      conf = res;
+      return;
+    }
+    res = conf;
+  }
+}
+
+void restoreRngState(std::mt19937_64& rng) {
+  if (FLAGS_tuner_rng_restore.empty()) {
+    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG state " << rng;
+  } else {
+    std::istringstream ss(FLAGS_tuner_rng_restore);
+    ss >> rng;
+    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG restored state " << rng;
+  }
+}
+
+SearchStrategy::Population makeInitialPopulation(
+    const std::vector<TuningConfiguration>& confs,
+    size_t populationSize,
+    std::mt19937_64& rng) {
+  TC_CHECK(not confs.empty()) << "empty set of predefined configurations";
+  SearchStrategy::Population population;
+  population.reserve(populationSize);
+  for (size_t i = 0; i < confs.size() && i < populationSize; ++i) {
+    population.push_back(make_unique<CandidateConfiguration>(confs[i]));
+  }
+  while (population.size() < populationSize) {
+    population.push_back(make_unique<CandidateConfiguration>(confs[0]));
+    randomizeConfiguration(population.back()->configuration, rng);
+  }
+  return population;
+}
+} // namespace detail
+} // namespace autotune
+} // namespace tc
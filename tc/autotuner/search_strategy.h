@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "tc/autotuner/parameters.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * A SearchStrategy explores the space of TuningConfiguration one generation
+ * of candidates at a time. The tuning harness evaluates all the candidates
+ * of population, i.e. sets their runtime or marks them invalid, then calls
+ * updateParameters which replaces population by the next generation, for
+ * numGenerations generations.
+ *
+ * Autotuner<Backend, SearchStrategy> creates its strategy with the static
+ * SearchStrategy::makeFromFlags, each strategy reads its own flags.
+ * Instantiating it with this base class selects the strategy with
+ * FLAGS_tuner_search_strategy.
+ */
+class SearchStrategy {
+ public:
+  using Population = std::vector<std::unique_ptr<CandidateConfiguration>>;
+
+  explicit SearchStrategy(size_t numGenerations)
+      : numGenerations(numGenerations) {}
+  virtual ~SearchStrategy() = default;
+
+  /// The strategy named by FLAGS_tuner_search_strategy ("genetic", "random",
+  /// "annealing", "halving" or "bayesian") seeded with confs.
+  static std::unique_ptr<SearchStrategy> makeFromFlags(
+      const std::vector<TuningConfiguration>& confs);
+
+  /// Learns from the evaluated population and replaces it with the next
+  /// generation.
+  virtual void updateParameters() = 0;
+
+  /// Number of benchmark iterations the candidates of the current population
+  /// should be measured with, 0 for the default of the tuner. Fewer
+  /// iterations give cheaper but noisier runtimes.
+  virtual size_t benchmarkIterations() const {
+    return 0;
+  }
+
+  Population population;
+  const size_t numGenerations;
+};
+
+namespace detail {
+/// Selects random options for all the parameters of conf until it is valid.
+void randomizeConfiguration(TuningConfiguration& conf, std::mt19937_64& rng);
+
+/// Randomly changes each parameter of conf that is not fixed with
+/// probability rate/100, trying up to iterations times to obtain a valid
+/// configuration. conf is left untouched if none was found.
+void mutateConfiguration(
+    TuningConfiguration& conf,
+    double rate,
+    size_t iterations,
+    std::mt19937_64& rng);
+
+/// Restores the state of rng from FLAGS_tuner_rng_restore if it is set,
+/// logs it otherwise.
+void restoreRngState(std::mt19937_64& rng);
+
+/// The first generation of most strategies: confs followed by random
+/// configurations based on the first one, populationSize in total.
+SearchStrategy::Population makeInitialPopulation(
+    const std::vector<TuningConfiguration>& confs,
+    size_t populationSize,
+    std::mt19937_64& rng);
+} // namespace detail
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/simulated_annealing.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "tc/core/check.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+SimulatedAnnealing::SimulatedAnnealing(
+    const std::vector<TuningConfiguration>& confs,
+    size_t numGenerations,
+    size_t populationSize,
+    double temperature,
+    double cooling)
+    : SearchStrategy(numGenerations),
+      baseConf(confs.at(0)),
+      maxPopulationSize(populationSize),
+      temperature(temperature),
+      cooling(cooling),
+      started(false),
+      current(confs.at(0)),
+      currentRuntime(Duration::max()),
+      rng{std::random_device{}()} {
+  TC_CHECK_GT(temperature, 0.0) << "the temperature must be positive";
+  TC_CHECK(cooling > 0.0 and cooling <= 1.0)
+      << "the cooling factor (" << cooling
+      << ") should be in the (0,1] interval";
+  detail::restoreRngState(rng);
+  population = detail::makeInitialPopulation(confs, populationSize, rng);
+}
+
+std::unique_ptr<SimulatedAnnealing> SimulatedAnnealing::makeFromFlags(
+    const std::vector<TuningConfiguration>& confs) {
+  return make_unique<SimulatedAnnealing>(
+      confs,
+      FLAGS_tuner_gen_generations,
+      FLAGS_tuner_gen_pop_size,
+      FLAGS_tuner_annealing_temperature,
+      FLAGS_tuner_annealing_cooling);
+}
+
+TuningConfiguration SimulatedAnnealing::neighbor(
+    const TuningConfiguration& conf) const {
+  TuningConfiguration res(conf);
+  std::vector<ParameterView> free;
+  for (auto& p : res.collectParameters()) {
+    if (not p.isForced() and p.numberOptions() > 1) {
+      free.push_back(p);
+    }
+  }
+  if (free.empty()) {
+    return conf;
+  }
+  for (size_t i = 0; i < neighborIterations; ++i) {
+    auto& p = free.at(
+        std::uniform_int_distribution<size_t>(0, free.size() - 1)(rng));
+    auto selected = p.selectedOption();
+    // Any option but the selected one
+    auto option = std::uniform_int_distribution<size_t>(
+        0, p.numberOptions() - 2)(rng);
+    p.selectOption(option < selected ? option : option + 1);
+    if (res.isValid()) {
+      return res;
+    }
+    p.selectOption(selected);
+  }
+  return conf;
+}
+
+void SimulatedAnnealing::updateParameters() {
+  const CandidateConfiguration* best = nullptr;
+  for (const auto& candidate : population) {
+    if (not candidate->invalid and
+        (not best or candidate->runtime < best->runtime)) {
+      best = candidate.get();
+    }
+  }
+
+  if (best) {
+    auto accept = [&]() {
+      if (not started or best->runtime < currentRuntime) {
+        return true;
+      }
+      auto delta = std::log(
+          static_cast<double>(best->runtime.toMicroSeconds()) /
+          std::max<double>(currentRuntime.toMicroSeconds(), 1));
+      return std::uniform_real_distribution<double>{}(rng) <
+          std::exp(-delta / temperature);
+    };
+    if (accept()) {
+      LOG_IF(INFO, FLAGS_debug_tuner)
+          << "Annealing moves to a configuration running in "
+          << best->runtime.toMicroSeconds() << "us at temperature "
+          << temperature;
+      current = best->configuration;
+      currentRuntime = best->runtime;
+      started = true;
+    }
+  }
+  temperature *= cooling;
+
+  population.clear();
+  for (size_t i = 0; i < maxPopulationSize; ++i) {
+    population.push_back(make_unique<CandidateConfiguration>(baseConf));
+    if (started) {
+      population.back()->configuration = neighbor(current);
+    } else {
+      detail::randomizeConfiguration(population.back()->configuration, rng);
+    }
+  }
+}
+
+} // namespace autotune
+} // namespace tc
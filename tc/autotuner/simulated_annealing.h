@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <random>
+
+#include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * SimulatedAnnealing walks from a current configuration to neighboring
+ * ones, which differ in a single parameter. Each generation evaluates
+ * populationSize neighbors of the current configuration and moves to the
+ * fastest of them with the Metropolis criterion: always if it is faster,
+ * otherwise with probability exp(-log(runtime / currentRuntime) /
+ * temperature). The temperature is multiplied by cooling after each
+ * generation so that the walk goes from exploration to hill climbing.
+ *
+ * The first generation consists of the seed configurations and random ones,
+ * the fastest becomes the current configuration. Generations stay random
+ * until some candidate is valid.
+ */
+class SimulatedAnnealing : public SearchStrategy {
+ public:
+  SimulatedAnnealing(
+      const std::vector<TuningConfiguration>& confs,
+      size_t numGenerations,
+      size_t populationSize,
+      double temperature,
+      double cooling);
+
+  /// Configured by FLAGS_tuner_gen_generations, FLAGS_tuner_gen_pop_size and
+  /// the FLAGS_tuner_annealing_* flags
+  static std::unique_ptr<SimulatedAnnealing> makeFromFlags(
+      const std::vector<TuningConfiguration>& confs);
+
+  void updateParameters() override;
+
+ private:
+  TuningConfiguration neighbor(const TuningConfiguration& conf) const;
+
+ public:
+  static constexpr int neighborIterations = 1000;
+
+  const TuningConfiguration baseConf;
+  const size_t maxPopulationSize;
+  double temperature;
+  const double cooling;
+
+  /// Whether the walk has started, i.e. current is valid
+  bool started;
+  TuningConfiguration current;
+  Duration currentRuntime;
+
+  mutable std::mt19937_64 rng;
+};
+
+} // namespace autotune
+} // namespace tc
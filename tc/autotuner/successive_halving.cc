@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/successive_halving.h"
+
+#include <algorithm>
+
+#include "tc/core/check.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+namespace {
+size_t ceilDiv(size_t a, size_t b) {
+  return (a + b - 1) / b;
+}
+
+size_t countRungs(size_t populationSize, size_t eta) {
+  size_t numRungs = 1;
+  for (auto size = populationSize; size > eta; size = ceilDiv(size, eta)) {
+    ++numRungs;
+  }
+  return numRungs;
+}
+} // namespace
+
+SuccessiveHalving::SuccessiveHalving(
+    const std::vector<TuningConfiguration>& confs,
+    size_t numGenerations,
+    size_t populationSize,
+    size_t eta)
+    : SearchStrategy(numGenerations),
+      baseConf(confs.at(0)),
+      maxPopulationSize(populationSize),
+      eta(eta),
+      numRungs(countRungs(populationSize, eta)),
+      bracketStart(0),
+      rung(0),
+      hasBest(false),
+      bestConf(confs.at(0)),
+      bestRuntime(Duration::max()),
+      rng{std::random_device{}()} {
+  TC_CHECK_GE(eta, 2u) << "the halving rate must be at least 2";
+  detail::restoreRngState(rng);
+  population = detail::makeInitialPopulation(confs, populationSize, rng);
+}
+
+std::unique_ptr<SuccessiveHalving> SuccessiveHalving::makeFromFlags(
+    const std::vector<TuningConfiguration>& confs) {
+  return make_unique<SuccessiveHalving>(
+      confs,
+      FLAGS_tuner_gen_generations,
+      FLAGS_tuner_gen_pop_size,
+      FLAGS_tuner_halving_rate);
+}
+
+size_t SuccessiveHalving::rungSize(size_t r) const {
+  auto size = maxPopulationSize;
+  for (size_t i = 0; i < r; ++i) {
+    size = ceilDiv(size, eta);
+  }
+  return size;
+}
+
+bool SuccessiveHalving::isLastRung() const {
+  return population.size() <= eta;
+}
+
+size_t SuccessiveHalving::benchmarkIterations() const {
+  if (isLastRung()) {
+    return 0;
+  }
+  size_t iterations = 1;
+  for (size_t i = 0; i < rung; ++i) {
+    iterations *= eta;
+  }
+  return iterations;
+}
+
+void SuccessiveHalving::updateParameters() {
+  std::vector<const CandidateConfiguration*> valid;
+  for (const auto& candidate : population) {
+    if (not candidate->invalid) {
+      valid.push_back(candidate.get());
+    }
+  }
+  std::sort(
+      valid.begin(),
+      valid.end(),
+      [](const CandidateConfiguration* a, const CandidateConfiguration* b) {
+        return a->runtime < b->runtime;
+      });
+  if (not valid.empty() and valid.front()->runtime < bestRuntime) {
+    hasBest = true;
+    bestConf = valid.front()->configuration;
+    bestRuntime = valid.front()->runtime;
+  }
+
+  // Promote the fastest candidates to the next rung
+  if (not isLastRung() and not valid.empty()) {
+    valid.resize(std::min(valid.size(), ceilDiv(population.size(), eta)));
+    Population survivors;
+    for (auto candidate : valid) {
+      survivors.push_back(
+          make_unique<CandidateConfiguration>(candidate->configuration));
+    }
+    population = std::move(survivors);
+    ++rung;
+    return;
+  }
+
+  // Start a new bracket
+  bracketStart = (bracketStart + 1) % numRungs;
+  rung = bracketStart;
+  LOG_IF(INFO, FLAGS_debug_tuner)
+      << "Successive halving starts a bracket at rung " << rung;
+  population.clear();
+  if (hasBest) {
+    population.push_back(make_unique<CandidateConfiguration>(bestConf));
+  }
+  while (population.size() < rungSize(rung)) {
+    population.push_back(make_unique<CandidateConfiguration>(baseConf));
+    detail::randomizeConfiguration(population.back()->configuration, rng);
+  }
+}
+
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <random>
+
+#include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * SuccessiveHalving spends few benchmark iterations on many candidates and
+ * more on the few that survive. A bracket starts with random candidates
+ * measured with a single iteration (rung 0), the fastest 1/eta of them are
+ * measured again with eta times more iterations (rung 1) and so on until at
+ * most eta candidates are left, which are measured with the default number
+ * of iterations of the tuner.
+ *
+ * Each generation is a rung. As in Hyperband, successive brackets start at
+ * successive rungs, i.e. with fewer candidates measured more accurately,
+ * which hedges against short runs ranking candidates poorly. New brackets
+ * start from the fastest configuration found so far and random ones, the
+ * first one also contains the seed configurations.
+ */
+class SuccessiveHalving : public SearchStrategy {
+ public:
+  SuccessiveHalving(
+      const std::vector<TuningConfiguration>& confs,
+      size_t numGenerations,
+      size_t populationSize,
+      size_t eta);
+
+  /// Configured by FLAGS_tuner_gen_generations, FLAGS_tuner_gen_pop_size and
+  /// FLAGS_tuner_halving_rate
+  static std::unique_ptr<SuccessiveHalving> makeFromFlags(
+      const std::vector<TuningConfiguration>& confs);
+
+  void updateParameters() override;
+
+  size_t benchmarkIterations() const override;
+
+ private:
+  /// Number of candidates of a bracket at rung
+  size_t rungSize(size_t rung) const;
+  bool isLastRung() const;
+
+ public:
+  const TuningConfiguration baseConf;
+  const size_t maxPopulationSize;
+  const size_t eta;
+  /// Number of rungs of the bracket starting at rung 0
+  const size_t numRungs;
+  size_t bracketStart;
+  size_t rung;
+
+  bool hasBest;
+  TuningConfiguration bestConf;
+  Duration bestRuntime;
+
+  mutable std::mt19937_64 rng;
+};
+
+} // namespace autotune
+} // namespace tc
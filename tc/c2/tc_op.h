@@ -23,6 +23,7 @@
 #include "tc/core/compiler.h"
 #include "tc/core/cuda/cuda.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/executor_cache.h"
 #include "tc/core/tensor.h"
 
 #include "tc/c2/context.h"
@@ -111,7 +112,8 @@ class TcOp : public Operator<Context> {
       }
 
       // compile
-      executor_ = tc::compile<tc::CudaBackend>(
+      // Operators running the same TC on the same sizes share the executor.
+      executor_ = tc::compileCached<tc::CudaBackend>(
           tc_,
           tc_name_,
           raw_input_dl_tensors_,
@@ -150,7 +152,7 @@ class TcOp : public Operator<Context> {
   std::vector<const void*> input_void_ptrs_;
   std::vector<void*> output_void_ptrs_;
 
-  std::unique_ptr<tc::CudaBackend::ExecutorType> executor_;
+  std::shared_ptr<tc::CudaBackend::ExecutorType> executor_;
 };
 
 class GetTcOpGradient : public GradientMakerBase {
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/compilation_stage_cache.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "tc/core/flags.h"
+#include "tc/external/isl.h"
+
+namespace tc {
+namespace {
+void appendKeyComponent(std::stringstream& ss, const std::string& s) {
+  ss << s.size() << ":" << s;
+}
+} // namespace
+
+template <typename T>
+T* CompilationStageCache::LruMap<T>::find(const std::string& key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return &it->second->second;
+}
+
+template <typename T>
+T& CompilationStageCache::LruMap<T>::insert(
+    const std::string& key,
+    T&& value) {
+  entries_.emplace_front(key, std::move(value));
+  index_[key] = entries_.begin();
+  while (entries_.size() > std::max<size_t>(
+                               FLAGS_compilation_stage_cache_size, 1)) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  return entries_.front().second;
+}
+
+template <typename T>
+void CompilationStageCache::LruMap<T>::clear() {
+  entries_.clear();
+  index_.clear();
+}
+
+CompilationStageCache& CompilationStageCache::forThisThread() {
+  // The cached scops hold isl objects, the isl context of the thread must
+  // outlive the cache, i.e. be constructed first.
+  isl::with_exceptions::globalIslCtx();
+  static thread_local CompilationStageCache cache;
+  return cache;
+}
+
+tc2halide::HalideComponents CompilationStageCache::translate(
+    const lang::TreeRef& tcDefinition) {
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  if (FLAGS_compilation_stage_cache_size == 0) {
+    return tc2halide::translate(ctx, tcDefinition);
+  }
+  std::stringstream ss;
+  ss << tcDefinition;
+  auto key = ss.str();
+  if (auto components = halideComponents_.find(key)) {
+    ++numHits_;
+    return *components;
+  }
+  return halideComponents_.insert(
+      key, tc2halide::translate(ctx, tcDefinition));
+}
+
+std::unique_ptr<polyhedral::Scop> CompilationStageCache::makeScheduledScop(
+    const tc2halide::HalideComponents& halideComponents,
+    const std::unordered_map<std::string, int>& pvm,
+    const MappingOptionsView& options) {
+  using polyhedral::Scop;
+  auto make = [&]() {
+    auto scop = Scop::makeScop(
+        isl::with_exceptions::globalIslCtx(), halideComponents);
+    scop = Scop::makeSpecializedScop(*scop, pvm);
+    if (options.proto.fix_parameters_before_scheduling()) {
+      scop->specializeToContext();
+    }
+    return Scop::makeScheduled(*scop, options.outerScheduleOptions);
+  };
+  if (FLAGS_compilation_stage_cache_size == 0) {
+    return make();
+  }
+
+  std::stringstream ss;
+  {
+    std::stringstream def;
+    def << halideComponents.def;
+    appendKeyComponent(ss, def.str());
+  }
+  std::vector<std::pair<std::string, int>> values(pvm.begin(), pvm.end());
+  std::sort(values.begin(), values.end());
+  for (const auto& kvp : values) {
+    appendKeyComponent(ss, kvp.first + "=" + std::to_string(kvp.second));
+  }
+  appendKeyComponent(
+      ss, options.proto.fix_parameters_before_scheduling() ? "1" : "0");
+  appendKeyComponent(
+      ss, options.outerScheduleOptions.proto.SerializeAsString());
+  auto key = ss.str();
+
+  auto scop = scheduledScops_.find(key);
+  if (scop) {
+    ++numHits_;
+  } else {
+    scop = &scheduledScops_.insert(key, make());
+  }
+  return Scop::makeScop(**scop);
+}
+
+void CompilationStageCache::clear() {
+  halideComponents_.clear();
+  scheduledScops_.clear();
+  numHits_ = 0;
+}
+} // namespace tc
@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "tc/core/mapping_options.h"
+#include "tc/core/polyhedral/scop.h"
+#include "tc/core/tc2halide.h"
+#include "tc/lang/tree.h"
+
+namespace tc {
+/**
+ * Memoizes the stages of polyhedral compilation that successive compilations
+ * of the same TC with different mapping options share, typically the
+ * candidates of an autotuning run which mostly differ in tiling and mapping.
+ *
+ * Each stage is keyed on what it depends on:
+ *   - translate, the Halide components, on the TC definition;
+ *   - makeScheduledScop, the scop specialized to the values of the
+ *     parameters, its dependences and its schedule, additionally on these
+ *     values, on fix_parameters_before_scheduling and on the outer scheduler
+ *     options.
+ * Scops are returned as clones which the caller is free to transform.
+ *
+ * isl objects can only be used from the thread owning their isl context
+ * (see globalIslCtx), there is therefore one cache per thread.  At most
+ * FLAGS_compilation_stage_cache_size entries are kept per stage, the least
+ * recently used ones are evicted first, 0 disables memoization.
+ */
+class CompilationStageCache {
+ public:
+  /// The cache of the calling thread.
+  static CompilationStageCache& forThisThread();
+
+  tc2halide::HalideComponents translate(const lang::TreeRef& tcDefinition);
+
+  /// Scop of halideComponents specialized to the parameter values in pvm,
+  /// specialized to its context if options fix parameters before scheduling
+  /// and scheduled with the outer scheduler options.
+  std::unique_ptr<polyhedral::Scop> makeScheduledScop(
+      const tc2halide::HalideComponents& halideComponents,
+      const std::unordered_map<std::string, int>& pvm,
+      const MappingOptionsView& options);
+
+  /// Number of stages found in the cache since the last clear.
+  size_t numHits() const {
+    return numHits_;
+  }
+  void clear();
+
+ private:
+  CompilationStageCache() = default;
+
+  template <typename T>
+  class LruMap {
+   public:
+    T* find(const std::string& key);
+    T& insert(const std::string& key, T&& value);
+    void clear();
+
+   private:
+    // Most recently used first.
+    std::list<std::pair<std::string, T>> entries_;
+    std::unordered_map<
+        std::string,
+        typename std::list<std::pair<std::string, T>>::iterator>
+        index_;
+  };
+
+  LruMap<tc2halide::HalideComponents> halideComponents_;
+  LruMap<std::unique_ptr<polyhedral::Scop>> scheduledScops_;
+  size_t numHits_ = 0;
+};
+} // namespace tc
@@ -19,6 +19,7 @@
 #include <string>
 
 #include "tc/core/check.h"
+#include "tc/core/compilation_stage_cache.h"
 #include "tc/core/flags.h"
 #include "tc/core/halide_utils.h"
 #include "tc/core/tensor.h"
@@ -55,7 +56,7 @@ std::unique_ptr<typename Backend::ExecutorType> compile(
   auto inputsInfo = makeTensorInfoVector(inputs);
   auto outputsInfo = detail::inferOutputTensorInfo(tcDefinition, inputs);
   auto halideComponents =
-      tc2halide::translate(isl::with_exceptions::globalIslCtx(), tcDefinition);
+      CompilationStageCache::forThisThread().translate(tcDefinition);
   detail::checkInputsCompliant(halideComponents, inputs);
 
   auto tcName = lang::Def(tcDefinition).name().name();
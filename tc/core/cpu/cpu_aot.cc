@@ -0,0 +1,379 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_aot.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "tc/core/check.h"
+#include "tc/core/compiler.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/flags.h"
+#include "tc/core/polyhedral/codegen_llvm.h"
+#include "tc/core/tc2halide.h"
+#include "tc/lang/canonicalize.h"
+
+namespace tc {
+namespace {
+// C type of the elements of a tensor of Halide type t.
+std::string cTypeName(const Halide::Type& t) {
+  if (t.is_float()) {
+    TC_CHECK(t.bits() == 32 || t.bits() == 64) << "NYI: float" << t.bits();
+    return t.bits() == 32 ? "float" : "double";
+  }
+  if (t.is_bool()) {
+    return "uint8_t";
+  }
+  std::stringstream ss;
+  ss << (t.is_uint() ? "uint" : "int") << t.bits() << "_t";
+  return ss.str();
+}
+
+std::string shapeString(const Halide::Type& t, const TensorInfo& info) {
+  std::stringstream ss;
+  ss << cTypeName(t);
+  for (auto s : info.shape) {
+    ss << "[" << s << "]";
+  }
+  return ss.str();
+}
+
+bool isCIdentifier(const std::string& s) {
+  if (s.empty() || std::isdigit(s[0])) {
+    return false;
+  }
+  for (auto c : s) {
+    if (!std::isalnum(c) && c != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Kernel after code generation, the module is linked into the exported one.
+struct GeneratedKernel {
+  std::string key;
+  std::string name;
+  std::string declaration;
+};
+
+GeneratedKernel generateKernel(
+    const CpuAotKernel& kernel,
+    llvm::Linker& linker,
+    llvm::LLVMContext& ctx) {
+  auto parsedTcs = detail::parse(kernel.tc);
+  TC_CHECK_EQ(parsedTcs.count(kernel.entryPoint), 1u)
+      << "attempting to access undefined function " << kernel.entryPoint;
+  auto tcDefinition = parsedTcs.at(kernel.entryPoint);
+  auto inputs = makeDLConstTensorVector(kernel.inputsInfo);
+  auto rawInputs = extractRawPtrs(inputs);
+  auto outputsInfo = detail::inferOutputTensorInfo(tcDefinition, rawInputs);
+  auto halideComponents =
+      tc2halide::translate(isl::with_exceptions::globalIslCtx(), tcDefinition);
+  detail::checkInputsCompliant(halideComponents, rawInputs);
+
+  auto result = emitCpuKernel(
+      kernel.entryPoint, halideComponents, rawInputs, kernel.options);
+  llvm::SMDiagnostic err;
+  auto module = llvm::parseIR(
+      llvm::MemoryBufferRef(result.source, result.specializedName), err, ctx);
+  TC_CHECK(module) << "Could not parse the LLVM IR of "
+                   << result.specializedName;
+
+  auto name = kernel.name.empty() ? result.specializedName : kernel.name;
+  TC_CHECK(isCIdentifier(name)) << "Invalid kernel name " << name;
+  if (name != result.specializedName) {
+    module->getFunction(result.specializedName)->setName(name);
+    module->getFunction(polyhedral::packedKernelName(result.specializedName))
+        ->setName(polyhedral::packedKernelName(name));
+  }
+  // Linking fails on duplicate definitions.
+  TC_CHECK(!linker.linkInModule(std::move(module)))
+      << "Could not link kernel " << name
+      << ", use CpuAotKernel::name to disambiguate kernels";
+
+  GeneratedKernel generated{makeCpuAotKey(kernel), name, ""};
+  std::stringstream decl;
+  decl << "/* " << kernel.entryPoint << "(";
+  for (size_t i = 0; i < halideComponents.inputs.size(); ++i) {
+    decl << (i > 0 ? ", " : "") << halideComponents.inputs[i].name() << ": "
+         << shapeString(
+                halideComponents.inputs[i].type(), kernel.inputsInfo.at(i));
+  }
+  decl << ") -> (";
+  for (size_t i = 0; i < halideComponents.outputs.size(); ++i) {
+    decl << (i > 0 ? ", " : "") << halideComponents.outputs[i].name() << ": "
+         << shapeString(halideComponents.outputs[i].type(), outputsInfo.at(i));
+  }
+  decl << ")\n * key: " << generated.key << " */\n";
+  decl << "void " << name << "(";
+  for (size_t i = 0; i < halideComponents.inputs.size(); ++i) {
+    const auto& in = halideComponents.inputs[i];
+    decl << (i > 0 ? ", " : "") << "const " << cTypeName(in.type()) << "* "
+         << in.name();
+  }
+  for (const auto& out : halideComponents.outputs) {
+    decl << ", " << cTypeName(out.type()) << "* " << out.name();
+  }
+  for (const auto& param : result.symbolicParameters) {
+    decl << ", int64_t " << param;
+  }
+  decl << ");\n";
+  decl << "void " << polyhedral::packedKernelName(name) << "(void** args);\n";
+  generated.declaration = decl.str();
+  return generated;
+}
+
+// Define tc_cpu_parallel_for as a weak sequential loop if kernels call it.
+void addSequentialParallelForFallback(llvm::Module& module) {
+  auto runtime = module.getFunction("tc_cpu_parallel_for");
+  if (!runtime || !runtime->isDeclaration()) {
+    return;
+  }
+  runtime->setLinkage(llvm::GlobalValue::WeakAnyLinkage);
+  llvm::IRBuilder<> builder(
+      llvm::BasicBlock::Create(module.getContext(), "entry", runtime));
+  std::vector<llvm::Value*> args;
+  for (auto& arg : runtime->args()) {
+    args.push_back(&arg);
+  }
+  // (body, closure, begin, end, ...) -> body(begin, end, closure)
+  builder.CreateCall(args[0], {args[2], args[3], args[1]});
+  builder.CreateRetVoid();
+}
+
+void addRegistry(
+    llvm::Module& module,
+    const std::vector<GeneratedKernel>& kernels,
+    const std::string& registryName) {
+  auto& ctx = module.getContext();
+  auto* i8PtrTy = llvm::Type::getInt8PtrTy(ctx);
+  auto* i64Ty = llvm::Type::getInt64Ty(ctx);
+  auto* packedTy = llvm::FunctionType::get(
+      llvm::Type::getVoidTy(ctx), {i8PtrTy->getPointerTo()}, false);
+  auto* entryTy =
+      llvm::StructType::get(ctx, {i8PtrTy, i8PtrTy, packedTy->getPointerTo()});
+
+  auto makeString = [&](const std::string& s) {
+    auto* init = llvm::ConstantDataArray::getString(ctx, s);
+    auto* str = new llvm::GlobalVariable(
+        module,
+        init->getType(),
+        true,
+        llvm::GlobalValue::PrivateLinkage,
+        init,
+        ".str");
+    return llvm::ConstantExpr::getPointerCast(str, i8PtrTy);
+  };
+  std::vector<llvm::Constant*> entries;
+  for (const auto& k : kernels) {
+    auto* kernel = module.getFunction(polyhedral::packedKernelName(k.name));
+    TC_CHECK(kernel) << "Missing packed entry point for " << k.name;
+    entries.push_back(llvm::ConstantStruct::get(
+        entryTy, {makeString(k.key), makeString(k.name), kernel}));
+  }
+  auto* registryTy = llvm::ArrayType::get(entryTy, entries.size());
+  new llvm::GlobalVariable(
+      module,
+      registryTy,
+      true,
+      llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantArray::get(registryTy, entries),
+      registryName + "_registry");
+  new llvm::GlobalVariable(
+      module,
+      i64Ty,
+      true,
+      llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantInt::get(i64Ty, entries.size()),
+      registryName + "_registry_size");
+}
+
+void emitObject(llvm::Module& module, const std::string& filename) {
+  std::unique_ptr<llvm::TargetMachine> targetMachine(
+      llvm::EngineBuilder()
+          .setRelocationModel(llvm::Reloc::PIC_)
+          .selectTarget());
+  module.setDataLayout(targetMachine->createDataLayout());
+  module.setTargetTriple(targetMachine->getTargetTriple().str());
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(filename, ec, llvm::sys::fs::F_None);
+  TC_CHECK(!ec) << "Could not open " << filename << ": " << ec.message();
+  llvm::legacy::PassManager passManager;
+#if LLVM_VERSION_MAJOR <= 6
+  auto failed = targetMachine->addPassesToEmitFile(
+      passManager, os, llvm::TargetMachine::CGFT_ObjectFile);
+#else
+  auto failed = targetMachine->addPassesToEmitFile(
+      passManager, os, nullptr, llvm::TargetMachine::CGFT_ObjectFile);
+#endif
+  TC_CHECK(!failed) << "The target cannot emit object files";
+  passManager.run(module);
+}
+
+void emitHeader(
+    const std::vector<GeneratedKernel>& kernels,
+    const std::string& registryName,
+    const std::string& filename) {
+  std::ofstream os(filename);
+  TC_CHECK(os) << "Could not open " << filename;
+  const auto& r = registryName;
+  os << "/* Generated by Tensor Comprehensions, do not edit. */\n"
+     << "#pragma once\n\n"
+     << "#include <stdint.h>\n"
+     << "#include <string.h>\n\n"
+     << "#ifdef __cplusplus\n"
+     << "extern \"C\" {\n"
+     << "#endif\n\n";
+  for (const auto& k : kernels) {
+    os << k.declaration << "\n";
+  }
+  os << "typedef void (*" << r << "_packed_kernel_t)(void** args);\n\n"
+     << "typedef struct {\n"
+     << "  const char* key;\n"
+     << "  const char* name;\n"
+     << "  " << r << "_packed_kernel_t kernel;\n"
+     << "} " << r << "_entry_t;\n\n"
+     << "extern const " << r << "_entry_t " << r << "_registry[];\n"
+     << "extern const uint64_t " << r << "_registry_size;\n\n"
+     << "/* Packed entry point of the kernel registered under key, NULL if\n"
+     << " * there is none. */\n"
+     << "static inline " << r << "_packed_kernel_t " << r
+     << "_lookup(const char* key) {\n"
+     << "  for (uint64_t i = 0; i < " << r << "_registry_size; ++i) {\n"
+     << "    if (strcmp(" << r << "_registry[i].key, key) == 0) {\n"
+     << "      return " << r << "_registry[i].kernel;\n"
+     << "    }\n"
+     << "  }\n"
+     << "  return NULL;\n"
+     << "}\n\n"
+     << "#ifdef __cplusplus\n"
+     << "} /* extern \"C\" */\n"
+     << "#endif\n";
+}
+
+void linkSharedLibrary(
+    const std::string& object,
+    const std::string& sharedLibrary) {
+  // The linker runs without a shell, CC names the compiler driver only.
+  auto cc = std::getenv("CC");
+  auto driver = llvm::sys::findProgramByName(cc ? cc : "cc");
+  if (!driver) {
+    throw std::runtime_error(
+        std::string("Could not find ") + (cc ? cc : "cc") + " to link " +
+        sharedLibrary);
+  }
+  std::vector<std::string> args{
+      *driver, "-shared", "-o", sharedLibrary, object};
+  std::string command;
+  for (const auto& arg : args) {
+    command += " " + arg;
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Linking:" << command;
+  std::string error;
+#if LLVM_VERSION_MAJOR <= 6
+  std::vector<const char*> argv;
+  for (const auto& arg : args) {
+    argv.push_back(arg.c_str());
+  }
+  argv.push_back(nullptr);
+  auto status = llvm::sys::ExecuteAndWait(
+      *driver, argv.data(), nullptr, nullptr, 0, 0, &error);
+#else
+  std::vector<llvm::StringRef> argv(args.begin(), args.end());
+  auto status = llvm::sys::ExecuteAndWait(
+      *driver, argv, llvm::None, {}, 0, 0, &error);
+#endif
+  if (status != 0) {
+    throw std::runtime_error(
+        "Could not link " + sharedLibrary +
+        (error.empty() ? std::string() : ": " + error));
+  }
+}
+} // namespace
+
+std::string makeCpuAotKey(const CpuAotKernel& kernel) {
+  llvm::MD5 hash;
+  auto update = [&hash](const std::string& field) {
+    hash.update(field);
+    hash.update(llvm::StringRef("\0", 1));
+  };
+  update(lang::canonicalTc(detail::parse(kernel.tc).at(kernel.entryPoint)));
+  for (const auto& info : kernel.inputsInfo) {
+    update(info.toProtobuf().SerializeAsString());
+  }
+  update(kernel.options.toProtobufSerializedString());
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return hex.str().str();
+}
+
+std::vector<std::string> exportCpuKernels(
+    const std::vector<CpuAotKernel>& kernels,
+    const std::string& outputPrefix,
+    const std::string& registryName,
+    CpuAotFormat format) {
+  TC_CHECK(isCIdentifier(registryName))
+      << "Invalid registry name " << registryName;
+  polyhedral::initialize_llvm();
+
+  llvm::LLVMContext ctx;
+  auto module = llvm::make_unique<llvm::Module>(registryName, ctx);
+  llvm::Linker linker(*module);
+  std::vector<GeneratedKernel> generated;
+  for (const auto& kernel : kernels) {
+    generated.push_back(generateKernel(kernel, linker, ctx));
+  }
+  addSequentialParallelForFallback(*module);
+  addRegistry(*module, generated, registryName);
+
+  std::vector<std::string> files{outputPrefix + ".o", outputPrefix + ".h"};
+  emitObject(*module, files[0]);
+  emitHeader(generated, registryName, files[1]);
+  if (format == CpuAotFormat::SharedLibrary) {
+    files.push_back(outputPrefix + ".so");
+    linkSharedLibrary(files[0], files.back());
+  }
+  return files;
+}
+} // namespace tc
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/tensor.h"
+
+namespace tc {
+/// A kernel to compile ahead of time: the TC function entryPoint of tc
+/// specialized for inputs described by inputsInfo and mapped with options.
+struct CpuAotKernel {
+  std::string tc;
+  std::string entryPoint;
+  std::vector<TensorInfo> inputsInfo;
+  CpuMappingOptions options;
+  /// Name of the exported C function, defaults to the specialized kernel
+  /// name which only depends on the TC function name and the parameter
+  /// values.
+  std::string name;
+};
+
+/// Returns the key under which a kernel is registered by exportCpuKernels.
+/// It identifies the canonical TC, the input tensor metadata and the mapping
+/// options, it does not depend on the host.
+std::string makeCpuAotKey(const CpuAotKernel& kernel);
+
+enum class CpuAotFormat { Object, SharedLibrary };
+
+/**
+ * Compiles kernels ahead of time for the host CPU so that they can be linked
+ * into programs that depend on neither LLVM, isl nor Halide.
+ * Writes:
+ *   - outputPrefix.o, an object file (position independent) defining, for
+ *     each kernel, a typed C function taking pointers to the inputs then
+ *     outputs, then the values of the symbolic parameters of the options (as
+ *     int64_t, in alphabetical order), its packed entry point (see
+ *     polyhedral::packedKernelName) and a registry of the packed entry
+ *     points indexed by makeCpuAotKey;
+ *   - outputPrefix.so, if format is SharedLibrary, linked from the object by
+ *     the system compiler driver ($CC or cc);
+ *   - outputPrefix.h, a C header declaring the above, where registryName
+ *     prefixes the registry symbols.
+ * Kernels with parallel loops call tc_cpu_parallel_for, the object carries a
+ * weak sequential definition of it so that it is self-contained; a strong
+ * definition linked into the same program, such as the one of the TC CPU
+ * library, takes precedence.
+ * Returns the list of written files.
+ */
+std::vector<std::string> exportCpuKernels(
+    const std::vector<CpuAotKernel>& kernels,
+    const std::string& outputPrefix,
+    const std::string& registryName,
+    CpuAotFormat format = CpuAotFormat::Object);
+} // namespace tc
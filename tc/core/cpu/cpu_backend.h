@@ -20,36 +20,42 @@
 
 #include <glog/logging.h>
 
+#include "tc/core/cpu/cpu_device.h"
 #include "tc/core/cpu/cpu_mapping_options.h"
 #include "tc/core/cpu/cpu_mapping_options_cpp_printer.h"
 #include "tc/core/cpu/cpu_rtc.h"
+#include "tc/core/cpu/cpu_target.h"
 #include "tc/core/halide_utils.h"
 #include "tc/core/tensor.h"
 
 namespace tc {
 /**
- * RAII placement support, modeled on CUDA getDevice / setDevice support in
- * WithCudaDevice.
- * TODO: Impl me (NUMA domain/pinned to core/nothing?)
- */
-struct WithCpuDevice {
-  WithCpuDevice(size_t g) {}
-};
-
-/**
- * Information returned by polyhedral compilation
+ * Information returned by polyhedral compilation. The source is the optimized
+ * textual LLVM IR of the kernel, JIT-compiled by the CpuRTCFunction.
+ * If the CPU object cache is enabled, cacheKey identifies the kernel in the
+ * cache and the source is empty when the object code was found there.
+ * The parameters are the values of the sizes the kernel is specialized for
+ * and symbolicParameters the names of the remaining ones, in the order in
+ * which the kernel takes their values.
  */
 struct CpuCompilationResult {
   std::string source;
   std::string specializedName;
   std::vector<long> parameters;
+  std::string cacheKey;
+  std::vector<std::string> symbolicParameters;
 };
 
 /**
  * Information that can be set at runtime to control placement and
  * synchronization information of a kernel.
+ * The parameters are the values of the symbolic parameters of a parametric
+ * kernel (see CpuTcExecutor::symbolicParameters), they are computed from the
+ * input sizes by CpuTcExecutor::run and must be provided to uncheckedRun.
  */
-struct CpuRuntimeInformation {};
+struct CpuRuntimeInformation {
+  std::vector<long> parameters;
+};
 
 struct CpuTcExecutor;
 
@@ -70,9 +76,9 @@ struct CpuBackend {
   using MappingOptionsAsCpp = CpuMappingOptionsAsCpp;
   using MappingOptionsCppPrinter = CpuMappingOptionsCppPrinter;
 
+  /// The LLVM name of the host CPU model, e.g. "broadwell".
   static inline std::string backendString() {
-    LOG(ERROR) << "NYI: CpuBackend::backendString";
-    return "SOME_CPU";
+    return hostCpuTarget().cpu;
   }
   static inline std::string makeDeviceFilename(const std::string& fn) {
     return fn + ".cpu";
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_device.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "tc/core/check.h"
+#include "tc/core/cpu/cpu_thread_pool.h"
+
+namespace tc {
+namespace {
+// Parses a sep separated list of cores or inclusive core ranges.
+std::vector<int> parseCoreList(const std::string& list, char sep) {
+  std::vector<int> res;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, sep)) {
+    int lo, hi;
+    char dash;
+    std::stringstream rs(range);
+    if (!(rs >> lo)) {
+      throw std::invalid_argument("Invalid core range: " + range);
+    }
+    hi = lo;
+    if (rs >> dash && (dash != '-' || !(rs >> hi))) {
+      throw std::invalid_argument("Invalid core range: " + range);
+    }
+    if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) {
+      throw std::invalid_argument("Invalid core range: " + range);
+    }
+    for (int c = lo; c <= hi; ++c) {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+std::vector<int> numaNodeCores(const std::string& node) {
+  auto path = "/sys/devices/system/node/node" + node + "/cpulist";
+  std::ifstream ifs(path);
+  std::string list;
+  if (!std::getline(ifs, list)) {
+    throw std::invalid_argument("Cannot read the cores of NUMA node " + node);
+  }
+  return parseCoreList(list, ',');
+}
+
+struct Device {
+  std::vector<int> cores;
+  std::mutex mutex;
+  std::unique_ptr<CpuThreadPool> pool;
+  // Process which created the pool.
+  pid_t pid = 0;
+};
+
+std::mutex& devicesMutex() {
+  static std::mutex m;
+  return m;
+}
+
+// Devices are never destroyed so that references to them remain valid.
+std::vector<std::unique_ptr<Device>>& devices() {
+  static std::vector<std::unique_ptr<Device>> d;
+  return d;
+}
+
+Device& device(size_t id) {
+  std::lock_guard<std::mutex> lock(devicesMutex());
+  TC_CHECK_LT(id, devices().size()) << "Unknown CPU device " << id;
+  return *devices()[id];
+}
+} // namespace
+
+std::vector<int> getThreadAffinity() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  auto err = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err != 0) {
+    throw std::runtime_error(
+        std::string("pthread_getaffinity_np: ") + strerror(err));
+  }
+  std::vector<int> res;
+  for (int c = 0; c < CPU_SETSIZE; ++c) {
+    if (CPU_ISSET(c, &set)) {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+void setThreadAffinity(const std::vector<int>& cores) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto c : cores) {
+    TC_CHECK(c >= 0 && c < CPU_SETSIZE) << "Invalid core " << c;
+    CPU_SET(c, &set);
+  }
+  auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err != 0) {
+    throw std::runtime_error(
+        std::string("pthread_setaffinity_np: ") + strerror(err));
+  }
+}
+
+std::vector<std::vector<int>> parseCpuCoreSets(const std::string& devices) {
+  std::vector<std::vector<int>> res;
+  std::set<int> seen;
+  std::stringstream ss(devices);
+  std::string device;
+  while (std::getline(ss, device, ',')) {
+    auto cores = device.compare(0, 4, "numa") == 0
+        ? numaNodeCores(device.substr(4))
+        : parseCoreList(device, '+');
+    std::sort(cores.begin(), cores.end());
+    cores.erase(std::unique(cores.begin(), cores.end()), cores.end());
+    if (cores.empty()) {
+      throw std::invalid_argument("Empty CPU device in " + devices);
+    }
+    for (auto c : cores) {
+      if (!seen.insert(c).second) {
+        throw std::invalid_argument(
+            "Core " + std::to_string(c) + " belongs to several CPU devices");
+      }
+    }
+    res.push_back(cores);
+  }
+  return res;
+}
+
+size_t CpuDevices::add(const std::vector<int>& cores) {
+  TC_CHECK(!cores.empty());
+  std::lock_guard<std::mutex> lock(devicesMutex());
+  auto& d = devices();
+  for (size_t i = 0; i < d.size(); ++i) {
+    if (d[i]->cores == cores) {
+      return i;
+    }
+  }
+  d.emplace_back(new Device());
+  d.back()->cores = cores;
+  return d.size() - 1;
+}
+
+const std::vector<int>& CpuDevices::cores(size_t id) {
+  return device(id).cores;
+}
+
+CpuThreadPool& CpuDevices::pool(size_t id) {
+  auto& d = device(id);
+  std::lock_guard<std::mutex> lock(d.mutex);
+  if (d.pool && d.pid != getpid()) {
+    // The workers of a pool created before a fork do not exist in the child
+    // process, the pool can be neither used nor destroyed.
+    d.pool.release();
+  }
+  if (!d.pool) {
+    d.pool.reset(new CpuThreadPool(d.cores.size(), d.cores));
+    d.pid = getpid();
+  }
+  return *d.pool;
+}
+
+WithCpuDevice::WithCpuDevice(size_t g)
+    : previousAffinity_(getThreadAffinity()) {
+  auto& pool = CpuDevices::pool(g);
+  setThreadAffinity(CpuDevices::cores(g));
+  previousPool_ = CpuThreadPool::setCurrent(&pool);
+}
+
+WithCpuDevice::~WithCpuDevice() {
+  CpuThreadPool::setCurrent(previousPool_);
+  try {
+    setThreadAffinity(previousAffinity_);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Could not restore the thread affinity: " << e.what();
+  }
+}
+} // namespace tc
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace tc {
+class CpuThreadPool;
+
+/// Cores the calling thread may run on.
+std::vector<int> getThreadAffinity();
+
+/// Restricts the calling thread to the given cores, throws on failure.
+void setThreadAffinity(const std::vector<int>& cores);
+
+/// Parses a comma separated list of CPU devices, each of which is either
+///   - numaN, the cores of NUMA node N, or
+///   - a '+' separated list of cores or inclusive core ranges such as
+///     0-3+8-11.
+/// The core sets are returned sorted, they must be non-empty and disjoint.
+std::vector<std::vector<int>> parseCpuCoreSets(const std::string& devices);
+
+/**
+ * Process-wide registry of CPU "devices": disjoint sets of cores which run
+ * kernels independently of each other, e.g. to perform concurrent
+ * measurements during autotuning.
+ *
+ * Each device owns a thread pool with one thread per core, pinned to its
+ * core, that executes the parallel loops of the kernels launched on the
+ * device (see WithCpuDevice).
+ */
+class CpuDevices {
+ public:
+  /// Returns the identifier of the device made of cores, registering it if
+  /// this set of cores was never registered.
+  static size_t add(const std::vector<int>& cores);
+
+  static const std::vector<int>& cores(size_t device);
+  /// Thread pool of the device, lazily created (again in a forked child).
+  static CpuThreadPool& pool(size_t device);
+};
+
+/**
+ * RAII placement support, modeled on CUDA getDevice / setDevice support in
+ * WithCudaDevice.
+ * While in scope, the calling thread is pinned to the cores of the CpuDevices
+ * device g and the parallel loops of the kernels it runs are executed by the
+ * thread pool of that device.  Memory first touched in scope is therefore
+ * allocated on the NUMA node of the device.
+ */
+class WithCpuDevice {
+ public:
+  explicit WithCpuDevice(size_t g);
+  ~WithCpuDevice();
+
+  WithCpuDevice(const WithCpuDevice&) = delete;
+  WithCpuDevice& operator=(const WithCpuDevice&) = delete;
+
+ private:
+  std::vector<int> previousAffinity_;
+  CpuThreadPool* previousPool_;
+};
+} // namespace tc
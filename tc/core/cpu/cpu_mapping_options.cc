@@ -56,7 +56,13 @@ CpuMappingOptions& CpuMappingOptions::operator=(
 }
 
 bool CpuMappingOptions::operator==(const CpuMappingOptions& options) const {
-  return generic == options.generic;
+  return ownedProto_.SerializeAsString() ==
+      options.ownedProto_.SerializeAsString();
+}
+
+bool CpuMappingOptions::operator!=(const CpuMappingOptions& options) const {
+  return ownedProto_.SerializeAsString() !=
+      options.ownedProto_.SerializeAsString();
 }
 
 std::string CpuMappingOptions::toProtobufSerializedString() const {
@@ -69,14 +75,67 @@ CpuMappingOptions& CpuMappingOptions::genericMappingOptions(
   return *this;
 }
 
+CpuMappingOptions& CpuMappingOptions::parallelize(bool b) {
+  ownedProto_.set_parallelize(b);
+  return *this;
+}
+
+CpuMappingOptions& CpuMappingOptions::parallelSchedule(
+    ParallelSchedule schedule) {
+  ownedProto_.set_parallel_schedule(schedule);
+  return *this;
+}
+
+CpuMappingOptions& CpuMappingOptions::parallelChunkSize(uint64_t size) {
+  ownedProto_.set_parallel_chunk_size(size);
+  return *this;
+}
+
+CpuMappingOptions& CpuMappingOptions::vectorize(uint64_t width) {
+  ownedProto_.set_vectorize(width);
+  return *this;
+}
+
+CpuMappingOptions& CpuMappingOptions::target(
+    const std::string& cpu,
+    const std::string& features) {
+  auto target = ownedProto_.mutable_target();
+  target->set_cpu(cpu);
+  target->set_features(features);
+  return *this;
+}
+
+CpuMappingOptions& CpuMappingOptions::addMultiversionTarget(
+    const std::string& cpu,
+    const std::string& features) {
+  auto target = ownedProto_.add_multiversion_targets();
+  target->set_cpu(cpu);
+  target->set_features(features);
+  return *this;
+}
+
+CpuMappingOptions& CpuMappingOptions::symbolicParameters(
+    const std::vector<std::string>& parameters) {
+  ownedProto_.clear_symbolic_parameters();
+  for (const auto& parameter : parameters) {
+    ownedProto_.add_symbolic_parameters(parameter);
+  }
+  return *this;
+}
+
 CpuMappingOptions CpuMappingOptions::makeUnmappedMappingOptions() {
   CpuMappingOptions mo;
-  mo.genericMappingOptions(MappingOptions::makeUnmappedMappingOptions());
+  mo.genericMappingOptions(MappingOptions::makeUnmappedMappingOptions())
+      .parallelize(false)
+      .parallelSchedule(ParallelSchedule::Static);
   return mo;
 }
 
 CpuMappingOptions CpuMappingOptions::makeNaiveMappingOptions() {
-  return makeUnmappedMappingOptions().tile(32, 32, 32).unroll(1);
+  return makeUnmappedMappingOptions()
+      .tile(32, 32, 32)
+      .unroll(1)
+      .parallelize(true);
 }
 
 std::ostream& operator<<(
@@ -43,6 +43,18 @@ class CpuMappingOptions {
 
   /// Set mappings
   CpuMappingOptions& genericMappingOptions(const MappingOptions& options);
+  CpuMappingOptions& parallelize(bool b);
+  CpuMappingOptions& parallelSchedule(ParallelSchedule schedule);
+  CpuMappingOptions& parallelChunkSize(uint64_t size);
+  CpuMappingOptions& vectorize(uint64_t width);
+  CpuMappingOptions& target(
+      const std::string& cpu,
+      const std::string& features = "");
+  CpuMappingOptions& addMultiversionTarget(
+      const std::string& cpu,
+      const std::string& features = "");
+  CpuMappingOptions& symbolicParameters(
+      const std::vector<std::string>& parameters);
 
   /// Static constructors for predefined strategies.
   static CpuMappingOptions makeNaiveMappingOptions();
@@ -18,12 +18,53 @@
 #include <sstream>
 
 namespace tc {
+namespace {
+std::string targetArguments(const CpuTargetProto& target) {
+  std::stringstream ss;
+  ss << "\"" << target.cpu() << "\", \"" << target.features() << "\"";
+  return ss.str();
+}
+
+std::string stringListArgument(
+    const google::protobuf::RepeatedPtrField<std::string>& values) {
+  std::stringstream ss;
+  ss << "{";
+  for (int i = 0; i < values.size(); ++i) {
+    ss << (i > 0 ? ", " : "") << "\"" << values.Get(i) << "\"";
+  }
+  ss << "}";
+  return ss.str();
+}
+} // namespace
 
 CpuMappingOptionsCppPrinter& operator<<(
     CpuMappingOptionsCppPrinter& prn,
     const CpuMappingOptions& options) {
   prn.printString("tc::CpuMappingOptions::makeNaiveMappingOptions()");
   prn.print(options.generic);
+  prn.printBooleanOption("parallelize", options.proto().parallelize());
+  prn.printValueOption(
+      "parallelSchedule",
+      "tc::ParallelSchedule::" +
+          ParallelSchedule_Name(options.proto().parallel_schedule()));
+  if (options.proto().has_parallel_chunk_size()) {
+    prn.printValueOption(
+        "parallelChunkSize", options.proto().parallel_chunk_size());
+  }
+  if (options.proto().has_vectorize()) {
+    prn.printValueOption("vectorize", options.proto().vectorize());
+  }
+  if (options.proto().has_target()) {
+    prn.printValueOption("target", targetArguments(options.proto().target()));
+  }
+  for (const auto& target : options.proto().multiversion_targets()) {
+    prn.printValueOption("addMultiversionTarget", targetArguments(target));
+  }
+  if (options.proto().symbolic_parameters_size() > 0) {
+    prn.printValueOption(
+        "symbolicParameters",
+        stringListArgument(options.proto().symbolic_parameters()));
+  }
   prn.endStmt();
   return prn;
 }
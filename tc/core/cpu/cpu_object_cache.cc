@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_object_cache.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "tc/core/check.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/flags.h"
+#include "tc/version/version.h"
+
+namespace tc {
+namespace {
+constexpr auto kKeyPrefix = "tc_cpu_";
+
+// Name and sorted list of enabled features of the host CPU.
+std::string hostCpuDescription() {
+  std::stringstream ss;
+  ss << llvm::sys::getHostCPUName().str();
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    std::vector<std::string> enabled;
+    for (const auto& f : features) {
+      if (f.getValue()) {
+        enabled.push_back(f.getKey().str());
+      }
+    }
+    std::sort(enabled.begin(), enabled.end());
+    for (const auto& f : enabled) {
+      ss << ",+" << f;
+    }
+  }
+  return ss.str();
+}
+} // namespace
+
+std::string makeCpuKernelKey(
+    const lang::CanonicalTcString& tc,
+    const std::vector<TensorInfo>& inputsInfo,
+    const CpuMappingOptions& options) {
+  static const std::string host = hostCpuDescription();
+
+  // Fields are separated by a character that appears in none of them.
+  llvm::MD5 hash;
+  auto update = [&hash](const std::string& field) {
+    hash.update(field);
+    hash.update(llvm::StringRef("\0", 1));
+  };
+  update(git_version);
+  update(LLVM_VERSION_STRING);
+  update(host);
+  update(tc);
+  for (const auto& info : inputsInfo) {
+    update(info.toProtobuf().SerializeAsString());
+  }
+  update(options.toProtobufSerializedString());
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return kKeyPrefix + hex.str().str();
+}
+
+CpuObjectCache::CpuObjectCache(const std::string& directory)
+    : directory_(directory) {
+  auto err = llvm::sys::fs::create_directories(directory_);
+  TC_CHECK(!err) << "Could not create the CPU object cache directory "
+                 << directory_ << ": " << err.message();
+}
+
+CpuObjectCache* CpuObjectCache::global() {
+  // Caches are never destroyed since JITs may keep pointers to them, one is
+  // created for each value the flag takes.
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<CpuObjectCache>> caches;
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto& directory = FLAGS_cpu_object_cache_dir;
+  if (directory.empty()) {
+    return nullptr;
+  }
+  auto& cache = caches[directory];
+  if (!cache) {
+    cache.reset(new CpuObjectCache(directory));
+  }
+  return cache.get();
+}
+
+bool CpuObjectCache::isKey(const std::string& id) {
+  return id.compare(0, std::string(kKeyPrefix).size(), kKeyPrefix) == 0;
+}
+
+std::string CpuObjectCache::path(
+    const std::string& key,
+    const std::string& ext) const {
+  return directory_ + "/" + key + ext;
+}
+
+void CpuObjectCache::writeAtomically(
+    const std::string& filename,
+    llvm::StringRef contents) {
+  int fd;
+  llvm::SmallString<128> tmp;
+  if (llvm::sys::fs::createUniqueFile(filename + ".%%%%%%.tmp", fd, tmp)) {
+    LOG(WARNING) << "Could not write " << filename;
+    return;
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+    os << contents;
+  }
+  if (llvm::sys::fs::rename(tmp, filename)) {
+    LOG(WARNING) << "Could not write " << filename;
+    llvm::sys::fs::remove(tmp);
+  }
+}
+
+bool CpuObjectCache::lookup(
+    const std::string& key,
+    std::string& specializedName,
+    std::vector<long>& parameters) const {
+  if (!llvm::sys::fs::exists(path(key, ".o"))) {
+    return false;
+  }
+  auto buffer = llvm::MemoryBuffer::getFile(path(key, ".meta"));
+  if (!buffer) {
+    return false;
+  }
+  std::istringstream is((*buffer)->getBuffer().str());
+  size_t numParameters;
+  if (!(is >> specializedName >> numParameters)) {
+    return false;
+  }
+  parameters.resize(numParameters);
+  for (auto& p : parameters) {
+    if (!(is >> p)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CpuObjectCache::store(
+    const std::string& key,
+    const std::string& specializedName,
+    const std::vector<long>& parameters) {
+  std::stringstream ss;
+  ss << specializedName << "\n" << parameters.size();
+  for (auto p : parameters) {
+    ss << " " << p;
+  }
+  ss << "\n";
+  writeAtomically(path(key, ".meta"), ss.str());
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CpuObjectCache::getObject(
+    const std::string& key) {
+  auto buffer = llvm::MemoryBuffer::getFile(path(key, ".o"));
+  if (!buffer) {
+    return nullptr;
+  }
+  return std::move(*buffer);
+}
+
+void CpuObjectCache::notifyObjectCompiled(
+    const llvm::Module* module,
+    llvm::MemoryBufferRef obj) {
+  const auto& key = module->getModuleIdentifier();
+  if (isKey(key)) {
+    writeAtomically(path(key, ".o"), obj.getBuffer());
+  }
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CpuObjectCache::getObject(
+    const llvm::Module* module) {
+  const auto& key = module->getModuleIdentifier();
+  if (!isKey(key)) {
+    return nullptr;
+  }
+  return getObject(key);
+}
+} // namespace tc
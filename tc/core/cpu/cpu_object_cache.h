@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+
+#include "tc/core/tensor.h"
+#include "tc/lang/canonicalize.h"
+
+namespace tc {
+class CpuMappingOptions;
+
+/// Returns the key under which a CPU kernel is stored in the object cache.
+/// It identifies the compiled object code uniquely: the canonical TC, the
+/// input tensor metadata, the mapping options, the host CPU and its features
+/// as well as the TC and LLVM versions all take part in it.
+std::string makeCpuKernelKey(
+    const lang::CanonicalTcString& tc,
+    const std::vector<TensorInfo>& inputsInfo,
+    const CpuMappingOptions& options);
+
+/**
+ * Persistent store of JIT-compiled CPU kernels in a directory, shared by all
+ * the processes pointing to that directory.
+ *
+ * Each kernel is stored as two files named after its key: the object file
+ * produced by the JIT (written through the llvm::ObjectCache interface for
+ * modules whose identifier is a key) and a metadata file holding the
+ * specialized kernel name and parameter values.  Files are written to a
+ * temporary file first and renamed so that concurrent readers never observe
+ * partial entries.
+ */
+class CpuObjectCache : public llvm::ObjectCache {
+ public:
+  explicit CpuObjectCache(const std::string& directory);
+
+  /// Cache in the current FLAGS_cpu_object_cache_dir, nullptr if the flag is
+  /// empty.
+  static CpuObjectCache* global();
+
+  /// Whether the module identifier "id" is a key made by makeCpuKernelKey.
+  static bool isKey(const std::string& id);
+
+  /// Looks up the metadata of the kernel stored under "key".
+  /// Returns false if either the metadata or the object are missing.
+  bool lookup(
+      const std::string& key,
+      std::string& specializedName,
+      std::vector<long>& parameters) const;
+
+  /// Stores the metadata of the kernel under "key", the object is stored
+  /// when the JIT compiles the module with that identifier.
+  void store(
+      const std::string& key,
+      const std::string& specializedName,
+      const std::vector<long>& parameters);
+
+  /// Returns the object stored under "key", nullptr if there is none.
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const std::string& key);
+
+  void notifyObjectCompiled(
+      const llvm::Module* module,
+      llvm::MemoryBufferRef obj) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(
+      const llvm::Module* module) override;
+
+ private:
+  std::string path(const std::string& key, const std::string& ext) const;
+  void writeAtomically(const std::string& filename, llvm::StringRef contents);
+
+  std::string directory_;
+};
+} // namespace tc
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_rtc.h"
+
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "tc/core/check.h"
+#include "tc/core/cpu/cpu_object_cache.h"
+#include "tc/core/flags.h"
+#include "tc/core/polyhedral/codegen_llvm.h"
+#include "tc/core/polyhedral/llvm_jit.h"
+
+namespace tc {
+CpuRTCFunction::CpuRTCFunction() : kernel_(nullptr) {}
+
+CpuRTCFunction::~CpuRTCFunction() {
+  clear();
+}
+
+void CpuRTCFunction::clear() {
+  kernel_ = nullptr;
+  jit_ = nullptr;
+  llvmCtx_ = nullptr;
+}
+
+std::unique_ptr<CpuRTCFunction> CpuRTCFunction::Compile(
+    const std::string& name,
+    const std::string& source,
+    const std::string& cacheKey) {
+  std::unique_ptr<CpuRTCFunction> res(new CpuRTCFunction());
+  res->specializedName = name;
+  res->llvmCtx_ = std::unique_ptr<llvm::LLVMContext>(new llvm::LLVMContext());
+  auto cache = cacheKey.empty() ? nullptr : CpuObjectCache::global();
+  res->jit_ = std::unique_ptr<Jit>(new Jit(cache));
+
+  if (source.empty()) {
+    TC_CHECK(cache) << "No source nor object cache for " << name;
+    auto object = cache->getObject(cacheKey);
+    TC_CHECK(object) << "Kernel " << name << " (" << cacheKey
+                     << ") is missing from the CPU object cache";
+    res->jit_->addObject(std::move(object));
+    res->kernel_ = reinterpret_cast<PackedKernelType>(
+        res->jit_->getSymbolAddress(polyhedral::packedKernelName(name)));
+    return res;
+  }
+
+  if (FLAGS_debug_tc_mapper) {
+    LOG(INFO) << "LLVM JIT function source:\n" << source;
+  }
+
+  llvm::SMDiagnostic err;
+  std::shared_ptr<llvm::Module> module = llvm::parseIR(
+      llvm::MemoryBufferRef(source, name), err, *res->llvmCtx_);
+  if (!module) {
+    std::string diagnostic;
+    llvm::raw_string_ostream rso(diagnostic);
+    err.print(name.c_str(), rso);
+    LOG(ERROR) << "Could not parse LLVM IR: " << rso.str()
+               << " source:" << source;
+    throw std::runtime_error("Could not compile function");
+  }
+  if (!cacheKey.empty()) {
+    module->setModuleIdentifier(cacheKey);
+  }
+
+  res->jit_->addModule(module);
+  res->kernel_ = reinterpret_cast<PackedKernelType>(
+      res->jit_->getSymbolAddress(polyhedral::packedKernelName(name)));
+  return res;
+}
+
+Duration CpuRTCFunction::Launch(
+    const std::vector<long>& params,
+    const std::vector<void*>& outputs,
+    const std::vector<const void*>& inputs,
+    bool profile) const {
+  TC_CHECK(kernel_) << "No kernel attached to " << specializedName;
+  // Arguments are packed on the stack, calling a kernel does not allocate
+  constexpr size_t kNumMaxParameters = 100;
+  std::array<void*, kNumMaxParameters> args;
+  TC_CHECK_GE(
+      kNumMaxParameters, outputs.size() + inputs.size() + params.size());
+  size_t ind = 0;
+  for (auto i : inputs) {
+    args[ind++] = const_cast<void*>(i);
+  }
+  for (auto o : outputs) {
+    args[ind++] = o;
+  }
+  // Scalars are passed by address.
+  for (const auto& p : params) {
+    args[ind++] = const_cast<long*>(&p);
+  }
+
+  if (!profile) {
+    kernel_(args.data());
+    return Duration::max();
+  }
+  auto start = std::chrono::system_clock::now();
+  kernel_(args.data());
+  return Duration::since(start);
+}
+} // namespace tc
@@ -15,15 +15,60 @@
  */
 #pragma once
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tc/core/utils/time.h"
+
+namespace llvm {
+class LLVMContext;
+} // namespace llvm
+
 namespace tc {
-/**
- * This is the class that holds a binary object resulting from compilation.
- * It must provide a clear function and be callable.
- * TODO: Impl me
- */
-struct CpuRTCFunction {
-  void clear() {}
-  template <typename... Args>
-  void operator()(Args&... args) {}
+class Jit;
+
+//
+// Basic interface to expose LLVM JIT compilation of the LLVM IR produced by
+// the CPU backend and synchronous calls to the resulting kernel.
+//
+class CpuRTCFunction {
+  CpuRTCFunction();
+
+ public:
+  ~CpuRTCFunction();
+
+  /// JIT-compiles the textual LLVM IR in "source", which must define the
+  /// packed entry point for the kernel "name" (see
+  /// polyhedral::packedKernelName).
+  /// If cacheKey is not empty and the CPU object cache is enabled, the
+  /// object code is stored in the cache under that key.  An empty source
+  /// loads the object stored under cacheKey instead of compiling.
+  static std::unique_ptr<CpuRTCFunction> Compile(
+      const std::string& name,
+      const std::string& source,
+      const std::string& cacheKey = "");
+
+  /// Calls the kernel synchronously in the current thread. Arguments are
+  /// packed on the stack so no allocation occurs on this path.
+  /// The kernel takes the inputs, the outputs and then the values of its
+  /// symbolic parameters, if any.
+  /// If profile is set it returns the kernel runtime.
+  Duration Launch(
+      const std::vector<long>& params,
+      const std::vector<void*>& outputs,
+      const std::vector<const void*>& inputs,
+      bool profile = false) const;
+
+  void clear();
+
+ private:
+  using PackedKernelType = void (*)(void**);
+
+  // The context must outlive the jit which owns modules living in it
+  std::unique_ptr<llvm::LLVMContext> llvmCtx_;
+  std::unique_ptr<Jit> jit_;
+  PackedKernelType kernel_;
+  std::string specializedName;
 };
 } // namespace tc
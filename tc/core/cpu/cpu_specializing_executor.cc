@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_specializing_executor.h"
+
+#include <chrono>
+#include <exception>
+
+#include <glog/logging.h>
+
+#include "tc/core/check.h"
+#include "tc/core/compiler.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace {
+// Bound on the number of distinct input sizes whose runs are counted, runs
+// of other sizes are served by the parametric kernel.
+constexpr size_t kMaxTrackedShapes = 1024;
+} // namespace
+
+CpuSpecializingExecutor::CpuSpecializingExecutor(
+    const std::string& tc,
+    const std::string& entryPoint,
+    const CpuMappingOptions& options,
+    size_t hotThreshold,
+    size_t maxSpecializations)
+    : tc_(tc),
+      entryPoint_(entryPoint),
+      options_(options),
+      hotThreshold_(hotThreshold),
+      maxSpecializations_(maxSpecializations) {
+  TC_CHECK_GT(options.proto().symbolic_parameters_size(), 0)
+      << "Options without symbolic parameters specialize for all sizes";
+}
+
+CpuSpecializingExecutor::~CpuSpecializingExecutor() {
+  for (auto& kvp : shapes_) {
+    if (kvp.second.pending.valid()) {
+      kvp.second.pending.wait();
+    }
+  }
+}
+
+const CpuTcExecutor& CpuSpecializingExecutor::select(
+    const std::vector<const DLConstTensor*>& inputs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!parametric_) {
+    parametric_ = compile<CpuBackend>(tc_, entryPoint_, inputs, options_);
+  }
+
+  Shapes shapes;
+  for (auto t : inputs) {
+    std::vector<int64_t> shape(t->shape, t->shape + t->ndim);
+    shapes.push_back(shape);
+    shapes.push_back(normalizeStrides(
+        shape,
+        std::vector<int64_t>(
+            t->strides, t->strides ? t->strides + t->ndim : nullptr)));
+  }
+  auto it = shapes_.find(shapes);
+  if (it == shapes_.end()) {
+    if (shapes_.size() >= kMaxTrackedShapes) {
+      return *parametric_;
+    }
+    it = shapes_.emplace(shapes, ShapeEntry()).first;
+  }
+  auto& entry = it->second;
+  if (entry.executor) {
+    return *entry.executor;
+  }
+  if (entry.failed) {
+    return *parametric_;
+  }
+
+  if (entry.pending.valid()) {
+    if (entry.pending.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready) {
+      return *parametric_;
+    }
+    try {
+      entry.executor = entry.pending.get();
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << "Switching to a specialized kernel of " << entryPoint_;
+      return *entry.executor;
+    } catch (const std::exception& e) {
+      // Keep using the parametric kernel for these sizes.
+      entry.failed = true;
+      LOG(WARNING) << "Could not specialize " << entryPoint_ << ": "
+                   << e.what();
+      return *parametric_;
+    }
+  }
+
+  if (++entry.runs >= hotThreshold_ &&
+      numStartedSpecializations_ < maxSpecializations_) {
+    ++numStartedSpecializations_;
+    auto options = options_;
+    options.symbolicParameters({});
+    auto inputsInfo = makeTensorInfoVector(inputs);
+    auto tc = tc_;
+    auto entryPoint = entryPoint_;
+    entry.pending = std::async(
+        std::launch::async, [tc, entryPoint, options, inputsInfo]() {
+          auto tensors = makeDLConstTensorVector(inputsInfo);
+          return compile<CpuBackend>(
+              tc, entryPoint, extractRawPtrs(tensors), options);
+        });
+  }
+  return *parametric_;
+}
+
+void CpuSpecializingExecutor::run(
+    const std::vector<const DLConstTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) {
+  // Executors are never destroyed before this object, they can be run
+  // concurrently outside the lock.
+  select(inputs).run(inputs, outputs);
+}
+
+size_t CpuSpecializingExecutor::numSpecializations() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t res = 0;
+  for (const auto& kvp : shapes_) {
+    if (kvp.second.executor) {
+      ++res;
+    }
+  }
+  return res;
+}
+} // namespace tc
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/tensor.h"
+
+namespace tc {
+/**
+ * Runs a TC function on inputs whose sizes vary from one run to the next
+ * without paying for a compilation at each new size.
+ *
+ * All the runs are first served by a single parametric kernel, compiled on
+ * the first run, which keeps the sizes listed in the symbolic parameters of
+ * the options symbolic.  Once the same input sizes have been run hotThreshold
+ * times, a kernel fully specialized for them is compiled in the background
+ * with the same options minus the symbolic parameters.  The parametric kernel
+ * keeps serving these sizes until the specialized kernel is ready.  At most
+ * maxSpecializations specialized kernels are compiled.
+ *
+ * Inputs must be contiguous.  The caller allocates outputs of the sizes
+ * inferred from the inputs, e.g. with tc::aten::prepareOutputs.
+ * run may be called concurrently.
+ */
+class CpuSpecializingExecutor {
+ public:
+  CpuSpecializingExecutor(
+      const std::string& tc,
+      const std::string& entryPoint,
+      const CpuMappingOptions& options,
+      size_t hotThreshold = 16,
+      size_t maxSpecializations = 8);
+
+  /// Waits for the compilations in flight.
+  ~CpuSpecializingExecutor();
+
+  void run(
+      const std::vector<const DLConstTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs);
+
+  /// Number of specialized kernels ready to run.
+  size_t numSpecializations() const;
+
+ private:
+  // Sizes and strides of the inputs of a run.
+  using Shapes = std::vector<std::vector<int64_t>>;
+
+  struct ShapeEntry {
+    size_t runs = 0;
+    bool failed = false;
+    std::future<std::unique_ptr<CpuTcExecutor>> pending;
+    std::unique_ptr<CpuTcExecutor> executor;
+  };
+
+  // The executor to run inputs with, compiling or collecting specialized
+  // kernels as needed.
+  const CpuTcExecutor& select(const std::vector<const DLConstTensor*>& inputs);
+
+  const std::string tc_;
+  const std::string entryPoint_;
+  const CpuMappingOptions options_;
+  const size_t hotThreshold_;
+  const size_t maxSpecializations_;
+
+  mutable std::mutex mutex_;
+  std::unique_ptr<CpuTcExecutor> parametric_;
+  std::map<Shapes, ShapeEntry> shapes_;
+  size_t numStartedSpecializations_ = 0;
+};
+} // namespace tc
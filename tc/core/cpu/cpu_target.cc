@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_target.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/Host.h"
+
+#include "tc/core/check.h"
+
+namespace tc {
+namespace {
+constexpr uint32_t kEBX = 1;
+constexpr uint32_t kECX = 2;
+constexpr uint32_t kEDX = 3;
+// SSE and AVX state, AVX-512 additionally needs the opmask and ZMM state.
+constexpr uint32_t kXcr0Avx = 0x6;
+constexpr uint32_t kXcr0Avx512 = 0xe6;
+
+// Intel SDM, Vol. 2A, CPUID: feature information (leaf 1) and structured
+// extended feature flags (leaf 7).
+const CpuidFeature kCpuidFeatures[] = {
+    {"sse2", 1, kEDX, 26, 0},
+    {"sse3", 1, kECX, 0, 0},
+    {"ssse3", 1, kECX, 9, 0},
+    {"sse4.1", 1, kECX, 19, 0},
+    {"sse4.2", 1, kECX, 20, 0},
+    {"popcnt", 1, kECX, 23, 0},
+    {"avx", 1, kECX, 28, kXcr0Avx},
+    {"f16c", 1, kECX, 29, kXcr0Avx},
+    {"fma", 1, kECX, 12, kXcr0Avx},
+    {"bmi", 7, kEBX, 3, 0},
+    {"avx2", 7, kEBX, 5, kXcr0Avx},
+    {"bmi2", 7, kEBX, 8, 0},
+    {"avx512f", 7, kEBX, 16, kXcr0Avx512},
+    {"avx512dq", 7, kEBX, 17, kXcr0Avx512},
+    {"avx512ifma", 7, kEBX, 21, kXcr0Avx512},
+    {"avx512cd", 7, kEBX, 28, kXcr0Avx512},
+    {"avx512bw", 7, kEBX, 30, kXcr0Avx512},
+    {"avx512vl", 7, kEBX, 31, kXcr0Avx512},
+    {"avx512vbmi", 7, kECX, 1, kXcr0Avx512},
+    {"avx512vnni", 7, kECX, 11, kXcr0Avx512},
+};
+
+CpuTarget detectHostCpuTarget() {
+  CpuTarget host{llvm::sys::getHostCPUName().str(), ""};
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    // Sort for the features string to be stable across runs as it is part
+    // of cache keys.
+    std::vector<std::string> names;
+    for (const auto& feature : features) {
+      names.push_back(
+          (feature.getValue() ? "+" : "-") + feature.getKey().str());
+    }
+    std::sort(names.begin(), names.end());
+    for (const auto& name : names) {
+      host.features += (host.features.empty() ? "" : ",") + name;
+    }
+  }
+  return host;
+}
+
+CpuTarget fromProto(const CpuTargetProto& proto) {
+  return CpuTarget{proto.cpu(), proto.features()};
+}
+} // namespace
+
+const CpuTarget& hostCpuTarget() {
+  static const CpuTarget host = detectHostCpuTarget();
+  return host;
+}
+
+std::vector<CpuTarget> cpuTargets(const CpuMappingOptions& options) {
+  std::vector<CpuTarget> targets;
+  for (const auto& target : options.proto().multiversion_targets()) {
+    targets.push_back(fromProto(target));
+  }
+  targets.push_back(
+      options.proto().has_target() ? fromProto(options.proto().target())
+                                   : hostCpuTarget());
+  return targets;
+}
+
+std::unique_ptr<llvm::TargetMachine> makeTargetMachine(
+    const CpuTarget& target,
+    bool pic) {
+  llvm::SmallVector<llvm::StringRef, 32> features;
+  llvm::StringRef(target.features).split(features, ",", -1, false);
+  llvm::EngineBuilder builder;
+  builder.setMCPU(target.cpu);
+  builder.setMAttrs(
+      std::vector<std::string>(features.begin(), features.end()));
+  if (pic) {
+    builder.setRelocationModel(llvm::Reloc::PIC_);
+  }
+  std::unique_ptr<llvm::TargetMachine> targetMachine(builder.selectTarget());
+  TC_CHECK(targetMachine) << "Could not create a target machine for "
+                          << target.cpu << " (" << target.features << ")";
+  return targetMachine;
+}
+
+std::vector<CpuidFeature> cpuidFeatures(const CpuTarget& target) {
+  auto targetMachine = makeTargetMachine(target);
+  const auto* subtarget = targetMachine->getMCSubtargetInfo();
+  std::vector<CpuidFeature> res;
+  for (const auto& feature : kCpuidFeatures) {
+    if (subtarget->checkFeatures(std::string("+") + feature.name)) {
+      res.push_back(feature);
+    }
+  }
+  return res;
+}
+} // namespace tc
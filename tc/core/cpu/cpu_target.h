@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/Target/TargetMachine.h"
+
+#include "tc/core/cpu/cpu_mapping_options.h"
+
+namespace tc {
+/// A CPU for which kernels are generated, in LLVM terms: a CPU model and the
+/// target features added to or removed from those of the model.
+struct CpuTarget {
+  std::string cpu;
+  std::string features;
+};
+
+/// The host CPU with all the features it supports.
+const CpuTarget& hostCpuTarget();
+
+/// Targets for which a version of the kernels mapped with options is
+/// generated, in dispatch order: the multiversion targets followed by the
+/// target, the host if not provided.
+std::vector<CpuTarget> cpuTargets(const CpuMappingOptions& options);
+
+/// Target machine generating code for target on the host OS, with position
+/// independent code if pic is set.
+std::unique_ptr<llvm::TargetMachine> makeTargetMachine(
+    const CpuTarget& target,
+    bool pic = false);
+
+/// An x86 instruction set extension whose support by the running CPU can be
+/// tested with the CPUID instruction.
+struct CpuidFeature {
+  /// Name of the LLVM target feature.
+  const char* name;
+  /// Leaf (EAX input, the subleaf is 0) whose output holds the flag.
+  uint32_t leaf;
+  /// Output register holding the flag, 0 to 3 for EAX, EBX, ECX and EDX.
+  uint32_t reg;
+  uint32_t bit;
+  /// Bits of XCR0 the OS must set for the extension to be usable, i.e. for
+  /// the registers it uses to be saved on context switches.
+  uint32_t xcr0Mask;
+};
+
+/// The extensions that code generated for target may use, among those
+/// known to the runtime dispatcher of multiversioned kernels.
+std::vector<CpuidFeature> cpuidFeatures(const CpuTarget& target);
+} // namespace tc
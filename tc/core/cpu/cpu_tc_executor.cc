@@ -15,16 +15,93 @@
  */
 #include "tc/core/cpu/cpu_tc_executor.h"
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <tuple>
+
+#include "tc/core/check.h"
+#include "tc/core/compilation_stage_cache.h"
+#include "tc/core/compiler.h"
 #include "tc/core/cpu/cpu_mapping_options.h"
 #include "tc/core/cpu/cpu_mapping_options_cpp_printer.h"
+#include "tc/core/cpu/cpu_object_cache.h"
+#include "tc/core/flags.h"
 #include "tc/core/halide_utils.h"
+#include "tc/core/polyhedral/codegen_llvm.h"
+#include "tc/core/polyhedral/scop.h"
 #include "tc/core/tc2halide.h"
 #include "tc/core/tensor.h"
+#include "tc/lang/canonicalize.h"
 #include "tc/lang/parser.h"
 #include "tc/lang/sema.h"
 #include "version.h"
 
 namespace tc {
+namespace {
+// Names of the parameters of the TC that the options keep symbolic, in
+// alphabetical order as expected by the kernel.
+std::vector<std::string> getSymbolicParameters(
+    const tc2halide::HalideComponents& halideComponents,
+    const CpuMappingOptions& options) {
+  std::vector<std::string> names(
+      options.proto().symbolic_parameters().begin(),
+      options.proto().symbolic_parameters().end());
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  for (const auto& name : names) {
+    TC_CHECK_EQ(halideComponents.params.count(name), 1u)
+        << "Symbolic parameter " << name << " is not a parameter of "
+        << halideComponents.getDef().name().name();
+  }
+  return names;
+}
+
+// Append ordered values to the kernel name, separated by "_".
+template <typename T>
+std::string specializeKernelName(
+    const std::string& tcName,
+    std::vector<T> params) {
+  std::stringstream ss;
+  ss << tcName;
+  for (auto i : params) {
+    ss << "_" << i;
+  }
+  return ss.str();
+}
+
+// Tile the scheduled scop according to the generic part of the CPU mapping
+// options. This follows the same steps as the CUDA mapper minus the mapping
+// to blocks and threads, steps 1a and 2 are memoized by
+// CompilationStageCache::makeScheduledScop.
+std::unique_ptr<polyhedral::Scop> tileScheduledScop(
+    std::unique_ptr<polyhedral::Scop>&& scop,
+    const CpuMappingOptions& options) {
+  using namespace polyhedral;
+  const auto& generic = options.generic;
+
+  // 3. Tile, an empty tiling vector leaves the schedule untouched
+  if (generic.tiling.size() > 0) {
+    auto outerBand = scop->tileOuterBand(generic.tiling);
+
+    // 4. Optionally reschedule if point loops need a different strategy than
+    // tile loops
+    if (generic.outerScheduleOptions != generic.intraTileScheduleOptions) {
+      scop->reschedule(outerBand->child({0}), generic.intraTileScheduleOptions);
+    }
+  }
+
+  // 1b. ...or after rescheduling
+  if (!generic.proto.fix_parameters_before_scheduling()) {
+    scop->specializeToContext();
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Scheduled schedule:" << std::endl
+                                      << *(scop->scheduleRoot());
+  return std::move(scop);
+}
+} // namespace
+
 CpuTcExecutor::CpuTcExecutor(
     const std::vector<TensorInfo>& inputsInfo,
     const std::vector<TensorInfo>& outputsInfo,
@@ -34,8 +111,31 @@ CpuTcExecutor::CpuTcExecutor(
           inputsInfo,
           outputsInfo,
           halideComponents,
-          compilationResult) {
-  LOG(ERROR) << "NYI: CpuTcExecutor::CpuTcExecutor setup RTC";
+          compilationResult),
+      symbolicParameters_(compilationResult.symbolicParameters) {
+  if (!symbolicParameters_.empty()) {
+    // Remember the sizes the kernel is specialized for to check them at
+    // each run.
+    auto tensors = makeDLConstTensorVector(inputsInfo);
+    fixedParameters_ =
+        computeParamValueMap(halideComponents, extractRawPtrs(tensors));
+    for (const auto& name : symbolicParameters_) {
+      fixedParameters_.erase(name);
+    }
+  }
+  auto t0 = std::chrono::high_resolution_clock::now();
+  // force unloading in case we JIT with the same name/input/outputs with
+  // different options.
+  this->clearRuntimeCompiledFunction();
+  rtcFun_ = CpuRTCFunction::Compile(
+      compilationResult.specializedName,
+      compilationResult.source,
+      compilationResult.cacheKey);
+  auto t1 = std::chrono::high_resolution_clock::now();
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "[COMPILE] Compiling with host JIT compiler took: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+      << "ms" << std::endl;
 }
 
 CpuCompilationResult CpuBackend::compileWithTcMapper(
@@ -44,23 +144,176 @@ CpuCompilationResult CpuBackend::compileWithTcMapper(
     const std::vector<const DLConstTensor*>& inputs,
     /* TODO: in the future also pass outputs for stride and alignment info */
     const CpuMappingOptions& options) {
-  LOG(ERROR) << "NYI: CpuBackend::compileWithTcMapper";
-  return CpuCompilationResult{std::string("source"),
-                              std::string("specializedName"),
-                              std::vector<long>()};
+  polyhedral::initialize_llvm();
+
+  // Skip code generation altogether if the object code is already cached.
+  std::string cacheKey;
+  if (auto cache = CpuObjectCache::global()) {
+    cacheKey = makeCpuKernelKey(
+        lang::canonicalCheckedTc(halideComponents.def),
+        makeTensorInfoVector(inputs),
+        options);
+    CpuCompilationResult cached{
+        "",
+        "",
+        {},
+        cacheKey,
+        getSymbolicParameters(halideComponents, options)};
+    if (cache->lookup(cacheKey, cached.specializedName, cached.parameters)) {
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << "Found " << cached.specializedName << " in the object cache";
+      return cached;
+    }
+  }
+
+  auto result = emitCpuKernel(tcName, halideComponents, inputs, options);
+  if (!cacheKey.empty()) {
+    CpuObjectCache::global()->store(
+        cacheKey, result.specializedName, result.parameters);
+  }
+  result.cacheKey = cacheKey;
+  return result;
+}
+
+CpuCompilationResult emitCpuKernel(
+    const std::string& tcName,
+    const tc2halide::HalideComponents& halideComponents,
+    const std::vector<const DLConstTensor*>& inputs,
+    const CpuMappingOptions& options) {
+  polyhedral::initialize_llvm();
+
+  auto symbolicParameters = getSymbolicParameters(halideComponents, options);
+  auto pvm = computeParamValueMap(halideComponents, inputs);
+  for (const auto& name : symbolicParameters) {
+    pvm.erase(name);
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << options;
+  auto scop = CompilationStageCache::forThisThread().makeScheduledScop(
+      halideComponents, pvm, options.generic);
+  scop->tensorStrides = computeNonContiguousStrides(halideComponents, inputs);
+  TC_CHECK(symbolicParameters.empty() || scop->tensorStrides.empty())
+      << "Kernels with symbolic parameters require contiguous inputs";
+
+  scop = tileScheduledScop(std::move(scop), options);
+
+  // Symbolic parameters appear by name in the kernel name.
+  std::vector<long> parameters;
+  std::vector<std::string> nameComponents;
+  for (const auto& param : scop->halide.params) {
+    auto value = scop->parameterValues.find(param.name());
+    if (value == scop->parameterValues.end()) {
+      nameComponents.push_back(param.name());
+    } else {
+      parameters.push_back(value->second);
+      nameComponents.push_back(std::to_string(value->second));
+    }
+  }
+  auto specializedName = specializeKernelName(tcName, nameComponents);
+
+  auto module = polyhedral::emitLLVMKernel(specializedName, *scop, options);
+  auto source = toString(module.get());
+  LOG_IF(INFO, FLAGS_llvm_dump_after_opt) << "generatedLLVMIR: " << source;
+
+  return CpuCompilationResult{
+      source, specializedName, parameters, "", symbolicParameters};
+}
+
+std::pair<std::vector<const void*>, std::vector<void*>>
+CpuTcExecutor::prepareParametricRun(
+    const std::vector<const DLConstTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    typename CpuBackend::RuntimeInformation& info) const {
+  detail::checkInputsCompliant(halideComponents_, inputs);
+  auto pvm = computeParamValueMap(halideComponents_, inputs);
+  for (const auto& kvp : fixedParameters_) {
+    if (pvm.at(kvp.first) != kvp.second) {
+      throw lang::ErrorReport(halideComponents_.getDef())
+          << "expected " << kvp.second << " for size " << kvp.first
+          << " but found " << pvm.at(kvp.first);
+    }
+  }
+  info.parameters.clear();
+  for (const auto& name : symbolicParameters_) {
+    info.parameters.push_back(pvm.at(name));
+  }
+
+  // The kernel handles contiguous tensors of any size compatible with the
+  // fixed parameters.
+  std::vector<TensorInfo> inputsInfo;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::vector<int64_t> shape(
+        inputs[i]->shape, inputs[i]->shape + inputs[i]->ndim);
+    inputsInfo.emplace_back(
+        inputsInfo_.at(i).dtype,
+        inputsInfo_.at(i).alignment,
+        shape,
+        makeStridesFromSizes(shape));
+  }
+  return detail::prepareRun(
+      inputs,
+      outputs,
+      inputsInfo,
+      inferOutputTensorInfo(halideComponents_, inputs),
+      halideComponents_);
+}
+
+void CpuTcExecutor::run(
+    const std::vector<const DLConstTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    typename CpuBackend::RuntimeInformation info) const {
+  if (symbolicParameters_.empty()) {
+    TcExecutor<CpuBackend>::run(inputs, outputs, info);
+    return;
+  }
+  std::vector<const void*> rawInputs;
+  std::vector<void*> rawOutputs;
+  std::tie(rawInputs, rawOutputs) =
+      prepareParametricRun(inputs, outputs, info);
+  uncheckedRun(rawInputs, rawOutputs, info);
+}
+
+ProfilingInfo CpuTcExecutor::profile(
+    const std::vector<const DLConstTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) const {
+  if (symbolicParameters_.empty()) {
+    return TcExecutor<CpuBackend>::profile(inputs, outputs);
+  }
+  auto start = std::chrono::system_clock::now();
+  CpuBackend::RuntimeInformation info;
+  std::vector<const void*> rawInputs;
+  std::vector<void*> rawOutputs;
+  std::tie(rawInputs, rawOutputs) =
+      prepareParametricRun(inputs, outputs, info);
+  ProfilingInfo pi(profileUnchecked(rawInputs, rawOutputs, info));
+  // The total CPU overhead is the total time minus the kernel runtime
+  Duration cpuOverhead(Duration::since(start));
+  cpuOverhead = cpuOverhead - pi.kernelRuntime;
+  return ProfilingInfo{cpuOverhead, pi.kernelRuntime};
 }
 
 void CpuTcExecutor::uncheckedRun(
     const std::vector<const void*>& inputs,
     const std::vector<void*>& outputs,
     typename CpuBackend::RuntimeInformation info) const {
-  LOG(ERROR) << "NYI: CpuTcExecutor::uncheckedRun";
+  TC_CHECK(rtcFun_) << "No rtcFun_ attached, cannot launch";
+  TC_CHECK_EQ(info.parameters.size(), symbolicParameters_.size())
+      << "Wrong number of symbolic parameter values";
+  rtcFun_->Launch(info.parameters, outputs, inputs);
 }
 
 ProfilingInfo CpuTcExecutor::profileUnchecked(
     const std::vector<const void*>& inputs,
-    const std::vector<void*>& outputs) const {
-  LOG(ERROR) << "NYI: CpuTcExecutor::profileUnchecked";
-  return ProfilingInfo{Duration::max(), Duration::max()};
+    const std::vector<void*>& outputs,
+    typename CpuBackend::RuntimeInformation info) const {
+  auto start = std::chrono::system_clock::now();
+  TC_CHECK(rtcFun_) << "No rtcFun_ attached, cannot launch";
+  TC_CHECK_EQ(info.parameters.size(), symbolicParameters_.size())
+      << "Wrong number of symbolic parameter values";
+  Duration kernelRuntime(
+      rtcFun_->Launch(info.parameters, outputs, inputs, true));
+  // The CPU overhead is the total time minus the kernel runtime
+  Duration cpuOverhead(Duration::since(start));
+  cpuOverhead = cpuOverhead - kernelRuntime;
+  return ProfilingInfo{cpuOverhead, kernelRuntime};
 }
 } // namespace tc
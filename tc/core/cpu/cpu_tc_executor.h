@@ -16,6 +16,8 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "tc/core/cpu/cpu_backend.h"
@@ -32,21 +34,70 @@ class CpuTcExecutor : public TcExecutor<CpuBackend> {
       const tc2halide::HalideComponents& halideComponents,
       const typename CpuBackend::CompilationResultType& compilationResult);
 
+  /// Same as TcExecutor::run and TcExecutor::profile for kernels without
+  /// symbolic parameters.  Parametric kernels accept contiguous tensors of
+  /// any size consistent with the sizes they are specialized for and the
+  /// values of their symbolic parameters are computed from the input sizes,
+  /// the output sizes are checked against the ones inferred from the inputs.
+  ///@{
+  void run(
+      const std::vector<const DLConstTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      typename CpuBackend::RuntimeInformation info = {}) const;
+
+  ProfilingInfo profile(
+      const std::vector<const DLConstTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs) const;
+  ///@}
+
   /// This is the "low-latency" mode in which we just propagate raw pointers to
   /// data in the address space where kernel is executed.
   /// No tensor-related information can be checked so it is the user's
   /// responsibility to ensure that shapes and strides match. If the user
   /// doesn't then segfault will likely occur.
+  /// The kernel runs synchronously in the calling thread and this call does
+  /// not allocate.
+  /// The values of the symbolic parameters of a parametric kernel must be
+  /// provided in info.parameters.
   void uncheckedRun(
       const std::vector<const void*>& inputs,
       const std::vector<void*>& outputs,
-      typename CpuBackend::RuntimeInformation info) const;
+      typename CpuBackend::RuntimeInformation info =
+          CpuBackend::RuntimeInformation()) const;
 
   /// Calls uncheckedRun and profiles the cpu overhead and kernel runtime
   /// (microseconds).
   /// \returns profiling information
   ProfilingInfo profileUnchecked(
       const std::vector<const void*>& inputs,
-      const std::vector<void*>& outputs) const;
+      const std::vector<void*>& outputs,
+      typename CpuBackend::RuntimeInformation info =
+          CpuBackend::RuntimeInformation()) const;
+
+  /// Names of the sizes the kernel is not specialized for, in the order in
+  /// which their values are passed in CpuRuntimeInformation::parameters.
+  const std::vector<std::string>& symbolicParameters() const {
+    return symbolicParameters_;
+  }
+
+ private:
+  /// Checks the tensors passed to a parametric kernel and computes the values
+  /// of its symbolic parameters into info.
+  std::pair<std::vector<const void*>, std::vector<void*>> prepareParametricRun(
+      const std::vector<const DLConstTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      typename CpuBackend::RuntimeInformation& info) const;
+
+  std::vector<std::string> symbolicParameters_;
+  std::unordered_map<std::string, int> fixedParameters_;
 };
+
+/// Maps and generates the optimized LLVM IR of a kernel, bypassing the CPU
+/// object cache which CpuBackend::compileWithTcMapper consults first.
+/// The resulting cacheKey is empty.
+CpuCompilationResult emitCpuKernel(
+    const std::string& tcName,
+    const tc2halide::HalideComponents& halideComponents,
+    const std::vector<const DLConstTensor*>& inputs,
+    const CpuMappingOptions& options);
 } // namespace tc
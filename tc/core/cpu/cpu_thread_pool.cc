@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_thread_pool.h"
+
+#include <algorithm>
+
+#include "tc/core/check.h"
+#include "tc/core/cpu/cpu_device.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace detail {
+/// A parallel loop being executed, lives on the stack of the thread calling
+/// parallelFor which waits until all participants have completed.
+/// Iterations are normalized to [0, numIterations).
+struct ParallelRegion {
+  ParallelLoopBody body;
+  void* closure;
+  int64_t begin;
+  int64_t step;
+  int64_t numIterations;
+  ParallelSchedule schedule;
+  int64_t chunkSize;
+  size_t numParticipants;
+  std::atomic<int64_t> next;
+  std::atomic<size_t> pending;
+
+  void runRange(int64_t lo, int64_t hi) const {
+    body(begin + lo * step, begin + hi * step, closure);
+  }
+
+  void run(size_t participant) {
+    auto P = static_cast<int64_t>(numParticipants);
+    auto p = static_cast<int64_t>(participant);
+    if (schedule == ParallelSchedule::Static) {
+      if (chunkSize <= 0) {
+        int64_t lo = numIterations * p / P;
+        int64_t hi = numIterations * (p + 1) / P;
+        if (lo < hi) {
+          runRange(lo, hi);
+        }
+      } else {
+        for (int64_t lo = p * chunkSize; lo < numIterations;
+             lo += P * chunkSize) {
+          runRange(lo, std::min(lo + chunkSize, numIterations));
+        }
+      }
+    } else if (schedule == ParallelSchedule::Dynamic) {
+      auto chunk = std::max<int64_t>(chunkSize, 1);
+      for (int64_t lo = next.fetch_add(chunk); lo < numIterations;
+           lo = next.fetch_add(chunk)) {
+        runRange(lo, std::min(lo + chunk, numIterations));
+      }
+    } else {
+      auto minChunk = std::max<int64_t>(chunkSize, 1);
+      int64_t lo = next.load();
+      while (lo < numIterations) {
+        auto chunk = std::max((numIterations - lo) / P, minChunk);
+        auto hi = std::min(lo + chunk, numIterations);
+        if (next.compare_exchange_weak(lo, hi)) {
+          runRange(lo, hi);
+          lo = next.load();
+        }
+      }
+    }
+    // The region may be destroyed by its owner as soon as pending reaches 0,
+    // nothing must access it past this point.
+    pending.fetch_sub(1);
+  }
+};
+} // namespace detail
+
+namespace {
+thread_local CpuThreadPool* currentPool = nullptr;
+} // namespace
+
+CpuThreadPool::CpuThreadPool(size_t numThreads, std::vector<int> cores)
+    : nextQueue_(0), numPendingTasks_(0), stop_(false) {
+  TC_CHECK_GE(numThreads, 1u);
+  for (size_t i = 0; i + 1 < numThreads; ++i) {
+    queues_.emplace_back(new Worker());
+  }
+  for (size_t i = 0; i + 1 < numThreads; ++i) {
+    workers_.emplace_back([this, i, cores]() {
+      if (!cores.empty()) {
+        setThreadAffinity({cores[(i + 1) % cores.size()]});
+      }
+      workerLoop(i);
+    });
+  }
+}
+
+CpuThreadPool::~CpuThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    stop_ = true;
+  }
+  sleepCv_.notify_all();
+  for (auto& w : workers_) {
+    w.join();
+  }
+}
+
+CpuThreadPool& CpuThreadPool::global() {
+  static CpuThreadPool pool(
+      FLAGS_cpu_threads > 0
+          ? FLAGS_cpu_threads
+          : std::max(std::thread::hardware_concurrency(), 1u));
+  return pool;
+}
+
+CpuThreadPool& CpuThreadPool::current() {
+  return currentPool ? *currentPool : global();
+}
+
+CpuThreadPool* CpuThreadPool::setCurrent(CpuThreadPool* pool) {
+  auto previous = currentPool;
+  currentPool = pool;
+  return previous;
+}
+
+bool CpuThreadPool::tryPop(size_t id, Task& task) {
+  auto& q = *queues_[id];
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.tasks.empty()) {
+    return false;
+  }
+  task = q.tasks.front();
+  q.tasks.pop_front();
+  numPendingTasks_.fetch_sub(1);
+  return true;
+}
+
+bool CpuThreadPool::trySteal(size_t thief, Task& task) {
+  for (size_t i = 1; i <= queues_.size(); ++i) {
+    auto& q = *queues_[(thief + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+      continue;
+    }
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    numPendingTasks_.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+void CpuThreadPool::workerLoop(size_t id) {
+  Task task;
+  while (true) {
+    if (tryPop(id, task) || trySteal(id, task)) {
+      task.region->run(task.participant);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    sleepCv_.wait(
+        lock, [this]() { return stop_ || numPendingTasks_.load() > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+void CpuThreadPool::parallelFor(
+    ParallelLoopBody body,
+    void* closure,
+    int64_t begin,
+    int64_t end,
+    int64_t step,
+    ParallelSchedule schedule,
+    int64_t chunkSize) {
+  TC_CHECK_GT(step, 0);
+  if (end <= begin) {
+    return;
+  }
+  auto numIterations = (end - begin + step - 1) / step;
+  auto numParticipants = std::min<size_t>(numThreads(), numIterations);
+  if (numParticipants == 1) {
+    body(begin, end, closure);
+    return;
+  }
+
+  detail::ParallelRegion region;
+  region.body = body;
+  region.closure = closure;
+  region.begin = begin;
+  region.step = step;
+  region.numIterations = numIterations;
+  region.schedule = schedule;
+  region.chunkSize = chunkSize;
+  region.numParticipants = numParticipants;
+  region.next = 0;
+  region.pending = numParticipants;
+
+  // Participant 0 is the calling thread, spread the others over the worker
+  // queues starting from a rotating position to balance concurrent callers.
+  auto first = nextQueue_.fetch_add(numParticipants - 1);
+  for (size_t p = 1; p < numParticipants; ++p) {
+    auto& q = *queues_[(first + p) % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.push_back(Task{&region, p});
+    numPendingTasks_.fetch_add(1);
+  }
+  {
+    // Synchronize with workers checking numPendingTasks_ before sleeping.
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+  }
+  sleepCv_.notify_all();
+
+  region.run(0);
+  // Help with whatever is pending (including tasks of other regions) until
+  // every participant of this region has completed.
+  Task task;
+  auto id = first % queues_.size();
+  while (region.pending.load() > 0) {
+    if (trySteal(id, task)) {
+      task.region->run(task.participant);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+} // namespace tc
+
+extern "C" void tc_cpu_parallel_for(
+    tc::ParallelLoopBody body,
+    void* closure,
+    int64_t begin,
+    int64_t end,
+    int64_t step,
+    int32_t schedule,
+    int64_t chunkSize) {
+  tc::CpuThreadPool::current().parallelFor(
+      body,
+      closure,
+      begin,
+      end,
+      step,
+      static_cast<tc::ParallelSchedule>(schedule),
+      chunkSize);
+}
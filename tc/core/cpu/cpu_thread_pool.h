@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tc/proto/mapping_options.pb.h"
+
+namespace tc {
+
+/// Signature of the outlined body of a parallel loop emitted by the CPU
+/// code generator. It executes the iterations [lo, hi) of the loop (in
+/// iterator values, with the step of the original loop) and reads all the
+/// values it captured from its enclosing function in closure.
+using ParallelLoopBody = void (*)(int64_t lo, int64_t hi, void* closure);
+
+namespace detail {
+struct ParallelRegion;
+} // namespace detail
+
+/**
+ * A work-stealing thread pool owned by TC which executes the parallel loops
+ * of JIT-compiled CPU kernels.
+ *
+ * Each worker owns a deque of tasks; it pops from the front of its own deque
+ * and steals from the back of the other workers' deques when it runs out of
+ * work. The thread calling parallelFor participates in the computation and
+ * helps with pending tasks until the whole loop has finished, so concurrent
+ * calls from multiple threads always make progress.
+ */
+class CpuThreadPool {
+ public:
+  /// If cores is not empty, worker i is pinned to core
+  /// cores[(i + 1) % cores.size()], cores[0] being left to the calling
+  /// thread.
+  explicit CpuThreadPool(size_t numThreads, std::vector<int> cores = {});
+  ~CpuThreadPool();
+
+  CpuThreadPool(const CpuThreadPool&) = delete;
+  CpuThreadPool& operator=(const CpuThreadPool&) = delete;
+
+  /// Process-wide pool of FLAGS_cpu_threads threads (hardware concurrency
+  /// if 0), lazily created on first use.
+  static CpuThreadPool& global();
+
+  /// Pool executing the parallel loops of the kernels run by the calling
+  /// thread: the one last set by setCurrent in this thread, or the global
+  /// pool.
+  static CpuThreadPool& current();
+  /// Sets the pool returned by current in the calling thread (the global
+  /// pool if nullptr) and returns the previous one.
+  static CpuThreadPool* setCurrent(CpuThreadPool* pool);
+
+  /// Number of threads participating in a parallel loop, including the
+  /// calling thread.
+  size_t numThreads() const {
+    return workers_.size() + 1;
+  }
+
+  /// Executes body over the iterations begin, begin + step, ... < end and
+  /// blocks until all of them have completed.
+  /// Iterations are distributed according to schedule:
+  ///   - Static splits the range into one contiguous block per thread, or
+  ///     round-robin chunks of chunkSize iterations if chunkSize > 0;
+  ///   - Dynamic hands out chunks of chunkSize (at least 1) iterations on
+  ///     demand;
+  ///   - Guided hands out chunks proportional to the remaining iterations
+  ///     divided by the number of threads, but never smaller than chunkSize.
+  void parallelFor(
+      ParallelLoopBody body,
+      void* closure,
+      int64_t begin,
+      int64_t end,
+      int64_t step,
+      ParallelSchedule schedule,
+      int64_t chunkSize);
+
+ private:
+  struct Task {
+    detail::ParallelRegion* region;
+    size_t participant;
+  };
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void workerLoop(size_t id);
+  bool tryPop(size_t id, Task& task);
+  bool trySteal(size_t thief, Task& task);
+
+  std::vector<std::unique_ptr<Worker>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> nextQueue_;
+  std::atomic<size_t> numPendingTasks_;
+  std::mutex sleepMutex_;
+  std::condition_variable sleepCv_;
+  std::atomic_bool stop_;
+};
+} // namespace tc
+
+/// Entry point called by JIT-compiled kernels for each outermost parallel
+/// loop, the schedule is the integer value of a tc::ParallelSchedule.
+extern "C" void tc_cpu_parallel_for(
+    tc::ParallelLoopBody body,
+    void* closure,
+    int64_t begin,
+    int64_t end,
+    int64_t step,
+    int32_t schedule,
+    int64_t chunkSize);
@@ -16,6 +16,7 @@
 #include "tc/core/cuda/cuda_tc_executor.h"
 
 #include "tc/core/check.h"
+#include "tc/core/compilation_stage_cache.h"
 #include "tc/core/cuda/cuda_mapping_options_cpp_printer.h"
 #include "tc/core/halide_utils.h"
 #include "tc/core/polyhedral/cuda/mapped_scop.h"
@@ -74,19 +75,15 @@ CudaCompilationResult CudaBackend::compileWithTcMapper(
     const std::vector<const DLConstTensor*>& inputs,
     /* TODO: in the future also pass outputs for stride and alignment info */
     const CudaMappingOptions& options) {
-  // A bit chicken-and-eggy, need scop from TC to have the space to build the
-  // context to specialize the scop..
-  auto scop = polyhedral::Scop::makeScop(
-      isl::with_exceptions::globalIslCtx(), halideComponents);
   auto pvm = computeParamValueMap(halideComponents, inputs);
-  scop = polyhedral::Scop::makeSpecializedScop(*scop, pvm);
   LOG_IF(INFO, FLAGS_debug_tc_mapper) << options;
-  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "original schedule:\n"
-                                      << *(scop->scheduleRoot());
+  auto scop = CompilationStageCache::forThisThread().makeScheduledScop(
+      halideComponents, pvm, options.generic);
+  scop->tensorStrides = computeNonContiguousStrides(halideComponents, inputs);
 
   // Now we can build stuff
   auto mappedScop =
-      polyhedral::MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      polyhedral::MappedScop::mapWithOuterBlockInnerThreadStrategy(
           std::move(scop), options);
   LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Mapped schedule:" << std::endl
                                       << *(mappedScop->schedule());
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+
+#include "tc/core/check.h"
+#include "tc/core/compiler.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace detail {
+// Length-prefixed so that distinct components never make equal keys.
+inline void appendKeyComponent(std::stringstream& ss, const std::string& s) {
+  ss << s.size() << ":" << s;
+}
+} // namespace detail
+
+template <typename Backend>
+ExecutorCache<Backend>::ExecutorCache(size_t capacity) : capacity_(capacity) {}
+
+template <typename Backend>
+ExecutorCache<Backend>& ExecutorCache<Backend>::global() {
+  static ExecutorCache<Backend> cache(FLAGS_executor_cache_size);
+  return cache;
+}
+
+template <typename Backend>
+lang::CanonicalTcString ExecutorCache<Backend>::canonicalTc(
+    const std::string& tc,
+    const std::string& entryPoint) {
+  std::stringstream ss;
+  detail::appendKeyComponent(ss, entryPoint);
+  detail::appendKeyComponent(ss, tc);
+  auto key = ss.str();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = canonicalTcs_.find(key);
+    if (it != canonicalTcs_.end()) {
+      return it->second;
+    }
+  }
+
+  auto parsedTcs = detail::parse(tc);
+  TC_CHECK_EQ(parsedTcs.count(entryPoint), 1u)
+      << "attempting to access undefined function " << entryPoint;
+  auto canonical = lang::canonicalTc(parsedTcs.at(entryPoint));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (canonicalTcs_.size() >= std::max(capacity_, size_t(1))) {
+    canonicalTcs_.clear();
+  }
+  canonicalTcs_.emplace(key, canonical);
+  return canonical;
+}
+
+template <typename Backend>
+std::shared_ptr<typename ExecutorCache<Backend>::ExecutorType>
+ExecutorCache<Backend>::compile(
+    const std::string& tc,
+    const std::string& entryPoint,
+    const std::vector<const DLConstTensor*>& inputs,
+    const typename Backend::MappingOptionsType& options) {
+  std::stringstream ss;
+  detail::appendKeyComponent(ss, canonicalTc(tc, entryPoint));
+  for (const auto& info : makeTensorInfoVector(inputs)) {
+    detail::appendKeyComponent(ss, info.toProtobuf().SerializeAsString());
+  }
+  detail::appendKeyComponent(ss, options.toProtobufSerializedString());
+  auto key = ss.str();
+
+  std::promise<std::shared_ptr<ExecutorType>> promise;
+  ExecutorFuture executor;
+  size_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      executor = it->second->executor;
+    } else {
+      executor = promise.get_future().share();
+      id = ++numCompilations_;
+      entries_.push_front(Entry{key, executor, id});
+      index_[key] = entries_.begin();
+      while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+      }
+    }
+  }
+  if (id == 0) {
+    // Possibly waits for the compilation started by another thread.
+    return executor.get();
+  }
+
+  try {
+    promise.set_value(std::shared_ptr<ExecutorType>(
+        tc::compile<Backend>(tc, entryPoint, inputs, options)));
+  } catch (...) {
+    {
+      // Let later requests retry.
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(key);
+      if (it != index_.end() && it->second->id == id) {
+        entries_.erase(it->second);
+        index_.erase(it);
+      }
+    }
+    promise.set_exception(std::current_exception());
+  }
+  return executor.get();
+}
+
+template <typename Backend>
+size_t ExecutorCache<Backend>::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+template <typename Backend>
+size_t ExecutorCache<Backend>::numCompilations() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numCompilations_;
+}
+
+template <typename Backend>
+void ExecutorCache<Backend>::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  index_.clear();
+  canonicalTcs_.clear();
+}
+
+template <typename Backend>
+std::shared_ptr<typename Backend::ExecutorType> compileCached(
+    const std::string& tc,
+    const std::string& entryPoint,
+    const std::vector<const DLConstTensor*>& inputs,
+    const typename Backend::MappingOptionsType& options) {
+  return ExecutorCache<Backend>::global().compile(
+      tc, entryPoint, inputs, options);
+}
+} // namespace tc
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tc/core/tensor.h"
+#include "tc/lang/canonicalize.h"
+
+namespace tc {
+/**
+ * In-process cache of compiled executors, templated by the Backend type.
+ *
+ * Executors are identified by the canonical form of the TC function (which
+ * does not depend on the choice of identifiers nor on the other functions
+ * defined alongside it), the metadata of the inputs and the mapping options.
+ * At most capacity executors are kept, the least recently used ones are
+ * evicted first.  Executors are shared, an evicted executor lives on as long
+ * as a caller holds it.
+ *
+ * All operations are thread-safe.  Compilation happens outside of the lock
+ * and concurrent requests for the same executor wait for a single
+ * compilation.  Failed compilations are not cached, their exception is
+ * rethrown to all the requests waiting for them.
+ */
+template <typename Backend>
+class ExecutorCache {
+ public:
+  using ExecutorType = typename Backend::ExecutorType;
+
+  explicit ExecutorCache(size_t capacity);
+
+  /// Process-wide cache whose capacity is FLAGS_executor_cache_size.
+  static ExecutorCache& global();
+
+  /// Returns the executor for the TC function entryPoint defined in tc,
+  /// compiling it with tc::compile if it is not cached.
+  std::shared_ptr<ExecutorType> compile(
+      const std::string& tc,
+      const std::string& entryPoint,
+      const std::vector<const DLConstTensor*>& inputs,
+      const typename Backend::MappingOptionsType& options);
+
+  size_t size() const;
+  size_t capacity() const {
+    return capacity_;
+  }
+  /// Number of compilations started by this cache.
+  size_t numCompilations() const;
+  void clear();
+
+ private:
+  using ExecutorFuture = std::shared_future<std::shared_ptr<ExecutorType>>;
+
+  struct Entry {
+    std::string key;
+    ExecutorFuture executor;
+    size_t id;
+  };
+
+  lang::CanonicalTcString canonicalTc(
+      const std::string& tc,
+      const std::string& entryPoint);
+
+  const size_t capacity_;
+
+  mutable std::mutex mutex_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, typename std::list<Entry>::iterator> index_;
+  // Canonical TCs by TC and entry point, to spare parsing and semantic
+  // analysis on cache hits.  Cleared when it exceeds the capacity.
+  std::unordered_map<std::string, lang::CanonicalTcString> canonicalTcs_;
+  size_t numCompilations_ = 0;
+};
+
+/// Same as tc::compile but the executor is shared through
+/// ExecutorCache<Backend>::global().
+template <typename Backend>
+std::shared_ptr<typename Backend::ExecutorType> compileCached(
+    const std::string& tc,
+    const std::string& entryPoint,
+    const std::vector<const DLConstTensor*>& inputs,
+    const typename Backend::MappingOptionsType& options);
+} // namespace tc
+
+#include "tc/core/executor_cache-inl.h"
@@ -37,10 +37,26 @@ DEFINE_bool(
     "Print debug spew for the tc_mapper like cuda code, mapping options etc");
 DEFINE_bool(dump_cuda, false, "Print the generated source");
 DEFINE_bool(dump_ptx, false, "Dump the generated PTX");
+DEFINE_uint32(
+    executor_cache_size,
+    128,
+    "Maximum number of compiled executors kept in memory by tc::compileCached");
+DEFINE_uint32(
+    compilation_stage_cache_size,
+    8,
+    "Number of Halide translations and scheduled scops memoized per compilation thread (0 to disable)");
 
 // CPU codegen options
 DEFINE_bool(llvm_dump_before_opt, false, "Print IR before optimization");
 DEFINE_bool(llvm_dump_after_opt, false, "Print IR after optimization");
+DEFINE_uint32(
+    cpu_threads,
+    0,
+    "Number of threads executing parallel loops of CPU kernels (0 for hardware concurrency)");
+DEFINE_string(
+    cpu_object_cache_dir,
+    "",
+    "Directory of the persistent cache of JIT-compiled CPU kernels, shared across processes (disabled if empty)");
 
 DEFINE_uint32(
     benchmark_warmup,
@@ -80,11 +96,67 @@ DEFINE_uint32(
     tuner_gen_number_elites,
     10,
     "The number of best candidates that are preserved intact between generations");
+DEFINE_string(
+    tuner_search_strategy,
+    "genetic",
+    "Search strategy of the tuners instantiated with tc::autotune::SearchStrategy: genetic, random, annealing, halving or bayesian");
+DEFINE_double(
+    tuner_annealing_temperature,
+    0.5,
+    "Initial temperature of simulated annealing, in units of log(runtime ratio)");
+DEFINE_double(
+    tuner_annealing_cooling,
+    0.85,
+    "Factor applied to the temperature of simulated annealing after each generation");
+DEFINE_uint32(
+    tuner_halving_rate,
+    3,
+    "Inverse of the fraction of candidates kept at each rung of successive halving");
+DEFINE_uint32(
+    tuner_bayesian_samples,
+    64,
+    "Number of configurations sampled for each candidate proposed by Bayesian search");
+DEFINE_double(
+    tuner_cost_model_prune_factor,
+    0,
+    "Skip the compilation of the candidates whose runtime predicted by the cost model exceeds this factor times the best runtime so far, 0 disables the cost model");
+DEFINE_uint32(
+    tuner_benchmark_min_runs,
+    3,
+    "Minimum number of runs of each candidate when measuring its runtime");
+DEFINE_uint32(
+    tuner_benchmark_max_runs,
+    10,
+    "Maximum number of runs of each candidate when measuring its runtime");
+DEFINE_double(
+    tuner_benchmark_relative_ci,
+    0.02,
+    "Stop measuring the runtime of a candidate once the 95% confidence interval of its median runtime is within this fraction of it");
+DEFINE_uint32(
+    tuner_benchmark_time_budget_ms,
+    1000,
+    "Stop measuring the runtime of a candidate after this many milliseconds");
+DEFINE_uint32(
+    tuner_time_budget_s,
+    0,
+    "Stop tuning after this many seconds, the candidates being evaluated then are dropped, 0 for no limit");
+DEFINE_uint32(
+    tuner_max_evaluations,
+    0,
+    "Stop tuning once this many candidates have been compiled and benchmarked, cached and repeated candidates do not count, 0 for no limit");
+DEFINE_uint32(
+    tuner_convergence_generations,
+    0,
+    "Stop tuning once the best runtime has not improved by more than tuner_convergence_threshold percent over this many generations, 0 disables the criterion");
+DEFINE_double(
+    tuner_convergence_threshold,
+    1.0,
+    "Improvement of the best runtime, in percent, below which tuning is considered converged (see tuner_convergence_generations)");
 DEFINE_uint32(tuner_threads, 8, "Number of CPU threads to use when autotuning");
 DEFINE_string(
     tuner_devices,
-    "0",
-    "Comma separated list of GPUs to use for autotuning");
+    "",
+    "Comma separated list of devices to use for autotuning: GPU ids with CUDA, core sets (e.g. 0-3+8-11) or NUMA nodes (e.g. numa1) on CPU. Empty for GPU 0 with CUDA and, on CPU, a single device made of all the cores the tuner may run on (tuners sharing a host should be given disjoint core sets)");
 DEFINE_bool(
     tuner_print_best,
     false,
@@ -114,6 +186,22 @@ DEFINE_uint32(
     tuner_save_best_candidates_count,
     10,
     "Number of best candidates to save from autotuning");
+DEFINE_bool(
+    tuner_isolate_candidates,
+    false,
+    "Compile and benchmark each candidate in a forked process so that crashes, hangs and memory blowups only invalidate the candidate (CPU only, children may deadlock on locks held by other tuner threads when forked, use --tuner_threads=1 to avoid spuriously timed out candidates)");
+DEFINE_uint32(
+    tuner_candidate_timeout,
+    300,
+    "Seconds after which an isolated candidate that is still compiling or benchmarking is killed (0 for no limit)");
+DEFINE_uint64(
+    tuner_candidate_memory_limit,
+    0,
+    "Address space limit in MB of the processes of isolated candidates (0 for no limit)");
+DEFINE_bool(
+    tuner_reuse_cached_runtimes,
+    false,
+    "Reuse the runtimes that the options cache holds for candidates instead of benchmarking them again (they may come from earlier runs)");
 
 uint64_t initRandomSeed() {
   static std::mutex mut;
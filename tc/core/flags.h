@@ -30,10 +30,14 @@ DECLARE_bool(debug_cuda);
 DECLARE_bool(debug_tuner);
 DECLARE_bool(dump_cuda);
 DECLARE_bool(dump_ptx);
+DECLARE_uint32(executor_cache_size);
+DECLARE_uint32(compilation_stage_cache_size);
 
 // llvm codegen
 DECLARE_bool(llvm_dump_before_opt);
 DECLARE_bool(llvm_dump_after_opt);
+DECLARE_uint32(cpu_threads);
+DECLARE_string(cpu_object_cache_dir);
 
 // Used in benchmarking and autotuning
 DECLARE_uint32(benchmark_warmup);
@@ -46,6 +50,20 @@ DECLARE_uint32(tuner_gen_crossover_rate);
 DECLARE_uint32(tuner_gen_mutation_rate);
 DECLARE_uint32(tuner_gen_generations);
 DECLARE_uint32(tuner_gen_number_elites);
+DECLARE_string(tuner_search_strategy);
+DECLARE_double(tuner_annealing_temperature);
+DECLARE_double(tuner_annealing_cooling);
+DECLARE_uint32(tuner_halving_rate);
+DECLARE_uint32(tuner_bayesian_samples);
+DECLARE_double(tuner_cost_model_prune_factor);
+DECLARE_uint32(tuner_benchmark_min_runs);
+DECLARE_uint32(tuner_benchmark_max_runs);
+DECLARE_double(tuner_benchmark_relative_ci);
+DECLARE_uint32(tuner_benchmark_time_budget_ms);
+DECLARE_uint32(tuner_time_budget_s);
+DECLARE_uint32(tuner_max_evaluations);
+DECLARE_uint32(tuner_convergence_generations);
+DECLARE_double(tuner_convergence_threshold);
 DECLARE_uint32(tuner_threads);
 DECLARE_string(tuner_devices);
 DECLARE_bool(tuner_print_best);
@@ -55,6 +73,10 @@ DECLARE_uint32(tuner_gen_restore_number);
 DECLARE_bool(tuner_gen_log_generations);
 DECLARE_uint64(tuner_min_launch_total_threads);
 DECLARE_uint32(tuner_save_best_candidates_count);
+DECLARE_bool(tuner_isolate_candidates);
+DECLARE_uint32(tuner_candidate_timeout);
+DECLARE_uint64(tuner_candidate_memory_limit);
+DECLARE_bool(tuner_reuse_cached_runtimes);
 
 // Misc
 DECLARE_int64(random_seed);
@@ -85,6 +85,21 @@ std::unordered_map<std::string, int> computeParamValueMap(
   return pvm;
 }
 
+std::unordered_map<std::string, std::vector<int64_t>>
+computeNonContiguousStrides(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLConstTensor*>& inputsDLT) {
+  std::unordered_map<std::string, std::vector<int64_t>> res;
+  for (size_t i = 0; i < inputsDLT.size(); ++i) {
+    TensorInfo info(inputsDLT[i]);
+    auto strides = normalizeStrides(info.shape, info.strides);
+    if (strides != makeStridesFromSizes(info.shape)) {
+      res.emplace(halide.inputs.at(i).name(), strides);
+    }
+  }
+  return res;
+}
+
 std::vector<TensorInfo> inferOutputTensorInfo(
     const tc2halide::HalideComponents& halide,
     const std::vector<const DLConstTensor*>& inputsDLT) {
@@ -33,6 +33,15 @@ std::unordered_map<std::string, int> computeParamValueMap(
     const tc2halide::HalideComponents& components,
     const std::vector<const DLConstTensor*>& inputsDLT);
 
+/// Given the result of translating TC language to Halide as components and the
+/// (metadata of) input tensors, compute a map between the names of the inputs
+/// that are not contiguous in memory and their normalized strides (see
+/// normalizeStrides).
+std::unordered_map<std::string, std::vector<int64_t>>
+computeNonContiguousStrides(
+    const tc2halide::HalideComponents& components,
+    const std::vector<const DLConstTensor*>& inputsDLT);
+
 /// Infer the numerical sizes of the output tensors in the TC definition
 /// translated into Halide using the provided map between symbolic parameter
 /// names and their values ("pvm").
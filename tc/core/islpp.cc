@@ -25,6 +25,7 @@ isl::ctx globalIslCtx(IslCtxOption options) {
   if (!inited) {
     // Default
     ctxtUptrs.push_back(CtxUPtr(new ctx(isl_ctx_alloc())));
+    inited = true;
   }
   return *ctxtUptrs.at(static_cast<int>(options));
 }
@@ -15,6 +15,9 @@
  */
 #include "tc/core/polyhedral/codegen_llvm.h"
 
+#include <algorithm>
+#include <functional>
+#include <map>
 #include <sstream>
 #include <vector>
 
@@ -24,8 +27,10 @@
 #include "llvm/Config/llvm-config.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO.h"
@@ -35,22 +40,21 @@
 
 #include "tc/core/check.h"
 #include "tc/core/constants.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_target.h"
 #include "tc/core/flags.h"
 #include "tc/core/halide2isl.h"
 #include "tc/core/polyhedral/codegen.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/scope_guard.h"
+#include "tc/core/tensor.h"
 #include "tc/external/isl.h"
 
 #ifndef LLVM_VERSION_MAJOR
 #error LLVM_VERSION_MAJOR not set
 #endif
 
-#ifdef TAPIR_VERSION_MAJOR
-#include "llvm/Transforms/Tapir/CilkABI.h"
-#endif
-
 using namespace Halide;
 
 namespace tc {
@@ -87,99 +91,113 @@ int64_t IslExprToSInt(isl::ast_expr e) {
   return toSInt(intExpr.get_val());
 }
 
-int64_t islIdToInt(isl::ast_expr_id e, isl::set context) {
+// Value of the parameter id, which must be fixed in context.  Other
+// parameters may be left unconstrained.
+int64_t islIdToInt(isl::id id, isl::set context) {
   auto space = context.get_space();
-  isl::aff param(isl::aff::param_on_domain_space(space, e.get_id()));
-  auto p = context.sample_point();
-  TC_CHECK(context.is_equal(p));
-  return toSInt(param.eval(p));
+  isl::aff param(isl::aff::param_on_domain_space(space, id));
+  auto value = context.min_val(param);
+  TC_CHECK(value.eq(context.max_val(param)))
+      << "Parameter " << id << " is not fixed in " << context;
+  return toSInt(value);
 }
 
-int64_t getTensorSize(isl::set context, const Halide::Expr& e) {
-  // isl will take care of substituting parameter values if they are known and
-  // simplifying the expression.
-  auto aff = halide2isl::makeIslAffFromExpr(context.get_space(), e);
-  auto p = context.sample_point();
-  TC_CHECK(context.is_equal(p));
-  return toSInt(aff.eval(p));
+// Whether the value of e depends on the identifier id.
+bool involves(isl::ast_expr e, isl::id id) {
+  if (auto idExpr = e.as<isl::ast_expr_id>()) {
+    return idExpr.get_id() == id;
+  } else if (auto opExpr = e.as<isl::ast_expr_op>()) {
+    for (int i = 0; i < opExpr.get_n_arg(); ++i) {
+      if (involves(opExpr.get_arg(i), id)) {
+        return true;
+      }
+    }
+  }
+  return false;
 }
 
-std::vector<int64_t> getTensorSizesWithoutLeadingDim(
+// Whether e is of the form "id + f" where f does not depend on id.
+bool isUnitStride(isl::ast_expr e, isl::id id) {
+  if (auto idExpr = e.as<isl::ast_expr_id>()) {
+    return idExpr.get_id() == id;
+  }
+  auto opExpr = e.as<isl::ast_expr_op>();
+  if (!opExpr || opExpr.get_n_arg() != 2) {
+    return false;
+  }
+  auto lhs = opExpr.get_arg(0);
+  auto rhs = opExpr.get_arg(1);
+  if (opExpr.as<isl::ast_op_add>()) {
+    return (isUnitStride(lhs, id) && !involves(rhs, id)) ||
+        (!involves(lhs, id) && isUnitStride(rhs, id));
+  } else if (opExpr.as<isl::ast_op_sub>()) {
+    return isUnitStride(lhs, id) && !involves(rhs, id);
+  }
+  return false;
+}
+
+// Extents of all the dimensions of t but the outermost one, in which the
+// parameters are replaced by their values in parameterValues.  The extents
+// are constant unless they involve symbolic parameters.
+std::vector<Halide::Expr> getTensorExtentsWithoutLeadingDim(
     const Halide::OutputImageParam& t,
-    isl::set context) {
+    const std::unordered_map<std::string, int>& parameterValues) {
+  std::map<std::string, Halide::Expr> substitutions;
+  for (const auto& kvp : parameterValues) {
+    substitutions.emplace(kvp.first, Halide::Expr(kvp.second));
+  }
   auto dims = t.dimensions();
-  std::vector<int64_t> sizes;
-  sizes.reserve(dims);
+  std::vector<Halide::Expr> extents;
+  extents.reserve(dims);
   for (int d = 1; d < dims; ++d) {
     Halide::Expr extent = t.parameter().extent_constraint(d);
     TC_CHECK(extent.defined())
         << "Undefined extent on input/output tensor. Forward bounds inference should have set these\n";
-    sizes.push_back(getTensorSize(context, extent));
+    extents.push_back(Halide::Internal::simplify(
+        Halide::Internal::substitute(substitutions, extent)));
   }
-  return sizes;
+  return extents;
 }
 
-class IslAstExprInterpeter {
-  isl::set context_;
-
- public:
-  IslAstExprInterpeter(isl::set context) : context_(context){};
-
-  int64_t interpret(isl::ast_expr e) {
-    if (auto intExpr = e.as<isl::ast_expr_int>()) {
-      return IslExprToSInt(intExpr);
-    } else if (auto idExpr = e.as<isl::ast_expr_id>()) {
-      return islIdToInt(idExpr, context_);
-    } else if (auto opExpr = e.as<isl::ast_expr_op>()) {
-      return interpretOp(opExpr);
-    } else {
-      TC_CHECK(false) << "NYI";
-      return 0; // avoid warning
-    }
-  };
-
- private:
-  int64_t interpretOp(isl::ast_expr_op e) {
-    switch (e.get_n_arg()) {
-      case 1:
-        return interpretUnaryOp(e);
-      case 2:
-        return interpretBinaryOp(e);
-      default:
-        TC_CHECK(false) << "NYI: " << e;
-        return 0; // avoid warning
-    }
-  }
-
-  int64_t interpretBinaryOp(isl::ast_expr_op e) {
-    auto left = interpret(e.get_arg(0));
-    auto right = interpret(e.get_arg(1));
-    if (e.as<isl::ast_op_add>()) {
-      return left + right;
-    } else if (e.as<isl::ast_op_sub>()) {
-      return left - right;
-    } else {
-      TC_CHECK(false) << "NYI: " << e;
-      return 0; // avoid warning
-    }
+// Strides of a contiguous tensor whose dimensions but the outermost one have
+// the given extents.
+std::vector<Halide::Expr> makeContiguousStrides(
+    const std::vector<Halide::Expr>& innerExtents) {
+  std::vector<Halide::Expr> strides(innerExtents.size() + 1);
+  strides.back() = Halide::Internal::make_one(Halide::Int(64));
+  for (size_t i = innerExtents.size(); i-- > 0;) {
+    strides[i] = Halide::Internal::simplify(
+        strides[i + 1] * Halide::cast(Halide::Int(64), innerExtents[i]));
   }
+  return strides;
+}
 
-  int64_t interpretUnaryOp(isl::ast_expr_op e) {
-    auto val = interpret(e.get_arg(0));
-    if (e.as<isl::ast_op_minus>()) {
-      return -val;
-    } else {
-      TC_CHECK(false) << "NYI";
-      return 0; // avoid warning
+// Names of the parameters of scop that are not fixed in its context, in
+// alphabetical order.  Their values are passed to the kernel.
+std::vector<std::string> getSymbolicParameters(const Scop& scop) {
+  std::vector<std::string> names;
+  for (const auto& param : scop.halide.params) {
+    if (scop.parameterValues.count(param.name()) == 0) {
+      names.push_back(param.name());
     }
   }
-};
+  std::sort(names.begin(), names.end());
+  return names;
+}
 
 static constexpr int kOptLevel = 3;
 
 class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
  public:
-  const IteratorMapType* iteratorMap_;
+  const IteratorMapType* iteratorMap_ = nullptr;
+  // Context of the scop, used to compute the values of the parameters that
+  // are not bound to an llvm::Value.
+  isl::set context_;
+  // Strides of the tensors passed as pointers to their elements rather than
+  // as pointers to arrays, whose accesses are linearized.  The strides may
+  // involve symbolic parameters.
+  std::unordered_map<std::string, std::vector<Halide::Expr>>
+      linearizedStrides_;
   CodeGen_TC(Target t) : CodeGen_X86(t) {}
 
   using CodeGen_X86::codegen;
@@ -218,21 +236,55 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
   }
 
   // Convert an isl AST expression into an llvm::Value.
-  // Only expressions that consist of a pure identifier or
-  // a pure integer constant are currently supported.
+  // Integer expressions are of type i64 and boolean expressions of type i1.
   llvm::Value* getValue(isl::ast_expr expr);
 
+  // Address of the element of the tensor "name" at the given subscripts.
+  llvm::Value* getElementAddress(
+      const std::string& name,
+      llvm::ArrayRef<llvm::Value*> subscripts) {
+    auto baseAddr = sym_get(name);
+    auto strides = linearizedStrides_.find(name);
+    if (strides == linearizedStrides_.end()) {
+      return builder->CreateInBoundsGEP(baseAddr, subscripts);
+    }
+    TC_CHECK_EQ(strides->second.size(), subscripts.size());
+    auto* i64Ty = builder->getInt64Ty();
+    llvm::Value* offset = builder->getInt64(0);
+    for (size_t i = 0; i < subscripts.size(); ++i) {
+      offset = builder->CreateNSWAdd(
+          offset,
+          builder->CreateNSWMul(
+              builder->CreateSExtOrTrunc(subscripts[i], i64Ty),
+              builder->CreateSExtOrTrunc(
+                  codegen(strides->second[i]), i64Ty)));
+    }
+    return builder->CreateInBoundsGEP(baseAddr, offset);
+  }
+
+  // Value of the parameter "name", either passed to the kernel if it is
+  // symbolic or fixed in the context.
+  llvm::Value* getParameterValue(const std::string& name) {
+    if (auto value = sym_get(name, false)) {
+      return value;
+    }
+    return getLLVMConstantSignedInt64(
+        islIdToInt(isl::id(context_.get_ctx(), name), context_));
+  }
+
+ private:
+  llvm::Value* getOpValue(isl::ast_expr_op expr);
+
  protected:
   using CodeGen_X86::visit;
   void visit(const Halide::Internal::Call* call) override {
     if (call->call_type == Halide::Internal::Call::CallType::Image ||
         call->call_type == Halide::Internal::Call::CallType::Halide) {
-      auto baseAddr = sym_get(call->name);
       std::vector<llvm::Value*> args(call->args.size());
       for (size_t i = 0; i < call->args.size(); i++) {
         args[i] = codegen(call->args[i]);
       }
-      auto addr = builder->CreateInBoundsGEP(baseAddr, args);
+      auto addr = getElementAddress(call->name, args);
       value = builder->CreateLoad(addr);
       return;
     } else if (call->is_intrinsic(tc2halide::kReductionUpdate)) {
@@ -244,7 +296,12 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
   }
 
   void visit(const Halide::Internal::Variable* op) override {
-    value = getValue(iteratorMap_->at(op->name));
+    // Variables are either statement iterators or tensor sizes.
+    if (iteratorMap_ && iteratorMap_->count(op->name) > 0) {
+      value = getValue(iteratorMap_->at(op->name));
+    } else {
+      value = getParameterValue(op->name);
+    }
 
     // Generate code for type casting if necessary.
     llvm::Type* ty = llvm_type_of(op->type);
@@ -265,7 +322,7 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
   }
 
  public:
-  void optimize_module() {
+  void optimize_module(llvm::TargetMachine& targetMachine) {
     LOG_IF(INFO, FLAGS_llvm_dump_before_opt)
         << "[LLVM-IR] Before optimization:\n"
         << toString(module.get());
@@ -273,27 +330,18 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
     llvm::legacy::FunctionPassManager functionPassManager(module.get());
     llvm::legacy::PassManager modulePassManager;
 
-    std::unique_ptr<llvm::TargetMachine> targetMachine =
-        Halide::Internal::make_target_machine(*module);
     modulePassManager.add(llvm::createTargetTransformInfoWrapperPass(
-        targetMachine ? targetMachine->getTargetIRAnalysis()
-                      : llvm::TargetIRAnalysis()));
+        targetMachine.getTargetIRAnalysis()));
     functionPassManager.add(llvm::createTargetTransformInfoWrapperPass(
-        targetMachine ? targetMachine->getTargetIRAnalysis()
-                      : llvm::TargetIRAnalysis()));
+        targetMachine.getTargetIRAnalysis()));
 
     llvm::PassManagerBuilder b;
     b.OptLevel = kOptLevel;
-#ifdef TAPIR_VERSION_MAJOR
-    b.tapirTarget = new llvm::CilkABI();
-#endif
     b.Inliner = llvm::createFunctionInliningPass(b.OptLevel, 0, false);
     b.LoopVectorize = true;
     b.SLPVectorize = true;
 
-    if (targetMachine) {
-      targetMachine->adjustPassManager(b);
-    }
+    targetMachine.adjustPassManager(b);
 
     b.populateFunctionPassManager(functionPassManager);
     b.populateModulePassManager(modulePassManager);
@@ -314,18 +362,119 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
 
 llvm::Value* CodeGen_TC::getValue(isl::ast_expr expr) {
   if (auto idExpr = expr.as<isl::ast_expr_id>()) {
-    return sym_get(idExpr.get_id().get_name());
+    auto name = idExpr.get_id().get_name();
+    if (auto value = sym_get(name, false)) {
+      return value;
+    }
+    return getLLVMConstantSignedInt64(islIdToInt(idExpr.get_id(), context_));
   } else if (auto intExpr = expr.as<isl::ast_expr_int>()) {
     return getLLVMConstantSignedInt64(toSInt(intExpr.get_val()));
+  } else if (auto opExpr = expr.as<isl::ast_expr_op>()) {
+    return getOpValue(opExpr);
   } else {
-    LOG(FATAL) << "NYI";
+    LOG(FATAL) << "NYI: " << expr;
     return nullptr;
   }
 }
 
+llvm::Value* CodeGen_TC::getOpValue(isl::ast_expr_op expr) {
+  std::vector<llvm::Value*> args;
+  for (int i = 0; i < expr.get_n_arg(); ++i) {
+    args.push_back(getValue(expr.get_arg(i)));
+  }
+  auto& b = *builder;
+
+  if (expr.as<isl::ast_op_minus>()) {
+    return b.CreateNeg(args.at(0));
+  } else if (expr.as<isl::ast_op_min>() || expr.as<isl::ast_op_max>()) {
+    bool isMin = expr.as<isl::ast_op_min>();
+    auto result = args.at(0);
+    for (size_t i = 1; i < args.size(); ++i) {
+      auto cmp = isMin ? b.CreateICmpSLT(args[i], result)
+                       : b.CreateICmpSGT(args[i], result);
+      result = b.CreateSelect(cmp, args[i], result);
+    }
+    return result;
+  } else if (expr.as<isl::ast_op_select>() || expr.as<isl::ast_op_cond>()) {
+    return b.CreateSelect(args.at(0), args.at(1), args.at(2));
+  }
+
+  TC_CHECK_EQ(args.size(), 2u) << "NYI: " << expr;
+  auto lhs = args[0];
+  auto rhs = args[1];
+  if (expr.as<isl::ast_op_add>()) {
+    return b.CreateAdd(lhs, rhs);
+  } else if (expr.as<isl::ast_op_sub>()) {
+    return b.CreateSub(lhs, rhs);
+  } else if (expr.as<isl::ast_op_mul>()) {
+    return b.CreateMul(lhs, rhs);
+  } else if (expr.as<isl::ast_op_div>()) {
+    // Exact division.
+    return b.CreateExactSDiv(lhs, rhs);
+  } else if (expr.as<isl::ast_op_fdiv_q>()) {
+    // Floor division, the divisor is known to be positive:
+    //   floor(a / d) = (a < 0 ? a - d + 1 : a) / d
+    auto isNegative = b.CreateICmpSLT(lhs, getLLVMConstantSignedInt64(0));
+    auto adjusted =
+        b.CreateAdd(b.CreateSub(lhs, rhs), getLLVMConstantSignedInt64(1));
+    return b.CreateSDiv(b.CreateSelect(isNegative, adjusted, lhs), rhs);
+  } else if (expr.as<isl::ast_op_pdiv_q>()) {
+    // Division of a non-negative dividend.
+    return b.CreateSDiv(lhs, rhs);
+  } else if (
+      expr.as<isl::ast_op_pdiv_r>() || expr.as<isl::ast_op_zdiv_r>()) {
+    // Remainder of a non-negative dividend, or remainder only ever compared
+    // to zero, for which the sign does not matter.
+    return b.CreateSRem(lhs, rhs);
+  } else if (expr.as<isl::ast_op_eq>()) {
+    return b.CreateICmpEQ(lhs, rhs);
+  } else if (expr.as<isl::ast_op_lt>()) {
+    return b.CreateICmpSLT(lhs, rhs);
+  } else if (expr.as<isl::ast_op_le>()) {
+    return b.CreateICmpSLE(lhs, rhs);
+  } else if (expr.as<isl::ast_op_gt>()) {
+    return b.CreateICmpSGT(lhs, rhs);
+  } else if (expr.as<isl::ast_op_ge>()) {
+    return b.CreateICmpSGE(lhs, rhs);
+  } else if (expr.as<isl::ast_op_and>() || expr.as<isl::ast_op_and_then>()) {
+    // Expressions have no side effects, no need to short-circuit.
+    return b.CreateAnd(lhs, rhs);
+  } else if (expr.as<isl::ast_op_or>() || expr.as<isl::ast_op_or_else>()) {
+    return b.CreateOr(lhs, rhs);
+  }
+  LOG(FATAL) << "NYI: " << expr;
+  return nullptr;
+}
+
 class LLVMCodegen {
   void collectTensor(const Halide::OutputImageParam& t) {
-    auto sizes = getTensorSizesWithoutLeadingDim(t, scop_.context());
+    auto extents =
+        getTensorExtentsWithoutLeadingDim(t, scop_.parameterValues);
+    std::vector<int64_t> sizes;
+    for (const auto& extent : extents) {
+      if (auto size = Halide::Internal::as_const_int(extent)) {
+        sizes.push_back(*size);
+      }
+    }
+    // Non-contiguous tensors are indexed through arrays whose sizes are
+    // derived from the strides if possible, otherwise the accesses are
+    // linearized.  So are the accesses to tensors with symbolic sizes.
+    auto strides = scop_.tensorStrides.find(t.name());
+    if (strides != scop_.tensorStrides.end()) {
+      sizes = makeArraySizesFromStrides(sizes, strides->second);
+      if (sizes.empty()) {
+        std::vector<Halide::Expr> strideExprs;
+        for (auto stride : strides->second) {
+          strideExprs.push_back(
+              Halide::Internal::make_const(Halide::Int(64), stride));
+        }
+        halide_cg.linearizedStrides_.emplace(t.name(), strideExprs);
+      }
+    } else if (sizes.size() != extents.size()) {
+      sizes.clear();
+      halide_cg.linearizedStrides_.emplace(
+          t.name(), makeContiguousStrides(extents));
+    }
     if (not sizes.empty()) {
       args_.emplace_back(
           makePtrToArrayType(halide_cg.llvm_type_of(t.type()), sizes));
@@ -351,15 +500,16 @@ class LLVMCodegen {
   LLVMCodegen(
       const Scop& scop,
       const IteratorMapsType& iteratorMaps,
-      const StmtSubscriptExprMapType& stmtSubscripts)
+      const StmtSubscriptExprMapType& stmtSubscripts,
+      const CpuMappingOptions& options,
+      const Halide::Target& target)
       : scop_(scop),
         iteratorMaps_(iteratorMaps),
         stmtSubscripts_(stmtSubscripts),
-        halide_cg(Halide::Target(
-            Halide::Target::OSUnknown,
-            Halide::Target::X86,
-            64)) {
+        options_(options),
+        halide_cg(target) {
     halide_cg.set_context(llvmCtx);
+    halide_cg.context_ = scop_.context();
 
     halide_cg.init_module();
   }
@@ -374,6 +524,13 @@ class LLVMCodegen {
 
     collectInputs(inputs);
     collectOutputs(outputs);
+    numInputs_ = inputs.size();
+    numTensors_ = args_.size();
+    for (const auto& name : getSymbolicParameters(scop_)) {
+      args_.push_back(llvm::Type::getInt64Ty(llvmCtx));
+      argNames_.push_back(name);
+    }
+    kernelName_ = fname;
 
     auto* functionType =
         llvm::FunctionType::get(llvm::Type::getVoidTy(llvmCtx), args_, false);
@@ -390,21 +547,51 @@ class LLVMCodegen {
       halide_cg.sym_push(argNames_.at(idx), &arg);
       arg.setName(argNames_.at(idx++));
     }
-
-    for (auto it = function->arg_begin(), end = function->arg_end(); it != end;
-         ++it) {
-      it->addAttr(llvm::Attribute::NoAlias);
-      it->addAttr(llvm::Attribute::NonNull);
-    }
-    for (auto it = function->arg_begin(), end = it + inputs.size(); it != end;
-         ++it) {
-      it->addAttr(llvm::Attribute::ReadOnly);
-    }
+    addTensorArgAttributes(function);
 
     auto entryBB_ = llvm::BasicBlock::Create(llvmCtx, "entry", function);
     halide_cg.get_builder().SetInsertPoint(entryBB_);
   }
 
+  // Emit a function that unpacks an array of type-erased pointers and
+  // forwards them to the kernel "fname". The kernel itself is usually inlined
+  // into the wrapper by the optimizer.
+  void createPackedWrapper(const std::string& fname) {
+    auto* kernel = halide_cg.get_module()->getFunction(fname);
+    TC_CHECK(kernel) << "Kernel " << fname << " not found in module";
+
+    auto* packedTy = llvm::Type::getInt8PtrTy(llvmCtx)->getPointerTo();
+    auto* functionType = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(llvmCtx), {packedTy}, false);
+    auto* wrapper = llvm::Function::Create(
+        functionType,
+        llvm::Function::ExternalLinkage,
+        packedKernelName(fname),
+        halide_cg.get_module());
+    auto packed = wrapper->arg_begin();
+    packed->setName("args");
+    packed->addAttr(llvm::Attribute::NoAlias);
+    packed->addAttr(llvm::Attribute::NonNull);
+
+    llvm::IRBuilder<> builder(
+        llvm::BasicBlock::Create(llvmCtx, "entry", wrapper));
+    std::vector<llvm::Value*> args;
+    args.reserve(args_.size());
+    for (size_t i = 0; i < args_.size(); ++i) {
+      auto* addr = builder.CreateConstInBoundsGEP1_64(&*packed, i);
+      auto* arg = builder.CreateLoad(addr, argNames_.at(i));
+      if (args_.at(i)->isPointerTy()) {
+        args.push_back(builder.CreateBitCast(arg, args_.at(i)));
+      } else {
+        // Scalars are passed by address.
+        args.push_back(builder.CreateLoad(
+            builder.CreateBitCast(arg, args_.at(i)->getPointerTo())));
+      }
+    }
+    builder.CreateCall(kernel, args);
+    builder.CreateRetVoid();
+  }
+
   void CodeGen(isl::ast_node node) {
     emitAst(node);
     halide_cg.get_builder().CreateRetVoid();
@@ -423,17 +610,41 @@ class LLVMCodegen {
       return emitStmt(userNode);
     } else if (auto blockNode = node.as<isl::ast_node_block>()) {
       return emitBlock(blockNode);
+    } else if (auto ifNode = node.as<isl::ast_node_if>()) {
+      return emitIf(ifNode);
     } else {
-      if (node.as<isl::ast_node_if>()) {
-        LOG(FATAL) << "NYI if node: " << node << std::endl;
-      } else {
-        LOG(FATAL) << "NYI " << node << std::endl;
-      }
+      LOG(FATAL) << "NYI " << node << std::endl;
       return static_cast<llvm::BasicBlock*>(nullptr); // avoid warning
     }
   }
 
  private:
+  llvm::BasicBlock* emitIf(isl::ast_node_if node) {
+    auto& builder = halide_cg.get_builder();
+    auto* function = builder.GetInsertBlock()->getParent();
+    auto* thenBB = llvm::BasicBlock::Create(llvmCtx, "if_then", function);
+    auto* elseBB = node.has_else()
+        ? llvm::BasicBlock::Create(llvmCtx, "if_else", function)
+        : nullptr;
+    auto* exitBB = llvm::BasicBlock::Create(llvmCtx, "if_exit", function);
+
+    auto cond = halide_cg.getValue(node.get_cond());
+    builder.CreateCondBr(cond, thenBB, elseBB ? elseBB : exitBB);
+
+    builder.SetInsertPoint(thenBB);
+    builder.SetInsertPoint(emitAst(node.get_then()));
+    builder.CreateBr(exitBB);
+
+    if (elseBB) {
+      builder.SetInsertPoint(elseBB);
+      builder.SetInsertPoint(emitAst(node.get_else()));
+      builder.CreateBr(exitBB);
+    }
+
+    builder.SetInsertPoint(exitBB);
+    return exitBB;
+  }
+
   llvm::BasicBlock* emitBlock(isl::ast_node_block node) {
     auto* function = halide_cg.get_builder().GetInsertBlock()->getParent();
     auto* currBB = llvm::BasicBlock::Create(llvmCtx, "block_exit", function);
@@ -452,6 +663,19 @@ class LLVMCodegen {
     return exit;
   }
 
+  // Tensors never alias and inputs are never written to.  The first
+  // numTensors_ arguments of "function" must be the tensors.
+  void addTensorArgAttributes(llvm::Function* function) {
+    auto it = function->arg_begin();
+    for (size_t i = 0; i < numTensors_; ++i, ++it) {
+      it->addAttr(llvm::Attribute::NoAlias);
+      it->addAttr(llvm::Attribute::NonNull);
+      if (i < numInputs_) {
+        it->addAttr(llvm::Attribute::ReadOnly);
+      }
+    }
+  }
+
   llvm::Type* makePtrToArrayType(
       llvm::Type* baseTy,
       const std::vector<int64_t>& sizes) {
@@ -464,10 +688,143 @@ class LLVMCodegen {
     return arrTy->getPointerTo();
   }
 
+  // Exclusive upper bound of the loop iterator if the loop condition is a
+  // single upper bound on the iterator, nullptr otherwise.  Must be called
+  // before the loop is entered.
+  llvm::Value* emitLoopEnd(isl::ast_node_for node) {
+    auto iterator = node.get_iterator().as<isl::ast_expr_id>().get_id();
+    auto cond = node.get_cond().as<isl::ast_expr_op>();
+    if (!cond || !(cond.as<isl::ast_op_lt>() || cond.as<isl::ast_op_le>())) {
+      return nullptr;
+    }
+    auto condLHS = cond.get_arg(0).as<isl::ast_expr_id>();
+    if (!condLHS || condLHS.get_id() != iterator) {
+      return nullptr;
+    }
+    auto bound = halide_cg.getValue(cond.get_arg(1));
+    if (cond.as<isl::ast_op_le>()) {
+      bound = halide_cg.get_builder().CreateAdd(
+          bound, getLLVMConstantSignedInt64(1));
+    }
+    return bound;
+  }
+
   llvm::BasicBlock* emitFor(isl::ast_node_for node) {
-    IteratorLLVMValueMapType iterPHIs;
+    auto iterator = node.get_iterator().as<isl::ast_expr_id>().get_id();
+    auto iterName = iterator.get_name();
+    auto init = halide_cg.getValue(node.get_init());
+    auto inc = IslExprToSInt(node.get_inc());
+    TC_CHECK_GT(inc, 0) << "NYI: loops with non-positive increment";
+
+    size_t vectorWidth = 0;
+    if (options_.proto().vectorize() > 1 && inc == 1 && node.is_coincident() &&
+        writesContiguously(node.get_body(), iterator)) {
+      vectorWidth = options_.proto().vectorize();
+    }
+
+    if (options_.proto().parallelize() && !inParallelRegion_ &&
+        node.is_coincident()) {
+      if (auto end = emitLoopEnd(node)) {
+        return emitParallelFor(node, iterName, init, end, inc, vectorWidth);
+      }
+    }
+    auto cond = node.get_cond();
+    return emitLoop(
+        iterName,
+        init,
+        [this, cond]() { return halide_cg.getValue(cond); },
+        inc,
+        node.get_body(),
+        vectorWidth);
+  }
+
+  // Whether node contains no loop and all the statements it contains write
+  // to contiguous tensor elements along iterator.
+  bool writesContiguously(isl::ast_node node, isl::id iterator) {
+    if (auto userNode = node.as<isl::ast_node_user>()) {
+      auto usrExp = userNode.get_expr().as<isl::ast_expr_op>();
+      auto id = usrExp.get_arg(0).as<isl::ast_expr_id>().get_id();
+      const auto& subscripts = stmtSubscripts_.at(id);
+      return !subscripts.empty() && isUnitStride(subscripts.back(), iterator);
+    } else if (auto blockNode = node.as<isl::ast_node_block>()) {
+      for (auto child : blockNode.get_children()) {
+        if (!writesContiguously(child, iterator)) {
+          return false;
+        }
+      }
+      return true;
+    } else if (auto ifNode = node.as<isl::ast_node_if>()) {
+      return writesContiguously(ifNode.get_then(), iterator) &&
+          (!ifNode.has_else() ||
+           writesContiguously(ifNode.get_else(), iterator));
+    }
+    return false;
+  }
+
+  // Force the vectorization of the loop whose latch is "latch" and whose body
+  // consists of "bodyBlocks" with "width" lanes.  The loop is coincident so
+  // all memory accesses in its body are marked as free of loop-carried
+  // dependences, which spares the vectorizer the runtime alias checks.  The
+  // vectorizer emits a scalar epilogue for the remaining iterations.
+  void forceVectorization(
+      llvm::BranchInst* latch,
+      const std::vector<llvm::BasicBlock*>& bodyBlocks,
+      size_t width) {
+    auto* i1Ty = llvm::Type::getInt1Ty(llvmCtx);
+    auto* i32Ty = llvm::Type::getInt32Ty(llvmCtx);
+    auto makeHint = [](llvm::StringRef name, llvm::Constant* value) {
+      return llvm::MDNode::get(
+          llvmCtx,
+          {llvm::MDString::get(llvmCtx, name),
+           llvm::ConstantAsMetadata::get(value)});
+    };
+
+    llvm::SmallVector<llvm::Metadata*, 4> loopMD;
+    loopMD.push_back(nullptr); // self-reference, set below
+    loopMD.push_back(makeHint(
+        "llvm.loop.vectorize.enable", llvm::ConstantInt::get(i1Ty, 1)));
+    loopMD.push_back(makeHint(
+        "llvm.loop.vectorize.width", llvm::ConstantInt::get(i32Ty, width)));
+#if LLVM_VERSION_MAJOR >= 8
+    auto* accessGroup = llvm::MDNode::getDistinct(llvmCtx, {});
+    loopMD.push_back(llvm::MDNode::get(
+        llvmCtx,
+        {llvm::MDString::get(llvmCtx, "llvm.loop.parallel_accesses"),
+         accessGroup}));
+#endif
+    auto* loopID = llvm::MDNode::getDistinct(llvmCtx, loopMD);
+    loopID->replaceOperandWith(0, loopID);
+    latch->setMetadata(llvm::LLVMContext::MD_loop, loopID);
+
+    for (auto* bb : bodyBlocks) {
+      for (auto& inst : *bb) {
+        if (!inst.mayReadOrWriteMemory()) {
+          continue;
+        }
+#if LLVM_VERSION_MAJOR >= 8
+        inst.setMetadata(llvm::LLVMContext::MD_access_group, accessGroup);
+#else
+        inst.setMetadata(
+            llvm::LLVMContext::MD_mem_parallel_loop_access, loopID);
+#endif
+      }
+    }
+  }
 
-    auto* incoming = halide_cg.get_builder().GetInsertBlock();
+  // Emit "for (iterName = init; cond(); iterName += inc) body" at the
+  // current insertion point.  The condition is emitted in the loop header
+  // where iterName is bound to the current value of the iterator.
+  // If vectorWidth is greater than 1, the loop is vectorized with that many
+  // lanes, see forceVectorization.
+  llvm::BasicBlock* emitLoop(
+      const std::string& iterName,
+      llvm::Value* init,
+      const std::function<llvm::Value*()>& cond,
+      int64_t inc,
+      isl::ast_node body,
+      size_t vectorWidth) {
+    auto& builder = halide_cg.get_builder();
+    auto* incoming = builder.GetInsertBlock();
     auto* function = incoming->getParent();
     auto* headerBB = llvm::BasicBlock::Create(llvmCtx, "loop_header", function);
     auto* loopBodyBB = llvm::BasicBlock::Create(llvmCtx, "loop_body", function);
@@ -475,103 +832,191 @@ class LLVMCodegen {
         llvm::BasicBlock::Create(llvmCtx, "loop_latch", function);
     auto* loopExitBB = llvm::BasicBlock::Create(llvmCtx, "loop_exit", function);
 
-    bool parallel = node.is_coincident();
-    llvm::Value* SyncRegion = nullptr;
+    builder.CreateBr(headerBB);
 
-#ifdef TAPIR_VERSION_MAJOR
-    if (parallel) {
-      SyncRegion = halide_cg.get_builder().CreateCall(
-          llvm::Intrinsic::getDeclaration(
-              function->getParent(), llvm::Intrinsic::syncregion_start),
-          {},
-          "syncreg");
-    }
-#endif
-
-    halide_cg.get_builder().CreateBr(headerBB);
+    // Loop Header
+    builder.SetInsertPoint(headerBB);
+    auto phi =
+        builder.CreatePHI(llvm::Type::getInt64Ty(llvmCtx), 2, iterName);
+    phi->addIncoming(init, incoming);
+    halide_cg.sym_push(iterName, phi);
+    builder.CreateCondBr(cond(), loopBodyBB, loopExitBB);
 
-    llvm::PHINode* phi = nullptr;
-    auto iterator = node.get_iterator().as<isl::ast_expr_id>().get_id();
+    // Create Body
+    builder.SetInsertPoint(loopBodyBB);
+    liveIterators_.push_back(iterName);
+    auto* currentBB = emitAst(body);
+    liveIterators_.pop_back();
+    builder.SetInsertPoint(currentBB);
+    builder.CreateBr(loopLatchBB);
 
-    // Loop Header
-    {
-      auto initVal = IslExprToSInt(node.get_init());
-      halide_cg.get_builder().SetInsertPoint(headerBB);
-      phi = halide_cg.get_builder().CreatePHI(
-          llvm::Type::getInt64Ty(llvmCtx), 2, iterator.get_name());
-      halide_cg.sym_push(iterator.get_name(), phi);
-      phi->addIncoming(getLLVMConstantSignedInt64(initVal), incoming);
-
-      auto cond_expr = node.get_cond().as<isl::ast_expr_op>();
-      TC_CHECK(cond_expr.as<isl::ast_op_lt>() or cond_expr.as<isl::ast_op_le>())
-          << "I only know how to codegen lt and le";
-      auto condLHS = cond_expr.get_arg(0).as<isl::ast_expr_id>();
-      TC_CHECK(condLHS);
-      TC_CHECK_EQ(condLHS.get_id(), iterator);
-
-      IslAstExprInterpeter i(scop_.context());
-      auto condRHSVal = i.interpret(cond_expr.get_arg(1));
-
-      auto cond = [&]() {
-        auto constant = getLLVMConstantSignedInt64(condRHSVal);
-        if (cond_expr.as<isl::ast_op_lt>()) {
-          return halide_cg.get_builder().CreateICmpSLT(phi, constant);
-        } else if (cond_expr.as<isl::ast_op_le>()) {
-          return halide_cg.get_builder().CreateICmpSLE(phi, constant);
-        } else {
-          TC_CHECK(false) << "NYI";
-          return static_cast<llvm::Value*>(nullptr); // avoid warning
-        }
-      }();
-      halide_cg.get_builder().CreateCondBr(cond, loopBodyBB, loopExitBB);
+    // Create Latch
+    builder.SetInsertPoint(loopLatchBB);
+    phi->addIncoming(
+        builder.CreateAdd(phi, getLLVMConstantSignedInt64(inc)), loopLatchBB);
+    auto* backEdge = builder.CreateBr(headerBB);
+
+    if (vectorWidth > 1) {
+      // Blocks emitted for the body are appended after the exit block.
+      std::vector<llvm::BasicBlock*> bodyBlocks{loopBodyBB};
+      for (auto it = std::next(loopExitBB->getIterator());
+           it != function->end();
+           ++it) {
+        bodyBlocks.push_back(&*it);
+      }
+      forceVectorization(backEdge, bodyBlocks, vectorWidth);
     }
 
-    // Create Body
+    halide_cg.sym_pop(iterName);
+    builder.SetInsertPoint(loopExitBB);
+    return loopExitBB;
+  }
+
+  // Outline the loop into a function executing a range of its iterations and
+  // hand it over to the TC thread pool (see tc_cpu_parallel_for in
+  // tc/core/cpu/cpu_thread_pool.h), which returns once all iterations have
+  // completed.  Two functions are emitted:
+  //   - "<kernel>_par<N>_range(tensors..., enclosing iterators..., lo, hi)"
+  //     which contains the loop over [lo, hi), with the same argument
+  //     attributes as the kernel so that noalias information is preserved;
+  //   - "<kernel>_par<N>(lo, hi, closure)" which unpacks the closure built
+  //     by the caller on its stack and calls the range function, into which
+  //     it is usually inlined.
+  llvm::BasicBlock* emitParallelFor(
+      isl::ast_node_for node,
+      const std::string& iterName,
+      llvm::Value* begin,
+      llvm::Value* end,
+      int64_t inc,
+      size_t vectorWidth) {
+    auto& builder = halide_cg.get_builder();
+    auto* parent = builder.GetInsertBlock()->getParent();
+    auto* voidTy = llvm::Type::getVoidTy(llvmCtx);
+    auto* i64Ty = llvm::Type::getInt64Ty(llvmCtx);
+    auto* i8PtrTy = llvm::Type::getInt8PtrTy(llvmCtx);
+    auto name = kernelName_ + "_par" + std::to_string(numParallelLoops_++);
+
+    // Values visible in the loop body: kernel arguments and enclosing
+    // iterators.
+    std::vector<std::string> captured(argNames_);
+    captured.insert(
+        captured.end(), liveIterators_.begin(), liveIterators_.end());
+    std::vector<llvm::Type*> capturedTypes(args_);
+    capturedTypes.insert(capturedTypes.end(), liveIterators_.size(), i64Ty);
+
+    auto rangeArgTypes = capturedTypes;
+    rangeArgTypes.push_back(i64Ty);
+    rangeArgTypes.push_back(i64Ty);
+    auto* range = llvm::Function::Create(
+        llvm::FunctionType::get(voidTy, rangeArgTypes, false),
+        llvm::Function::InternalLinkage,
+        name + "_range",
+        halide_cg.get_module());
+    addTensorArgAttributes(range);
+    std::vector<llvm::Value*> rangeArgs;
+    for (auto& arg : range->args()) {
+      rangeArgs.push_back(&arg);
+    }
+    for (size_t i = 0; i < captured.size(); ++i) {
+      rangeArgs[i]->setName(captured[i]);
+    }
+    auto* lo = rangeArgs[captured.size()];
+    auto* hi = rangeArgs[captured.size() + 1];
+    lo->setName("lo");
+    hi->setName("hi");
+
+    // Emit the loop in the range function, shadowing the captured values.
+    auto savedIP = builder.saveIP();
+    halide_cg.set_function(range);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(llvmCtx, "entry", range));
+    for (size_t i = 0; i < captured.size(); ++i) {
+      halide_cg.sym_push(captured[i], rangeArgs[i]);
+    }
+    inParallelRegion_ = true;
+    auto cond = [&builder, iterName, hi, this]() {
+      return builder.CreateICmpSLT(halide_cg.sym_get(iterName), hi);
+    };
+    builder.SetInsertPoint(
+        emitLoop(iterName, lo, cond, inc, node.get_body(), vectorWidth));
+    builder.CreateRetVoid();
+    inParallelRegion_ = false;
+    for (auto it = captured.rbegin(); it != captured.rend(); ++it) {
+      halide_cg.sym_pop(*it);
+    }
+    halide_cg.set_function(parent);
+    builder.restoreIP(savedIP);
+
+    // Emit the body function called by the thread pool.
+    auto* closureTy = llvm::StructType::get(llvmCtx, capturedTypes);
+    auto* bodyTy =
+        llvm::FunctionType::get(voidTy, {i64Ty, i64Ty, i8PtrTy}, false);
+    auto* body = llvm::Function::Create(
+        bodyTy,
+        llvm::Function::InternalLinkage,
+        name,
+        halide_cg.get_module());
     {
-      halide_cg.get_builder().SetInsertPoint(loopBodyBB);
-
-#ifdef TAPIR_VERSION_MAJOR
-      if (parallel) {
-        auto* detachedBB =
-            llvm::BasicBlock::Create(llvmCtx, "det.achd", function);
-        halide_cg.get_builder().CreateDetach(
-            detachedBB, loopLatchBB, SyncRegion);
-        halide_cg.get_builder().SetInsertPoint(detachedBB);
+      auto arg = body->arg_begin();
+      llvm::Value* bodyLo = &*arg++;
+      llvm::Value* bodyHi = &*arg++;
+      llvm::Value* rawClosure = &*arg;
+      llvm::IRBuilder<> bodyBuilder(
+          llvm::BasicBlock::Create(llvmCtx, "entry", body));
+      auto* closure = bodyBuilder.CreateBitCast(
+          rawClosure, closureTy->getPointerTo(), "closure");
+      std::vector<llvm::Value*> args;
+      for (size_t i = 0; i < captured.size(); ++i) {
+        args.push_back(bodyBuilder.CreateLoad(
+            bodyBuilder.CreateStructGEP(closureTy, closure, i), captured[i]));
       }
-#endif
-      auto* currentBB = emitAst(node.get_body());
-      halide_cg.get_builder().SetInsertPoint(currentBB);
+      args.push_back(bodyLo);
+      args.push_back(bodyHi);
+      bodyBuilder.CreateCall(range, args);
+      bodyBuilder.CreateRetVoid();
+    }
 
-      if (parallel) {
-#ifdef TAPIR_VERSION_MAJOR
-        halide_cg.get_builder().CreateReattach(loopLatchBB, SyncRegion);
-#endif
-      } else {
-        halide_cg.get_builder().CreateBr(loopLatchBB);
-      }
+    // Fill the closure and call the runtime.
+    llvm::IRBuilder<> entryBuilder(
+        &parent->getEntryBlock(), parent->getEntryBlock().begin());
+    auto* closure = entryBuilder.CreateAlloca(closureTy, nullptr, "closure");
+    for (size_t i = 0; i < captured.size(); ++i) {
+      builder.CreateStore(
+          halide_cg.sym_get(captured[i]),
+          builder.CreateStructGEP(closureTy, closure, i));
     }
+    builder.CreateCall(
+        getParallelForRuntime(bodyTy),
+        {body,
+         builder.CreateBitCast(closure, i8PtrTy),
+         begin,
+         end,
+         getLLVMConstantSignedInt64(inc),
+         llvm::ConstantInt::get(
+             llvm::Type::getInt32Ty(llvmCtx),
+             options_.proto().parallel_schedule()),
+         getLLVMConstantSignedInt64(options_.proto().parallel_chunk_size())});
+    return builder.GetInsertBlock();
+  }
 
-    // Create Latch
-    {
-      halide_cg.get_builder().SetInsertPoint(loopLatchBB);
-      auto incVal = IslExprToSInt(node.get_inc());
-      phi->addIncoming(
-          halide_cg.get_builder().CreateAdd(
-              phi, getLLVMConstantSignedInt64(incVal)),
-          loopLatchBB);
-      halide_cg.get_builder().CreateBr(headerBB);
-    }
-
-    halide_cg.get_builder().SetInsertPoint(loopExitBB);
-    halide_cg.sym_pop(iterator.get_name());
-#ifdef TAPIR_VERSION_MAJOR
-    if (parallel) {
-      auto* syncBB = llvm::BasicBlock::Create(llvmCtx, "synced", function);
-      halide_cg.get_builder().CreateSync(syncBB, SyncRegion);
-      halide_cg.get_builder().SetInsertPoint(syncBB);
+  llvm::Function* getParallelForRuntime(llvm::FunctionType* bodyTy) {
+    static constexpr auto kName = "tc_cpu_parallel_for";
+    auto* module = halide_cg.get_module();
+    if (auto* runtime = module->getFunction(kName)) {
+      return runtime;
     }
-#endif
-    return halide_cg.get_builder().GetInsertBlock();
+    auto* i64Ty = llvm::Type::getInt64Ty(llvmCtx);
+    auto* functionType = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(llvmCtx),
+        {bodyTy->getPointerTo(),
+         llvm::Type::getInt8PtrTy(llvmCtx),
+         i64Ty,
+         i64Ty,
+         i64Ty,
+         llvm::Type::getInt32Ty(llvmCtx),
+         i64Ty},
+        false);
+    return llvm::Function::Create(
+        functionType, llvm::Function::ExternalLinkage, kName, module);
   }
 
   llvm::BasicBlock* emitStmt(isl::ast_node_user node) {
@@ -590,10 +1035,8 @@ class LLVMCodegen {
       subscriptValues.push_back(halide_cg.getValue(subscript));
     }
 
-    auto destAddr = halide_cg.get_builder().CreateInBoundsGEP(
-        halide_cg.sym_get(arrayName), subscriptValues);
-
     halide_cg.iteratorMap_ = &iteratorMaps_.at(id);
+    auto destAddr = halide_cg.getElementAddress(arrayName, subscriptValues);
     llvm::Value* rhs = halide_cg.codegen(op->values[0]);
     halide_cg.get_builder().CreateStore(rhs, destAddr);
     return halide_cg.get_builder().GetInsertBlock();
@@ -608,9 +1051,19 @@ class LLVMCodegen {
   const Scop& scop_;
   const IteratorMapsType& iteratorMaps_;
   const StmtSubscriptExprMapType& stmtSubscripts_;
+  const CpuMappingOptions& options_;
 
   std::vector<llvm::Type*> args_;
   std::vector<std::string> argNames_;
+  size_t numInputs_ = 0;
+  // Tensors come first in args_, followed by the symbolic parameters.
+  size_t numTensors_ = 0;
+  std::string kernelName_;
+
+  // Iterators of the loops enclosing the node being emitted, outermost first.
+  std::vector<std::string> liveIterators_;
+  bool inParallelRegion_ = false;
+  size_t numParallelLoops_ = 0;
 
  public:
   CodeGen_TC halide_cg;
@@ -675,21 +1128,276 @@ IslCodegenRes codegenISL(const Scop& scop) {
       std::move(iteratorMaps), std::move(stmtSubscripts), std::move(astNode)};
 }
 
+// Halide only uses the target to pick intrinsics, LLVM is told about the
+// complete target through function attributes.
+Halide::Target makeHalideTarget(const CpuTarget& target) {
+  Halide::Target res(Halide::Target::OSUnknown, Halide::Target::X86, 64);
+  const std::unordered_map<std::string, Halide::Target::Feature> features{
+      {"sse4.1", Halide::Target::SSE41},
+      {"avx", Halide::Target::AVX},
+      {"avx2", Halide::Target::AVX2},
+      {"fma", Halide::Target::FMA},
+      {"f16c", Halide::Target::F16C},
+  };
+  for (const auto& feature : cpuidFeatures(target)) {
+    if (features.count(feature.name) > 0) {
+      res.set_feature(features.at(feature.name));
+    }
+  }
+  return res;
+}
+
+// Restrict the code generated for the functions defined in module to
+// target, regardless of the target machine that compiles them.
+void setTargetAttributes(llvm::Module& module, const CpuTarget& target) {
+  for (auto& function : module) {
+    if (function.isDeclaration()) {
+      continue;
+    }
+    if (!target.cpu.empty()) {
+      function.addFnAttr("target-cpu", target.cpu);
+    }
+    if (!target.features.empty()) {
+      function.addFnAttr("target-features", target.features);
+    }
+  }
+}
+
+std::unique_ptr<llvm::Module> emitKernelVersion(
+    const std::string& name,
+    const Scop& scop,
+    const IslCodegenRes& islCg,
+    const CpuMappingOptions& options,
+    const CpuTarget& target) {
+  auto targetMachine = makeTargetMachine(target);
+  LLVMCodegen cg(
+      scop,
+      islCg.iteratorMaps,
+      islCg.stmtSubscripts,
+      options,
+      makeHalideTarget(target));
+  auto* module = cg.halide_cg.get_module();
+  module->setDataLayout(targetMachine->createDataLayout());
+  module->setTargetTriple(targetMachine->getTargetTriple().str());
+  cg.createSignature(scop.halide.inputs, scop.halide.outputs, name);
+  cg.createPackedWrapper(name);
+  cg.CodeGen(islCg.astNode);
+  setTargetAttributes(*module, target);
+  cg.halide_cg.optimize_module(*targetMachine);
+  return cg.halide_cg.move_module();
+}
+
+// Emit "i32 name()" returning the position of the first of targets whose
+// features the running CPU supports, or the last position if there is none.
+// Support is checked with CPUID (and XGETBV for the extensions needing OS
+// support) on the first call only, the result is cached in a global.
+llvm::Function* emitVersionSelector(
+    llvm::Module& module,
+    const std::string& name,
+    const std::vector<CpuTarget>& targets) {
+  auto& ctx = module.getContext();
+  auto* i32Ty = llvm::Type::getInt32Ty(ctx);
+  auto* selector = llvm::Function::Create(
+      llvm::FunctionType::get(i32Ty, false),
+      llvm::Function::InternalLinkage,
+      name,
+      &module);
+  auto* cached = new llvm::GlobalVariable(
+      module,
+      i32Ty,
+      false,
+      llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantInt::get(i32Ty, -1),
+      name + "_cached");
+  cached->setAlignment(4);
+
+  auto* entryBB = llvm::BasicBlock::Create(ctx, "entry", selector);
+  auto* cachedBB = llvm::BasicBlock::Create(ctx, "cached", selector);
+  auto* detectBB = llvm::BasicBlock::Create(ctx, "detect", selector);
+  auto* xgetbvBB = llvm::BasicBlock::Create(ctx, "xgetbv", selector);
+  auto* selectBB = llvm::BasicBlock::Create(ctx, "select", selector);
+  llvm::IRBuilder<> builder(entryBB);
+
+  // Several threads may race to initialize the cache, they all store the
+  // same value.
+  auto* load = builder.CreateAlignedLoad(cached, 4);
+  load->setAtomic(llvm::AtomicOrdering::Monotonic);
+  builder.CreateCondBr(
+      builder.CreateICmpSGE(load, builder.getInt32(0)), cachedBB, detectBB);
+  builder.SetInsertPoint(cachedBB);
+  builder.CreateRet(load);
+
+  builder.SetInsertPoint(detectBB);
+  auto* cpuidResTy = llvm::StructType::get(ctx, {i32Ty, i32Ty, i32Ty, i32Ty});
+  auto* cpuid = llvm::InlineAsm::get(
+      llvm::FunctionType::get(cpuidResTy, {i32Ty, i32Ty}, false),
+      "cpuid",
+      "={ax},={bx},={cx},={dx},0,2,~{dirflag},~{fpsr},~{flags}",
+      false);
+  std::unordered_map<uint32_t, llvm::Value*> leaves;
+  for (auto leaf : {0u, 1u, 7u}) {
+    leaves[leaf] = builder.CreateCall(
+        cpuid, {builder.getInt32(leaf), builder.getInt32(0)});
+  }
+  auto* maxLeaf = builder.CreateExtractValue(leaves.at(0), {0});
+  auto isSet = [&builder](llvm::Value* reg, uint32_t bit) {
+    return builder.CreateICmpNE(
+        builder.CreateAnd(reg, builder.getInt32(1u << bit)),
+        builder.getInt32(0));
+  };
+  // XGETBV faults unless the OS enabled it (OSXSAVE).
+  auto* osxsave = isSet(builder.CreateExtractValue(leaves.at(1), {2}), 27);
+  builder.CreateCondBr(osxsave, xgetbvBB, selectBB);
+
+  builder.SetInsertPoint(xgetbvBB);
+  auto* xgetbv = llvm::InlineAsm::get(
+      llvm::FunctionType::get(
+          llvm::StructType::get(ctx, {i32Ty, i32Ty}), {i32Ty}, false),
+      "xgetbv",
+      "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}",
+      false);
+  auto* xcr0Value = builder.CreateExtractValue(
+      builder.CreateCall(xgetbv, {builder.getInt32(0)}), {0});
+  builder.CreateBr(selectBB);
+
+  builder.SetInsertPoint(selectBB);
+  auto* xcr0 = builder.CreatePHI(i32Ty, 2);
+  xcr0->addIncoming(builder.getInt32(0), detectBB);
+  xcr0->addIncoming(xcr0Value, xgetbvBB);
+
+  llvm::Value* version = builder.getInt32(targets.size() - 1);
+  for (size_t i = targets.size() - 1; i-- > 0;) {
+    llvm::Value* supported = builder.getTrue();
+    for (const auto& feature : cpuidFeatures(targets[i])) {
+      auto leaf = leaves.find(feature.leaf);
+      TC_CHECK(leaf != leaves.end()) << "CPUID leaf not queried";
+      supported = builder.CreateAnd(
+          supported,
+          builder.CreateICmpUGE(maxLeaf, builder.getInt32(feature.leaf)));
+      supported = builder.CreateAnd(
+          supported,
+          isSet(
+              builder.CreateExtractValue(leaf->second, {feature.reg}),
+              feature.bit));
+      if (feature.xcr0Mask != 0) {
+        auto* mask = builder.getInt32(feature.xcr0Mask);
+        supported = builder.CreateAnd(
+            supported,
+            builder.CreateICmpEQ(builder.CreateAnd(xcr0, mask), mask));
+      }
+    }
+    version = builder.CreateSelect(supported, builder.getInt32(i), version);
+  }
+  auto* store = builder.CreateAlignedStore(version, cached, 4);
+  store->setAtomic(llvm::AtomicOrdering::Monotonic);
+  builder.CreateRet(version);
+  return selector;
+}
+
+// Emit the function "name" which forwards its arguments to the function
+// among versions at the position returned by selector.
+void emitDispatcher(
+    llvm::Module& module,
+    const std::string& name,
+    const std::vector<std::string>& versions,
+    llvm::Function* selector) {
+  auto& ctx = module.getContext();
+  auto* first = module.getFunction(versions.front());
+  auto* dispatcher = llvm::Function::Create(
+      first->getFunctionType(),
+      llvm::Function::ExternalLinkage,
+      name,
+      &module);
+  // Only the parameter and return attributes of the versions carry over,
+  // their target attributes would let the dispatcher itself use
+  // instructions the CPU running it may not have.
+  auto attributes = first->getAttributes();
+  std::vector<llvm::AttributeSet> paramAttributes;
+  for (unsigned i = 0; i < first->arg_size(); ++i) {
+    paramAttributes.push_back(attributes.getParamAttributes(i));
+  }
+  dispatcher->setAttributes(llvm::AttributeList::get(
+      ctx,
+      llvm::AttributeSet(),
+      attributes.getRetAttributes(),
+      paramAttributes));
+  std::vector<llvm::Value*> args;
+  for (auto& arg : dispatcher->args()) {
+    args.push_back(&arg);
+  }
+
+  llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", dispatcher));
+  auto* version = builder.CreateCall(selector);
+  auto* fallbackBB = llvm::BasicBlock::Create(ctx, "fallback", dispatcher);
+  auto* switchInst =
+      builder.CreateSwitch(version, fallbackBB, versions.size() - 1);
+  for (size_t i = 0; i < versions.size(); ++i) {
+    auto* versionBB = fallbackBB;
+    if (i + 1 < versions.size()) {
+      versionBB = llvm::BasicBlock::Create(
+          ctx, "version" + std::to_string(i), dispatcher, fallbackBB);
+      switchInst->addCase(builder.getInt32(i), versionBB);
+    }
+    llvm::IRBuilder<> versionBuilder(versionBB);
+    versionBuilder.CreateCall(module.getFunction(versions[i]), args);
+    versionBuilder.CreateRetVoid();
+  }
+}
+
 } // namespace
 
 std::unique_ptr<llvm::Module> emitLLVMKernel(
     const std::string& specializedName,
     const Scop& scop,
-    const llvm::DataLayout& dataLayout) {
+    const CpuMappingOptions& options) {
   auto islCg = codegenISL(scop);
-  LLVMCodegen cg(scop, islCg.iteratorMaps, islCg.stmtSubscripts);
-  cg.halide_cg.get_module()->setDataLayout(dataLayout);
-  cg.halide_cg.get_module()->setTargetTriple(
-      llvm::EngineBuilder().selectTarget()->getTargetTriple().str());
-  cg.createSignature(scop.halide.inputs, scop.halide.outputs, specializedName);
-  cg.CodeGen(islCg.astNode);
-  cg.halide_cg.optimize_module();
-  return cg.halide_cg.move_module();
+  auto targets = cpuTargets(options);
+  if (targets.size() == 1) {
+    return emitKernelVersion(
+        specializedName, scop, islCg, options, targets.front());
+  }
+
+  // Generate one version per target named after its position in the
+  // dispatch order, then the dispatching entry points.
+  std::unique_ptr<llvm::Module> module;
+  std::vector<std::string> versions;
+  for (const auto& target : targets) {
+    versions.push_back(
+        specializedName + "_v" + std::to_string(versions.size()));
+    auto version =
+        emitKernelVersion(versions.back(), scop, islCg, options, target);
+    if (!module) {
+      module = std::move(version);
+    } else {
+      TC_CHECK(!llvm::Linker::linkModules(*module, std::move(version)))
+          << "Could not link the versions of " << specializedName;
+    }
+  }
+  auto* selector =
+      emitVersionSelector(*module, specializedName + "_select", targets);
+  std::vector<std::string> packedVersions;
+  for (const auto& version : versions) {
+    packedVersions.push_back(packedKernelName(version));
+  }
+  emitDispatcher(*module, specializedName, versions, selector);
+  emitDispatcher(
+      *module, packedKernelName(specializedName), packedVersions, selector);
+  // Versions are only reachable through the dispatchers.
+  for (size_t i = 0; i < versions.size(); ++i) {
+    module->getFunction(versions[i])->setLinkage(
+        llvm::GlobalValue::InternalLinkage);
+    module->getFunction(packedVersions[i])
+        ->setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
+
+  if (llvm::verifyModule(*module)) {
+    llvm::verifyModule(*module, &llvm::outs());
+    throw std::runtime_error("LLVM multiversioned module is invalid.");
+  }
+  LOG_IF(INFO, FLAGS_llvm_dump_after_opt)
+      << "[LLVM-IR] Multiversioned kernel:\n"
+      << toString(module.get());
+  return module;
 }
 
 } // namespace polyhedral
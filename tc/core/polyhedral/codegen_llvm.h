@@ -49,13 +49,33 @@ static inline std::string toString(llvm::Module* llvmObject) {
   return output;
 }
 
+class CpuMappingOptions;
+
 namespace polyhedral {
 struct Scop;
 
+/// Name of the entry point emitted alongside each kernel which takes all the
+/// kernel arguments packed in a single array of pointers (inputs first, then
+/// outputs, then pointers to the 64-bit values of the symbolic parameters).
+/// This allows calling kernels with an arbitrary number of
+/// arguments through a single function pointer type: void(*)(void**).
+inline std::string packedKernelName(const std::string& specializedName) {
+  return specializedName + "_packed";
+}
+
+/// Emit an LLVM module for the scheduled scop.  The outermost coincident
+/// loops are outlined and executed on the TC CPU thread pool if
+/// options.proto().parallelize() is set.
+/// Code is generated for the target CPU of the options.  If the options
+/// have multiversion targets, one version is generated per target and the
+/// kernel entry points select one at runtime depending on the features of
+/// the running CPU (see cpuTargets).
+/// The parameters of the scop that are not fixed in its context are passed
+/// to the kernel as 64-bit integers after the tensors, in alphabetical order.
 std::unique_ptr<llvm::Module> emitLLVMKernel(
     const std::string& specializedName,
     const Scop& scop,
-    const llvm::DataLayout& dataLayout);
+    const CpuMappingOptions& options);
 
 // TODO: I want to do something like the following, but compilation was unhappy
 //  using initialize_llvm = Halide::Internal::CodeGen_LLVM::initialize_llvm;
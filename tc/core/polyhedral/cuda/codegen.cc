@@ -31,6 +31,7 @@
 #include "tc/core/polyhedral/memory_promotion.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/schedule_transforms.h"
+#include "tc/core/tensor.h"
 
 using namespace std;
 
@@ -163,36 +164,52 @@ void emitKernelSignature(
 // This is similar to the pass unpack_buffers in
 // Halide, which unpacks strides, grabs alignment constraints,
 // etc.
-// TODO: this is still incorrect because at this point we only use the
-// DLTensor shape (i.e. sizes) of the computations.
-// To be correct we need the strides.
-// Unfortunately, strides are related to memory allocation and are ML
-// framework specific.
+// Strides are related to memory allocation and are ML framework specific.
 // Halide has its own facilities to allocate memory and handles concrete
 // allocated memory at the (linearized) Buffer level.
 // We don't want that, and we are even at a higher level of IR where Buffer to
 // not exist.
-// So we must pass an additional structure to save strides that we collect at
-// runtime from the actual tensors that are passed to TcOp.
+// So we JIT-specialize on the strides collected from the actual tensors that
+// are passed to TcOp: tensors that are not contiguous are viewed as arrays
+// whose sizes are derived from their strides (see makeArraySizesFromStrides).
 // We could go parametric but then we need to pass all the strides as
 // parameters to the kernel call. This is doable, we've been doing it since
 // day 1 with fbcuda's DeviceTensor but it loses runtime alignment information
 // (or we need to jump through hoops to make proper use of it).
-// So the better path here is probably to JIT everything, except people want
-// as parametric code as possible, **sigh**.
 void emitTensorView(
     stringstream& ss,
     Halide::OutputImageParam p,
     const map<string, Halide::Expr>& paramValues,
+    const Scop& scop,
     bool constInput = false) {
   WS ws;
   stringstream ssViewType;
-  for (int i = 1; i < p.dimensions(); ++i) { // Skip the outermost dimension
-    Halide::Expr extent = p.parameter().extent_constraint(i);
-    extent = Halide::Internal::substitute(paramValues, extent);
-    TC_CHECK(extent.defined())
-        << "Undefined extent on input/output tensor. Forward bounds inference should have set these\n";
-    ssViewType << "[" << extent << "]";
+  auto strides = scop.tensorStrides.find(p.name());
+  if (strides != scop.tensorStrides.end()) {
+    std::vector<int64_t> innerSizes;
+    for (int i = 1; i < p.dimensions(); ++i) { // Skip the outermost dimension
+      auto extent = Halide::Internal::simplify(Halide::Internal::substitute(
+          paramValues, p.parameter().extent_constraint(i)));
+      if (auto size = Halide::Internal::as_const_int(extent)) {
+        innerSizes.push_back(*size);
+      }
+    }
+    auto sizes = makeArraySizesFromStrides(innerSizes, strides->second);
+    TC_CHECK(!sizes.empty())
+        << "NYI: CUDA kernels on tensor " << p.name()
+        << " whose strides do not derive from those of a contiguous tensor"
+        << " or whose elements overlap";
+    for (auto size : sizes) {
+      ssViewType << "[" << size << "]";
+    }
+  } else {
+    for (int i = 1; i < p.dimensions(); ++i) { // Skip the outermost dimension
+      Halide::Expr extent = p.parameter().extent_constraint(i);
+      extent = Halide::Internal::substitute(paramValues, extent);
+      TC_CHECK(extent.defined())
+          << "Undefined extent on input/output tensor. Forward bounds inference should have set these\n";
+      ssViewType << "[" << extent << "]";
+    }
   }
   ss << ws.tab();
   ss << (constInput ? "const " : "") << p.type() << " (*" << p.name() << ")"
@@ -208,18 +225,20 @@ void emitTensorView(
 void emitTensorViews(
     stringstream& ss,
     const vector<Halide::OutputImageParam>& params,
-    const map<string, Halide::Expr>& paramValues) {
+    const map<string, Halide::Expr>& paramValues,
+    const Scop& scop) {
   for (auto p : params) {
-    emitTensorView(ss, p, paramValues);
+    emitTensorView(ss, p, paramValues, scop);
   }
 }
 
 void emitTensorViews(
     stringstream& ss,
     const vector<Halide::ImageParam>& params,
-    const map<string, Halide::Expr>& paramValues) {
+    const map<string, Halide::Expr>& paramValues,
+    const Scop& scop) {
   for (auto p : params) {
-    emitTensorView(ss, p, paramValues, true);
+    emitTensorView(ss, p, paramValues, scop, true);
   }
 }
 
@@ -798,8 +817,8 @@ string emitCudaKernel(
   stringstream ss;
   emitKernelSignature(ss, specializedName, scop);
   emitThreadIdInit(ss, mscop);
-  emitTensorViews(ss, scop.halide.outputs, paramValues);
-  emitTensorViews(ss, scop.halide.inputs, paramValues);
+  emitTensorViews(ss, scop.halide.outputs, paramValues, scop);
+  emitTensorViews(ss, scop.halide.inputs, paramValues, scop);
   emitTmpDecl(ss, scop);
   emitPromotedArrayViewsHalide(ss, scop);
   NodeInfoMapType nodeInfoMap;
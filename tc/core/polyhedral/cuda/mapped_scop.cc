@@ -985,25 +985,33 @@ detail::ScheduleTree* MappedScop::splitOutReductionTileAndInsertSyncs(
 std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
     std::unique_ptr<Scop>&& scopUPtr,
     const CudaMappingOptions& cudaOptions) {
+  const auto& generic = cudaOptions.generic;
+
+  // 1a. Optionally specialize before scheduling...
+  if (generic.proto.fix_parameters_before_scheduling()) {
+    scopUPtr->specializeToContext();
+  }
+
+  // 2. Schedule
+  return mapWithOuterBlockInnerThreadStrategy(
+      Scop::makeScheduled(*scopUPtr, generic.outerScheduleOptions),
+      cudaOptions);
+}
+
+std::unique_ptr<MappedScop> MappedScop::mapWithOuterBlockInnerThreadStrategy(
+    std::unique_ptr<Scop>&& scheduledScop,
+    const CudaMappingOptions& cudaOptions) {
   using namespace polyhedral::detail;
 
   const auto& generic = cudaOptions.generic;
   auto mappedScop = std::unique_ptr<MappedScop>(new MappedScop(
-      std::move(scopUPtr),
+      std::move(scheduledScop),
       ::tc::Grid(cudaOptions.grid),
       ::tc::Block(cudaOptions.block),
       generic.proto.unroll(),
       cudaOptions.proto().use_readonly_cache()));
   auto& scop = mappedScop->scop_;
 
-  // 1a. Optionally specialize before scheduling...
-  if (generic.proto.fix_parameters_before_scheduling()) {
-    scop->specializeToContext();
-  }
-
-  // 2. Schedule
-  scop = Scop::makeScheduled(*scop, generic.outerScheduleOptions);
-
   // 3. Tile
   TC_CHECK_LT(0u, generic.tiling.size())
       << "Must pass tile vector with >= 1 tile sizes";
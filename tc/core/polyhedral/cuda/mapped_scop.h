@@ -96,6 +96,12 @@ class MappedScop {
   static std::unique_ptr<MappedScop> makeWithOuterBlockInnerThreadStrategy(
       std::unique_ptr<Scop>&& scopUPtr,
       const CudaMappingOptions& mappingOptions);
+  // Same as makeWithOuterBlockInnerThreadStrategy for a scop that is already
+  // specialized (if fix_parameters_before_scheduling is set) and scheduled
+  // with the outer schedule options, e.g. by CompilationStageCache.
+  static std::unique_ptr<MappedScop> mapWithOuterBlockInnerThreadStrategy(
+      std::unique_ptr<Scop>&& scheduledScop,
+      const CudaMappingOptions& mappingOptions);
 
   // Map the initial (up to "nToMap") band members of "band"
   // to successive block identifiers.
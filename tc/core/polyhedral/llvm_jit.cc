@@ -24,73 +24,44 @@
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include "tc/core/check.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_target.h"
+#include "tc/core/cpu/cpu_thread_pool.h"
 #include "tc/core/flags.h"
 #include "tc/core/polyhedral/codegen_llvm.h"
 
 using namespace llvm;
 
-// Parse through ldconfig to find the path of a particular
-// shared library. This is an unfortunate way to have to
-// find it, but I couldn't immediately find something in
-// imported libraries that would resolve this for us.
-std::string find_library_path(std::string library) {
-  std::string command = "ldconfig -p | grep " + library + " | grep x86-64";
-
-  FILE* fpipe = popen(command.c_str(), "r");
-
-  if (fpipe == nullptr) {
-    throw std::runtime_error("Failed to popen()");
-  }
-
-  std::string output;
-  char buffer[512];
-
-  while (1) {
-    int charactersRead = fread(buffer, 1, sizeof(buffer), fpipe);
-    if (charactersRead == 0)
-      break;
-    output += std::string(buffer, charactersRead);
-  }
-  pclose(fpipe);
+namespace tc {
 
-  auto idx = output.rfind("=> ");
-  if (idx == std::string::npos) {
-    throw std::runtime_error("Failed locate library: " + library);
-  }
-  output = output.substr(idx + 3);
-  if (output.length() > 0 && output[output.length() - 1] == '\n') {
-    output = output.substr(0, output.length() - 1);
-  }
-  return output;
+namespace {
+// Make the runtime functions called by generated kernels resolvable
+// regardless of how the library containing them was loaded.
+void registerRuntimeSymbols() {
+  sys::DynamicLibrary::AddSymbol(
+      "tc_cpu_parallel_for", reinterpret_cast<void*>(&tc_cpu_parallel_for));
 }
-
-namespace tc {
+} // namespace
 
 #if LLVM_VERSION_MAJOR <= 6
 
-Jit::Jit()
-    : TM_(EngineBuilder().selectTarget()),
+Jit::Jit(ObjectCache* cache)
+    : TM_(makeTargetMachine(hostCpuTarget())),
       DL_(TM_->createDataLayout()),
       objectLayer_([]() { return std::make_shared<SectionMemoryManager>(); }),
-      compileLayer_(objectLayer_, orc::SimpleCompiler(*TM_)) {
-  std::string err;
-
-  auto path = find_library_path("libcilkrts.so");
-  sys::DynamicLibrary::LoadLibraryPermanently(path.c_str(), &err);
-  if (err != "") {
-    throw std::runtime_error("Failed to find cilkrts: " + err);
-  }
+      compileLayer_(objectLayer_, orc::SimpleCompiler(*TM_, cache)) {
+  registerRuntimeSymbols();
 }
 
-void Jit::addModule(std::shared_ptr<Module> M) {
-  M->setTargetTriple(TM_->getTargetTriple().str());
-  auto Resolver = orc::createLambdaResolver(
-      [&](const std::string& Name) {
+std::shared_ptr<JITSymbolResolver> Jit::makeResolver() {
+  return orc::createLambdaResolver(
+      [this](const std::string& Name) {
         if (auto Sym = compileLayer_.findSymbol(Name, false))
           return Sym;
         return JITSymbol(nullptr);
@@ -100,14 +71,30 @@ void Jit::addModule(std::shared_ptr<Module> M) {
           return JITSymbol(SymAddr, JITSymbolFlags::Exported);
         return JITSymbol(nullptr);
       });
+}
 
-  auto res = compileLayer_.addModule(M, std::move(Resolver));
+void Jit::addModule(std::shared_ptr<Module> M) {
+  M->setTargetTriple(TM_->getTargetTriple().str());
+  auto res = compileLayer_.addModule(M, makeResolver());
   TC_CHECK(res) << "Failed to jit compile.";
 }
 
+void Jit::addObject(std::unique_ptr<MemoryBuffer> object) {
+  auto obj = object::ObjectFile::createObjectFile(object->getMemBufferRef());
+  if (!obj) {
+    throw std::runtime_error(
+        "Could not load object: " + llvm::toString(obj.takeError()));
+  }
+  auto res = objectLayer_.addObject(
+      std::make_shared<object::OwningBinary<object::ObjectFile>>(
+          std::move(*obj), std::move(object)),
+      makeResolver());
+  TC_CHECK(res) << "Failed to load object.";
+}
+
 #else
 
-Jit::Jit()
+Jit::Jit(ObjectCache* cache)
     : ES(),
       Resolver(llvm::orc::createLegacyLookupResolver(
           ES,
@@ -122,7 +109,7 @@ Jit::Jit()
             return nullptr;
           },
           [](Error err) { throw std::runtime_error("Lookup failed!"); })),
-      TM_(EngineBuilder().selectTarget()),
+      TM_(makeTargetMachine(hostCpuTarget())),
       DL_(TM_->createDataLayout()),
       objectLayer_(
           ES,
@@ -130,13 +117,14 @@ Jit::Jit()
             return llvm::orc::RTDyldObjectLinkingLayer::Resources{
                 std::make_shared<SectionMemoryManager>(), Resolver};
           }),
-      compileLayer_(objectLayer_, orc::SimpleCompiler(*TM_)) {
+      compileLayer_(objectLayer_, orc::SimpleCompiler(*TM_, cache)) {
   std::string err;
 
   sys::DynamicLibrary::LoadLibraryPermanently(nullptr, &err);
   if (err != "") {
-    throw std::runtime_error("Failed to find cilkrts: " + err);
+    throw std::runtime_error("Failed to load process symbols: " + err);
   }
+  registerRuntimeSymbols();
 }
 
 void Jit::addModule(std::shared_ptr<Module> M) {
@@ -145,13 +133,21 @@ void Jit::addModule(std::shared_ptr<Module> M) {
   llvm::Error res = compileLayer_.addModule(K, CloneModule(*M));
   TC_CHECK(!res) << "Failed to jit compile.";
 }
+
+void Jit::addObject(std::unique_ptr<MemoryBuffer> object) {
+  auto K = ES.allocateVModule();
+  llvm::Error res = objectLayer_.addObject(K, std::move(object));
+  TC_CHECK(!res) << "Failed to load object.";
+}
 #endif
 
 std::shared_ptr<Module> Jit::codegenScop(
     const std::string& specializedName,
     const polyhedral::Scop& scop) {
   std::shared_ptr<Module> mod = emitLLVMKernel(
-      specializedName, scop, getTargetMachine().createDataLayout());
+      specializedName,
+      scop,
+      CpuMappingOptions::makeNaiveMappingOptions().parallelize(false));
   addModule(mod);
   return mod;
 }
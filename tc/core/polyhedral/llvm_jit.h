@@ -25,6 +25,11 @@
 #include "llvm/ExecutionEngine/Orc/Core.h"
 #endif
 
+namespace llvm {
+class MemoryBuffer;
+class ObjectCache;
+} // namespace llvm
+
 namespace tc {
 
 namespace polyhedral {
@@ -43,13 +48,21 @@ class Jit {
   llvm::orc::IRCompileLayer<decltype(objectLayer_), llvm::orc::SimpleCompiler>
       compileLayer_;
 
+#if LLVM_VERSION_MAJOR <= 6
+  std::shared_ptr<llvm::JITSymbolResolver> makeResolver();
+#endif
+
  public:
-  Jit();
+  /// If cache is not null, compiled objects are looked up in and stored into
+  /// it, based on the module identifiers.
+  explicit Jit(llvm::ObjectCache* cache = nullptr);
 
   std::shared_ptr<llvm::Module> codegenScop(
       const std::string& specializedName,
       const polyhedral::Scop& scop);
   void addModule(std::shared_ptr<llvm::Module> M);
+  /// Links an object file previously produced by the JIT for the same target.
+  void addObject(std::unique_ptr<llvm::MemoryBuffer> object);
 
   llvm::JITSymbol findSymbol(const std::string name);
   llvm::JITTargetAddress getSymbolAddress(const std::string name);
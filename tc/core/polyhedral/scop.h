@@ -66,6 +66,7 @@ struct Scop {
   static std::unique_ptr<Scop> makeScop(const Scop& scop) {
     auto res = std::unique_ptr<Scop>(new Scop());
     res->parameterValues = scop.parameterValues;
+    res->tensorStrides = scop.tensorStrides;
     res->halide = scop.halide;
     res->body = scop.body;
     res->dependences = scop.dependences;
@@ -508,6 +509,11 @@ struct Scop {
   const isl::union_set domain() const;
   // The parameter values of a specialized Scop.
   std::unordered_map<std::string, int> parameterValues;
+  // The strides, in number of elements, of the tensors that are not
+  // contiguous in memory, indexed by tensor name.  Code generation
+  // specializes the accesses to these tensors for these strides, the other
+  // tensors are assumed contiguous.
+  std::unordered_map<std::string, std::vector<int64_t>> tensorStrides;
 
   Body body;
 
@@ -63,6 +63,20 @@ void checkSizesAndStridesAreCompliant(
             << " but found " << actual->shape[ii];
       }
     }
+    // Kernels are specialized for the memory layout of their arguments.
+    auto actualStrides = normalizeStrides(
+        expected.shape,
+        std::vector<int64_t>(
+            actual->strides,
+            actual->strides ? actual->strides + actual->ndim : nullptr));
+    auto expectedStrides = normalizeStrides(expected.shape, expected.strides);
+    for (int ii = 0; ii < actual->ndim; ++ii) {
+      if (actualStrides[ii] != expectedStrides[ii]) {
+        throw lang::ErrorReport(dbg)
+            << "expected stride " << expectedStrides[ii] << " for dim " << ii
+            << " but found " << actualStrides[ii];
+      }
+    }
   }
 }
 } // namespace
@@ -43,6 +43,60 @@ std::vector<int64_t> toIntVector(const int64_t* ptr, size_t ndim) {
 }
 } // namespace detail
 
+std::vector<int64_t> normalizeStrides(
+    const std::vector<int64_t>& sizes,
+    const std::vector<int64_t>& strides) {
+  if (strides.empty()) {
+    return makeStridesFromSizes(sizes);
+  }
+  TC_CHECK_EQ(sizes.size(), strides.size());
+  auto res = strides;
+  for (int i = static_cast<int>(sizes.size()) - 1; i >= 0; --i) {
+    if (sizes[i] == 1) {
+      res[i] = (i + 1 < static_cast<int>(sizes.size()))
+          ? res[i + 1] * sizes[i + 1]
+          : 1;
+    }
+  }
+  return res;
+}
+
+std::vector<int64_t> makeArraySizesFromStrides(
+    const std::vector<int64_t>& innerSizes,
+    const std::vector<int64_t>& strides) {
+  if (strides.size() < 2 || innerSizes.size() + 1 != strides.size()) {
+    return {};
+  }
+  std::vector<int64_t> sizes(innerSizes.size(), 1);
+  // The nearest inner dimension not of size 1 and its stride, at first a
+  // virtual innermost dimension of stride 1.
+  auto inner = strides.size();
+  int64_t innerStride = 1;
+  for (auto i = strides.size(); i-- > 0;) {
+    if (i > 0 && innerSizes[i - 1] == 1) {
+      continue;
+    }
+    if (strides[i] <= 0 || strides[i] % innerStride != 0) {
+      return {};
+    }
+    auto size = strides[i] / innerStride;
+    if (inner < strides.size()) {
+      if (size < innerSizes[inner - 1]) {
+        return {};
+      }
+      sizes[inner - 1] = size;
+    } else if (i + 1 < strides.size()) {
+      // Only dimensions of size 1 are inner to i.
+      sizes.back() = size;
+    } else if (size != 1) {
+      return {};
+    }
+    inner = i;
+    innerStride = strides[i];
+  }
+  return sizes;
+}
+
 TensorInfo::TensorInfo(
     DLDataType t,
     uint64_t align,
@@ -113,6 +113,36 @@ struct TensorInfo {
 template <typename T>
 std::vector<T> makeStridesFromSizes(const std::vector<T>& sizes);
 
+/// Given sizes and strides, this returns strides describing the same memory
+/// layout where the strides of the dimensions of size 1, which do not affect
+/// addressing, are the contiguous ones.  Empty strides denote a contiguous
+/// tensor (DLPack convention).
+/// Two tensors with the same sizes whose elements are laid out identically
+/// have the same normalized strides.
+std::vector<int64_t> normalizeStrides(
+    const std::vector<int64_t>& sizes,
+    const std::vector<int64_t>& strides);
+
+/// Given the strides of a tensor with at least 2 dimensions and the sizes of
+/// its inner dimensions (all but the outermost one), this returns the sizes
+/// of the inner dimensions of an array through which the tensor can be
+/// indexed as if it were contiguous, i.e. such that each stride is the product
+/// of the array sizes of the inner dimensions.
+/// This is the case if the innermost stride is 1 and every stride is a
+/// multiple of the next one, at least the next one times the size of its
+/// dimension so that the elements do not overlap, e.g. for tensors sliced
+/// from contiguous ones.
+/// Dimensions of size 1 are only indexed by 0, their strides are ignored and
+/// their array size is 1, unless there is no other inner dimension to make up
+/// for the stride of the outer ones.
+/// For instance, a [3, 4, 5] slice of a contiguous [3, 8, 6] tensor has
+/// strides [48, 6, 1] and can be indexed through an array of [8, 6], a
+/// [3, 1, 5] slice of it through an array of [1, 48].
+/// \returns an empty vector if there is no such array.
+std::vector<int64_t> makeArraySizesFromStrides(
+    const std::vector<int64_t>& innerSizes,
+    const std::vector<int64_t>& strides);
+
 // Specializes for DLTensor, DLConstTensor
 template <typename DLTensorPtrType>
 std::vector<TensorInfo> makeTensorInfoVector(
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "tc/core/utils/math.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+/// Stopping criteria of measure: run at least minRuns (and 2, if maxRuns
+/// allows, to estimate the variance) and at most maxRuns times, and stop in
+/// between as soon as the confidence interval of the median runtime is
+/// within relativeConfidenceInterval of the median, or once the runs have
+/// taken timeBudget.
+struct MeasurementOptions {
+  size_t minRuns;
+  size_t maxRuns;
+  double relativeConfidenceInterval;
+  Duration timeBudget;
+};
+
+namespace detail {
+/// Runtimes further from the median than this many median absolute
+/// deviations, scaled to estimate the standard deviation of normally
+/// distributed runtimes, are outliers (e.g. preempted runs). Runtimes within
+/// kMinOutlierDeviation of the median never are, the median absolute
+/// deviation of runtimes measured with a coarse clock is often zero.
+constexpr double kOutlierDeviations = 3.0;
+constexpr double kMadToStdDev = 1.4826;
+constexpr double kMinOutlierDeviation = 0.05;
+/// 95% confidence, with the standard error of the median of normally
+/// distributed values, about 1.2533 sigma / sqrt(n).
+constexpr double kConfidenceZ = 1.96;
+constexpr double kMedianStdErrorFactor = 1.2533;
+
+inline std::vector<double> toMicroSeconds(const std::vector<Duration>& v) {
+  std::vector<double> res;
+  res.reserve(v.size());
+  for (auto d : v) {
+    res.push_back(static_cast<double>(d.toMicroSeconds()));
+  }
+  return res;
+}
+} // namespace detail
+
+/// Statistics of the kernel runtimes of several executions, after removal
+/// of the outliers, together with the median cpu overhead.
+inline ProfilingInfo summarizeRuntimes(
+    const std::vector<Duration>& kernelRuntimes,
+    const std::vector<Duration>& cpuOverheads) {
+  auto runtimes = detail::toMicroSeconds(kernelRuntimes);
+  auto center = median(runtimes);
+  std::vector<double> deviations;
+  deviations.reserve(runtimes.size());
+  for (auto r : runtimes) {
+    deviations.push_back(std::abs(r - center));
+  }
+  auto maxDeviation = std::max(
+      detail::kOutlierDeviations * detail::kMadToStdDev * median(deviations),
+      detail::kMinOutlierDeviation * center);
+
+  std::vector<double> inliers;
+  for (auto r : runtimes) {
+    if (std::abs(r - center) <= maxDeviation) {
+      inliers.push_back(r);
+    }
+  }
+  double mean = 0;
+  for (auto r : inliers) {
+    mean += r;
+  }
+  mean /= inliers.size();
+  double variance = 0;
+  for (auto r : inliers) {
+    variance += (r - mean) * (r - mean);
+  }
+  if (inliers.size() > 1) {
+    variance /= inliers.size() - 1;
+  }
+
+  return ProfilingInfo(
+      median(cpuOverheads),
+      Duration::fromMicroSeconds(std::llround(median(inliers))),
+      Duration::fromMicroSeconds(std::llround(std::sqrt(variance))),
+      inliers.size());
+}
+
+/// Half-width of the 95% confidence interval of the median runtime of
+/// timings.
+inline double confidenceInterval(ProfilingInfo timings) {
+  auto stdDev = timings.kernelRuntimeStdDev.toMicroSeconds();
+  return detail::kConfidenceZ * detail::kMedianStdErrorFactor * stdDev /
+      std::sqrt(timings.numRuns);
+}
+
+/// Same, relative to the median runtime.
+inline double relativeConfidenceInterval(ProfilingInfo timings) {
+  auto interval = confidenceInterval(timings);
+  if (interval == 0) {
+    return 0;
+  }
+  auto runtime = timings.kernelRuntime.toMicroSeconds();
+  return runtime == 0 ? std::numeric_limits<double>::infinity()
+                      : interval / runtime;
+}
+
+/// Calls profile, which returns the ProfilingInfo of one execution, until
+/// the stopping criteria of options are met.
+/// \returns the statistics of the runs (see summarizeRuntimes)
+template <typename Profile>
+ProfilingInfo measure(Profile profile, const MeasurementOptions& options) {
+  auto start = std::chrono::system_clock::now();
+  auto maxRuns = std::max<size_t>(options.maxRuns, 1);
+  std::vector<Duration> kernelRuntimes;
+  std::vector<Duration> cpuOverheads;
+  kernelRuntimes.reserve(maxRuns);
+  cpuOverheads.reserve(maxRuns);
+  while (kernelRuntimes.size() < maxRuns) {
+    auto timings = profile();
+    kernelRuntimes.push_back(timings.kernelRuntime);
+    cpuOverheads.push_back(timings.cpuOverhead);
+    // The variance cannot be estimated from a single run.
+    if (kernelRuntimes.size() < std::max<size_t>(options.minRuns, 2)) {
+      continue;
+    }
+    if (options.timeBudget < Duration::since(start) or
+        relativeConfidenceInterval(summarizeRuntimes(
+            kernelRuntimes, cpuOverheads)) <=
+            options.relativeConfidenceInterval) {
+      break;
+    }
+  }
+  return summarizeRuntimes(kernelRuntimes, cpuOverheads);
+}
+} // namespace tc
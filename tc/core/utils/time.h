@@ -74,8 +74,23 @@ struct Duration {
   std::chrono::microseconds val_;
 };
 
+/// Timings of one execution of a kernel, or statistics of several executions
+/// (see measure): kernelRuntime is then the median of the numRuns runtimes
+/// retained and kernelRuntimeStdDev their standard deviation.
 struct ProfilingInfo {
+  ProfilingInfo(
+      Duration cpuOverhead,
+      Duration kernelRuntime,
+      Duration kernelRuntimeStdDev = Duration::zero(),
+      size_t numRuns = 1)
+      : cpuOverhead(cpuOverhead),
+        kernelRuntime(kernelRuntime),
+        kernelRuntimeStdDev(kernelRuntimeStdDev),
+        numRuns(numRuns) {}
+
   Duration cpuOverhead;
   Duration kernelRuntime;
+  Duration kernelRuntimeStdDev;
+  size_t numRuns;
 };
 } // namespace tc
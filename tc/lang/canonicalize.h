@@ -67,6 +67,13 @@ inline CanonicalTcString canonicalTc(const lang::TreeRef& tc) {
   return CanonicalTcString(ss.str());
 }
 
+// same as canonicalTc for a tree that already went through semantic analysis
+inline CanonicalTcString canonicalCheckedTc(const lang::TreeRef& tc) {
+  std::stringstream ss;
+  ss << lang::canonicalize(tc);
+  return CanonicalTcString(ss.str());
+}
+
 inline CanonicalTcString canonicalTc(const std::string& tc) {
   return canonicalTc(lang::Parser(tc).parseFunction());
 }
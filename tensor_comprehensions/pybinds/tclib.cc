@@ -288,6 +288,10 @@ class TunerConfig {
         tunerMinLaunchTotalThreads_(tc::FLAGS_tuner_min_launch_total_threads),
         threads_(tc::FLAGS_tuner_threads),
         devices_(tc::FLAGS_tuner_devices),
+        timeBudget_(tc::FLAGS_tuner_time_budget_s),
+        maxEvaluations_(tc::FLAGS_tuner_max_evaluations),
+        convergenceGenerations_(tc::FLAGS_tuner_convergence_generations),
+        convergenceThreshold_(tc::FLAGS_tuner_convergence_threshold),
         logtostderr_(false),
         // Suppress non-FATAL errors from the python user by default
         stderrthreshold_(google::FATAL) {}
@@ -324,6 +328,22 @@ class TunerConfig {
     devices_ = val;
     return *this;
   }
+  TunerConfig& timeBudget(uint32_t val) {
+    timeBudget_ = val;
+    return *this;
+  }
+  TunerConfig& maxEvaluations(uint32_t val) {
+    maxEvaluations_ = val;
+    return *this;
+  }
+  TunerConfig& convergenceGenerations(uint32_t val) {
+    convergenceGenerations_ = val;
+    return *this;
+  }
+  TunerConfig& convergenceThreshold(double val) {
+    convergenceThreshold_ = val;
+    return *this;
+  }
   TunerConfig& logtostderr(bool val) {
     logtostderr_ = val;
     return *this;
@@ -342,6 +362,10 @@ class TunerConfig {
     savedTunerMinLaunchTotalThreads_ = tc::FLAGS_tuner_min_launch_total_threads;
     savedThreads_ = tc::FLAGS_tuner_threads;
     savedDevices_ = tc::FLAGS_tuner_devices;
+    savedTimeBudget_ = tc::FLAGS_tuner_time_budget_s;
+    savedMaxEvaluations_ = tc::FLAGS_tuner_max_evaluations;
+    savedConvergenceGenerations_ = tc::FLAGS_tuner_convergence_generations;
+    savedConvergenceThreshold_ = tc::FLAGS_tuner_convergence_threshold;
     savedLogtostderr_ = FLAGS_logtostderr;
     savedStderrthreshold_ = FLAGS_stderrthreshold;
 
@@ -353,6 +377,10 @@ class TunerConfig {
     tc::FLAGS_tuner_min_launch_total_threads = tunerMinLaunchTotalThreads_;
     tc::FLAGS_tuner_threads = threads_;
     tc::FLAGS_tuner_devices = devices_;
+    tc::FLAGS_tuner_time_budget_s = timeBudget_;
+    tc::FLAGS_tuner_max_evaluations = maxEvaluations_;
+    tc::FLAGS_tuner_convergence_generations = convergenceGenerations_;
+    tc::FLAGS_tuner_convergence_threshold = convergenceThreshold_;
     FLAGS_logtostderr = logtostderr_;
     FLAGS_stderrthreshold = stderrthreshold_;
   }
@@ -365,6 +393,10 @@ class TunerConfig {
     tc::FLAGS_tuner_min_launch_total_threads = savedTunerMinLaunchTotalThreads_;
     tc::FLAGS_tuner_threads = savedThreads_;
     tc::FLAGS_tuner_devices = savedDevices_;
+    tc::FLAGS_tuner_time_budget_s = savedTimeBudget_;
+    tc::FLAGS_tuner_max_evaluations = savedMaxEvaluations_;
+    tc::FLAGS_tuner_convergence_generations = savedConvergenceGenerations_;
+    tc::FLAGS_tuner_convergence_threshold = savedConvergenceThreshold_;
     FLAGS_logtostderr = savedLogtostderr_;
     FLAGS_stderrthreshold = savedStderrthreshold_;
   }
@@ -378,6 +410,10 @@ class TunerConfig {
   uint32_t tunerMinLaunchTotalThreads_;
   uint32_t threads_;
   std::string devices_;
+  uint32_t timeBudget_;
+  uint32_t maxEvaluations_;
+  uint32_t convergenceGenerations_;
+  double convergenceThreshold_;
   bool logtostderr_;
   uint32_t stderrthreshold_;
   mutable uint32_t savedGenerations_;
@@ -388,6 +424,10 @@ class TunerConfig {
   mutable uint32_t savedTunerMinLaunchTotalThreads_;
   mutable uint32_t savedThreads_;
   mutable std::string savedDevices_;
+  mutable uint32_t savedTimeBudget_;
+  mutable uint32_t savedMaxEvaluations_;
+  mutable uint32_t savedConvergenceGenerations_;
+  mutable double savedConvergenceThreshold_;
   mutable bool savedLogtostderr_;
   mutable uint32_t savedStderrthreshold_;
 };
@@ -524,6 +564,30 @@ PYBIND11_MODULE(tclib, m) {
           gflags::DescribeOneFlag(
               gflags::GetCommandLineFlagInfoOrDie("tuner_devices"))
               .c_str())
+      .def(
+          "time_budget",
+          &TunerConfig::timeBudget,
+          gflags::DescribeOneFlag(
+              gflags::GetCommandLineFlagInfoOrDie("tuner_time_budget_s"))
+              .c_str())
+      .def(
+          "max_evaluations",
+          &TunerConfig::maxEvaluations,
+          gflags::DescribeOneFlag(
+              gflags::GetCommandLineFlagInfoOrDie("tuner_max_evaluations"))
+              .c_str())
+      .def(
+          "convergence_generations",
+          &TunerConfig::convergenceGenerations,
+          gflags::DescribeOneFlag(gflags::GetCommandLineFlagInfoOrDie(
+                                      "tuner_convergence_generations"))
+              .c_str())
+      .def(
+          "convergence_threshold",
+          &TunerConfig::convergenceThreshold,
+          gflags::DescribeOneFlag(gflags::GetCommandLineFlagInfoOrDie(
+                                      "tuner_convergence_threshold"))
+              .c_str())
       .def(
           "logtostderr",
           &TunerConfig::logtostderr,
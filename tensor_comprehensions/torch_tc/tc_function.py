@@ -55,10 +55,40 @@ def unpack_variables(inputs):
         raise RuntimeError("Unsupported input type: ", type(inputs).__name__)
 
 
-# TC doesn't support strided tensors yet, so we have to make inputs contiguous
+# TC kernels are specialized for the strides of their inputs if these are
+# those of a slice of a contiguous tensor, other inputs such as transposed
+# tensors must be made contiguous. This follows normalizeStrides and
+# makeArraySizesFromStrides in tc/core/tensor.cc: the strides of dimensions of
+# size 1 do not matter.
+def is_slice_of_contiguous(tensor):
+    sizes, strides = list(tensor.size()), list(tensor.stride())
+    if tensor.is_contiguous() or len(sizes) == 0:
+        return True
+    if len(sizes) < 2:
+        return False
+    ndim = len(sizes)
+    for i in reversed(range(ndim)):
+        if sizes[i] == 1:
+            strides[i] = strides[i + 1] * sizes[i + 1] if i + 1 < ndim else 1
+    # the nearest inner dimension not of size 1 and its stride
+    inner, inner_stride = ndim, 1
+    for i in reversed(range(ndim)):
+        if i > 0 and sizes[i] == 1:
+            continue
+        if strides[i] <= 0 or strides[i] % inner_stride != 0:
+            return False
+        size = strides[i] // inner_stride
+        if inner < ndim and size < sizes[inner]:
+            return False
+        if inner == ndim and i + 1 == ndim and size != 1:
+            return False
+        inner, inner_stride = i, strides[i]
+    return True
+
+
 def make_contiguous(inputs):
     if isinstance(inputs, Variable) or torch.is_tensor(inputs):
-        return inputs.contiguous()
+        return inputs if is_slice_of_contiguous(inputs) else inputs.contiguous()
     elif isinstance(inputs, tuple):
         return tuple(make_contiguous(v) for v in inputs)
     elif isinstance(inputs, list):
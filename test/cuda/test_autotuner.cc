@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -28,6 +29,8 @@
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
+#include "tc/core/scope_guard.h"
+#include "tc/lang/canonicalize.h"
 
 #include "test_harness_aten_cuda.h"
 
@@ -153,6 +156,96 @@ def matmul(float(M,N) A, float(N,K) B) -> (output) {
   auto bestOptions = autotune(TC, name, inputs, options);
 }
 
+TEST_F(ATenCompilationUnitTest, MultipleShapes) {
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+  output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  auto name = "matmul";
+  std::vector<std::vector<at::Tensor>> inputs;
+  for (auto batch : {8, 32, 128}) {
+    inputs.push_back({at::CUDA(at::kFloat).rand({batch, 64}),
+                      at::CUDA(at::kFloat).rand({64, 72})});
+  }
+
+  tc::aten::ATenAutotuner<tc::CudaBackend, tc::autotune::GeneticSearch> tuner(
+      TC);
+  auto baseMapping = tc::CudaMappingOptions::makeNaiveMappingOptions();
+  auto bestOptions = tuner.tune(name, inputs, {0.5, 0.3, 0.2}, {baseMapping});
+  ASSERT_EQ(1u, bestOptions.size());
+
+  // The same options serve all the shapes, and the runtime of every
+  // candidate was recorded for each of them.
+  auto canonical = lang::canonicalTc(TC);
+  for (const auto& shapeInputs : inputs) {
+    Check(TC, name, bestOptions[0], shapeInputs);
+    std::vector<tc::TensorInfo> inputsInfo;
+    for (const auto& t : shapeInputs) {
+      inputsInfo.push_back(tc::aten::toTensorInfo(t));
+    }
+    std::vector<tc::TensorInfo> outputsInfo;
+    for (const auto& t : tc::aten::prepareOutputs(TC, name, shapeInputs)) {
+      outputsInfo.push_back(tc::aten::toTensorInfo(t));
+    }
+    EXPECT_FALSE(tuner.optionsCache
+                     ->getRuntimes(
+                         canonical,
+                         inputsInfo,
+                         outputsInfo,
+                         tc::CudaBackend::backendString(),
+                         bestOptions[0])
+                     .empty());
+  }
+
+  // One weight per shape
+  EXPECT_THROW(tuner.tune(name, inputs, {1.0}, {baseMapping}), std::exception);
+}
+
+TEST_F(ATenCompilationUnitTest, StopsEarly) {
+  at::Tensor mat1 = at::CUDA(at::kFloat).rand({72, 26});
+  at::Tensor mat2 = at::CUDA(at::kFloat).rand({26, 72});
+  std::vector<at::Tensor> inputs = {mat1, mat2};
+
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+  output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  auto options = tc::CudaMappingOptions::makeNaiveMappingOptions();
+  auto name = "matmul";
+
+  auto savedGenerations = tc::FLAGS_tuner_gen_generations;
+  auto savedTimeBudget = tc::FLAGS_tuner_time_budget_s;
+  auto savedMaxEvaluations = tc::FLAGS_tuner_max_evaluations;
+  auto savedConvergence = tc::FLAGS_tuner_convergence_generations;
+  tc::ScopeGuard sg([&]() {
+    tc::FLAGS_tuner_gen_generations = savedGenerations;
+    tc::FLAGS_tuner_time_budget_s = savedTimeBudget;
+    tc::FLAGS_tuner_max_evaluations = savedMaxEvaluations;
+    tc::FLAGS_tuner_convergence_generations = savedConvergence;
+  });
+  // Any of the criteria stops tuning long before that many generations.
+  tc::FLAGS_tuner_gen_generations = 100000;
+  auto tuneWithin = [&](std::chrono::seconds limit) {
+    auto start = std::chrono::system_clock::now();
+    auto bestOptions = autotune(TC, name, inputs, options);
+    EXPECT_LT(std::chrono::system_clock::now() - start, limit);
+    Check(TC, name, bestOptions, inputs);
+  };
+
+  tc::FLAGS_tuner_time_budget_s = 5;
+  tuneWithin(std::chrono::seconds(60));
+  tc::FLAGS_tuner_time_budget_s = 0;
+
+  tc::FLAGS_tuner_max_evaluations = 2 * tc::FLAGS_tuner_gen_pop_size;
+  tuneWithin(std::chrono::seconds(60));
+  tc::FLAGS_tuner_max_evaluations = 0;
+
+  tc::FLAGS_tuner_convergence_generations = 2;
+  tuneWithin(std::chrono::seconds(300));
+}
+
 TEST_F(ATenCompilationUnitTest, TensorDot) {
   at::Tensor I0 = at::CUDA(at::kFloat).rand({N, C1, C2, H, W});
   at::Tensor I1 = at::CUDA(at::kFloat).rand({N, C2, C3, H, W});
@@ -13,8 +13,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <unistd.h>
+
+#include <fstream>
+#include <atomic>
 #include <future>
 #include <memory>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -22,6 +27,7 @@
 
 #include "tc/aten/aten_compiler.h"
 #include "tc/autotuner/autotuner.h"
+#include "tc/autotuner/cache_file.h"
 #include "tc/autotuner/genetic_search.h"
 #include "tc/core/cuda/cuda.h"
 #include "tc/core/cuda/cuda_backend.h"
@@ -39,10 +45,17 @@ using tc::autotune::OptionsCacheKey;
 using CudaOptionsCache = tc::autotune::OptionsCache<tc::CudaBackend>;
 struct CudaOptionsCacheForTesting : public CudaOptionsCache {
  public:
-  // Unsafe equal_range not performed under lock, for testing only
-  std::pair<MultiMapType::iterator, MultiMapType::iterator> equal_range(
-      const OptionsCacheKey& key) {
-    return store_.equal_range(key);
+  // Copies the current entries of key, valid until the next call, for
+  // testing only
+  std::pair<std::vector<Entry>::iterator, std::vector<Entry>::iterator>
+  equal_range(const OptionsCacheKey& key) {
+    entries_.clear();
+    if (auto entries = find(key)) {
+      for (const auto& value : entries->values) {
+        entries_.emplace_back(key, *value);
+      }
+    }
+    return {entries_.begin(), entries_.end()};
   }
   typename tc::CudaBackend::OptionsCacheProtoType toProtobuf() const {
     return CudaOptionsCache::toProtobuf();
@@ -51,6 +64,9 @@ struct CudaOptionsCacheForTesting : public CudaOptionsCache {
       const typename tc::CudaBackend::OptionsCacheProtoType& proto) {
     return CudaOptionsCache::fromProtobuf(proto);
   }
+
+ private:
+  std::vector<Entry> entries_;
 };
 
 std::string backendStr() {
@@ -213,6 +229,76 @@ TEST_F(OptionsCacheTest, DifferentOptions) {
   ASSERT_EQ(optionsCache->numberCacheAttempts, 2u);
 }
 
+TEST_F(OptionsCacheTest, GetRuntimes) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveMappingOptions();
+  auto options1 = tc::CudaMappingOptions::makeMlpMappingOptions();
+  auto inputTIs = tc::makeTensorInfoVector(makeInputPtrs());
+  auto outputTIs = tc::makeTensorInfoVector(makeOutputPtrs());
+
+  recordRuntime("kernel", options0, 1);
+  recordRuntime("kernel", options0, 3);
+
+  auto runtimes = optionsCache->getRuntimes(
+      lang::CanonicalTcString("kernel"),
+      inputTIs,
+      outputTIs,
+      backendStr(),
+      options0);
+  ASSERT_EQ(runtimes.size(), 2u);
+  ASSERT_EQ(runtimes[0], tc::Duration::fromMicroSeconds(1));
+  ASSERT_EQ(runtimes[1], tc::Duration::fromMicroSeconds(3));
+  ASSERT_EQ(
+      optionsCache
+          ->getRuntimes(
+              lang::CanonicalTcString("kernel"),
+              inputTIs,
+              outputTIs,
+              backendStr(),
+              options1)
+          .size(),
+      0u);
+  ASSERT_EQ(optionsCache->numberAttemptedRetrievals, 2u);
+  ASSERT_EQ(optionsCache->numberSuccessfulRetrievals, 1u);
+}
+
+TEST_F(OptionsCacheTest, RuntimeStdDevs) {
+  auto options = tc::CudaMappingOptions::makeNaiveMappingOptions();
+  auto canonical = lang::CanonicalTcString("kernel");
+  auto inputTIs = tc::makeTensorInfoVector(makeInputPtrs());
+  auto outputTIs = tc::makeTensorInfoVector(makeOutputPtrs());
+
+  recordRuntime("kernel", options, 1);
+  optionsCache->recordRuntime(
+      canonical,
+      inputTIs,
+      outputTIs,
+      backendStr(),
+      options,
+      tc::Duration::fromMicroSeconds(3),
+      tc::Duration::fromMicroSeconds(2));
+
+  auto check = [&](size_t lastStdDev) {
+    std::vector<tc::Duration> stdDevs;
+    auto runtimes = optionsCache->getRuntimes(
+        canonical, inputTIs, outputTIs, backendStr(), options, &stdDevs);
+    ASSERT_EQ(runtimes.size(), 2u);
+    ASSERT_EQ(stdDevs.size(), 2u);
+    ASSERT_EQ(stdDevs[0], tc::Duration::zero());
+    ASSERT_EQ(stdDevs[1], tc::Duration::fromMicroSeconds(lastStdDev));
+  };
+  check(2);
+
+  // Standard deviations survive serialization, caches without any get zeros.
+  auto buf = optionsCache->toProtobuf();
+  optionsCache->clear();
+  optionsCache->fromProtobuf(buf);
+  check(2);
+  buf.mutable_values(0)->clear_recorded_runtime_stddevs();
+  optionsCache->clear();
+  optionsCache->fromProtobuf(buf);
+  check(0);
+}
+
 TEST_F(OptionsCacheTest, DifferentInputs) {
   auto options = tc::CudaMappingOptions::makeNaiveMappingOptions();
   auto inputPtrs = makeInputPtrs();
@@ -507,6 +593,184 @@ TEST_F(OptionsCacheTest, RetrieveBestMedianTime) {
   ASSERT_EQ(optionsCache->numberCacheAttempts, 6u);
 }
 
+TEST_F(OptionsCacheTest, NearestShapes) {
+  auto makeTensors = [](std::vector<int64_t> shape) {
+    return std::vector<tc::TensorInfo>{
+        tc::TensorInfo(
+            DLDataType{kDLFloat, 32, 1},
+            256,
+            shape,
+            tc::makeStridesFromSizes(shape))};
+  };
+  auto kernel = lang::CanonicalTcString("kernel");
+  auto record = [&](std::vector<int64_t> shape,
+                    const tc::CudaMappingOptions& options,
+                    size_t us) {
+    optionsCache->recordRuntime(
+        kernel,
+        makeTensors(shape),
+        makeTensors(shape),
+        backendStr(),
+        options,
+        tc::Duration::fromMicroSeconds(us));
+  };
+  auto nearest = [&](std::vector<int64_t> shape, size_t K, bool rescale) {
+    return optionsCache->getTopKOptionsForNearestShapes(
+        kernel,
+        makeTensors(shape),
+        makeTensors(shape),
+        backendStr(),
+        K,
+        rescale);
+  };
+  auto options = [](std::vector<uint64_t> tiles) {
+    return tc::CudaMappingOptions::makeNaiveMappingOptions().tile(tiles);
+  };
+
+  record({32, 64}, options({32, 16}), 10);
+  record({32, 64}, options({8, 8}), 20);
+  record({128, 64}, options({4, 4}), 5);
+  // Different rank, never near.
+  record({32}, options({1}), 1);
+
+  // Exact match first, then the next nearest shape.
+  auto top = nearest({32, 64}, 3, false);
+  ASSERT_EQ(3u, top.size());
+  EXPECT_EQ(options({32, 16}), top[0]);
+  EXPECT_EQ(options({8, 8}), top[1]);
+  EXPECT_EQ(options({4, 4}), top[2]);
+  // Unseen shape, nearer to 32x64 than to 128x64.
+  top = nearest({48, 64}, 1, false);
+  ASSERT_EQ(1u, top.size());
+  EXPECT_EQ(options({32, 16}), top[0]);
+  // The tile size covering the whole rescaled dimension follows it.
+  top = nearest({48, 64}, 1, true);
+  ASSERT_EQ(1u, top.size());
+  EXPECT_EQ(options({48, 16}), top[0]);
+  // Nothing comparable.
+  EXPECT_TRUE(nearest({2, 3, 4}, 1, false).empty());
+  EXPECT_TRUE(optionsCache
+                  ->getTopKOptionsForNearestShapes(
+                      lang::CanonicalTcString("other"),
+                      makeTensors({32, 64}),
+                      makeTensors({32, 64}),
+                      backendStr(),
+                      1)
+                  .empty());
+  EXPECT_EQ(5u, optionsCache->numberAttemptedRetrievals);
+  EXPECT_EQ(3u, optionsCache->numberSuccessfulRetrievals);
+}
+
+TEST_F(OptionsCacheTest, NearestShapesInCacheFile) {
+  using namespace tc::autotune;
+  auto filename = std::string("/tmp/test_nearest_options_cache_") +
+      std::to_string(::getpid()) + ".pb";
+  auto removeFiles = [&]() {
+    detail::removeFile(filename);
+    detail::removeFile(detail::journalFilename(filename));
+    detail::removeFile(filename + ".lock");
+  };
+  removeFiles();
+  tc::ScopeGuard sg(removeFiles);
+
+  std::string tc = R"TC(
+def scale(float(M, N) I) -> (O) {
+    O(m, n) = 2 * I(m, n)
+}
+)TC";
+  auto load = [&](int64_t M, bool nearestShapes) {
+    at::Tensor I = at::CUDA(at::kFloat).rand({M, 64});
+    auto inputs = tc::aten::makeDLConstTensors({I});
+    return loadTopKFromCacheFile<tc::CudaBackend>(
+        tc, "scale", filename, tc::extractRawPtrs(inputs), 1, nearestShapes);
+  };
+  {
+    at::Tensor I = at::CUDA(at::kFloat).rand({32, 64});
+    auto inputs = tc::aten::makeDLConstTensors({I});
+    CudaOptionsCache cache;
+    cache.recordRuntime(
+        lang::canonicalTc(tc::detail::parse(tc).at("scale")),
+        tc::makeTensorInfoVector(tc::extractRawPtrs(inputs)),
+        tc::inferOutputTensorInfo(tc, "scale", tc::extractRawPtrs(inputs)),
+        tc::CudaBackend::backendString(),
+        tc::CudaMappingOptions::makeNaiveMappingOptions().tile(32, 16),
+        tc::Duration::fromMicroSeconds(10));
+    appendTopKToCacheFile(cache, filename, 1);
+  }
+
+  auto tuned = tc::CudaMappingOptions::makeNaiveMappingOptions().tile(32, 16);
+  ASSERT_EQ(1u, load(32, false).size());
+  EXPECT_EQ(tuned, load(32, false)[0]);
+  // Shapes that were not tuned only fall back to the nearest ones on demand,
+  // with rescaled tile sizes.
+  EXPECT_TRUE(load(48, false).empty());
+  auto nearest = load(48, true);
+  ASSERT_EQ(1u, nearest.size());
+  EXPECT_EQ(
+      tc::CudaMappingOptions::makeNaiveMappingOptions().tile(48, 16),
+      nearest[0]);
+}
+
+TEST_F(OptionsCacheTest, ConcurrentLookups) {
+  constexpr size_t kNumWriters = 4;
+  constexpr size_t kNumReaders = 4;
+  constexpr size_t kNumKernels = 16;
+  constexpr size_t kNumRuns = 500;
+  auto inputTIs = tc::makeTensorInfoVector(makeInputPtrs());
+  auto outputTIs = tc::makeTensorInfoVector(makeOutputPtrs());
+  auto kernel = [](size_t i) {
+    return lang::CanonicalTcString("kernel" + std::to_string(i));
+  };
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < kNumReaders; ++r) {
+    readers.emplace_back([&]() {
+      while (!done) {
+        for (size_t k = 0; k < kNumKernels; ++k) {
+          auto top = optionsCache->getTopKOptions(
+              kernel(k), inputTIs, outputTIs, backendStr(), 2);
+          EXPECT_LE(top.size(), 2u);
+        }
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (size_t w = 0; w < kNumWriters; ++w) {
+    writers.emplace_back([&, w]() {
+      auto options =
+          tc::CudaMappingOptions::makeNaiveMappingOptions().tile(w + 1);
+      for (size_t i = 0; i < kNumRuns; ++i) {
+        optionsCache->recordRuntime(
+            kernel(i % kNumKernels),
+            inputTIs,
+            outputTIs,
+            backendStr(),
+            options,
+            tc::Duration::fromMicroSeconds(w + 1));
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  ASSERT_EQ(kNumKernels * kNumWriters, optionsCache->size());
+  for (size_t k = 0; k < kNumKernels; ++k) {
+    // The fastest writer comes first.
+    auto top = optionsCache->getTopKOptions(
+        kernel(k), inputTIs, outputTIs, backendStr(), 1);
+    ASSERT_EQ(1u, top.size());
+    EXPECT_EQ(
+        tc::CudaMappingOptions::makeNaiveMappingOptions().tile(1), top[0]);
+  }
+  EXPECT_EQ(kNumWriters * kNumRuns, optionsCache->numberCacheAttempts);
+}
+
 TEST_F(OptionsCacheTest, Serialization) {
   auto options0 = tc::CudaMappingOptions::makeNaiveMappingOptions().tile(0);
   auto options1 = tc::CudaMappingOptions::makeNaiveMappingOptions().tile(1);
@@ -577,6 +841,238 @@ TEST_F(OptionsCacheTest, Serialization) {
   }
 }
 
+TEST_F(OptionsCacheTest, ConcurrentFileUpdates) {
+  using namespace tc::autotune;
+  auto filename = std::string("/tmp/test_options_cache_") +
+      std::to_string(::getpid()) + ".pb";
+  auto journal = detail::journalFilename(filename);
+  auto removeFiles = [&]() {
+    detail::removeFile(filename);
+    detail::removeFile(journal);
+    detail::removeFile(filename + ".lock");
+  };
+  removeFiles();
+  tc::ScopeGuard sg(removeFiles);
+
+  // Concurrent tuners appending to the same file all keep their results.
+  constexpr size_t kNumTuners = 8;
+  auto inputs = tc::makeTensorInfoVector(makeInputPtrs());
+  auto outputs = tc::makeTensorInfoVector(makeOutputPtrs());
+  auto tune = [&](size_t i) {
+    CudaOptionsCache cache;
+    cache.recordRuntime(
+        lang::CanonicalTcString("kernel"),
+        inputs,
+        outputs,
+        backendStr(),
+        tc::CudaMappingOptions::makeNaiveMappingOptions().tile(i + 1),
+        tc::Duration::fromMicroSeconds(i + 1));
+    appendTopKToCacheFile(cache, filename, 1);
+  };
+  std::vector<std::future<void>> tuners;
+  for (size_t i = 0; i < kNumTuners; ++i) {
+    tuners.push_back(std::async(std::launch::async, tune, i));
+  }
+  for (auto& tuner : tuners) {
+    tuner.get();
+  }
+  auto load = [&]() {
+    CudaOptionsCache cache;
+    cache.loadCacheFromFile(filename);
+    return cache;
+  };
+  ASSERT_EQ(kNumTuners, load().size());
+
+  // A record torn by a crash is ignored.
+  {
+    std::ofstream torn(journal, std::ios::binary | std::ios::app);
+    torn << "torn";
+  }
+  ASSERT_EQ(kNumTuners, load().size());
+  // and does not hide the records appended after it.
+  tune(kNumTuners);
+  ASSERT_EQ(kNumTuners + 1, load().size());
+
+  // Replaying the journal of an interrupted compaction is harmless.
+  auto records = detail::readFile(journal);
+  compactCacheFile<tc::CudaBackend>(filename);
+  EXPECT_EQ(0u, detail::fileSize(journal));
+  EXPECT_EQ(kNumTuners + 1, load().size());
+  {
+    std::ofstream replayed(journal, std::ios::binary);
+    replayed << records;
+  }
+  auto cache = load();
+  ASSERT_EQ(kNumTuners + 1, cache.size());
+  EXPECT_EQ(
+      1u,
+      cache
+          .getRuntimes(
+              lang::CanonicalTcString("kernel"),
+              inputs,
+              outputs,
+              backendStr(),
+              tc::CudaMappingOptions::makeNaiveMappingOptions().tile(1))
+          .size());
+
+  // Tuners extending the same runtimes only add their own, also when they
+  // record identical runtimes or their records are replayed.
+  compactCacheFile<tc::CudaBackend>(filename);
+  auto extend = [&](CudaOptionsCache& cache, size_t runtime) {
+    cache.recordRuntime(
+        lang::CanonicalTcString("kernel"),
+        inputs,
+        outputs,
+        backendStr(),
+        tc::CudaMappingOptions::makeNaiveMappingOptions().tile(1),
+        tc::Duration::fromMicroSeconds(runtime));
+    appendTopKToCacheFile(cache, filename, kNumTuners + 1);
+  };
+  auto first = load();
+  auto second = load();
+  extend(first, 100);
+  extend(second, 200);
+  auto third = load();
+  auto fourth = load();
+  extend(third, 300);
+  extend(fourth, 300);
+  // Appending a cache again only appends the runtimes recorded since.
+  appendTopKToCacheFile(third, filename, kNumTuners + 1);
+  records = detail::readFile(journal);
+  std::vector<tc::Duration> expected{tc::Duration::fromMicroSeconds(1),
+                                     tc::Duration::fromMicroSeconds(100),
+                                     tc::Duration::fromMicroSeconds(200),
+                                     tc::Duration::fromMicroSeconds(300),
+                                     tc::Duration::fromMicroSeconds(300)};
+  for (auto replay : {false, true}) {
+    if (replay) {
+      compactCacheFile<tc::CudaBackend>(filename);
+      std::ofstream replayed(journal, std::ios::binary);
+      replayed << records;
+    }
+    auto extended = load();
+    EXPECT_EQ(
+        expected,
+        extended.getRuntimes(
+            lang::CanonicalTcString("kernel"),
+            inputs,
+            outputs,
+            backendStr(),
+            tc::CudaMappingOptions::makeNaiveMappingOptions().tile(1)));
+  }
+
+  // Storing replaces the file and its journal.
+  CudaOptionsCache().storeCacheToFile(filename);
+  EXPECT_EQ(0u, load().size());
+}
+
+TEST_F(OptionsCacheTest, KeyFingerprint) {
+  auto makeKey = [](const std::string& name,
+                    std::vector<int64_t> shape,
+                    const std::string& backend) {
+    auto strides = tc::makeStridesFromSizes(shape);
+    return OptionsCacheKey{
+        lang::CanonicalTcString(name),
+        {tc::TensorInfo(DLDataType{kDLFloat, 32, 1}, 256, shape, strides)},
+        {},
+        backend};
+  };
+  auto key = makeKey("kernel", {5, 6}, "backend");
+  EXPECT_EQ(key.fingerprint, makeKey("kernel", {5, 6}, "backend").fingerprint);
+  EXPECT_EQ(
+      key.fingerprint,
+      OptionsCacheKey::fromProtobuf(key.toProtobuf()).fingerprint);
+  EXPECT_NE(key.fingerprint, makeKey("kernel2", {5, 6}, "backend").fingerprint);
+  EXPECT_NE(key.fingerprint, makeKey("kernel", {6, 5}, "backend").fingerprint);
+  EXPECT_NE(key.fingerprint, makeKey("kernel", {5, 6}, "backend2").fingerprint);
+  // Fingerprints index the cache files, they must not change across
+  // processes or builds (on a given architecture).
+  EXPECT_EQ(0x8587f765565efb48ull, key.fingerprint);
+}
+
+TEST_F(OptionsCacheTest, IndexedCacheFile) {
+  using namespace tc::autotune;
+  auto filename = std::string("/tmp/test_indexed_options_cache_") +
+      std::to_string(::getpid()) + ".pb";
+  auto removeFiles = [&]() {
+    detail::removeFile(filename);
+    detail::removeFile(detail::journalFilename(filename));
+    detail::removeFile(filename + ".lock");
+  };
+  removeFiles();
+  tc::ScopeGuard sg(removeFiles);
+
+  auto options0 = tc::CudaMappingOptions::makeNaiveMappingOptions().tile(0);
+  auto options1 = tc::CudaMappingOptions::makeNaiveMappingOptions().tile(1);
+  recordRuntime("kernel0", options0, 10);
+  recordRuntime("kernel0", options1, 11);
+  recordRuntime("kernel1", options0, 1);
+
+  // Each key is serialized once.
+  auto buf = optionsCache->toProtobuf();
+  ASSERT_EQ(2, buf.keys().size());
+  ASSERT_EQ(3, buf.values().size());
+
+  auto key = [&](const std::string& name) {
+    return OptionsCacheKey{lang::CanonicalTcString(name),
+                           tc::makeTensorInfoVector(makeInputPtrs()),
+                           tc::makeTensorInfoVector(makeOutputPtrs()),
+                           backendStr()};
+  };
+  auto check = [&]() {
+    CudaOptionsCache all;
+    all.loadCacheFromFile(filename);
+    EXPECT_EQ(3u, all.size());
+    CudaOptionsCache kernel0;
+    kernel0.loadKeyFromCacheFile(filename, key("kernel0"));
+    EXPECT_EQ(2u, kernel0.size());
+    EXPECT_EQ(2u, kernel0.count(key("kernel0")));
+    CudaOptionsCache unknown;
+    unknown.loadKeyFromCacheFile(filename, key("kernel2"));
+    EXPECT_EQ(0u, unknown.size());
+  };
+  optionsCache->storeCacheToFile(filename);
+  check();
+
+  // Cache files stored before they were indexed, with a key per value, are
+  // still read.
+  tc::CudaOptionsCacheProto legacy;
+  for (auto i : buf.key_indices()) {
+    *legacy.add_keys() = buf.keys(i);
+  }
+  *legacy.mutable_values() = buf.values();
+  detail::writeFileAtomically(filename, legacy.SerializeAsString());
+  check();
+
+  // Loading a key only reads and verifies the journal records holding it.
+  auto journal = detail::journalFilename(filename);
+  CudaOptionsCache kernel2;
+  kernel2.recordRuntime(
+      lang::CanonicalTcString("kernel2"),
+      tc::makeTensorInfoVector(makeInputPtrs()),
+      tc::makeTensorInfoVector(makeOutputPtrs()),
+      backendStr(),
+      options0,
+      tc::Duration::fromMicroSeconds(1));
+  appendTopKToCacheFile(kernel2, filename, 1);
+  auto numRecords = [&](const std::string& name) {
+    auto hash = key(name).fingerprint;
+    return detail::readJournalRecords(detail::MappedFile(journal), &hash)
+        .size();
+  };
+  EXPECT_EQ(1u, numRecords("kernel2"));
+  EXPECT_EQ(0u, numRecords("kernel0"));
+  // A corrupted blob of kernel2 is only noticed when loading kernel2.
+  auto records = detail::readFile(journal);
+  records.back() ^= 1;
+  {
+    std::ofstream corrupted(journal, std::ios::binary | std::ios::trunc);
+    corrupted << records;
+  }
+  EXPECT_EQ(0u, numRecords("kernel2"));
+  check();
+}
+
 class MatMulTester {
  public:
   MatMulTester(
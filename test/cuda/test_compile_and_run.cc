@@ -199,6 +199,50 @@ def matmul(float(M,N) A, float(N,K) B) -> (output) {
   checkRtol(diff, inputs, N);
 }
 
+TEST_F(CompilationTest, MatMulSlices) {
+  // Slices of contiguous tensors are used in place, without copies.
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 7}).narrow(1, 2, 4);
+  at::Tensor b =
+      at::CUDA(at::kFloat).rand({6, 9}).narrow(0, 1, 4).narrow(1, 2, 5);
+  ASSERT_FALSE(a.is_contiguous());
+  ASSERT_FALSE(b.is_contiguous());
+  std::vector<at::Tensor> inputs = {a, b};
+
+  std::vector<at::Tensor> outputs = Check(
+      R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+    )",
+      "matmul",
+      tc::CudaMappingOptions::makeMlpMappingOptions(),
+      inputs);
+
+  at::Tensor diff = outputs[0].sub(a.mm(b));
+  checkRtol(diff, inputs, N);
+
+  // The strides of dimensions of size 1 do not matter, [2, 1, 3] with strides
+  // [16, 4, 1] is a slice of a contiguous tensor of [2, 1, 16].
+  at::Tensor x =
+      at::CUDA(at::kFloat).rand({2, 4, 4}).narrow(1, 0, 1).narrow(2, 0, 3);
+  at::Tensor y = at::CUDA(at::kFloat).rand({2, 3, 5});
+  ASSERT_FALSE(x.is_contiguous());
+  std::vector<at::Tensor> batchInputs = {x, y};
+
+  outputs = Check(
+      R"(
+def batch_matmul(float(B,M,N) X, float(B,N,K) Y) -> (output) {
+    output(b, m, k) +=! X(b, m, r_n) * Y(b, r_n, k)
+}
+    )",
+      "batch_matmul",
+      tc::CudaMappingOptions::makeNaiveMappingOptions(),
+      batchInputs);
+
+  diff = outputs[0].sub(x.bmm(y));
+  checkRtol(diff, batchInputs, 3);
+}
+
 TEST_F(CompilationTest, Convolution2d) {
   at::Tensor I = at::CUDA(at::kFloat).rand({N, C, H, W});
   at::Tensor W1 = at::CUDA(at::kFloat).rand({O, C, KH, KW});
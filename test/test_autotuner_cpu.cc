@@ -0,0 +1,353 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "tc/aten/aten.h"
+#include "tc/aten/aten_autotuner.h"
+#include "tc/aten/aten_compiler.h"
+#include "tc/autotuner/child_process.h"
+#include "tc/autotuner/cost_model.h"
+#include "tc/autotuner/search_strategy.h"
+#include "tc/autotuner/successive_halving.h"
+#include "tc/core/compiler.h"
+#include "tc/core/cpu/cpu_backend.h"
+#include "tc/core/cpu/cpu_device.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/cpu/cpu_thread_pool.h"
+#include "tc/core/flags.h"
+#include "tc/core/polyhedral/codegen_llvm.h"
+#include "tc/core/scope_guard.h"
+#include "tc/core/tensor.h"
+#include "tc/lang/canonicalize.h"
+
+#include "test_harness_aten.h"
+
+using namespace tc;
+
+TEST(CpuDevice, PinnedParallelRun) {
+  EXPECT_EQ(
+      (std::vector<std::vector<int>>{{0, 1, 3}, {2}}),
+      parseCpuCoreSets("3+0-1,2"));
+  EXPECT_THROW(parseCpuCoreSets("0-3,2"), std::invalid_argument);
+  EXPECT_THROW(parseCpuCoreSets("0-"), std::invalid_argument);
+
+  auto affinity = getThreadAffinity();
+  ASSERT_FALSE(affinity.empty());
+  auto device = CpuDevices::add({affinity[0]});
+  EXPECT_EQ(device, CpuDevices::add({affinity[0]}));
+
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({64, 24});
+  at::Tensor Y = at::CPU(at::kFloat).rand({24, 32});
+  auto options =
+      CpuMappingOptions::makeNaiveMappingOptions().tile(4, 8).parallelize(true);
+  auto pExecutor = tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+  auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+  {
+    WithCpuDevice wd(device);
+    EXPECT_EQ(std::vector<int>{affinity[0]}, getThreadAffinity());
+    EXPECT_EQ(&CpuDevices::pool(device), &CpuThreadPool::current());
+    tc::aten::run(*pExecutor, {X, Y}, outputs);
+  }
+  EXPECT_EQ(affinity, getThreadAffinity());
+  EXPECT_EQ(&CpuThreadPool::global(), &CpuThreadPool::current());
+  checkRtol(outputs[0] - X.mm(Y), {X, Y}, 24, 3e-7);
+}
+
+TEST(CpuDevice, DefaultTuningDevice) {
+  EXPECT_EQ(
+      "", gflags::GetCommandLineFlagInfoOrDie("tuner_devices").default_value);
+  // A single device made of all the cores, not of core 0 only.
+  auto affinity = getThreadAffinity();
+  auto devices = tc::autotune::detail::parseDevices<CpuBackend>("");
+  ASSERT_EQ(1u, devices.size());
+  EXPECT_EQ(affinity, CpuDevices::cores(devices[0]));
+  EXPECT_EQ(affinity.size(), CpuDevices::pool(devices[0]).numThreads());
+  if (affinity.size() > 1) {
+    EXPECT_LT(1u, CpuDevices::cores(devices[0]).size());
+  }
+}
+
+TEST(ChildProcess, IsolatesCrashesAndHangs) {
+  using namespace tc::autotune::detail;
+  auto timeout = std::chrono::milliseconds(2000);
+  ChildProcess echo([](Channel& parent) {
+    int value;
+    if (parent.receive(value)) {
+      parent.send(value + 1);
+    }
+  });
+  int value = 0;
+  EXPECT_TRUE(echo.channel().send(41));
+  EXPECT_TRUE(echo.channel().receive(value, timeout));
+  EXPECT_EQ(42, value);
+  EXPECT_EQ("exited with status 0", echo.wait());
+
+  ChildProcess crash([](Channel&) { raise(SIGSEGV); });
+  EXPECT_FALSE(crash.channel().receive(value, timeout));
+  EXPECT_EQ(0u, crash.wait().find("killed by signal 11"));
+
+  ChildProcess hang([](Channel&) { std::this_thread::sleep_for(timeout); });
+  EXPECT_FALSE(hang.channel().receive(value, std::chrono::milliseconds(10)));
+  hang.kill();
+  EXPECT_EQ(0u, hang.wait().find("killed by signal 9"));
+
+  ChildProcess blowup(
+      [](Channel& parent) {
+        std::vector<char> v;
+        try {
+          v.resize(size_t(1) << 32);
+        } catch (const std::bad_alloc&) {
+          parent.send(0);
+          return;
+        }
+        parent.send(1);
+      },
+      size_t(1) << 31);
+  EXPECT_TRUE(blowup.channel().receive(value, timeout));
+  EXPECT_EQ(0, value);
+}
+
+namespace {
+// Runtime of a configuration on a synthetic problem whose best tile sizes
+// are 16 and best unroll factor is 4.
+tc::Duration syntheticRuntime(const tc::autotune::TuningConfiguration& conf) {
+  long cost = 1;
+  for (const auto& dim : conf.tilingParams.dims) {
+    cost += std::abs(static_cast<long>(std::log2(dim.value())) - 4);
+  }
+  cost += conf.unrollFactor.value() == 4 ? 0 : 1;
+  return tc::Duration::fromMicroSeconds(cost);
+}
+
+tc::autotune::TuningConfiguration makeSyntheticConfiguration() {
+  using namespace tc::autotune;
+  std::vector<size_t> tiles{1, 2, 4, 8, 16, 32, 64, 128};
+  TuningConfiguration conf;
+  conf.tilingParams.setRange(2, tiles);
+  conf.unrollFactor = RangeParameter({1, 2, 4, 8}, "unroll");
+  conf.applyToParameters([](ParameterView& p) {
+    if (p.numberOptions() > 0) {
+      p.selectOption(0);
+    }
+  });
+  return conf;
+}
+} // namespace
+
+TEST(SearchStrategy, AllStrategiesImprove) {
+  using namespace tc::autotune;
+  auto savedStrategy = FLAGS_tuner_search_strategy;
+  auto savedGenerations = FLAGS_tuner_gen_generations;
+  auto savedPopSize = FLAGS_tuner_gen_pop_size;
+  ScopeGuard sg([&]() {
+    FLAGS_tuner_search_strategy = savedStrategy;
+    FLAGS_tuner_gen_generations = savedGenerations;
+    FLAGS_tuner_gen_pop_size = savedPopSize;
+  });
+  FLAGS_tuner_gen_generations = 10;
+  FLAGS_tuner_gen_pop_size = 27;
+
+  auto seed = makeSyntheticConfiguration();
+  for (auto name : {"genetic", "random", "annealing", "halving", "bayesian"}) {
+    FLAGS_tuner_search_strategy = name;
+    auto strategy = SearchStrategy::makeFromFlags({seed});
+    auto best = tc::Duration::max();
+    for (size_t i = 0; i < strategy->numGenerations; ++i) {
+      ASSERT_FALSE(strategy->population.empty()) << name;
+      for (auto& candidate : strategy->population) {
+        EXPECT_TRUE(candidate->configuration.isValid()) << name;
+        candidate->runtime = syntheticRuntime(candidate->configuration);
+        best = std::min(best, candidate->runtime);
+      }
+      strategy->updateParameters();
+    }
+    EXPECT_LT(best, syntheticRuntime(seed)) << name;
+  }
+
+  FLAGS_tuner_search_strategy = "unknown";
+  EXPECT_THROW(SearchStrategy::makeFromFlags({seed}), std::invalid_argument);
+}
+
+TEST(SearchStrategy, SuccessiveHalvingRungs) {
+  using namespace tc::autotune;
+  SuccessiveHalving halving({makeSyntheticConfiguration()}, 7, 27, 3);
+  // Brackets starting at rungs 0, 1 and 2, then 0 again. The last rung of a
+  // bracket uses the default number of iterations.
+  std::vector<std::pair<size_t, size_t>> expected{
+      {27, 1}, {9, 3}, {3, 0}, {9, 3}, {3, 0}, {3, 0}, {27, 1}};
+  for (const auto& rung : expected) {
+    EXPECT_EQ(rung.first, halving.population.size());
+    EXPECT_EQ(rung.second, halving.benchmarkIterations());
+    for (auto& candidate : halving.population) {
+      candidate->runtime = syntheticRuntime(candidate->configuration);
+    }
+    halving.updateParameters();
+  }
+}
+
+TEST(CostModel, LearnsFromFeatures) {
+  using namespace tc::autotune;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  auto tcTree = tc::detail::parse(tc).at("matmul");
+  at::Tensor X = at::CPU(at::kFloat).rand({32, 24});
+  at::Tensor Y = at::CPU(at::kFloat).rand({24, 16});
+  auto inputs = tc::aten::makeDLConstTensors({X, Y});
+  auto features = [&](size_t tile, size_t unroll) {
+    auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                       .tile(tile, tile, tile)
+                       .unroll(unroll);
+    return extractFeatures(tcTree, extractRawPtrs(inputs), options.generic);
+  };
+
+  // Larger tiles do more work on a larger footprint.
+  auto small = features(2, 1);
+  auto large = features(16, 1);
+  ASSERT_EQ(kNumCostModelFeatures, small.size());
+  EXPECT_LT(small[1], large[1]);
+  EXPECT_LT(small[4], large[4]);
+
+  // Runtimes halve with each doubling of the work per tile.
+  auto runtime = [](const std::vector<double>& f) {
+    return tc::Duration::fromMicroSeconds(
+        static_cast<size_t>(std::exp2(16 - f[4]) - 1));
+  };
+  CostModel model;
+  for (auto tile : {2, 4, 8, 16}) {
+    for (auto unroll : {1, 2, 4, 8}) {
+      EXPECT_EQ(tc::Duration::max(), model.predict(small));
+      auto f = features(tile, unroll);
+      model.train(f, runtime(f));
+    }
+  }
+  ASSERT_EQ(CostModel::minSamples, model.numSamples());
+  EXPECT_LT(model.predict(large), model.predict(small));
+  auto unseen = features(8, 16);
+  auto predicted = model.predict(unseen).toMicroSeconds();
+  auto expected = runtime(unseen).toMicroSeconds();
+  EXPECT_LT(predicted, 2 * expected);
+  EXPECT_LT(expected, 2 * predicted);
+}
+
+namespace {
+// Search strategy whose generations consist of copies of the first seed.
+class CopiesOfSeed : public tc::autotune::SearchStrategy {
+ public:
+  static constexpr size_t kNumCopies = 4;
+
+  static std::unique_ptr<tc::autotune::SearchStrategy> makeFromFlags(
+      const std::vector<tc::autotune::TuningConfiguration>& confs) {
+    return std::unique_ptr<tc::autotune::SearchStrategy>(
+        new CopiesOfSeed(confs.at(0)));
+  }
+
+  explicit CopiesOfSeed(const tc::autotune::TuningConfiguration& seed)
+      : SearchStrategy(2) {
+    for (size_t i = 0; i < kNumCopies; ++i) {
+      population.emplace_back(new tc::autotune::CandidateConfiguration(seed));
+    }
+  }
+
+  void updateParameters() override {
+    for (const auto& candidate : population) {
+      EXPECT_FALSE(candidate->invalid);
+      EXPECT_EQ(population[0]->runtime, candidate->runtime);
+    }
+  }
+};
+} // namespace
+
+TEST(TuningHarness, EvaluatesCopiesOnce) {
+  auto savedPopSize = FLAGS_tuner_gen_pop_size;
+  auto savedReuse = FLAGS_tuner_reuse_cached_runtimes;
+  ScopeGuard sg([&]() {
+    FLAGS_tuner_gen_pop_size = savedPopSize;
+    FLAGS_tuner_reuse_cached_runtimes = savedReuse;
+  });
+  FLAGS_tuner_gen_pop_size = CopiesOfSeed::kNumCopies;
+  FLAGS_tuner_reuse_cached_runtimes = false;
+
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({16, 8});
+  at::Tensor Y = at::CPU(at::kFloat).rand({8, 4});
+  tc::aten::ATenAutotuner<CpuBackend, CopiesOfSeed> tuner(tc);
+  auto tune = [&]() {
+    return tuner
+        .tune(
+            "matmul",
+            {X, Y},
+            {CpuMappingOptions::makeNaiveMappingOptions().tile(4, 4)})
+        .at(0);
+  };
+  auto numBenchmarks = [&](const CpuMappingOptions& options) {
+    auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+    return tuner.optionsCache
+        ->getRuntimes(
+            lang::canonicalTc(tc),
+            makeTensorInfoVector(
+                extractRawPtrs(tc::aten::makeDLConstTensors({X, Y}))),
+            makeTensorInfoVector(
+                extractRawPtrs(tc::aten::makeDLTensors(outputs))),
+            CpuBackend::backendString(),
+            options)
+        .size();
+  };
+
+  // The copies in the first generation wait for the benchmark of the first
+  // one, the second generation reuses its result.
+  auto options = tune();
+  EXPECT_EQ(1u, numBenchmarks(options));
+
+  // The runtimes in the options cache are only reused when requested.
+  FLAGS_tuner_reuse_cached_runtimes = true;
+  EXPECT_EQ(options, tune());
+  EXPECT_EQ(1u, numBenchmarks(options));
+  FLAGS_tuner_reuse_cached_runtimes = false;
+  tune();
+  EXPECT_EQ(2u, numBenchmarks(options));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  tc::polyhedral::initialize_llvm();
+  return RUN_ALL_TESTS();
+}
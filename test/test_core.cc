@@ -15,7 +15,9 @@
  */
 #include <cassert>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -23,11 +25,13 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "tc/autotuner/blocking_queue.h"
 #include "tc/core/flags.h"
 #include "tc/core/halide_utils.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/tensor.h"
+#include "tc/core/utils/measure.h"
 #include "tc/external/isl.h"
 #include "tc/lang/error_report.h"
 #include "tc/library/copy.h"
@@ -57,6 +61,59 @@ dtype {
   ASSERT_EQ(expected, toString(*p));
 }
 
+TEST(ArraySizesFromStrides, Default) {
+  // A [3, 4, 5] slice of a contiguous [3, 8, 6] tensor.
+  EXPECT_EQ(
+      (vector<int64_t>{8, 6}), makeArraySizesFromStrides({4, 5}, {48, 6, 1}));
+  // Contiguous.
+  EXPECT_EQ((vector<int64_t>{5}), makeArraySizesFromStrides({5}, {5, 1}));
+  // Every other element of the rows.
+  EXPECT_TRUE(makeArraySizesFromStrides({5}, {10, 2}).empty());
+  // Strides that are not multiples of each other.
+  EXPECT_TRUE(makeArraySizesFromStrides({4, 5}, {45, 6, 1}).empty());
+  // Rows of 5 elements 4 apart overlap.
+  EXPECT_TRUE(makeArraySizesFromStrides({5}, {4, 1}).empty());
+  EXPECT_TRUE(makeArraySizesFromStrides({4, 5}, {48, 4, 1}).empty());
+  // The strides of dimensions of size 1 do not matter, e.g. in a [2, 1, 3]
+  // slice of a contiguous [2, 4, 4] tensor, normalized or not.
+  EXPECT_EQ(
+      (vector<int64_t>{1, 16}), makeArraySizesFromStrides({1, 3}, {16, 4, 1}));
+  EXPECT_EQ(
+      (vector<int64_t>{1, 16}), makeArraySizesFromStrides({1, 3}, {16, 3, 1}));
+  EXPECT_EQ(
+      (vector<int64_t>{6, 1}), makeArraySizesFromStrides({3, 1}, {6, 1, 1}));
+  EXPECT_EQ((vector<int64_t>{5}), makeArraySizesFromStrides({1}, {5, 7}));
+}
+
+TEST(Measure, StopsAndRemovesOutliers) {
+  auto budget = Duration::fromMicroSeconds(1000000);
+  // Steady runtimes, but for a preempted run, stop as soon as allowed.
+  size_t run = 0;
+  auto steady = [&run]() {
+    auto us = ++run == 2 ? 1000 : run % 2 ? 99 : 101;
+    return ProfilingInfo(
+        Duration::fromMicroSeconds(1), Duration::fromMicroSeconds(us));
+  };
+  auto timings = measure(steady, MeasurementOptions{5, 100, 0.05, budget});
+  EXPECT_EQ(5u, run);
+  EXPECT_EQ(4u, timings.numRuns);
+  EXPECT_TRUE(timings.kernelRuntime == Duration::fromMicroSeconds(99));
+  EXPECT_TRUE(timings.kernelRuntimeStdDev == Duration::fromMicroSeconds(1));
+  EXPECT_LT(relativeConfidenceInterval(timings), 0.05);
+
+  // Noisy runtimes run until the maximum number of runs.
+  run = 0;
+  auto noisy = [&run]() {
+    auto us = 100 + (++run * 37) % 41;
+    return ProfilingInfo(
+        Duration::fromMicroSeconds(1), Duration::fromMicroSeconds(us));
+  };
+  timings = measure(noisy, MeasurementOptions{2, 20, 0.01, budget});
+  EXPECT_EQ(20u, run);
+  EXPECT_EQ(20u, timings.numRuns);
+  EXPECT_GT(relativeConfidenceInterval(timings), 0.01);
+}
+
 struct GenericHalideCoreTest : public ::testing::Test {
   void CheckC(const std::string& tc, const std::vector<std::string>& expected) {
     auto curPos = std::string::npos;
@@ -402,6 +459,27 @@ def fun(float(M, N) I) -> (O1, O2, O3) {
   Check(tc, {123, 13});
 }
 
+TEST(BlockingQueue, BoundedAndClosable) {
+  tc::autotune::BlockingQueue<std::unique_ptr<int>> queue(2);
+  std::vector<int> popped;
+  std::thread consumer([&]() {
+    std::unique_ptr<int> value;
+    while (queue.pop(value)) {
+      popped.push_back(*value);
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(queue.push(std::unique_ptr<int>(new int(i))));
+  }
+  queue.close();
+  consumer.join();
+  ASSERT_EQ(100u, popped.size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i, popped[i]);
+  }
+  EXPECT_FALSE(queue.push(std::unique_ptr<int>(new int(0))));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
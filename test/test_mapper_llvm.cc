@@ -14,14 +14,30 @@
  * limitations under the License.
  */
 
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+
 #include "tc/aten/aten.h"
+#include "tc/aten/aten_compiler.h"
 #include "tc/core/check.h"
+#include "tc/core/compilation_stage_cache.h"
+#include "tc/core/compiler.h"
+#include "tc/core/cpu/cpu_aot.h"
 #include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_specializing_executor.h"
 #include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/executor_cache.h"
+#include "tc/core/flags.h"
 #include "tc/core/polyhedral/codegen_llvm.h"
 #include "tc/core/polyhedral/llvm_jit.h"
 #include "tc/core/polyhedral/scop.h"
@@ -245,6 +261,472 @@ def concat(float(M, N) A, float(M, N) B) -> (O1) {
   checkRtol(O1c - O1, {A, B}, N * M);
 }
 
+TEST(LLVMCodegen, CompileAndRun) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  auto N = 40;
+  auto M = 24;
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, M});
+  auto options = CpuMappingOptions::makeNaiveMappingOptions().tile(8, 8);
+  auto pExecutor = tc::aten::compile<CpuBackend>(tc, "fun", {A, B}, options);
+  auto outputs = tc::aten::prepareOutputs(tc, "fun", {A, B});
+  tc::aten::run(*pExecutor, {A, B}, outputs);
+  checkRtol(outputs[0] - (A + B), {A, B}, N * M);
+
+  // Running again with the unchecked path reuses the JIT-compiled kernel
+  at::Tensor A2 = at::CPU(at::kFloat).rand({N, M});
+  tc::aten::uncheckedRun(*pExecutor, {A2, B}, outputs);
+  checkRtol(outputs[0] - (A2 + B), {A2, B}, N * M);
+}
+
+TEST(LLVMCodegen, CompileAndRunMatMul) {
+  auto N = 32;
+  auto M = 24;
+  auto K = 16;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, K});
+  auto options = CpuMappingOptions::makeNaiveMappingOptions().tile(8, 8, 8);
+  auto pExecutor =
+      tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+  auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+  tc::aten::run(*pExecutor, {X, Y}, outputs);
+  checkRtol(outputs[0] - X.mm(Y), {X, Y}, M, 3e-7);
+}
+
+TEST(LLVMCodegen, CompileAndRunParallel) {
+  auto N = 64;
+  auto M = 24;
+  auto K = 32;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, K});
+  for (auto schedule : {tc::ParallelSchedule::Static,
+                        tc::ParallelSchedule::Dynamic,
+                        tc::ParallelSchedule::Guided}) {
+    for (uint64_t chunk : {0, 1, 3}) {
+      auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                         .tile(4, 8, 8)
+                         .parallelize(true)
+                         .parallelSchedule(schedule)
+                         .parallelChunkSize(chunk);
+      auto pExecutor =
+          tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+      auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+      tc::aten::run(*pExecutor, {X, Y}, outputs);
+      checkRtol(outputs[0] - X.mm(Y), {X, Y}, M, 3e-7);
+    }
+  }
+}
+
+TEST(LLVMCodegen, CompileAndRunPartialTiles) {
+  auto N = 67;
+  auto M = 23;
+  auto K = 33;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, K});
+  for (auto parallelize : {false, true}) {
+    auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                       .tile(5, 7, 4)
+                       .parallelize(parallelize);
+    auto pExecutor =
+        tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+    auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+    tc::aten::run(*pExecutor, {X, Y}, outputs);
+    checkRtol(outputs[0] - X.mm(Y), {X, Y}, M, 3e-7);
+  }
+}
+
+TEST(LLVMCodegen, CompileAndRunGuards) {
+  std::string tc = R"(
+def fun(float(N) A, float(M) B) -> (C, D) {
+    C(i) = A(i) + 1
+    D(j) = B(j) * 2
+}
+)";
+  at::Tensor A = at::CPU(at::kFloat).rand({37});
+  at::Tensor B = at::CPU(at::kFloat).rand({19});
+  auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                     .tile(8)
+                     .scheduleFusionStrategy(tc::FusionStrategy::Max);
+  auto pExecutor = tc::aten::compile<CpuBackend>(tc, "fun", {A, B}, options);
+  auto outputs = tc::aten::prepareOutputs(tc, "fun", {A, B});
+  tc::aten::run(*pExecutor, {A, B}, outputs);
+  checkRtol(outputs[0] - (A + 1), {A}, 1);
+  checkRtol(outputs[1] - (B * 2), {B}, 1);
+}
+
+TEST(LLVMCodegen, CompileAndRunVectorized) {
+  auto N = 45;
+  auto M = 37;
+  auto K = 29;
+  std::string tc = R"(
+def fun(float(N, M) X, float(M, K) Y, float(N, K) B) -> (Z, O) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+    O(n, k) = Z(n, k) + B(n, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, K});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, K});
+  for (auto parallelize : {false, true}) {
+    auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                       .tile(16, 16, 16)
+                       .parallelize(parallelize)
+                       .vectorize(8);
+    auto pExecutor =
+        tc::aten::compile<CpuBackend>(tc, "fun", {X, Y, B}, options);
+    auto outputs = tc::aten::prepareOutputs(tc, "fun", {X, Y, B});
+    tc::aten::run(*pExecutor, {X, Y, B}, outputs);
+    checkRtol(outputs[1] - (X.mm(Y) + B), {X, Y, B}, M, 3e-7);
+  }
+}
+
+TEST(LLVMCodegen, CompileAndRunStrided) {
+  auto N = 24;
+  auto M = 20;
+  auto K = 28;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  // X is indexed through an array of the size of the sliced rows, Y, which
+  // takes every other element of the rows, with linearized accesses.
+  at::Tensor X = at::CPU(at::kFloat).rand({N, M + 5}).narrow(1, 3, M);
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, K, 2}).select(2, 0);
+  ASSERT_FALSE(X.is_contiguous());
+  ASSERT_FALSE(Y.is_contiguous());
+  auto options = CpuMappingOptions::makeNaiveMappingOptions().tile(8, 8, 8);
+  auto pExecutor =
+      tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+  auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+  tc::aten::run(*pExecutor, {X, Y}, outputs);
+  checkRtol(outputs[0] - X.mm(Y), {X, Y}, M, 3e-7);
+
+  // The kernel is specialized for the strides of its inputs.
+  EXPECT_THROW(
+      tc::aten::run(*pExecutor, {X.contiguous(), Y}, outputs),
+      lang::ErrorReport);
+
+  // The rows of W overlap, it cannot be indexed through an array of
+  // M - 4 elements and its accesses are linearized.
+  at::Tensor W =
+      at::CPU(at::kFloat).rand({N * M}).as_strided({N, M}, {M - 4, 1});
+  pExecutor = tc::aten::compile<CpuBackend>(tc, "matmul", {W, Y}, options);
+  outputs = tc::aten::prepareOutputs(tc, "matmul", {W, Y});
+  tc::aten::run(*pExecutor, {W, Y}, outputs);
+  checkRtol(outputs[0] - W.mm(Y), {W, Y}, M, 3e-7);
+}
+
+TEST(LLVMCodegen, CompileAndRunParametric) {
+  auto M = 24;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  // Y and Z have a symbolic inner size, their accesses are linearized.
+  auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                     .tile(8, 8, 8)
+                     .parallelize(true)
+                     .symbolicParameters({"N", "K"});
+  at::Tensor X = at::CPU(at::kFloat).rand({16, M});
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, 20});
+  auto pExecutor =
+      tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+  EXPECT_EQ(
+      std::vector<std::string>({"K", "N"}), pExecutor->symbolicParameters());
+  for (auto sizes : std::vector<std::pair<int, int>>{{16, 20}, {3, 37}}) {
+    X = at::CPU(at::kFloat).rand({sizes.first, M});
+    Y = at::CPU(at::kFloat).rand({M, sizes.second});
+    auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+    tc::aten::run(*pExecutor, {X, Y}, outputs);
+    checkRtol(outputs[0] - X.mm(Y), {X, Y}, M, 3e-7);
+  }
+
+  // The kernel is specialized for M.
+  X = at::CPU(at::kFloat).rand({16, M + 1});
+  Y = at::CPU(at::kFloat).rand({M + 1, 20});
+  auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+  EXPECT_THROW(tc::aten::run(*pExecutor, {X, Y}, outputs), lang::ErrorReport);
+}
+
+TEST(LLVMCodegen, SpecializingExecutor) {
+  std::string tc = R"(
+def add(float(N) A, float(N) B) -> (C) {
+    C(n) = A(n) + B(n)
+}
+)";
+  auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                     .tile(16)
+                     .symbolicParameters({"N"});
+  CpuSpecializingExecutor executor(tc, "add", options, 2, 1);
+  auto runAndCheck = [&](int N) {
+    at::Tensor A = at::CPU(at::kFloat).rand({N});
+    at::Tensor B = at::CPU(at::kFloat).rand({N});
+    auto outputs = tc::aten::prepareOutputs(tc, "add", {A, B});
+    auto inputDLTensors = tc::aten::makeDLConstTensors({A, B});
+    auto outputDLTensors = tc::aten::makeDLTensors(outputs);
+    executor.run(
+        extractRawPtrs(inputDLTensors), extractRawPtrs(outputDLTensors));
+    checkRtol(outputs[0] - (A + B), {A, B}, 1);
+  };
+  runAndCheck(7);
+  runAndCheck(100);
+  EXPECT_EQ(0u, executor.numSpecializations());
+
+  // Size 100 is hot, it gets a specialized kernel once compiled in the
+  // background; the parametric kernel serves it meanwhile.
+  for (int i = 0; i < 600 && executor.numSpecializations() == 0; ++i) {
+    runAndCheck(100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(1u, executor.numSpecializations());
+  // No more specializations past the limit.
+  for (int i = 0; i < 4; ++i) {
+    runAndCheck(9);
+  }
+  runAndCheck(7);
+  EXPECT_EQ(1u, executor.numSpecializations());
+}
+
+TEST(LLVMCodegen, CompileAndRunMultiversioned) {
+  EXPECT_FALSE(CpuBackend::backendString().empty());
+
+  auto N = 40;
+  auto M = 24;
+  auto K = 36;
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Y = at::CPU(at::kFloat).rand({M, K});
+  // Whatever the host, the dispatcher picks a version it can run, the
+  // generic x86-64 one if none of the others.
+  auto options = CpuMappingOptions::makeNaiveMappingOptions()
+                     .tile(8, 8, 8)
+                     .target("x86-64")
+                     .addMultiversionTarget("skylake-avx512")
+                     .addMultiversionTarget("haswell");
+  auto pExecutor =
+      tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+  EXPECT_NE(std::string::npos, pExecutor->compiledSource.find("_v2"));
+  // The dispatchers, the only external functions, have no target attributes
+  // (#N), whatever the targets of the versions they call.
+  std::istringstream ir(pExecutor->compiledSource);
+  size_t numDispatchers = 0;
+  for (std::string line; std::getline(ir, line);) {
+    if (line.compare(0, 13, "define void @") == 0) {
+      ++numDispatchers;
+      EXPECT_EQ(std::string::npos, line.find(" #")) << line;
+    }
+  }
+  EXPECT_EQ(2u, numDispatchers);
+  auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+  // The second run uses the version selected by the first one.
+  for (int i = 0; i < 2; ++i) {
+    tc::aten::run(*pExecutor, {X, Y}, outputs);
+    checkRtol(outputs[0] - X.mm(Y), {X, Y}, M, 3e-7);
+  }
+}
+
+TEST(LLVMCodegen, ObjectCache) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("tc_object_cache", dir));
+  auto savedDir = FLAGS_cpu_object_cache_dir;
+  FLAGS_cpu_object_cache_dir = dir.str();
+  ScopeGuard sg([&]() {
+    FLAGS_cpu_object_cache_dir = savedDir;
+    llvm::sys::fs::remove_directories(dir);
+  });
+
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) * B(n, m)
+}
+)TC";
+  at::Tensor A = at::CPU(at::kFloat).rand({33, 17});
+  at::Tensor B = at::CPU(at::kFloat).rand({33, 17});
+  auto options = CpuMappingOptions::makeNaiveMappingOptions().tile(8, 8);
+
+  // The first compilation populates the cache, the second one loads the
+  // object code without generating code.
+  for (auto fromCache : {false, true}) {
+    auto pExecutor = tc::aten::compile<CpuBackend>(tc, "fun", {A, B}, options);
+    EXPECT_EQ(fromCache, pExecutor->compiledSource.empty());
+    auto outputs = tc::aten::prepareOutputs(tc, "fun", {A, B});
+    tc::aten::run(*pExecutor, {A, B}, outputs);
+    checkRtol(outputs[0] - A * B, {A, B}, 1);
+  }
+
+  // Different options do not hit the cache.
+  auto pExecutor = tc::aten::compile<CpuBackend>(
+      tc, "fun", {A, B}, options.parallelize(false));
+  EXPECT_FALSE(pExecutor->compiledSource.empty());
+}
+
+TEST(LLVMCodegen, CompilationStageCache) {
+  auto& cache = CompilationStageCache::forThisThread();
+  cache.clear();
+  std::string tc = R"(
+def matmul(float(N, M) X, float(M, K) Y) -> (Z) {
+    Z(n, k) +=! X(n, r_m) * Y(r_m, k)
+}
+)";
+  at::Tensor X = at::CPU(at::kFloat).rand({32, 24});
+  at::Tensor Y = at::CPU(at::kFloat).rand({24, 16});
+
+  // Candidates that only differ in tiling share translation and scheduling.
+  size_t expectedHits = 0;
+  for (auto tile : {4, 8, 16}) {
+    auto options =
+        CpuMappingOptions::makeNaiveMappingOptions().tile(tile, tile, tile);
+    auto pExecutor =
+        tc::aten::compile<CpuBackend>(tc, "matmul", {X, Y}, options);
+    EXPECT_EQ(expectedHits, cache.numHits());
+    expectedHits += 2;
+    auto outputs = tc::aten::prepareOutputs(tc, "matmul", {X, Y});
+    tc::aten::run(*pExecutor, {X, Y}, outputs);
+    checkRtol(outputs[0] - X.mm(Y), {X, Y}, 24, 3e-7);
+  }
+
+  // Other sizes only share the translation.
+  at::Tensor X2 = at::CPU(at::kFloat).rand({40, 24});
+  tc::aten::compile<CpuBackend>(
+      tc, "matmul", {X2, Y}, CpuMappingOptions::makeNaiveMappingOptions());
+  EXPECT_EQ(expectedHits - 1, cache.numHits());
+}
+
+TEST(ExecutorCache, SharesAndEvicts) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  // Identifiers and other functions do not take part in the key.
+  string renamed = R"TC(
+def other(float(N) X) -> (Y) {
+    Y(n) = X(n)
+}
+def fun(float(K, L) X, float(K, L) Y) -> (Z) {
+    Z(k, l) = X(k, l) + Y(k, l)
+}
+)TC";
+  at::Tensor A = at::CPU(at::kFloat).rand({33, 17});
+  at::Tensor B = at::CPU(at::kFloat).rand({33, 17});
+  auto inputs = tc::aten::makeDLConstTensors({A, B});
+  auto options = CpuMappingOptions::makeNaiveMappingOptions().tile(8, 8);
+  ExecutorCache<CpuBackend> cache(2);
+
+  // Concurrent requests trigger a single compilation.
+  std::vector<std::shared_ptr<CpuTcExecutor>> executors(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < executors.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      executors[i] = cache.compile(
+          i % 2 ? tc : renamed, "fun", extractRawPtrs(inputs), options);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(1u, cache.numCompilations());
+  for (const auto& executor : executors) {
+    EXPECT_EQ(executors[0], executor);
+  }
+  auto outputs = tc::aten::prepareOutputs(tc, "fun", {A, B});
+  tc::aten::run(*executors[0], {A, B}, outputs);
+  checkRtol(outputs[0] - (A + B), {A, B}, 1);
+
+  // The least recently used executor is evicted.
+  cache.compile(tc, "fun", extractRawPtrs(inputs), options.tile(4, 4));
+  cache.compile(tc, "fun", extractRawPtrs(inputs), options.tile(8, 8));
+  cache.compile(tc, "fun", extractRawPtrs(inputs), options.tile(2, 2));
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(3u, cache.numCompilations());
+  cache.compile(tc, "fun", extractRawPtrs(inputs), options.tile(4, 4));
+  EXPECT_EQ(4u, cache.numCompilations());
+
+  // Failed compilations are not cached.
+  EXPECT_THROW(
+      cache.compile(tc, "missing", extractRawPtrs(inputs), options),
+      std::exception);
+  EXPECT_EQ(2u, cache.size());
+}
+
+TEST(LLVMCodegen, ExportSharedLibrary) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("tc_aot", dir));
+  ScopeGuard sg([&]() { llvm::sys::fs::remove_directories(dir); });
+
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) * B(n, m)
+}
+)TC";
+  at::Tensor A = at::CPU(at::kFloat).rand({33, 17});
+  at::Tensor B = at::CPU(at::kFloat).rand({33, 17});
+  CpuAotKernel kernel{tc,
+                      "fun",
+                      {tc::aten::toTensorInfo(A), tc::aten::toTensorInfo(B)},
+                      CpuMappingOptions::makeNaiveMappingOptions().tile(8, 8),
+                      "exported_fun"};
+  // The paths are not interpreted by a shell.
+  auto files = exportCpuKernels(
+      {kernel},
+      (dir + "/it's $(kernels)").str(),
+      "test",
+      CpuAotFormat::SharedLibrary);
+  ASSERT_EQ(3u, files.size());
+  for (const auto& file : files) {
+    EXPECT_TRUE(llvm::sys::fs::exists(file)) << file;
+  }
+
+  std::string err;
+  auto library = llvm::sys::DynamicLibrary::getPermanentLibrary(
+      files.back().c_str(), &err);
+  ASSERT_TRUE(library.isValid()) << err;
+  struct Entry {
+    const char* key;
+    const char* name;
+    void (*kernel)(void**);
+  };
+  auto registry =
+      static_cast<const Entry*>(library.getAddressOfSymbol("test_registry"));
+  auto size = static_cast<const uint64_t*>(
+      library.getAddressOfSymbol("test_registry_size"));
+  ASSERT_TRUE(registry && size);
+  ASSERT_EQ(1u, *size);
+  EXPECT_EQ(makeCpuAotKey(kernel), registry[0].key);
+  EXPECT_EQ(std::string("exported_fun"), registry[0].name);
+
+  auto C = at::CPU(at::kFloat).zeros({33, 17});
+  void* args[] = {A.data_ptr(), B.data_ptr(), C.data_ptr()};
+  registry[0].kernel(args);
+  checkRtol(C - A * B, {A, B}, 1);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);